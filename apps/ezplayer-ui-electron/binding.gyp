@@ -26,6 +26,116 @@
         "<!(node -p \"require('node-addon-api').gyp\")"
       ],
       "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"]
+    },
+    {
+      "target_name": "udp_batch",
+      "sources": ["mainsrc/udp-batch/udpbatch.cpp"],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")",
+      ],
+      "dependencies": [
+        "<!(node -p \"require('node-addon-api').gyp\")"
+      ],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"],
+      "conditions": [
+        ["OS==\"win\"", {
+          "libraries": ["ws2_32.lib"]
+        }]
+      ]
+    },
+    {
+      "target_name": "output_engine",
+      "sources": ["mainsrc/output-engine/outputengine.cpp"],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")",
+      ],
+      "dependencies": [
+        "<!(node -p \"require('node-addon-api').gyp\")"
+      ],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"],
+      "conditions": [
+        ["OS==\"win\"", {
+          "libraries": ["ws2_32.lib", "winmm.lib"]
+        }]
+      ]
+    },
+    {
+      "target_name": "pixel_kernels",
+      "sources": ["mainsrc/pixel-kernels/pixelkernels.cpp"],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")",
+      ],
+      "dependencies": [
+        "<!(node -p \"require('node-addon-api').gyp\")"
+      ],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"]
+    },
+    {
+      "target_name": "fseq_map",
+      "sources": ["mainsrc/fseq-map/fseqmap.cpp"],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")",
+      ],
+      "dependencies": [
+        "<!(node -p \"require('node-addon-api').gyp\")"
+      ],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"]
+    },
+    {
+      "target_name": "zstd",
+      "type": "static_library",
+      "sources": [
+        "third_party/zstd/lib/common/debug.c",
+        "third_party/zstd/lib/common/entropy_common.c",
+        "third_party/zstd/lib/common/error_private.c",
+        "third_party/zstd/lib/common/fse_decompress.c",
+        "third_party/zstd/lib/common/pool.c",
+        "third_party/zstd/lib/common/threading.c",
+        "third_party/zstd/lib/common/xxhash.c",
+        "third_party/zstd/lib/common/zstd_common.c",
+        "third_party/zstd/lib/compress/fse_compress.c",
+        "third_party/zstd/lib/compress/hist.c",
+        "third_party/zstd/lib/compress/huf_compress.c",
+        "third_party/zstd/lib/compress/zstd_compress.c",
+        "third_party/zstd/lib/compress/zstd_compress_literals.c",
+        "third_party/zstd/lib/compress/zstd_compress_sequences.c",
+        "third_party/zstd/lib/compress/zstd_compress_superblock.c",
+        "third_party/zstd/lib/compress/zstd_double_fast.c",
+        "third_party/zstd/lib/compress/zstd_fast.c",
+        "third_party/zstd/lib/compress/zstd_lazy.c",
+        "third_party/zstd/lib/compress/zstd_ldm.c",
+        "third_party/zstd/lib/compress/zstd_opt.c",
+        "third_party/zstd/lib/compress/zstd_preSplit.c",
+        "third_party/zstd/lib/compress/zstdmt_compress.c",
+        "third_party/zstd/lib/decompress/huf_decompress.c",
+        "third_party/zstd/lib/decompress/zstd_ddict.c",
+        "third_party/zstd/lib/decompress/zstd_decompress.c",
+        "third_party/zstd/lib/decompress/zstd_decompress_block.c",
+        "third_party/zstd/lib/dictBuilder/cover.c",
+        "third_party/zstd/lib/dictBuilder/divsufsort.c",
+        "third_party/zstd/lib/dictBuilder/fastcover.c",
+        "third_party/zstd/lib/dictBuilder/zdict.c"
+      ],
+      "defines": [
+        "ZSTD_DISABLE_ASM",
+        "ZSTDLIB_VISIBLE=", "ZDICTLIB_VISIBLE=", "ZSTDERRORLIB_VISIBLE="
+      ],
+      "direct_dependent_settings": {
+        "include_dirs": ["third_party/zstd/lib"],
+        "defines": ["ZSTDLIB_VISIBLE=", "ZDICTLIB_VISIBLE=", "ZSTDERRORLIB_VISIBLE="]
+      }
+    },
+    {
+      "target_name": "zstd_native",
+      "sources": ["mainsrc/zstd-native/zstdnative.cpp"],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")",
+      ],
+      "dependencies": [
+        "<!(node -p \"require('node-addon-api').gyp\")",
+        "zstd"
+      ],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"]
     }
   ]
 }
@@ -267,6 +267,7 @@ async function startPlaybackWorker(): Promise<Worker> {
         workerData: {
             name: 'main',
             logFile: path.join(app.getPath('logs'), 'playbackmain.log'),
+            cacheDir: path.join(app.getPath('userData'), 'cache'),
         } satisfies PlaybackWorkerData,
     });
     await new Promise<void>((resolve) => {
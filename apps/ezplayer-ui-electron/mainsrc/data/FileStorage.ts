@@ -5,11 +5,12 @@ import {
     type SequenceRecord,
 } from '@ezplayer/ezplayer-core';
 
-import { FSEQReaderAsync } from '@ezplayer/epp';
 
 import * as path from 'path';
 import fsp from 'fs/promises';
 import { atomicWriteFile } from './atomicWrite.js';
+import { readFSEQHeaderFast } from '../fseq-map/fseqmap.js';
+import { indexShowFolder, ShowFolderIndex, showIndexFile } from '../fseq-map/fseqindex.js';
 
 // sequences.json
 interface TempSeqsAPIPayload {
@@ -74,6 +75,7 @@ export async function loadSequencesAPI(folder: string): Promise<SequenceRecord[]
     try {
         const p: TempSeqsAPIPayload = await JSON.parse(await fsp.readFile(sf(folder, 'sequences.json'), 'utf-8'));
         const seqs = p?.data?.allSongs ?? [];
+        let index: ShowFolderIndex | null | undefined;
         for (const s of seqs) {
             if (s.files?.fseq) {
                 s.files.fseq = ensureAbsolute(s.files.fseq, folder);
@@ -87,7 +89,11 @@ export async function loadSequencesAPI(folder: string): Promise<SequenceRecord[]
             // This is supposed to be seconds; for now if it looks like it could be milliseconds we will verify it.
             if (s.files?.fseq && (!s.work.length || s.work.length > 10000)) {
                 try {
-                    const fhdr = await FSEQReaderAsync.readFSEQHeaderAsync(s.files.fseq);
+                    // One indexing pass for all of them, rather than a header read each
+                    if (index === undefined) {
+                        index = await indexShowFolder(folder, { cacheFile: showIndexFile(folder) }).catch(() => null);
+                    }
+                    const fhdr = index?.header(s.files.fseq) ?? (await readFSEQHeaderFast(s.files.fseq));
                     s.work.length = (fhdr.frames * fhdr.msperframe) / 1000;
                 } catch (e) {
                     console.log(e);
@@ -1,7 +1,7 @@
 import * as path from 'path';
 import * as fs from 'node:fs/promises';
 import { parseAudioTags } from 'audiofile';
-import { FSEQReaderAsync } from '@ezplayer/epp';
+import { readFSEQHeaderFast } from '../fseq-map/fseqmap.js';
 
 const AUDIO_EXTENSIONS = ['.mp3', '.wav', '.m4a', '.aac', '.flac', '.ogg', '.wma'];
 const IMAGE_EXTENSIONS = ['.jpg', '.jpeg', '.png', '.gif', '.webp', '.bmp'];
@@ -115,7 +115,7 @@ export async function autoDetectSongFilesFromFseq(fseqFilePath: string): Promise
 
     let headerAudioName: string | undefined;
     try {
-        const header = await FSEQReaderAsync.readFSEQHeaderAsync(fseqFilePath);
+        const header = await readFSEQHeaderFast(fseqFilePath);
         out.durationSecs = (header.frames * header.msperframe) / 1000;
         const keys = Object.keys(header.headers);
         console.log(
@@ -0,0 +1,392 @@
+// fseq-map/fseqfile.h — Reading and parsing FSEQ headers.
+//
+// Everything here is plain C++ (no N-API), so it can run on a worker thread.
+// The directory listing is here for the same reason: indexFolder() walks the
+// show folder from a pool of threads.
+// The parse follows FSEQReaderAsync.decodeFSEQHeader (PSEQ / FSEQ v1 and v2,
+// and ESEQ), but goes through the header in one pass, with bounds checks in
+// place of the JS reader's implicit DataView range errors.
+//
+// Headers are read with pread / ReadFile, not mapped: xLights rewrites
+// sequences in place, and a mapped file truncated underneath us faults
+// (SIGBUS) where a read just comes up short.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <errno.h>
+  #include <dirent.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Reading
+// ---------------------------------------------------------------------------
+// Up to `want` bytes from the start of path into out (fewer if the file is
+// shorter), and the file's size
+static inline bool read_file_head(const std::string& path, size_t want, std::vector<uint8_t>& out,
+                                  uint64_t& fileSize, std::string& error) {
+#if defined(_WIN32)
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring wpath(wlen > 0 ? wlen : 0, L'\0');
+    if (wlen > 0) MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wpath[0], wlen);
+    HANDLE f = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        error = "open failed (" + std::to_string(GetLastError()) + "): " + path;
+        return false;
+    }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz)) {
+        CloseHandle(f);
+        error = "unreadable file: " + path;
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(sz.QuadPart);
+    out.resize(static_cast<size_t>(std::min<uint64_t>(want, fileSize)));
+    size_t got = 0;
+    while (got < out.size()) {
+        DWORD n = 0;
+        if (!ReadFile(f, out.data() + got, static_cast<DWORD>(out.size() - got), &n, nullptr)) {
+            CloseHandle(f);
+            error = "read failed (" + std::to_string(GetLastError()) + "): " + path;
+            return false;
+        }
+        if (n == 0) break;
+        got += n;
+    }
+    CloseHandle(f);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::string("open: ") + strerror(errno) + ": " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        error = "unreadable file: " + path;
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(st.st_size);
+    out.resize(static_cast<size_t>(std::min<uint64_t>(want, fileSize)));
+    size_t got = 0;
+    while (got < out.size()) {
+        const ssize_t n = ::pread(fd, out.data() + got, out.size() - got, static_cast<off_t>(got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            error = std::string("read: ") + strerror(errno) + ": " + path;
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+#endif
+    out.resize(got);  // Shorter if the file was cut short meanwhile
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Directory listing
+// ---------------------------------------------------------------------------
+struct DirEntry {
+    std::string name;
+    bool isDir = false;
+    double mtimeMs = 0;  // As fs.Stats.mtimeMs
+    double size = 0;
+};
+
+// Files and subdirectories of dir, following links; false if it can't be read
+static inline bool list_dir(const std::string& dir, std::vector<DirEntry>& out) {
+#if defined(_WIN32)
+    const std::string pattern = dir + "\\*";
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, pattern.c_str(), -1, nullptr, 0);
+    std::wstring wpattern(wlen > 0 ? wlen : 0, L'\0');
+    if (wlen > 0) MultiByteToWideChar(CP_UTF8, 0, pattern.c_str(), -1, &wpattern[0], wlen);
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileExW(wpattern.c_str(), FindExInfoBasic, &fd, FindExSearchNameMatch, nullptr,
+                                FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    do {
+        if (!wcscmp(fd.cFileName, L".") || !wcscmp(fd.cFileName, L"..")) continue;
+        int len = WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, nullptr, 0, nullptr, nullptr);
+        if (len <= 1) continue;
+        DirEntry e;
+        e.name.resize(len - 1);
+        WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, &e.name[0], len, nullptr, nullptr);
+        e.isDir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        ULARGE_INTEGER t;
+        t.LowPart = fd.ftLastWriteTime.dwLowDateTime;
+        t.HighPart = fd.ftLastWriteTime.dwHighDateTime;
+        e.mtimeMs = static_cast<double>(t.QuadPart - 116444736000000000ULL) / 10000.0;  // From 1601, in 100ns
+        e.size = static_cast<double>((static_cast<uint64_t>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow);
+        out.push_back(std::move(e));
+    } while (FindNextFileW(h, &fd));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    while (dirent* de = readdir(d)) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+        struct stat st;
+        if (stat((dir + "/" + de->d_name).c_str(), &st) != 0) continue;
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) continue;
+        DirEntry e;
+        e.name = de->d_name;
+        e.isDir = S_ISDIR(st.st_mode);
+  #if defined(__APPLE__)
+        e.mtimeMs = st.st_mtimespec.tv_sec * 1000.0 + st.st_mtimespec.tv_nsec / 1e6;
+  #else
+        e.mtimeMs = st.st_mtim.tv_sec * 1000.0 + st.st_mtim.tv_nsec / 1e6;
+  #endif
+        e.size = static_cast<double>(st.st_size);
+        out.push_back(std::move(e));
+    }
+    closedir(d);
+#endif
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Header
+// ---------------------------------------------------------------------------
+struct FseqBlock {
+    uint32_t framenum;
+    uint32_t blocksize;
+};
+
+struct FseqRange {
+    uint32_t startch;
+    uint32_t chcount;
+};
+
+// Field for field what FSEQHeader holds in JS
+struct FseqHeader {
+    std::string hdr4;
+    uint32_t modelcount = 0;
+    uint32_t stepsize = 0;
+    uint32_t modelstart = 0;
+    uint32_t modelsize = 0;
+    uint32_t chdataOffset = 0;
+    uint32_t majver = 0;
+    uint32_t minver = 0;
+    uint32_t fixedhdr = 0;
+    uint32_t channels = 0;
+    uint32_t frames = 0;
+    uint32_t msperframe = 50;
+    uint32_t reserved1 = 0;
+    uint32_t univcnt = 0;
+    uint32_t universesize = 0;
+    uint32_t gamma = 0;
+    uint32_t colorenc = 0;
+    uint32_t reserved2 = 0;
+    uint32_t compression = 0;
+    uint32_t compblks = 0;
+    uint32_t nsparseranges = 0;
+    uint32_t uuid1 = 0;
+    uint32_t uuid2 = 0;
+    std::vector<FseqBlock> compblocklist;
+    std::vector<FseqRange> chranges;
+    std::vector<std::pair<std::string, std::string>> headers;
+};
+
+class FseqCursor {
+public:
+    FseqCursor(const uint8_t* p, size_t n) : p_(p), n_(n) {}
+    bool has(size_t k) const { return off_ + k <= n_; }
+    size_t off() const { return off_; }
+    uint32_t u8() { return p_[off_++]; }
+    uint32_t u16() {
+        uint32_t v = p_[off_] | (p_[off_ + 1] << 8);
+        off_ += 2;
+        return v;
+    }
+    uint32_t u24() {
+        uint32_t v = p_[off_] | (p_[off_ + 1] << 8) | (p_[off_ + 2] << 16);
+        off_ += 3;
+        return v;
+    }
+    uint32_t u32() {
+        uint32_t v = static_cast<uint32_t>(p_[off_]) | (static_cast<uint32_t>(p_[off_ + 1]) << 8) |
+                     (static_cast<uint32_t>(p_[off_ + 2]) << 16) | (static_cast<uint32_t>(p_[off_ + 3]) << 24);
+        off_ += 4;
+        return v;
+    }
+    std::string str(size_t k) {
+        std::string s(reinterpret_cast<const char*>(p_ + off_), k);
+        off_ += k;
+        return s;
+    }
+
+private:
+    const uint8_t* p_;
+    size_t n_;
+    size_t off_ = 0;
+};
+
+// p[0, n) is the start of the file, at least up to the channel data where the file is that long
+static inline bool parse_fseq_header(const uint8_t* p, size_t n, uint64_t fileSize, FseqHeader& h,
+                                     std::string& error) {
+    FseqCursor c(p, n);
+    if (!c.has(4)) {
+        error = "Not an xSEQ file";
+        return false;
+    }
+    h.hdr4 = c.str(4);
+    const bool isEseq = h.hdr4 == "ESEQ";
+    if (h.hdr4 != "PSEQ" && h.hdr4 != "ESEQ" && h.hdr4 != "FSEQ") {
+        error = "Not an xSEQ file";
+        return false;
+    }
+
+    if (isEseq) {
+        if (!c.has(16)) {
+            error = "Truncated ESEQ header";
+            return false;
+        }
+        h.chdataOffset = 20;
+        h.majver = 2;
+        h.modelcount = c.u32();
+        h.stepsize = c.u32();
+        h.modelstart = c.u32();
+        h.channels = c.u32();
+        h.modelsize = h.channels;
+        // No frame count, timing or compression in ESEQ; the file size says how many frames
+        h.frames = h.stepsize && fileSize > h.chdataOffset
+                       ? static_cast<uint32_t>((fileSize - h.chdataOffset) / h.stepsize)
+                       : 0;
+        // The frames fit in the file, but 4 GiB of them would not fit the block size
+        const uint64_t dataLen = static_cast<uint64_t>(h.frames) * h.stepsize;
+        if (dataLen > UINT32_MAX) {
+            error = "ESEQ channel data over 4 GiB";
+            return false;
+        }
+        h.compblocklist.push_back({0, static_cast<uint32_t>(dataLen)});
+        h.chranges.push_back({h.modelstart, h.modelsize});
+        return true;
+    }
+
+    if (!c.has(16)) {
+        error = "Truncated FSEQ header";
+        return false;
+    }
+    h.chdataOffset = c.u16();
+    h.minver = c.u8();
+    h.majver = c.u8();
+    h.fixedhdr = c.u16();
+    h.channels = c.u32();
+    h.stepsize = (h.channels + 3) / 4 * 4;
+    h.frames = c.u32();
+    h.msperframe = c.u8();
+    h.reserved1 = c.u8();
+    if (h.chdataOffset > n) {
+        error = "Channel data offset past end of file";
+        return false;
+    }
+
+    if (h.majver == 1) {
+        if (!c.has(8)) {
+            error = "Truncated FSEQ v1 header";
+            return false;
+        }
+        h.univcnt = c.u16();
+        h.universesize = c.u16();
+        h.gamma = c.u8();
+        h.colorenc = c.u8();
+        h.reserved2 = c.u16();
+        const uint64_t dataLen = static_cast<uint64_t>(h.frames) * h.channels;
+        if (dataLen > fileSize - h.chdataOffset) {
+            error = "FSEQ v1 frames past end of file";
+            return false;
+        }
+        if (dataLen > UINT32_MAX) {
+            error = "FSEQ v1 channel data over 4 GiB";
+            return false;
+        }
+        h.compblocklist.push_back({0, static_cast<uint32_t>(dataLen)});
+    } else {
+        if (!c.has(12)) {
+            error = "Truncated FSEQ v2 header";
+            return false;
+        }
+        const uint32_t compandblks = c.u8();
+        h.compression = compandblks & 15;
+        h.compblks = ((compandblks & 240) << 4) + c.u8();
+        h.nsparseranges = c.u8();
+        h.reserved2 = c.u8();
+        h.uuid1 = c.u32();
+        h.uuid2 = c.u32();
+
+        if (!c.has(static_cast<size_t>(h.compblks) * 8 + static_cast<size_t>(h.nsparseranges) * 6) ||
+            c.off() + static_cast<size_t>(h.compblks) * 8 + static_cast<size_t>(h.nsparseranges) * 6 >
+                h.chdataOffset) {
+            error = "Block index / sparse ranges overrun the header";
+            return false;
+        }
+        bool seenEmpty = false;
+        h.compblocklist.reserve(h.compblks);
+        for (uint32_t i = 0; i < h.compblks; ++i) {
+            const uint32_t framenum = c.u32();
+            const uint32_t blocksize = c.u32();
+            if (!blocksize) {
+                seenEmpty = true;
+                if (framenum) {
+                    error = "Empty block (" + std::to_string(i) + ") with frame number (" +
+                            std::to_string(framenum) + ") assigned";
+                    return false;
+                }
+                continue;
+            }
+            if (seenEmpty) {
+                error = "Empty blocks followed by nonempty blocks " + std::to_string(i);
+                return false;
+            }
+            h.compblocklist.push_back({framenum, blocksize});
+        }
+        for (uint32_t i = 0; i < h.nsparseranges; ++i) {
+            const uint32_t startch = c.u24();
+            const uint32_t chcount = c.u24();
+            h.chranges.push_back({startch, chcount});
+        }
+    }
+
+    if (h.chranges.empty()) h.chranges.push_back({1, h.channels});
+
+    // Variable headers: 2 length (including these 4 bytes), 2 name, value
+    while (c.off() + 4 <= h.chdataOffset) {
+        const uint32_t len = c.u16();
+        std::string name = c.str(2);
+        if (len < 4 || c.off() + (len - 4) > h.chdataOffset) break;
+        std::string val = c.str(len - 4);
+        while (!val.empty() && val.back() == '\0') val.pop_back();
+        h.headers.emplace_back(std::move(name), std::move(val));
+    }
+    return true;
+}
+
+// Reads and parses path's header: the fixed part first, then the rest up to the channel data
+static inline bool read_fseq_header(const std::string& path, FseqHeader& h, std::string& error) {
+    std::vector<uint8_t> head;
+    uint64_t fileSize = 0;
+    if (!read_file_head(path, 4096, head, fileSize, error)) return false;
+    if (head.size() >= 6 && std::memcmp(head.data(), "ESEQ", 4) != 0) {
+        const size_t chdataOffset = head[4] | (head[5] << 8);
+        if (chdataOffset > head.size() && !read_file_head(path, chdataOffset, head, fileSize, error)) return false;
+    }
+    return parse_fseq_header(head.data(), head.size(), fileSize, h, error);
+}
@@ -0,0 +1,195 @@
+import * as path from 'path';
+import { promises as fsp } from 'fs';
+import { FSEQHeader, FSEQReaderAsync } from '@ezplayer/epp';
+
+import { atomicWriteFile } from '../data/atomicWrite.js';
+import { indexFolderNative } from './fseqmap.js';
+
+/** A file in the show folder, as of when it was indexed */
+export interface ShowFileEntry {
+    rel: string; // Relative to the show folder, '/' separated
+    mtimeMs: number;
+    size: number;
+    header?: FSEQHeader; // .fseq files whose header parsed
+    error?: string; // .fseq files whose header did not
+}
+
+/** How far below the show folder to look, as buildShowFolderIndex always has */
+export const SHOW_INDEX_MAX_DEPTH = 5;
+
+/** Where a show folder's index is kept between launches */
+export function showIndexFile(folder: string) {
+    return path.join(folder, '.ezplayer', 'fseq-index.bin');
+}
+
+const utf8 = new TextDecoder('utf-8');
+
+// The 22 u32 fields fseqmap.cpp writes for a header, in its order
+const HEADER_FIELDS = [
+    'modelcount',
+    'stepsize',
+    'modelstart',
+    'modelsize',
+    'chdata_offset',
+    'majver',
+    'minver',
+    'fixedhdr',
+    'channels',
+    'frames',
+    'msperframe',
+    'reserved1',
+    'univcnt',
+    'universesize',
+    'gamma',
+    'colorenc',
+    'reserved2',
+    'compression',
+    'compblks',
+    'nsparseranges',
+    'uuid1',
+    'uuid2',
+] as const;
+
+/** Decode the index indexFolderNative returns (format described in fseqmap.cpp) */
+export function decodeShowIndex(buf: ArrayBuffer): { entries: ShowFileEntry[]; parsed: number } {
+    const dv = new DataView(buf);
+    const bytes = new Uint8Array(buf);
+    if (buf.byteLength < 16 || utf8.decode(bytes.subarray(0, 4)) !== 'FSIX' || dv.getUint32(4, true) !== 1) {
+        throw new Error('Not a show folder index');
+    }
+    const count = dv.getUint32(8, true);
+    const parsed = dv.getUint32(12, true);
+    let off = 16;
+    const u16 = () => ((off += 2), dv.getUint16(off - 2, true));
+    const u32 = () => ((off += 4), dv.getUint32(off - 4, true));
+    const str = (n: number) => utf8.decode(bytes.subarray(off, (off += n)));
+    const entries: ShowFileEntry[] = [];
+    for (let i = 0; i < count; ++i) {
+        const len = u32();
+        const end = off + len;
+        const rel = str(u16());
+        const e: ShowFileEntry = { rel, mtimeMs: dv.getFloat64(off, true), size: dv.getFloat64(off + 8, true) };
+        const kind = dv.getUint8(off + 16);
+        off += 17;
+        if (kind === 2) {
+            e.error = str(u16());
+        } else if (kind === 1) {
+            const h: Record<string, unknown> = { hdr4: str(4) };
+            for (const f of HEADER_FIELDS) h[f] = u32();
+            const compblocklist = [];
+            for (let n = u32(); n > 0; --n) compblocklist.push({ framenum: u32(), blocksize: u32() });
+            const chranges = [];
+            for (let n = u32(); n > 0; --n) chranges.push({ startch: u32(), chcount: u32() });
+            const headers: Record<string, string> = {};
+            for (let n = u16(); n > 0; --n) {
+                const k = str(u16());
+                headers[k] = str(u16());
+            }
+            e.header = { ...h, compblocklist, chranges, headers } as unknown as FSEQHeader;
+        }
+        entries.push(e);
+        off = end;
+    }
+    return { entries, parsed };
+}
+
+/**
+ * Every file under a show folder (to SHOW_INDEX_MAX_DEPTH), with the header of each .fseq,
+ *  shallowest first.
+ */
+export class ShowFolderIndex {
+    private byRel = new Map<string, ShowFileEntry>();
+
+    constructor(
+        readonly folder: string,
+        readonly entries: ShowFileEntry[],
+        readonly parsed: number, // Headers that had to be read, rather than taken from the last index
+    ) {
+        for (const e of entries) this.byRel.set(e.rel, e);
+    }
+
+    /** Header of the .fseq at `file` (absolute, or relative to the folder), if indexed and valid */
+    header(file: string): FSEQHeader | undefined {
+        const rel = path.relative(this.folder, path.resolve(this.folder, file)).replace(/\\/g, '/');
+        return this.byRel.get(rel)?.header;
+    }
+
+    /** Lowercase file name -> path relative to the folder; where names repeat, the shallowest wins */
+    fileNameIndex(): Map<string, string> {
+        const index = new Map<string, string>();
+        for (const e of this.entries) {
+            const key = e.rel.slice(e.rel.lastIndexOf('/') + 1).toLowerCase();
+            if (!index.has(key)) index.set(key, e.rel);
+        }
+        return index;
+    }
+}
+
+const depthOf = (rel: string) => rel.split('/').length - 1;
+
+// Without the addon: the same listing, by readdir and one header read at a time per folder
+async function indexShowFolderJS(folder: string, maxDepth: number): Promise<ShowFolderIndex> {
+    const entries: ShowFileEntry[] = [];
+    async function scan(rel: string, depth: number) {
+        let dirents: import('fs').Dirent[];
+        try {
+            dirents = await fsp.readdir(path.join(folder, rel), { withFileTypes: true });
+        } catch (e) {
+            if (!rel) throw e;
+            return;
+        }
+        const subdirs: string[] = [];
+        await Promise.all(
+            dirents.map(async (d) => {
+                const r = rel ? `${rel}/${d.name}` : d.name;
+                if (d.isDirectory()) {
+                    if (depth < maxDepth) subdirs.push(r);
+                    return;
+                }
+                if (!d.isFile()) return;
+                const full = path.join(folder, r);
+                const st = await fsp.stat(full).catch(() => undefined);
+                if (!st) return;
+                const e: ShowFileEntry = { rel: r, mtimeMs: st.mtimeMs, size: st.size };
+                if (d.name.toLowerCase().endsWith('.fseq')) {
+                    try {
+                        e.header = await FSEQReaderAsync.readFSEQHeaderAsync(full);
+                    } catch (err) {
+                        e.error = (err as Error).message;
+                    }
+                }
+                entries.push(e);
+            }),
+        );
+        for (const sub of subdirs) await scan(sub, depth + 1);
+    }
+    await scan('', 0);
+    entries.sort((a, b) => depthOf(a.rel) - depthOf(b.rel) || (a.rel < b.rel ? -1 : a.rel > b.rel ? 1 : 0));
+    return new ShowFolderIndex(folder, entries, entries.filter((e) => e.header || e.error).length);
+}
+
+/**
+ * Index a show folder: every file's path, modification time and size, and the header (with
+ *  block index and sparse ranges) of every sequence.  With the native addon this is one call
+ *  listing and parsing on a pool of threads, and the result is kept in `cacheFile` so that
+ *  the next launch only opens sequences that have changed.
+ */
+export async function indexShowFolder(
+    folder: string,
+    opts: { cacheFile?: string; maxDepth?: number } = {},
+): Promise<ShowFolderIndex> {
+    const maxDepth = opts.maxDepth ?? SHOW_INDEX_MAX_DEPTH;
+    const prev = opts.cacheFile ? await fsp.readFile(opts.cacheFile).catch(() => undefined) : undefined;
+    const pending = indexFolderNative(folder, maxDepth, prev);
+    if (!pending) return indexShowFolderJS(folder, maxDepth);
+
+    const buf = await pending;
+    const { entries, parsed } = decodeShowIndex(buf);
+    if (opts.cacheFile && (parsed > 0 || !prev)) {
+        // Unchanged otherwise; entries for files since removed are harmless until the next write
+        await atomicWriteFile(opts.cacheFile, new Uint8Array(buf)).catch((e) =>
+            console.warn(`[fseqindex] could not save ${opts.cacheFile}: ${(e as Error).message}`),
+        );
+    }
+    return new ShowFolderIndex(folder, entries, parsed);
+}
@@ -0,0 +1,428 @@
+// fseq-map/fseqmap.cpp — Native FSEQ header reads.
+//
+// readHeader() reads a file's header and parses it, block index and sparse
+// ranges included, in one pass on a libuv worker thread; probing a
+// show folder's sequences costs one small task each rather than a file-reader
+// worker and dozens of awaited reads per file.  Frames are read by the
+// prefetch cache (FSeqPrefetchCache), not from here.
+//
+// indexFolder() lists a whole show folder and parses every .fseq header in
+// it, from a pool of threads, into one compact binary index (format below).
+// Given the previous index, files whose modification time and size have not
+// changed keep their entry without being opened, so a launch that finds the
+// folder as it was only has to list it.
+#include "napi.h"
+#include "fseqfile.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// ---------------------------------------------------------------------------
+// Header => JS object shaped like FSEQHeader
+// ---------------------------------------------------------------------------
+static Napi::Object header_to_js(Napi::Env env, const FseqHeader& h) {
+    auto o = Napi::Object::New(env);
+    o.Set("hdr4", Napi::String::New(env, h.hdr4));
+    o.Set("modelcount", Napi::Number::New(env, h.modelcount));
+    o.Set("stepsize", Napi::Number::New(env, h.stepsize));
+    o.Set("modelstart", Napi::Number::New(env, h.modelstart));
+    o.Set("modelsize", Napi::Number::New(env, h.modelsize));
+    o.Set("chdata_offset", Napi::Number::New(env, h.chdataOffset));
+    o.Set("majver", Napi::Number::New(env, h.majver));
+    o.Set("minver", Napi::Number::New(env, h.minver));
+    o.Set("fixedhdr", Napi::Number::New(env, h.fixedhdr));
+    o.Set("channels", Napi::Number::New(env, h.channels));
+    o.Set("frames", Napi::Number::New(env, h.frames));
+    o.Set("msperframe", Napi::Number::New(env, h.msperframe));
+    o.Set("reserved1", Napi::Number::New(env, h.reserved1));
+    o.Set("univcnt", Napi::Number::New(env, h.univcnt));
+    o.Set("universesize", Napi::Number::New(env, h.universesize));
+    o.Set("gamma", Napi::Number::New(env, h.gamma));
+    o.Set("colorenc", Napi::Number::New(env, h.colorenc));
+    o.Set("reserved2", Napi::Number::New(env, h.reserved2));
+    o.Set("compression", Napi::Number::New(env, h.compression));
+    o.Set("compblks", Napi::Number::New(env, h.compblks));
+    o.Set("nsparseranges", Napi::Number::New(env, h.nsparseranges));
+    o.Set("uuid1", Napi::Number::New(env, h.uuid1));
+    o.Set("uuid2", Napi::Number::New(env, h.uuid2));
+
+    auto blocks = Napi::Array::New(env, h.compblocklist.size());
+    for (size_t i = 0; i < h.compblocklist.size(); ++i) {
+        auto b = Napi::Object::New(env);
+        b.Set("framenum", Napi::Number::New(env, h.compblocklist[i].framenum));
+        b.Set("blocksize", Napi::Number::New(env, h.compblocklist[i].blocksize));
+        blocks.Set(static_cast<uint32_t>(i), b);
+    }
+    o.Set("compblocklist", blocks);
+
+    auto ranges = Napi::Array::New(env, h.chranges.size());
+    for (size_t i = 0; i < h.chranges.size(); ++i) {
+        auto r = Napi::Object::New(env);
+        r.Set("startch", Napi::Number::New(env, h.chranges[i].startch));
+        r.Set("chcount", Napi::Number::New(env, h.chranges[i].chcount));
+        ranges.Set(static_cast<uint32_t>(i), r);
+    }
+    o.Set("chranges", ranges);
+
+    auto headers = Napi::Object::New(env);
+    for (const auto& kv : h.headers) headers.Set(kv.first, Napi::String::New(env, kv.second));
+    o.Set("headers", headers);
+    return o;
+}
+
+// ---------------------------------------------------------------------------
+// Read + parse on a worker thread
+// ---------------------------------------------------------------------------
+class HeaderWorker : public Napi::AsyncWorker {
+public:
+    HeaderWorker(Napi::Env env, const std::string& path)
+        : Napi::AsyncWorker(env, "FseqHeader"), deferred_(Napi::Promise::Deferred::New(env)), path_(path) {}
+
+    Napi::Promise Promise() const { return deferred_.Promise(); }
+
+    void Execute() override {
+        std::string error;
+        if (!read_fseq_header(path_, header_, error)) SetError(error);
+    }
+
+    void OnOK() override { deferred_.Resolve(header_to_js(Env(), header_)); }
+
+    void OnError(const Napi::Error& e) override { deferred_.Reject(e.Value()); }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    std::string path_;
+    FseqHeader header_;
+};
+
+// ---------------------------------------------------------------------------
+// N-API export: readHeader(path) => Promise<FSEQHeader>
+// ---------------------------------------------------------------------------
+static Napi::Value ReadHeader(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (path: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto* w = new HeaderWorker(env, info[0].As<Napi::String>().Utf8Value());
+    Napi::Promise p = w->Promise();
+    w->Queue();
+    return p;
+}
+
+// ---------------------------------------------------------------------------
+// Show folder index
+//
+// Little-endian throughout:
+//   "FSIX", u32 version, u32 entry count, u32 headers parsed (not reused)
+//   per entry: u32 length of the rest of the entry,
+//     u16 + path (UTF-8, relative to the folder, '/' separated), f64 mtimeMs, f64 size,
+//     u8 kind: 0 other file, 1 sequence, 2 sequence whose header did not parse
+//     kind 1: hdr4 (4 bytes), the 22 u32 fields of FseqHeader in declaration order,
+//             u32 + blocks (u32 framenum, u32 blocksize), u32 + ranges (u32 startch, u32 chcount),
+//             u16 + variable headers (u16 + name, u16 + value)
+//     kind 2: u16 + error message
+//   Entries are ordered shallowest first, then by path.
+// ---------------------------------------------------------------------------
+static const uint32_t kIndexVersion = 1;
+
+class IndexWriter {
+public:
+    explicit IndexWriter(std::string& out) : out_(out) {}
+    void u8(uint32_t v) { out_.push_back(static_cast<char>(v & 0xff)); }
+    void u16(uint32_t v) {
+        u8(v);
+        u8(v >> 8);
+    }
+    void u32(uint32_t v) {
+        u16(v & 0xffff);
+        u16(v >> 16);
+    }
+    void f64(double d) {
+        uint64_t v;
+        std::memcpy(&v, &d, 8);
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+    void str16(const std::string& s) {
+        const size_t n = std::min<size_t>(s.size(), 0xffff);
+        u16(static_cast<uint32_t>(n));
+        out_.append(s, 0, n);
+    }
+
+private:
+    std::string& out_;
+};
+
+struct IndexFile {
+    std::string rel;
+    int depth;
+    double mtimeMs;
+    double size;
+    bool sequence;
+    std::string entry;  // Serialized, from u32 length on
+};
+
+static void serialize_entry(IndexFile& f, const FseqHeader* h, const std::string& error) {
+    std::string body;
+    IndexWriter w(body);
+    w.str16(f.rel);
+    w.f64(f.mtimeMs);
+    w.f64(f.size);
+    if (!f.sequence) {
+        w.u8(0);
+    } else if (!h) {
+        w.u8(2);
+        w.str16(error);
+    } else {
+        w.u8(1);
+        body.append((h->hdr4 + std::string(4, '\0')).substr(0, 4));
+        for (uint32_t v : {h->modelcount, h->stepsize, h->modelstart, h->modelsize, h->chdataOffset, h->majver,
+                           h->minver, h->fixedhdr, h->channels, h->frames, h->msperframe, h->reserved1, h->univcnt,
+                           h->universesize, h->gamma, h->colorenc, h->reserved2, h->compression, h->compblks,
+                           h->nsparseranges, h->uuid1, h->uuid2}) {
+            w.u32(v);
+        }
+        w.u32(static_cast<uint32_t>(h->compblocklist.size()));
+        for (const auto& b : h->compblocklist) {
+            w.u32(b.framenum);
+            w.u32(b.blocksize);
+        }
+        w.u32(static_cast<uint32_t>(h->chranges.size()));
+        for (const auto& r : h->chranges) {
+            w.u32(r.startch);
+            w.u32(r.chcount);
+        }
+        w.u16(static_cast<uint32_t>(std::min<size_t>(h->headers.size(), 0xffff)));
+        for (size_t i = 0; i < h->headers.size() && i < 0xffff; ++i) {
+            w.str16(h->headers[i].first);
+            w.str16(h->headers[i].second);
+        }
+    }
+    f.entry.clear();
+    IndexWriter(f.entry).u32(static_cast<uint32_t>(body.size()));
+    f.entry += body;
+}
+
+struct PrevEntry {
+    double mtimeMs;
+    double size;
+    const uint8_t* entry;  // From u32 length on
+    size_t len;
+};
+
+// Entries of a previous index by path; empty if it is not one this version wrote
+static std::unordered_map<std::string, PrevEntry> read_prev_index(const uint8_t* p, size_t n) {
+    std::unordered_map<std::string, PrevEntry> prev;
+    if (n < 16 || std::memcmp(p, "FSIX", 4) != 0) return prev;
+    FseqCursor c(p, n);
+    c.str(4);
+    if (c.u32() != kIndexVersion) return prev;
+    const uint32_t count = c.u32();
+    c.u32();
+    for (uint32_t i = 0; i < count && c.has(4); ++i) {
+        const size_t start = c.off();
+        const uint32_t len = c.u32();
+        if (!c.has(len) || len < 2) break;
+        const size_t end = c.off() + len;
+        const uint32_t plen = c.u16();
+        if (c.off() + plen + 16 > end) break;
+        std::string rel = c.str(plen);
+        uint64_t bits[2];
+        for (auto& b : bits) {
+            b = c.u32();
+            b |= static_cast<uint64_t>(c.u32()) << 32;
+        }
+        PrevEntry e;
+        std::memcpy(&e.mtimeMs, &bits[0], 8);
+        std::memcpy(&e.size, &bits[1], 8);
+        e.entry = p + start;
+        e.len = end - start;
+        prev.emplace(std::move(rel), e);
+        while (c.off() < end) c.u8();
+    }
+    return prev;
+}
+
+static bool is_fseq_name(const std::string& name) {
+    if (name.size() < 5) return false;
+    std::string ext = name.substr(name.size() - 5);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return ext == ".fseq";
+}
+
+// Runs fn(i) for i in [0, n) on up to nthreads threads
+template <typename Fn>
+static void parallel_for(size_t n, size_t nthreads, Fn fn) {
+    std::atomic<size_t> next{0};
+    auto run = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < n;) fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(nthreads, n); ++t) threads.emplace_back(run);
+    run();
+    for (auto& t : threads) t.join();
+}
+
+// Lists the tree from a shared queue of directories, down to maxDepth levels below root
+static bool walk_folder(const std::string& root, int maxDepth, size_t nthreads, std::vector<IndexFile>& files) {
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<std::pair<std::string, int>> dirs{{std::string(), 0}};  // Relative path, depth
+    size_t busy = 0;
+    bool rootRead = true;
+
+    auto run = [&] {
+        std::unique_lock<std::mutex> lk(m);
+        for (;;) {
+            cv.wait(lk, [&] { return !dirs.empty() || busy == 0; });
+            if (dirs.empty()) return;
+            auto dir = std::move(dirs.back());
+            dirs.pop_back();
+            ++busy;
+            lk.unlock();
+
+            std::vector<DirEntry> entries;
+            const bool ok = list_dir(dir.first.empty() ? root : root + "/" + dir.first, entries);
+            std::vector<IndexFile> found;
+            std::vector<std::pair<std::string, int>> subdirs;
+            for (auto& e : entries) {
+                std::string rel = dir.first.empty() ? e.name : dir.first + "/" + e.name;
+                if (e.isDir) {
+                    if (dir.second < maxDepth) subdirs.emplace_back(std::move(rel), dir.second + 1);
+                } else {
+                    found.push_back({std::move(rel), dir.second, e.mtimeMs, e.size, is_fseq_name(e.name), {}});
+                }
+            }
+
+            lk.lock();
+            if (!ok && dir.first.empty()) rootRead = false;
+            for (auto& f : found) files.push_back(std::move(f));
+            for (auto& d : subdirs) dirs.push_back(std::move(d));
+            --busy;
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nthreads; ++t) threads.emplace_back(run);
+    run();
+    for (auto& t : threads) t.join();
+    return rootRead;
+}
+
+// The whole index of root, reusing entries of prev; false (with error set) if root can't be read
+static bool build_index(const std::string& root, int maxDepth, const uint8_t* prevData, size_t prevLen,
+                        std::string& out, std::string& error) {
+    const unsigned hw = std::thread::hardware_concurrency();
+    const size_t nthreads = std::max(2u, std::min(hw, 8u));  // Mostly waiting on the disk
+    std::vector<IndexFile> files;
+    if (!walk_folder(root, maxDepth, nthreads, files)) {
+        error = "cannot read folder: " + root;
+        return false;
+    }
+
+    auto prev = read_prev_index(prevData, prevLen);
+    std::atomic<uint32_t> parsed{0};
+    parallel_for(files.size(), nthreads, [&](size_t i) {
+        IndexFile& f = files[i];
+        auto it = f.sequence ? prev.find(f.rel) : prev.end();
+        if (it != prev.end() && it->second.mtimeMs == f.mtimeMs && it->second.size == f.size) {
+            f.entry.assign(reinterpret_cast<const char*>(it->second.entry), it->second.len);
+            return;
+        }
+        if (!f.sequence) {
+            serialize_entry(f, nullptr, std::string());
+            return;
+        }
+        ++parsed;
+        std::string err;
+        FseqHeader h;
+        const bool ok = read_fseq_header(root + "/" + f.rel, h, err);
+        serialize_entry(f, ok ? &h : nullptr, err);
+    });
+
+    std::sort(files.begin(), files.end(), [](const IndexFile& a, const IndexFile& b) {
+        return a.depth != b.depth ? a.depth < b.depth : a.rel < b.rel;
+    });
+    size_t total = 16;
+    for (const auto& f : files) total += f.entry.size();
+    out.clear();
+    out.reserve(total);
+    out += "FSIX";
+    IndexWriter w(out);
+    w.u32(kIndexVersion);
+    w.u32(static_cast<uint32_t>(files.size()));
+    w.u32(parsed.load());
+    for (const auto& f : files) out += f.entry;
+    return true;
+}
+
+class IndexWorker : public Napi::AsyncWorker {
+public:
+    IndexWorker(Napi::Env env, const std::string& root, int maxDepth, const uint8_t* prev, size_t prevLen)
+        : Napi::AsyncWorker(env, "FseqIndex"), deferred_(Napi::Promise::Deferred::New(env)), root_(root),
+          maxDepth_(maxDepth), prev_(prev, prev + prevLen) {}
+
+    Napi::Promise Promise() const { return deferred_.Promise(); }
+
+    void Execute() override {
+        std::string error;
+        if (!build_index(root_, maxDepth_, prev_.data(), prev_.size(), out_, error)) SetError(error);
+    }
+
+    void OnOK() override {
+        Napi::Env env = Env();
+        auto ab = Napi::ArrayBuffer::New(env, out_.size());
+        std::memcpy(ab.Data(), out_.data(), out_.size());
+        deferred_.Resolve(ab);
+    }
+
+    void OnError(const Napi::Error& e) override { deferred_.Reject(e.Value()); }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    std::string root_;
+    int maxDepth_;
+    std::vector<uint8_t> prev_;  // Copied, as the caller's buffer may go before Execute runs
+    std::string out_;
+};
+
+// ---------------------------------------------------------------------------
+// N-API export: indexFolder(root, maxDepth, prev?: Uint8Array) => Promise<ArrayBuffer>
+//   The index described above, of every file in root and up to maxDepth folders
+//   below it; entries in prev for files that have not changed are reused as they are.
+// ---------------------------------------------------------------------------
+static Napi::Value IndexFolder(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (root: string, maxDepth: number, prev?: Uint8Array)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    const uint8_t* prev = nullptr;
+    size_t prevLen = 0;
+    if (info.Length() > 2 && info[2].IsTypedArray()) {
+        auto p = info[2].As<Napi::Uint8Array>();
+        prev = p.Data();
+        prevLen = p.ByteLength();
+    }
+    auto* w = new IndexWorker(env, info[0].As<Napi::String>().Utf8Value(),
+                              std::max(0, info[1].As<Napi::Number>().Int32Value()), prev, prevLen);
+    Napi::Promise p = w->Promise();
+    w->Queue();
+    return p;
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("readHeader", Napi::Function::New(env, ReadHeader));
+    exports.Set("indexFolder", Napi::Function::New(env, IndexFolder));
+    return exports;
+}
+
+NODE_API_MODULE(fseq_map, Init)
@@ -0,0 +1,39 @@
+import { createRequire } from 'module';
+import { FSEQHeader, FSEQReaderAsync } from '@ezplayer/epp';
+
+const require = createRequire(import.meta.url);
+
+interface NativeAddon {
+    readHeader(path: string): Promise<FSEQHeader>;
+    indexFolder(root: string, maxDepth: number, prev?: Uint8Array): Promise<ArrayBuffer>;
+}
+
+let native: NativeAddon | null = null;
+try {
+    const bindings = require('bindings');
+    native = bindings('fseq_map');
+} catch (e) {
+    console.error('NO fseq_map BINDING');
+    console.error(e);
+}
+
+export const haveNativeFseqMap = !!native;
+
+/**
+ * List root and up to maxDepth folders below it, and parse every .fseq header found, from a
+ *  pool of native threads, into the binary index that fseqindex.ts reads.  Entries of `prev`
+ *  (an earlier result) are reused for files whose modification time and size are unchanged.
+ *  Undefined if the addon could not be loaded.
+ */
+export function indexFolderNative(root: string, maxDepth: number, prev?: Uint8Array): Promise<ArrayBuffer> | undefined {
+    return native?.indexFolder(root, maxDepth, prev);
+}
+
+/**
+ * Parse an FSEQ header (with block index, sparse ranges and variable headers) from a memory
+ *  mapping on a libuv thread.  Falls back to FSEQReaderAsync if the addon could not be loaded.
+ */
+export async function readFSEQHeaderFast(path: string): Promise<FSEQHeader> {
+    if (!native) return FSEQReaderAsync.readFSEQHeaderAsync(path);
+    return native.readHeader(path);
+}
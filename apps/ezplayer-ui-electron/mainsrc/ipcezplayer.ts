@@ -69,7 +69,7 @@ import type {
     SequenceRecord,
 } from '@ezplayer/ezplayer-core';
 
-import { FSEQReaderAsync } from '@ezplayer/epp';
+import { readFSEQHeaderFast } from './fseq-map/fseqmap.js';
 
 import { mergePlaylists, mergeSchedule, mergeSequences } from '@ezplayer/ezplayer-core';
 
@@ -452,12 +452,10 @@ export async function putSequencesWithDurations(recs: SequenceRecord[]): Promise
         if (!ups?.work?.length && ups.files?.fseq) {
             // best-effort: a corrupt fseq shouldn't fail the whole upsert
             try {
-                const fseq = new FSEQReaderAsync(ups.files.fseq);
-                await fseq.open();
-                const frameTime = fseq.header!.msperframe; // 50 -> 20FPS, 25 -> 40 FPS, 20 -> 50 FPS, 10 -> 100 FPS
-                const nframes = fseq.header!.frames;
+                const header = await readFSEQHeaderFast(ups.files.fseq);
+                const frameTime = header.msperframe; // 50 -> 20FPS, 25 -> 40 FPS, 20 -> 50 FPS, 10 -> 100 FPS
+                const nframes = header.frames;
                 ups.work.length = (frameTime * nframes) / 1000;
-                await fseq.close();
             } catch (e) {
                 console.warn(`[sequences] could not read FSEQ header for ${ups.files.fseq}:`, e);
             }
@@ -0,0 +1,563 @@
+// output-engine/outputengine.cpp — Native frame output on its own clock.
+//
+// JS publishes finished frames into a SharedArrayBuffer laid out like
+// LatestFrameRingBuffer (ezplayer-core FrameRingBuffer.ts) and tells the
+// engine when each published sequence number is due on the wire.  A single
+// long-lived "output" thread, started in start() and joined in stop(),
+// sleeps until the due time, copies the slot out of the ring (one memcpy
+// per frame, so the writer can reuse the slot while packets are in flight),
+// packetizes DDP / E1.31 with prebuilt headers (packetize.h), and sends each
+// controller's packets in one batch (udpsock.h).  Per-frame statistics go
+// back to JS through a TypedThreadSafeFunction.
+//
+// GC pauses and event-loop stalls on the JS side therefore only matter if
+// they exceed the publish lead; they no longer show up as jitter on the wire.
+//
+// With txTime (Linux, SO_TXTIME), the thread wakes a little before the due
+// time and queues each batch with the due time as its launch time, so the
+// qdisc rather than this thread's wakeup decides when packets leave.  One
+// TX timestamp per controller per frame is read back and reported as the
+// achieved-minus-requested delta.  If the timestamps show launch times are
+// being ignored (no fq/etf qdisc), the engine goes back to timed sends.
+#include "napi.h"
+#include "../udp-batch/udpsock.h"
+#include "packetize.h"
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+  #include <mmsystem.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Forward declarations for TSFN template
+// ---------------------------------------------------------------------------
+struct FrameStats;
+static void CallJs(Napi::Env env, Napi::Function jsCallback,
+                   void* context, FrameStats* data);
+
+using TSFN = Napi::TypedThreadSafeFunction<void, FrameStats, CallJs>;
+
+// ---------------------------------------------------------------------------
+// Ring header (Int32 indices, see LatestFrameRingBuffer)
+// ---------------------------------------------------------------------------
+static const int kRingSlotCount = 0;
+static const int kRingFrameSize = 1;
+static const int kRingLatestSeq = 4;
+static const size_t kRingHeaderBytes = 32;
+
+static inline int32_t load_i32(const int32_t* p) {
+#if defined(_MSC_VER)
+    return static_cast<int32_t>(InterlockedOr(
+        reinterpret_cast<volatile LONG*>(const_cast<int32_t*>(p)), 0));
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Engine state
+// ---------------------------------------------------------------------------
+struct EngineController {
+    std::string address;
+    sock_t sock = BAD_SOCK;
+    SendPath path;
+    ControllerPlan plan;
+    int64_t minFrameTimeNs = 0;
+    int64_t lastSendNs = 0;
+    int64_t pendingTxDueNs = 0;   // requested time of the batch awaiting a TX stamp
+    std::vector<io_buf> iov;
+    std::vector<PacketSpan> spans;
+};
+
+struct ScheduledFrame {
+    int32_t seq;
+    int64_t dueNs;
+};
+
+struct FrameStats {
+    int32_t seq = 0;
+    double dueMs = 0;
+    double lateMs = 0;         // actual send start - due time
+    double sendMs = 0;         // time to packetize and send every controller
+    uint32_t packets = 0;
+    uint32_t errors = 0;
+    uint32_t skippedControllers = 0;
+    uint32_t txSamples = 0;    // TX stamps read back (for earlier frames)
+    double txDeltaMinMs = 0;   // achieved - requested launch time
+    double txDeltaMaxMs = 0;
+    double txDeltaSumMs = 0;
+    uint32_t txDrops = 0;      // datagrams dropped for missing their launch time
+    std::string dropped;       // "", "late" or "overrun"
+    std::string error;
+};
+
+static TSFN tsfn;
+static bool have_tsfn = false;
+static std::thread engine_thread;
+static std::atomic<bool> running{false};
+static std::mutex sched_mutex;
+static std::condition_variable sched_cv;
+static std::vector<ScheduledFrame> schedule;
+
+static std::vector<EngineController> controllers;
+static Napi::ObjectReference ring_ref;
+static const uint8_t* ring_base = nullptr;
+static size_t ring_bytes = 0;
+static std::vector<uint8_t> frame_copy;
+static int64_t skip_late_ns = 5 * 1000000LL;
+static bool use_txtime = false;
+static bool tx_honored = true;
+static int tx_early_count = 0;
+static int64_t tx_lead_ns = 4 * 1000000LL;
+
+static inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---------------------------------------------------------------------------
+// TSFN callback — runs on the JS event-loop thread
+// ---------------------------------------------------------------------------
+static void CallJs(Napi::Env env, Napi::Function jsCallback,
+                   void* /*context*/, FrameStats* data) {
+    if (data == nullptr) return;
+    if (env != nullptr && !jsCallback.IsEmpty()) {
+        auto obj = Napi::Object::New(env);
+        obj.Set("seq", Napi::Number::New(env, data->seq));
+        obj.Set("dueMs", Napi::Number::New(env, data->dueMs));
+        obj.Set("lateMs", Napi::Number::New(env, data->lateMs));
+        obj.Set("sendMs", Napi::Number::New(env, data->sendMs));
+        obj.Set("packets", Napi::Number::New(env, data->packets));
+        obj.Set("errors", Napi::Number::New(env, data->errors));
+        obj.Set("skippedControllers", Napi::Number::New(env, data->skippedControllers));
+        if (data->txSamples || data->txDrops) {
+            obj.Set("txSamples", Napi::Number::New(env, data->txSamples));
+            obj.Set("txDeltaMinMs", Napi::Number::New(env, data->txDeltaMinMs));
+            obj.Set("txDeltaMaxMs", Napi::Number::New(env, data->txDeltaMaxMs));
+            obj.Set("txDeltaSumMs", Napi::Number::New(env, data->txDeltaSumMs));
+            obj.Set("txDrops", Napi::Number::New(env, data->txDrops));
+        }
+        if (!data->dropped.empty()) {
+            obj.Set("dropped", Napi::String::New(env, data->dropped));
+        }
+        if (!data->error.empty()) {
+            obj.Set("error", Napi::String::New(env, data->error));
+        }
+        jsCallback.Call({obj});
+    }
+    delete data;
+}
+
+static void post_stats(FrameStats* st) {
+    if (tsfn.NonBlockingCall(st) != napi_ok) {
+        delete st;   // queue full or TSFN closing — stats are best-effort
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TX timestamps for earlier frames.  Runs on the output thread.
+// ---------------------------------------------------------------------------
+static void collect_tx_reports(FrameStats* st, int64_t now) {
+    const int64_t rtOffset = realtime_offset_ns();
+    for (auto& c : controllers) {
+        if (c.sock == BAD_SOCK || !c.path.txtime) continue;
+        TxReport tr;
+        read_tx_reports(c.sock, tr);
+        st->txDrops += tr.drops;
+        if (!c.pendingTxDueNs) continue;
+        if (!tr.stamps) {
+            if (now - c.pendingTxDueNs > 1000000000LL) c.pendingTxDueNs = 0;   // lost
+            continue;
+        }
+        double delta = static_cast<double>(tr.lastStampNs - rtOffset - c.pendingTxDueNs) / 1e6;
+        c.pendingTxDueNs = 0;
+        if (!st->txSamples || delta < st->txDeltaMinMs) st->txDeltaMinMs = delta;
+        if (!st->txSamples || delta > st->txDeltaMaxMs) st->txDeltaMaxMs = delta;
+        st->txDeltaSumMs += delta;
+        ++st->txSamples;
+    }
+
+    // Packets leaving well before their launch time means the qdisc ignores it
+    if (use_txtime && tx_honored && st->txSamples) {
+        const double lead = static_cast<double>(tx_lead_ns) / 1e6;
+        if (st->txDeltaMaxMs < -lead / 2) {
+            if (++tx_early_count >= 3) {
+                tx_honored = false;
+                st->error = "launch times are not honoured by the interface qdisc (fq or etf needed); "
+                            "sending on the engine clock instead";
+            }
+        } else {
+            tx_early_count = 0;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Send one scheduled frame.  Runs on the output thread.
+// ---------------------------------------------------------------------------
+static void send_frame(const ScheduledFrame& sf) {
+    auto* st = new FrameStats();
+    st->seq = sf.seq;
+    st->dueMs = static_cast<double>(sf.dueNs) / 1e6;
+
+    int64_t start = now_ns();
+    collect_tx_reports(st, start);
+    const bool txtime = use_txtime && tx_honored;
+    st->lateMs = static_cast<double>(start - sf.dueNs) / 1e6;
+    if (txtime) st->lateMs = std::max(0.0, st->lateMs);   // early on purpose
+    if (start - sf.dueNs > skip_late_ns) {
+        st->dropped = "late";
+        post_stats(st);
+        return;
+    }
+
+    // Locate and copy the slot.  The writer puts seq n in slot (n - 1) % slots
+    //  and fills slot(latestSeq + 1) before bumping latestSeq, so our slot is
+    //  safe while latestSeq - seq <= slots - 2.  The slot comes from seq alone:
+    //  latestSlot is stored separately, and a publish between reading it and
+    //  latestSeq would point one slot ahead.
+    const int32_t* hdr = reinterpret_cast<const int32_t*>(ring_base);
+    int32_t slots = load_i32(hdr + kRingSlotCount);
+    int32_t frameSize = load_i32(hdr + kRingFrameSize);
+    int32_t latestSeq = load_i32(hdr + kRingLatestSeq);
+    int32_t age = latestSeq - sf.seq;
+    if (slots < 2 || sf.seq < 1 || age < 0 || age > slots - 2) {
+        st->dropped = "overrun";
+        post_stats(st);
+        return;
+    }
+    int32_t slot = (sf.seq - 1) % slots;
+    std::memcpy(frame_copy.data(),
+                ring_base + kRingHeaderBytes + static_cast<size_t>(slot) * frameSize,
+                std::min(frame_copy.size(), static_cast<size_t>(frameSize)));
+    if (load_i32(hdr + kRingLatestSeq) - sf.seq > slots - 2) {
+        st->dropped = "overrun";   // writer lapped us during the copy
+        post_stats(st);
+        return;
+    }
+
+    // Packetize and send, controller by controller
+    const int64_t sendAt = txtime ? std::max(start, sf.dueNs) : start;
+    for (auto& c : controllers) {
+        if (c.sock == BAD_SOCK) continue;
+        if (c.minFrameTimeNs && sendAt < c.lastSendNs + c.minFrameTimeNs - 100000) {
+            ++st->skippedControllers;
+            continue;
+        }
+        c.lastSendNs = sendAt;
+
+        stamp_sequence(c.plan);
+        c.iov.clear();
+        c.spans.clear();
+        for (const PacketPlan& pp : c.plan.packets) {
+            c.spans.push_back({c.iov.size(), 2});
+            c.iov.push_back(make_io_buf(&c.plan.headers[pp.hdrOff], pp.hdrLen));
+            c.iov.push_back(make_io_buf(frame_copy.data() + pp.dataOff, pp.dataLen));
+        }
+
+        SendOpts so;
+        if (txtime && c.path.txtime) so.txtimeNs = static_cast<uint64_t>(sendAt);
+        so.txStamp = c.path.txtime && !c.pendingTxDueNs;
+        SendCounts sc;
+        send_batch(c.sock, c.path, c.iov.data(), c.spans.data(), c.spans.size(), sc, &so);
+        if (so.txStamp && sc.nOk) c.pendingTxDueNs = sf.dueNs;
+        st->packets += sc.nOk;
+        st->errors += sc.nErr;
+        if (!sc.error.empty()) st->error = c.address + ": " + sc.error;
+    }
+
+    st->sendMs = static_cast<double>(now_ns() - start) / 1e6;
+    post_stats(st);
+}
+
+// ---------------------------------------------------------------------------
+// Output thread
+// ---------------------------------------------------------------------------
+static void engine_thread_func() {
+#if defined(_WIN32)
+    timeBeginPeriod(1);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#endif
+    // Sleep on the condvar until this close to the due time, then yield-spin.
+    //  With launch times, wake tx_lead_ns early instead and don't spin.
+    const int64_t kSpinNs = 2 * 1000000LL;
+
+    std::unique_lock<std::mutex> lk(sched_mutex);
+    while (running.load()) {
+        if (schedule.empty()) {
+            sched_cv.wait_for(lk, std::chrono::milliseconds(100));
+            continue;
+        }
+        auto next = std::min_element(schedule.begin(), schedule.end(),
+            [](const ScheduledFrame& a, const ScheduledFrame& b) { return a.dueNs < b.dueNs; });
+        const bool txtime = use_txtime && tx_honored;
+        const int64_t early = txtime ? tx_lead_ns : kSpinNs;
+        int64_t wait = next->dueNs - now_ns();
+        if (wait > early) {
+            // Woken early if an earlier frame is scheduled or on stop()
+            sched_cv.wait_for(lk, std::chrono::nanoseconds(wait - early));
+            continue;
+        }
+        ScheduledFrame sf = *next;
+        schedule.erase(next);
+        lk.unlock();
+
+        if (!txtime) {
+            while (now_ns() < sf.dueNs) std::this_thread::yield();
+        }
+        send_frame(sf);
+
+        lk.lock();
+    }
+    schedule.clear();
+
+#if defined(_WIN32)
+    timeEndPeriod(1);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+static void close_controllers() {
+    for (auto& c : controllers) {
+        if (c.sock != BAD_SOCK) close_sock(c.sock);
+    }
+    controllers.clear();
+}
+
+static void stop_engine() {
+    if (running.exchange(false)) {
+        sched_cv.notify_all();
+        if (engine_thread.joinable()) engine_thread.join();
+    }
+    if (have_tsfn) {
+        tsfn.Release();
+        have_tsfn = false;
+    }
+}
+
+static std::string get_string(const Napi::Object& o, const char* key, const std::string& def) {
+    Napi::Value v = o.Get(key);
+    return v.IsString() ? v.As<Napi::String>().Utf8Value() : def;
+}
+
+static double get_number(const Napi::Object& o, const char* key, double def) {
+    Napi::Value v = o.Get(key);
+    return v.IsNumber() ? v.As<Napi::Number>().DoubleValue() : def;
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: configure({ ring, controllers, skipLateMs, gso, txTime,
+//                           txLeadMs, onStats })
+//   ring: Uint8Array over the LatestFrameRingBuffer SharedArrayBuffer
+//   controllers: [{ proto, address, port, bufStart, bufLen, startChNum,
+//                   startUniverse, channelsPerPacket, minFrameTime,
+//                   sendBufSize, sourceName }]
+//   => [{ address, error?, gso?, txTime? }] — one entry per controller
+// ---------------------------------------------------------------------------
+static Napi::Value Configure(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected (options: object)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto opts = info[0].As<Napi::Object>();
+    Napi::Value ringv = opts.Get("ring");
+    Napi::Value ctrlv = opts.Get("controllers");
+    Napi::Value statsv = opts.Get("onStats");
+    if (!ringv.IsTypedArray() || !ctrlv.IsArray() || !statsv.IsFunction()) {
+        Napi::TypeError::New(env, "Expected { ring: Uint8Array, controllers: Array, onStats: Function }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    stop_engine();
+    close_controllers();
+
+    auto ring = ringv.As<Napi::Uint8Array>();
+    if (ring.ByteLength() < kRingHeaderBytes) {
+        Napi::RangeError::New(env, "Ring buffer too small").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    ring_ref = Napi::Persistent(ring.As<Napi::Object>());
+    ring_base = ring.Data();
+    ring_bytes = ring.ByteLength();
+    const int32_t* hdr = reinterpret_cast<const int32_t*>(ring_base);
+    int32_t slots = load_i32(hdr + kRingSlotCount);
+    int32_t frameSize = load_i32(hdr + kRingFrameSize);
+    if (slots < 2 || frameSize <= 0 ||
+        kRingHeaderBytes + static_cast<size_t>(slots) * frameSize > ring_bytes) {
+        Napi::RangeError::New(env, "Ring buffer header does not match its size")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    frame_copy.assign(static_cast<size_t>(frameSize), 0);
+    skip_late_ns = static_cast<int64_t>(get_number(opts, "skipLateMs", 5) * 1e6);
+    Napi::Value gsov = opts.Get("gso");
+    bool allowGso = !gsov.IsBoolean() || gsov.As<Napi::Boolean>().Value();
+    Napi::Value txv = opts.Get("txTime");
+    bool wantTxTime = txv.IsBoolean() && txv.As<Napi::Boolean>().Value();
+    tx_lead_ns = static_cast<int64_t>(get_number(opts, "txLeadMs", 4) * 1e6);
+
+    auto list = ctrlv.As<Napi::Array>();
+    auto result = Napi::Array::New(env, list.Length());
+    for (uint32_t i = 0; i < list.Length(); ++i) {
+        Napi::Value cv = list[i];
+        auto entry = Napi::Object::New(env);
+        result.Set(i, entry);
+        if (!cv.IsObject()) {
+            entry.Set("error", Napi::String::New(env, "controller entry is not an object"));
+            continue;
+        }
+        auto co = cv.As<Napi::Object>();
+        EngineController c;
+        c.address = get_string(co, "address", "");
+        entry.Set("address", Napi::String::New(env, c.address));
+
+        uint32_t bufStart = static_cast<uint32_t>(get_number(co, "bufStart", 0));
+        uint32_t bufLen = static_cast<uint32_t>(get_number(co, "bufLen", 0));
+        if (bufStart >= static_cast<uint32_t>(frameSize)) bufLen = 0;
+        else bufLen = std::min(bufLen, static_cast<uint32_t>(frameSize) - bufStart);
+        c.plan.bufStart = bufStart;
+        c.plan.bufLen = bufLen;
+        c.minFrameTimeNs = static_cast<int64_t>(get_number(co, "minFrameTime", 0) * 1e6);
+
+        std::string proto = get_string(co, "proto", "DDP");
+        uint32_t chPerPacket = static_cast<uint32_t>(get_number(co, "channelsPerPacket", 0));
+        if (proto == "E131") {
+            build_e131_plan(c.plan, static_cast<uint16_t>(get_number(co, "startUniverse", 1)),
+                            chPerPacket, get_string(co, "sourceName", "EZPlayer"));
+        } else {
+            build_ddp_plan(c.plan, static_cast<uint32_t>(get_number(co, "startChNum", 0)),
+                           chPerPacket, true);
+        }
+
+        std::string err;
+        int port = static_cast<int>(get_number(co, "port", proto == "E131" ? 5568 : 4048));
+        c.sock = open_udp_socket(c.address, port, 4,
+                                 static_cast<int>(get_number(co, "sendBufSize", 0)), err);
+        if (c.sock == BAD_SOCK) {
+            entry.Set("error", Napi::String::New(env, err));
+        } else {
+            c.path = open_send_path(c.sock, allowGso);
+            entry.Set("gso", Napi::Boolean::New(env, c.path.gso));
+            if (wantTxTime) entry.Set("txTime", Napi::Boolean::New(env, enable_txtime(c.sock, c.path)));
+        }
+        controllers.push_back(std::move(c));
+    }
+
+    // Launch times only if every open socket took them; a mix can't share one wake-up
+    use_txtime = false;
+    if (wantTxTime) {
+        use_txtime = true;
+        bool anyOpen = false;
+        for (const auto& c : controllers) {
+            if (c.sock == BAD_SOCK) continue;
+            anyOpen = true;
+            use_txtime = use_txtime && c.path.txtime;
+        }
+        use_txtime = use_txtime && anyOpen;
+    }
+    tx_honored = true;
+    tx_early_count = 0;
+
+    // TSFN: bounded queue; stats are dropped rather than piling up
+    tsfn = TSFN::New(env, statsv.As<Napi::Function>(), "OutputEngineTSFN", 256, 1);
+    have_tsfn = true;
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: start() / stop()
+// ---------------------------------------------------------------------------
+static Napi::Value Start(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!have_tsfn || !ring_base) {
+        Napi::Error::New(env, "configure() must be called before start()")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!running.exchange(true)) {
+        engine_thread = std::thread(engine_thread_func);
+    }
+    return env.Undefined();
+}
+
+static Napi::Value Stop(const Napi::CallbackInfo& info) {
+    stop_engine();
+    close_controllers();
+    ring_ref.Reset();
+    ring_base = nullptr;
+    return info.Env().Undefined();
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: schedule(seq, dueMs) — dueMs is in the nowMs() time base
+// ---------------------------------------------------------------------------
+static Napi::Value Schedule(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (seq: number, dueMs: number)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    ScheduledFrame sf{info[0].As<Napi::Number>().Int32Value(),
+                      static_cast<int64_t>(info[1].As<Napi::Number>().DoubleValue() * 1e6)};
+    {
+        std::lock_guard<std::mutex> lk(sched_mutex);
+        // A frame can't be sent more than once; never let the list grow unbounded
+        if (schedule.size() < 64) schedule.push_back(sf);
+    }
+    sched_cv.notify_all();
+    return env.Undefined();
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: nowMs() — the engine's clock, for aligning with performance.now()
+// ---------------------------------------------------------------------------
+static Napi::Value NowMs(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(now_ns()) / 1e6);
+}
+
+// ---------------------------------------------------------------------------
+// Cleanup hook — safety net if stop() was never called
+// ---------------------------------------------------------------------------
+static void CleanupHook(void*) {
+    if (running.exchange(false)) {
+        sched_cv.notify_all();
+        if (engine_thread.joinable()) engine_thread.join();
+    }
+    if (have_tsfn) {
+        tsfn.Abort();
+        have_tsfn = false;
+    }
+    close_controllers();
+    ring_ref.SuppressDestruct();
+    ring_base = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Module init
+// ---------------------------------------------------------------------------
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    napi_add_env_cleanup_hook(env, CleanupHook, nullptr);
+
+    exports.Set("configure", Napi::Function::New(env, Configure));
+    exports.Set("start", Napi::Function::New(env, Start));
+    exports.Set("stop", Napi::Function::New(env, Stop));
+    exports.Set("schedule", Napi::Function::New(env, Schedule));
+    exports.Set("nowMs", Napi::Function::New(env, NowMs));
+    return exports;
+}
+
+NODE_API_MODULE(output_engine, Init)
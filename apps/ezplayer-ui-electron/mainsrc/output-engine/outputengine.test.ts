@@ -0,0 +1,63 @@
+import { describe, it, expect } from 'vitest';
+import dgram from 'node:dgram';
+import type { AddressInfo } from 'node:net';
+import { LatestFrameRingBuffer } from '@ezplayer/ezplayer-core';
+import { OutputEngine } from './outputengine';
+
+const N_UNIVERSES = 40;
+const N_FRAMES = 4;
+
+const sleep = (ms: number) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// Needs the built addon (node-gyp rebuild); skipped without it
+describe.skipIf(!OutputEngine.isAvailable())('OutputEngine', () => {
+    it('steps each E1.31 universe sequence by one per frame', async () => {
+        const sock = dgram.createSocket({ type: 'udp4', recvBufferSize: 1 << 20 });
+        const seqs = new Map<number, number[]>(); // universe -> h[111] of each packet, in order
+        sock.on('message', (m) => {
+            const universe = m.readUInt16BE(113);
+            if (!seqs.has(universe)) seqs.set(universe, []);
+            seqs.get(universe)!.push(m[111]);
+        });
+        await new Promise<void>((resolve) => sock.bind(0, '127.0.0.1', resolve));
+
+        const nChannels = N_UNIVERSES * 510;
+        const ring = LatestFrameRingBuffer.allocate(nChannels, 4, true) as SharedArrayBuffer;
+        const writer = new LatestFrameRingBuffer({ buffer: ring, frameSize: nChannels, slotCount: 4, isWriter: true });
+        const engine = new OutputEngine();
+        const opened = engine.configure({
+            ring,
+            controllers: [
+                {
+                    proto: 'E131',
+                    address: '127.0.0.1',
+                    port: (sock.address() as AddressInfo).port,
+                    bufStart: 0,
+                    bufLen: nChannels,
+                    startUniverse: 1,
+                    channelsPerPacket: 510,
+                },
+            ],
+            skipLateMs: 1000,
+            onStats: () => {},
+        });
+        expect(opened[0].error).toBeUndefined();
+        engine.start();
+        try {
+            for (let f = 0; f < N_FRAMES; ++f) {
+                engine.schedule(writer.publishFrom(new Uint8Array(nChannels).fill(f)), performance.now());
+                await sleep(30);
+            }
+            await sleep(100);
+        } finally {
+            engine.stop();
+            sock.close();
+        }
+
+        expect(seqs.size).toBe(N_UNIVERSES);
+        for (const [universe, s] of seqs) {
+            expect(s.length, `universe ${universe}`).toBe(N_FRAMES);
+            for (let i = 1; i < s.length; ++i) expect((s[i] - s[i - 1]) & 0xff, `universe ${universe}`).toBe(1);
+        }
+    });
+});
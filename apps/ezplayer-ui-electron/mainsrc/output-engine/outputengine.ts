@@ -0,0 +1,167 @@
+import { createRequire } from 'module';
+import type { ControllerState } from '@ezplayer/epp';
+
+const require = createRequire(import.meta.url);
+
+/** Per-frame report from the native output thread */
+export interface EngineFrameStats {
+    seq: number;
+    dueMs: number;
+    lateMs: number;
+    sendMs: number;
+    packets: number;
+    errors: number;
+    skippedControllers: number;
+    // Launch-time (txTime) results read back for earlier frames; achieved - requested
+    txSamples?: number;
+    txDeltaMinMs?: number;
+    txDeltaMaxMs?: number;
+    txDeltaSumMs?: number;
+    txDrops?: number;
+    dropped?: 'late' | 'overrun';
+    error?: string;
+}
+
+export interface EngineControllerConfig {
+    proto: 'DDP' | 'E131';
+    address: string;
+    port?: number;
+    bufStart: number; // 0-based channel within the frame
+    bufLen: number;
+    startChNum?: number; // DDP channel offset on the controller
+    startUniverse?: number; // E1.31
+    channelsPerPacket?: number;
+    minFrameTime?: number; // ms
+    sendBufSize?: number;
+    sourceName?: string;
+}
+
+interface NativeAddon {
+    configure(opts: {
+        ring: Uint8Array;
+        controllers: EngineControllerConfig[];
+        skipLateMs: number;
+        gso?: boolean;
+        txTime?: boolean;
+        txLeadMs?: number;
+        onStats: (s: EngineFrameStats) => void;
+    }): { address: string; error?: string; gso?: boolean; txTime?: boolean }[];
+    start(): void;
+    stop(): void;
+    schedule(seq: number, dueMs: number): void;
+    nowMs(): number;
+}
+
+let native: NativeAddon | null = null;
+try {
+    const bindings = require('bindings');
+    native = bindings('output_engine');
+} catch (e) {
+    console.error('NO output_engine BINDING');
+    console.error(e);
+}
+
+/**
+ * Sends frames from a LatestFrameRingBuffer on a native thread, at the times given to schedule().
+ *  JS publishes each frame into the ring a little ahead of its due time and is then out of the
+ *  timing-critical path.
+ */
+export class OutputEngine {
+    private clockOffsetMs = 0; // engine nowMs() - performance.now()
+
+    static isAvailable() {
+        return !!native;
+    }
+
+    /** Returns one entry per controller, with `error` set if its socket could not be opened */
+    configure(args: {
+        ring: SharedArrayBuffer;
+        controllers: EngineControllerConfig[];
+        skipLateMs: number;
+        gso?: boolean;
+        /** Queue packets ahead with SO_TXTIME launch times (Linux; needs the fq qdisc) */
+        txTime?: boolean;
+        txLeadMs?: number;
+        onStats: (s: EngineFrameStats) => void;
+    }) {
+        if (!native) throw new Error('Native output engine is not available');
+        this.syncClock();
+        return native.configure({
+            ring: new Uint8Array(args.ring),
+            controllers: args.controllers,
+            skipLateMs: args.skipLateMs,
+            gso: args.gso,
+            txTime: args.txTime,
+            txLeadMs: args.txLeadMs,
+            onStats: args.onStats,
+        });
+    }
+
+    start() {
+        native?.start();
+    }
+
+    stop() {
+        native?.stop();
+    }
+
+    /** Send ring sequence `seq` at `targetPN` (performance.now() time base) */
+    schedule(seq: number, targetPN: number) {
+        native?.schedule(seq, targetPN + this.clockOffsetMs);
+    }
+
+    /** Convert an engine-reported time back to performance.now() */
+    toPerfNow(engineMs: number) {
+        return engineMs - this.clockOffsetMs;
+    }
+
+    /** Estimate the offset between the two clocks, keeping the tightest bracket */
+    syncClock() {
+        if (!native) return;
+        let best = Infinity;
+        for (let i = 0; i < 5; ++i) {
+            const p0 = performance.now();
+            const e = native.nowMs();
+            const p1 = performance.now();
+            if (p1 - p0 < best) {
+                best = p1 - p0;
+                this.clockOffsetMs = e - (p0 + p1) / 2;
+            }
+        }
+    }
+}
+
+/**
+ * Build engine controller configs the same way openControllersForDataSend sets up its senders.
+ *  Only controllers that opened successfully there are included.
+ */
+export function engineControllersFrom(ctrls: ControllerState[], opts?: { ddpPort?: number }) {
+    const res: EngineControllerConfig[] = [];
+    for (const c of ctrls) {
+        const xc = c.xlRecord;
+        if (!xc || !c.setup.usable || c.report?.status !== 'open') continue;
+        const base = {
+            address: c.setup.address,
+            bufStart: c.setup.startCh - 1,
+            bufLen: c.setup.nCh,
+            minFrameTime: xc.desc?.minFrameTime ?? 0,
+            sendBufSize: Math.max(256_000, c.setup.nCh * 2),
+        };
+        if (c.setup.proto === 'DDP') {
+            res.push({
+                ...base,
+                proto: 'DDP',
+                port: opts?.ddpPort,
+                startChNum: xc.keepChannelNumbers ? xc.startch - 1 : 0,
+            });
+        } else if (c.setup.proto === 'E131') {
+            res.push({
+                ...base,
+                proto: 'E131',
+                startUniverse: xc.universeNumbers?.[0] ?? 1,
+                channelsPerPacket: xc.universeSizes?.[0] ?? 510,
+            });
+        }
+    }
+    return res;
+}
@@ -0,0 +1,160 @@
+// output-engine/packetize.h — DDP / E1.31 packet plans for the output engine.
+//
+// A controller's channel range is cut into packets once, when the engine is
+// configured, and every header is prebuilt.  Per frame, only the sequence
+// bytes are stamped; payloads are gathered from the engine's copy of the
+// frame, so no packet is assembled in a buffer of its own.
+//
+// Header layouts mirror fillInDDPHeader() (epp DDP.ts) and
+// fillE131PacketHeader() (epp E131.ts).
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const uint32_t kDDPHeaderLen = 10;
+static const uint32_t kDDPMaxPayload = 1440;
+static const uint32_t kE131HeaderLen = 126;
+static const uint32_t kE131MaxPayload = 512;
+
+enum class OutputProto { DDP = 0, E131 = 1 };
+
+struct PacketPlan {
+    uint32_t hdrOff;       // into ControllerPlan::headers
+    uint32_t hdrLen;
+    uint32_t dataOff;      // into the frame (absolute channel offset)
+    uint32_t dataLen;
+};
+
+struct ControllerPlan {
+    OutputProto proto = OutputProto::DDP;
+    uint32_t bufStart = 0;         // first frame channel (0-based)
+    uint32_t bufLen = 0;           // channel count
+    std::vector<uint8_t> headers;
+    std::vector<PacketPlan> packets;
+    uint32_t seq = 0;              // sequence: per packet for DDP, per frame for E1.31
+};
+
+static inline void put_be16(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+static inline void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+// ---------------------------------------------------------------------------
+// DDP — http://www.3waylabs.com/ddp/
+// ---------------------------------------------------------------------------
+static inline void fill_ddp_header(uint8_t* h, uint32_t startChannel,
+                                   uint32_t dataLen, bool push) {
+    h[0] = push ? 0x41 : 0x40;     // V=01, P
+    h[1] = 0;                      // sequence, stamped per frame
+    h[2] = 0;                      // data type: pre-agreed
+    h[3] = 1;                      // default output device
+    put_be32(h + 4, startChannel);
+    put_be16(h + 8, dataLen);
+}
+
+// startChNum is the DDP channel offset of bufStart on the controller.
+static inline void build_ddp_plan(ControllerPlan& cp, uint32_t startChNum,
+                                  uint32_t chPerPacket, bool pushOnLast) {
+    if (chPerPacket == 0 || chPerPacket > kDDPMaxPayload) chPerPacket = kDDPMaxPayload;
+    cp.proto = OutputProto::DDP;
+    cp.headers.clear();
+    cp.packets.clear();
+    for (uint32_t off = 0; off < cp.bufLen; off += chPerPacket) {
+        uint32_t len = std::min(chPerPacket, cp.bufLen - off);
+        PacketPlan pp{static_cast<uint32_t>(cp.headers.size()), kDDPHeaderLen,
+                      cp.bufStart + off, len};
+        cp.headers.resize(cp.headers.size() + kDDPHeaderLen);
+        fill_ddp_header(&cp.headers[pp.hdrOff], startChNum + off, len,
+                        pushOnLast && off + len >= cp.bufLen);
+        cp.packets.push_back(pp);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// E1.31 — https://tsp.esta.org/tsp/documents/docs/E1-31-2016.pdf
+// ---------------------------------------------------------------------------
+static const uint8_t kE131Cid[16] = {
+    0xe4, 0xea, 0xaa, 0xf2, 0xd1, 0x42, 0x11, 0xe1,
+    0xb3, 0xe4, 0x08, 0x00, 0x27, 0x62, 0x0c, 0xdd,
+};
+static const uint8_t kAcnPacketIdentifier[12] = {
+    0x41, 0x53, 0x43, 0x2d, 0x45, 0x31, 0x2e, 0x31, 0x37, 0x00, 0x00, 0x00,
+};
+
+static inline void fill_e131_header(uint8_t* h, uint16_t universe,
+                                    const std::string& sourceName,
+                                    uint32_t dataLen, uint16_t syncUniverse) {
+    std::memset(h, 0, kE131HeaderLen);
+    // Root layer
+    put_be16(h + 0, 0x0010);                                  // preamble size
+    put_be16(h + 2, 0x0000);                                  // postamble size
+    std::memcpy(h + 4, kAcnPacketIdentifier, 12);
+    put_be16(h + 16, 0x7000 | (kE131HeaderLen + dataLen - 16));
+    put_be32(h + 18, 0x00000004);                             // VECTOR_ROOT_E131_DATA
+    std::memcpy(h + 22, kE131Cid, 16);
+    // Framing layer
+    put_be16(h + 38, 0x7000 | (kE131HeaderLen + dataLen - 38));
+    put_be32(h + 40, 0x00000002);                             // VECTOR_E131_DATA_PACKET
+    std::memcpy(h + 44, sourceName.data(), std::min<size_t>(sourceName.size(), 63));
+    h[108] = 100;                                             // priority
+    put_be16(h + 109, syncUniverse);
+    h[111] = 0;                                               // sequence, stamped per frame
+    h[112] = 0;                                               // options
+    put_be16(h + 113, universe);
+    // DMP layer
+    put_be16(h + 115, 0x7000 | (kE131HeaderLen + dataLen - 115));
+    h[117] = 0x02;                                            // VECTOR_DMP_SET_PROPERTY
+    h[118] = 0xa1;
+    put_be16(h + 119, 0);                                     // first property address
+    put_be16(h + 121, 1);                                     // address increment
+    put_be16(h + 123, dataLen + 1);                           // property value count
+    h[125] = 0;                                               // start code
+}
+
+static inline void build_e131_plan(ControllerPlan& cp, uint16_t startUniverse,
+                                   uint32_t chPerPacket, const std::string& sourceName) {
+    if (chPerPacket == 0 || chPerPacket > kE131MaxPayload) chPerPacket = 510;
+    cp.proto = OutputProto::E131;
+    cp.headers.clear();
+    cp.packets.clear();
+    uint16_t univ = startUniverse;
+    for (uint32_t off = 0; off < cp.bufLen; off += chPerPacket, ++univ) {
+        uint32_t len = std::min(chPerPacket, cp.bufLen - off);
+        PacketPlan pp{static_cast<uint32_t>(cp.headers.size()), kE131HeaderLen,
+                      cp.bufStart + off, len};
+        cp.headers.resize(cp.headers.size() + kE131HeaderLen);
+        fill_e131_header(&cp.headers[pp.hdrOff], univ, sourceName, len, 0);
+        cp.packets.push_back(pp);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Per-frame: stamp sequence numbers into the prebuilt headers
+// ---------------------------------------------------------------------------
+static inline void stamp_sequence(ControllerPlan& cp) {
+    if (cp.proto == OutputProto::DDP) {
+        for (const PacketPlan& pp : cp.packets) {
+            cp.headers[pp.hdrOff + 1] = static_cast<uint8_t>((cp.seq % 15) + 1);
+            ++cp.seq;
+        }
+        return;
+    }
+    // E1.31 sequences are per universe, and each universe is one packet a
+    // frame, so they all step once per frame.  Counting packets instead would
+    // jump each universe by the universe count, which receivers take as out
+    // of order (and drop) from about 236 universes.
+    const uint8_t s = static_cast<uint8_t>(cp.seq & 0xff);
+    for (const PacketPlan& pp : cp.packets) cp.headers[pp.hdrOff + 111] = s;
+    ++cp.seq;
+}
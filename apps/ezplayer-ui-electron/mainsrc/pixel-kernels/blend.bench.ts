@@ -0,0 +1,47 @@
+// Compositing a foreground frame with a background frame (170k channels, about 57k RGB pixels)
+//  into the sender's mix frame, in each blend mode: the JS loop, and each native kernel this
+//  machine can run ('none' is the native scalar loop).  Then a three-layer stack (background,
+//  show, and an overlay over a few thousand channels) through FrameCompositor.
+// Run with: pnpm vitest bench mainsrc/pixel-kernels/blend
+import { bench, describe } from 'vitest';
+import { BlendMode, jsBlendKernel, type BlendKernel } from '../processing/blend';
+import { FrameCompositor, jsCompositeKernel, type CompositeLayer } from '../processing/compose';
+import { nativeBlendKernelFor, nativeBlendKernels, nativeCompositeKernel } from './pixelkernels';
+
+const N_CHANNELS = 170_000;
+
+const fg = new Uint8Array(N_CHANNELS);
+const bg = new Uint8Array(N_CHANNELS);
+const mask = new Uint8Array(N_CHANNELS);
+for (let i = 0; i < N_CHANNELS; ++i) {
+    fg[i] = (i * 37) & 255;
+    bg[i] = (i * 101 + 50) & 255;
+    mask[i] = (i >> 6) & 255; // Ramps, as a wipe would
+}
+const out = new Uint8Array(N_CHANNELS);
+
+const kernels: BlendKernel[] = [jsBlendKernel];
+for (const k of nativeBlendKernels) kernels.push(nativeBlendKernelFor(k)!);
+
+for (const [name, mode] of Object.entries(BlendMode)) {
+    describe(`${name}, ${N_CHANNELS} channels`, () => {
+        for (const k of kernels) {
+            bench(k.name, () => k.blend(out, fg, bg, mode, 96, mask));
+        }
+    });
+}
+
+const stack: CompositeLayer[] = [
+    { mode: BlendMode.Max },
+    { mode: BlendMode.Max },
+    { mode: BlendMode.Over, opacity: 200, ranges: [{ start: 30_000, length: 4_000 }] },
+];
+const stackFrames = [bg, fg, mask];
+describe(`3 layers, ${N_CHANNELS} channels`, () => {
+    const js = new FrameCompositor(jsCompositeKernel);
+    bench('js', () => js.compose(out, stack, stackFrames));
+    if (nativeCompositeKernel) {
+        const native = new FrameCompositor(nativeCompositeKernel);
+        bench(nativeCompositeKernel.name, () => native.compose(out, stack, stackFrames));
+    }
+});
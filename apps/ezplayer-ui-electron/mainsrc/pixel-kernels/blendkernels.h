@@ -0,0 +1,365 @@
+// pixel-kernels/blendkernels.h — Compositing a foreground frame over a
+// background frame, byte for byte.
+//
+// Plain C++ (no N-API).  SSE2 and NEON are baseline on x86-64 and arm64;
+// AVX2 is compiled alongside (function-level target attribute) and chosen at
+// runtime when the CPU and OS support it.  Every mode has a scalar version,
+// which does the tail and everything on other targets.  The vector and scalar
+// versions give identical results: weighted modes round to nearest, using
+// x / 255 == (y + (y >> 8)) >> 8 with y = x + 128, exact for x <= 255 * 255.
+//
+// alpha is the opacity of the result over bg, for every mode: the blended
+// value r becomes (r * alpha + bg * (255 - alpha)) / 255 unless alpha is 255.
+// For Over, r is just fg.
+//
+// out may be fg or bg (compositing in place), but must not otherwise overlap.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define BK_SSE2 1
+  #if defined(__x86_64__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define BK_AVX2 1
+    #if defined(_MSC_VER) && !defined(__clang__)
+      #include <intrin.h>
+      #define BK_TARGET_AVX2
+    #else
+      #define BK_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+  #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define BK_NEON 1
+#endif
+
+enum class BlendMode : uint32_t {
+    Max = 0,       // Highest takes precedence, as DMX HTP merging
+    Over = 1,      // fg, so (with alpha) (fg * a + bg * (255 - a)) / 255
+    Add = 2,       // fg + bg, saturating
+    Multiply = 3,  // fg * bg / 255
+    Mask = 4,      // As Over, with each channel's alpha from mask
+};
+
+static const uint32_t kBlendModes = 5;
+
+struct BlendArgs {
+    uint8_t* out;
+    const uint8_t* fg;
+    const uint8_t* bg;
+    const uint8_t* mask;  // Mask mode only
+    size_t n;
+    uint32_t alpha;  // Opacity, 0..255
+    BlendMode mode;
+};
+
+static inline uint8_t div255_round(uint32_t x) {
+    const uint32_t y = x + 128;
+    return static_cast<uint8_t>((y + (y >> 8)) >> 8);
+}
+
+static inline uint32_t blend_one(BlendMode mode, uint32_t f, uint32_t b, uint32_t m) {
+    switch (mode) {
+        case BlendMode::Max:
+            return f > b ? f : b;
+        case BlendMode::Add:
+            return f + b > 255 ? 255 : f + b;
+        case BlendMode::Multiply:
+            return div255_round(f * b);
+        case BlendMode::Mask:
+            return div255_round(f * m + b * (255 - m));
+        default:
+            return f;
+    }
+}
+
+static inline void blend_scalar(const BlendArgs& a, size_t from) {
+    uint8_t* out = a.out;
+    const uint8_t* fg = a.fg;
+    const uint8_t* bg = a.bg;
+    const uint32_t alpha = a.alpha;
+    if (alpha == 255 && a.mode == BlendMode::Max) {
+        // The common case (HTP with nothing faded) without the per-byte switch
+        for (size_t i = from; i < a.n; ++i) out[i] = fg[i] > bg[i] ? fg[i] : bg[i];
+        return;
+    }
+    for (size_t i = from; i < a.n; ++i) {
+        const uint32_t b = bg[i];
+        uint32_t r = blend_one(a.mode, fg[i], b, a.mode == BlendMode::Mask ? a.mask[i] : 0);
+        if (alpha != 255) r = div255_round(r * alpha + b * (255 - alpha));
+        out[i] = static_cast<uint8_t>(r);
+    }
+}
+
+#if defined(BK_SSE2)
+// (x + 128) / 255 for 16-bit lanes, then packed back to bytes
+static inline __m128i div255_pack_sse2(__m128i lo, __m128i hi) {
+    const __m128i k128 = _mm_set1_epi16(128);
+    lo = _mm_add_epi16(lo, k128);
+    hi = _mm_add_epi16(hi, k128);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+// fg * w + bg * (255 - w), w per byte
+static inline __m128i lerp_sse2(__m128i f, __m128i b, __m128i w) {
+    const __m128i z = _mm_setzero_si128();
+    const __m128i k255 = _mm_set1_epi16(255);
+    const __m128i wl = _mm_unpacklo_epi8(w, z), wh = _mm_unpackhi_epi8(w, z);
+    const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(f, z), wl),
+                                     _mm_mullo_epi16(_mm_unpacklo_epi8(b, z), _mm_sub_epi16(k255, wl)));
+    const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(f, z), wh),
+                                     _mm_mullo_epi16(_mm_unpackhi_epi8(b, z), _mm_sub_epi16(k255, wh)));
+    return div255_pack_sse2(lo, hi);
+}
+
+// Returns how many bytes were done (a multiple of 16)
+static inline size_t blend_sse2(const BlendArgs& a) {
+    const size_t n = a.n & ~static_cast<size_t>(15);
+    const __m128i z = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(a.alpha));
+    const bool fade = a.alpha != 255;
+    for (size_t i = 0; i < n; i += 16) {
+        const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.fg + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.bg + i));
+        __m128i r;
+        switch (a.mode) {
+            case BlendMode::Max:
+                r = _mm_max_epu8(f, b);
+                break;
+            case BlendMode::Over:
+                r = f;
+                break;
+            case BlendMode::Add:
+                r = _mm_adds_epu8(f, b);
+                break;
+            case BlendMode::Multiply:
+                r = div255_pack_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(f, z), _mm_unpacklo_epi8(b, z)),
+                                     _mm_mullo_epi16(_mm_unpackhi_epi8(f, z), _mm_unpackhi_epi8(b, z)));
+                break;
+            default:
+                r = lerp_sse2(f, b, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.mask + i)));
+                break;
+        }
+        if (fade) r = lerp_sse2(r, b, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a.out + i), r);
+    }
+    return n;
+}
+#endif
+
+#if defined(BK_AVX2)
+// As the SSE2 versions, 32 bytes at a time.  unpack and pack both work within
+// 128-bit lanes, so the bytes come back out in order.
+BK_TARGET_AVX2 static inline __m256i div255_pack_avx2(__m256i lo, __m256i hi) {
+    const __m256i k128 = _mm256_set1_epi16(128);
+    lo = _mm256_add_epi16(lo, k128);
+    hi = _mm256_add_epi16(hi, k128);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+BK_TARGET_AVX2 static inline __m256i lerp_avx2(__m256i f, __m256i b, __m256i w) {
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i k255 = _mm256_set1_epi16(255);
+    const __m256i wl = _mm256_unpacklo_epi8(w, z), wh = _mm256_unpackhi_epi8(w, z);
+    const __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(f, z), wl),
+                                        _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, z), _mm256_sub_epi16(k255, wl)));
+    const __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(f, z), wh),
+                                        _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, z), _mm256_sub_epi16(k255, wh)));
+    return div255_pack_avx2(lo, hi);
+}
+
+BK_TARGET_AVX2 static size_t blend_avx2(const BlendArgs& a) {
+    const size_t n = a.n & ~static_cast<size_t>(31);
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(a.alpha));
+    const bool fade = a.alpha != 255;
+    for (size_t i = 0; i < n; i += 32) {
+        const __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.fg + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.bg + i));
+        __m256i r;
+        switch (a.mode) {
+            case BlendMode::Max:
+                r = _mm256_max_epu8(f, b);
+                break;
+            case BlendMode::Over:
+                r = f;
+                break;
+            case BlendMode::Add:
+                r = _mm256_adds_epu8(f, b);
+                break;
+            case BlendMode::Multiply:
+                r = div255_pack_avx2(
+                    _mm256_mullo_epi16(_mm256_unpacklo_epi8(f, z), _mm256_unpacklo_epi8(b, z)),
+                    _mm256_mullo_epi16(_mm256_unpackhi_epi8(f, z), _mm256_unpackhi_epi8(b, z)));
+                break;
+            default:
+                r = lerp_avx2(f, b, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.mask + i)));
+                break;
+        }
+        if (fade) r = lerp_avx2(r, b, alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.out + i), r);
+    }
+    return n;
+}
+
+static inline bool cpu_has_avx2() {
+  #if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    if (!(r[2] & (1 << 27))) return false;  // OSXSAVE
+    if ((_xgetbv(0) & 6) != 6) return false;  // OS saves the YMM registers
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+  #else
+    return __builtin_cpu_supports("avx2");
+  #endif
+}
+#endif
+
+#if defined(BK_NEON)
+// fg * w + bg * (255 - w) + 128, w per byte, then / 255
+static inline uint8x8_t lerp_half_neon(uint8x8_t f, uint8x8_t b, uint8x8_t w) {
+    uint16x8_t y = vmull_u8(f, w);
+    y = vmlal_u8(y, b, vmvn_u8(w));  // 255 - w
+    y = vaddq_u16(y, vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(y, vshrq_n_u16(y, 8)), 8);
+}
+
+static inline uint8x16_t lerp_neon(uint8x16_t f, uint8x16_t b, uint8x16_t w) {
+    return vcombine_u8(lerp_half_neon(vget_low_u8(f), vget_low_u8(b), vget_low_u8(w)),
+                       lerp_half_neon(vget_high_u8(f), vget_high_u8(b), vget_high_u8(w)));
+}
+
+static inline uint8x8_t mul_half_neon(uint8x8_t f, uint8x8_t b) {
+    uint16x8_t y = vaddq_u16(vmull_u8(f, b), vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(y, vshrq_n_u16(y, 8)), 8);
+}
+
+static inline size_t blend_neon(const BlendArgs& a) {
+    const size_t n = a.n & ~static_cast<size_t>(15);
+    const uint8x16_t alpha = vdupq_n_u8(static_cast<uint8_t>(a.alpha));
+    const bool fade = a.alpha != 255;
+    for (size_t i = 0; i < n; i += 16) {
+        const uint8x16_t f = vld1q_u8(a.fg + i);
+        const uint8x16_t b = vld1q_u8(a.bg + i);
+        uint8x16_t r;
+        switch (a.mode) {
+            case BlendMode::Max:
+                r = vmaxq_u8(f, b);
+                break;
+            case BlendMode::Over:
+                r = f;
+                break;
+            case BlendMode::Add:
+                r = vqaddq_u8(f, b);
+                break;
+            case BlendMode::Multiply:
+                r = vcombine_u8(mul_half_neon(vget_low_u8(f), vget_low_u8(b)),
+                                mul_half_neon(vget_high_u8(f), vget_high_u8(b)));
+                break;
+            default:
+                r = lerp_neon(f, b, vld1q_u8(a.mask + i));
+                break;
+        }
+        if (fade) r = lerp_neon(r, b, alpha);
+        vst1q_u8(a.out + i, r);
+    }
+    return n;
+}
+#endif
+
+enum class BlendIsa { Scalar, Sse2, Avx2, Neon };
+
+// The widest kernel this machine can run, decided once
+static inline BlendIsa blend_isa() {
+#if defined(BK_AVX2)
+    static const BlendIsa isa = cpu_has_avx2() ? BlendIsa::Avx2 : BlendIsa::Sse2;
+    return isa;
+#elif defined(BK_SSE2)
+    return BlendIsa::Sse2;
+#elif defined(BK_NEON)
+    return BlendIsa::Neon;
+#else
+    return BlendIsa::Scalar;
+#endif
+}
+
+static inline const char* blend_isa_name(BlendIsa isa) {
+    switch (isa) {
+        case BlendIsa::Avx2:
+            return "avx2";
+        case BlendIsa::Sse2:
+            return "sse2";
+        case BlendIsa::Neon:
+            return "neon";
+        default:
+            return "none";
+    }
+}
+
+// Blend with the given kernel (for benchmarks and tests), or blend_isa()'s
+static inline void blend_frames(const BlendArgs& a, BlendIsa isa) {
+    size_t done = 0;
+    switch (isa) {
+#if defined(BK_AVX2)
+        case BlendIsa::Avx2:
+            done = blend_avx2(a);
+            break;
+#endif
+#if defined(BK_SSE2)
+        case BlendIsa::Sse2:
+            done = blend_sse2(a);
+            break;
+#endif
+#if defined(BK_NEON)
+        case BlendIsa::Neon:
+            done = blend_neon(a);
+            break;
+#endif
+        default:
+            break;
+    }
+    blend_scalar(a, done);
+}
+
+// Layer compositing (compose.ts compileComposite): a table of five u32s per op,
+// (op, layer, alpha, start, len), run in order over one output frame.  op is a
+// BlendMode (out = layer (op) out), or one of these.  The compiler emits the
+// ops for each stretch of output together, so the stretch stays in cache
+// while every layer covering it is applied.
+static const uint32_t kCompositeCopy = 16;  // out = layer
+static const uint32_t kCompositeZero = 17;  // out = 0
+static const size_t kCompositeOpFields = 5;
+
+// Ops must already be checked against the buffers
+static inline void composite_frames(uint8_t* out, const uint8_t* const* layers, const uint8_t* const* masks,
+                                    const uint32_t* ops, size_t nops, BlendIsa isa) {
+    for (size_t o = 0; o < nops; ++o, ops += kCompositeOpFields) {
+        const uint32_t op = ops[0], layer = ops[1], start = ops[3], len = ops[4];
+        if (op == kCompositeZero) {
+            std::memset(out + start, 0, len);
+        } else if (op == kCompositeCopy) {
+            std::memcpy(out + start, layers[layer] + start, len);
+        } else {
+            BlendArgs a{};
+            a.out = out + start;
+            a.fg = layers[layer] + start;
+            a.bg = out + start;
+            a.mask = masks[layer] ? masks[layer] + start : nullptr;
+            a.n = len;
+            a.alpha = ops[2];
+            a.mode = static_cast<BlendMode>(op);
+            blend_frames(a, isa);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+// pixel-kernels/lutkernels.h — Mapping each byte of a frame through a
+// 256-entry table (dimming curves on the way out).
+//
+// Plain C++ (no N-API).  On arm64 this is a vector lookup: TBL/TBX take 64
+// table bytes at a time, so four of them cover the table for 16 channels.
+// x86 has no byte lookup short of AVX-512 VBMI; the nibble-split PSHUFB
+// version (16 shuffles and selects per vector) measured slower than plain
+// loads from a table that sits in L1, so x86 and everything else use an
+// unrolled scalar loop.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define LK_NEON 1
+#endif
+
+static inline void lut_scalar(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t a = lut[src[i]], b = lut[src[i + 1]], c = lut[src[i + 2]], d = lut[src[i + 3]];
+        dst[i] = a;
+        dst[i + 1] = b;
+        dst[i + 2] = c;
+        dst[i + 3] = d;
+    }
+    for (; i < n; ++i) dst[i] = lut[src[i]];
+}
+
+#if defined(LK_NEON)
+static inline uint8x16x4_t lut_quarter_neon(const uint8_t* lut) {
+    uint8x16x4_t t;
+    t.val[0] = vld1q_u8(lut);
+    t.val[1] = vld1q_u8(lut + 16);
+    t.val[2] = vld1q_u8(lut + 32);
+    t.val[3] = vld1q_u8(lut + 48);
+    return t;
+}
+
+static inline void lut_neon(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t n) {
+    const uint8x16x4_t t0 = lut_quarter_neon(lut), t1 = lut_quarter_neon(lut + 64);
+    const uint8x16x4_t t2 = lut_quarter_neon(lut + 128), t3 = lut_quarter_neon(lut + 192);
+    const uint8x16_t k64 = vdupq_n_u8(64);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        // TBX leaves lanes whose index is past its 64 bytes alone
+        uint8x16_t x = vld1q_u8(src + i);
+        uint8x16_t r = vqtbl4q_u8(t0, x);
+        x = vsubq_u8(x, k64);
+        r = vqtbx4q_u8(r, t1, x);
+        x = vsubq_u8(x, k64);
+        r = vqtbx4q_u8(r, t2, x);
+        x = vsubq_u8(x, k64);
+        r = vqtbx4q_u8(r, t3, x);
+        vst1q_u8(dst + i, r);
+    }
+    lut_scalar(dst + i, src + i, lut, n - i);
+}
+#endif
+
+static inline void lut_map(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t n) {
+#if defined(LK_NEON)
+    lut_neon(dst, src, lut, n);
+#else
+    lut_scalar(dst, src, lut, n);
+#endif
+}
+
+// A dimming plan (dimming.ts compileDimming): three u32s per span, (start,
+// len, lut), lut being the index of a 256-byte table, or this for channels
+// that go out unchanged.
+static const uint32_t kLutNone = 0xffffffffu;
+static const size_t kLutOpFields = 3;
+
+// dst may be src.  Spans past n (a short frame) are cut off; tables must
+// already be checked.
+static inline void apply_luts(uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* luts, const uint32_t* ops,
+                              size_t nops) {
+    for (size_t o = 0; o < nops; ++o, ops += kLutOpFields) {
+        const size_t start = ops[0];
+        if (start >= n) continue;
+        const size_t len = ops[1] < n - start ? ops[1] : n - start;
+        if (ops[2] != kLutNone) lut_map(dst + start, src + start, luts + static_cast<size_t>(ops[2]) * 256, len);
+        else if (dst != src) std::memcpy(dst + start, src + start, len);
+    }
+}
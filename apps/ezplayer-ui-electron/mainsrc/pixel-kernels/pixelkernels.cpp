@@ -0,0 +1,408 @@
+// pixel-kernels/pixelkernels.cpp — SIMD helpers for the JS frame path.
+//
+// diffCopy: compare slices of a frame against the shadow copy of what a
+// controller was last sent, and refresh the shadow where they differ.  One
+// call covers all of a controller's packets, so the per-call overhead is paid
+// once per controller per frame rather than once per packet.
+//
+// SSE2 on x86-64 and NEON on arm64 (both baseline, so no runtime dispatch);
+// scalar elsewhere.  Unchanged 32-byte blocks are only read, never written,
+// so a mostly static frame costs about two streaming reads.
+//
+// scatter: expand a decoded chunk of sparse FSEQ frames into dense frames,
+// following the flat (src, dst, len) table compileScatterPlan builds once per
+// file.  The whole chunk is one call; each entry is a memcpy or memset, which
+// the C library already does with the widest vectors the CPU has.
+//
+// blend: composite one frame with another in a single pass (blendkernels.h),
+// out = fg (op) bg, with out usually the sender's mix frame or one of the
+// inputs.  Unlike the kernels above this picks AVX2 at runtime when it can.
+//
+// composite: a stack of layers into one frame, following the op table
+// compileComposite builds (see blendkernels.h), all in one call.
+//
+// applyLuts: the output dimming pass (lutkernels.h); every channel of a frame
+// through its model's 256-entry curve, one sweep per frame.
+//
+// remap: fill a controller's buffer from the frame in its own color order
+// (remapkernels.h), widening RGB nodes to RGBW where it takes white; a byte
+// shuffle per vector, PSHUFB (SSSE3, chosen at runtime) or TBL.
+#include "napi.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "blendkernels.h"
+#include "lutkernels.h"
+#include "remapkernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define PK_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define PK_NEON 1
+#endif
+
+// Returns true if src and dst differed; dst == src afterwards.
+static bool diff_copy(const uint8_t* src, uint8_t* dst, size_t n) {
+    bool changed = false;
+    size_t i = 0;
+#if defined(PK_SSE2)
+    for (; i + 32 <= n; i += 32) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i + 16));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a0, b0), _mm_cmpeq_epi8(a1, b1));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 16), a1);
+            changed = true;
+        }
+    }
+#elif defined(PK_NEON)
+    for (; i + 32 <= n; i += 32) {
+        uint8x16_t a0 = vld1q_u8(src + i);
+        uint8x16_t a1 = vld1q_u8(src + i + 16);
+        uint8x16_t b0 = vld1q_u8(dst + i);
+        uint8x16_t b1 = vld1q_u8(dst + i + 16);
+        uint8x16_t x = vorrq_u8(veorq_u8(a0, b0), veorq_u8(a1, b1));
+        if (vmaxvq_u8(x) != 0) {
+            vst1q_u8(dst + i, a0);
+            vst1q_u8(dst + i + 16, a1);
+            changed = true;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (src[i] != dst[i]) {
+            dst[i] = src[i];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// diffCopy(src, shadow, srcStart, shadowStart, len, first, count, changed) -> number changed
+static Napi::Value DiffCopy(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 8 || !info[0].IsTypedArray() || !info[1].IsTypedArray() ||
+        !info[2].IsTypedArray() || !info[3].IsTypedArray() || !info[4].IsTypedArray() ||
+        !info[5].IsNumber() || !info[6].IsNumber() || !info[7].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (src, shadow, srcStart, shadowStart, len, first, count, changed)")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto src = info[0].As<Napi::Uint8Array>();
+    auto shadow = info[1].As<Napi::Uint8Array>();
+    auto srcStart = info[2].As<Napi::Uint32Array>();
+    auto shadowStart = info[3].As<Napi::Uint32Array>();
+    auto len = info[4].As<Napi::Uint32Array>();
+    uint32_t first = info[5].As<Napi::Number>().Uint32Value();
+    uint32_t count = info[6].As<Napi::Number>().Uint32Value();
+    auto changed = info[7].As<Napi::Uint8Array>();
+
+    size_t end = static_cast<size_t>(first) + count;
+    if (end > srcStart.ElementLength() || end > shadowStart.ElementLength() ||
+        end > len.ElementLength() || end > changed.ElementLength()) {
+        Napi::RangeError::New(env, "Segment range out of bounds").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    const uint8_t* s = src.Data();
+    uint8_t* d = shadow.Data();
+    size_t sLen = src.ElementLength();
+    size_t dLen = shadow.ElementLength();
+    uint32_t nChanged = 0;
+    for (size_t i = first; i < end; ++i) {
+        size_t so = srcStart[i], dof = shadowStart[i], l = len[i];
+        // A short frame (or stale plan) only compares what is there
+        if (so >= sLen || dof >= dLen) {
+            changed[i] = 0;
+            continue;
+        }
+        l = std::min(l, std::min(sLen - so, dLen - dof));
+        bool c = diff_copy(s + so, d + dof, l);
+        changed[i] = c ? 1 : 0;
+        if (c) ++nChanged;
+    }
+    return Napi::Number::New(env, nChanged);
+}
+
+// Zero-fill entries in a scatter table have this as their source offset
+static const uint32_t SCATTER_ZERO = 0xffffffffu;
+
+// scatter(dense, sparse, nframes, fileStride, denseStep, table)
+static Napi::Value Scatter(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 6 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsNumber() ||
+        !info[3].IsNumber() || !info[4].IsNumber() || !info[5].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dense, sparse, nframes, fileStride, denseStep, table)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto dense = info[0].As<Napi::Uint8Array>();
+    auto sparse = info[1].As<Napi::Uint8Array>();
+    size_t nframes = info[2].As<Napi::Number>().Uint32Value();
+    size_t fileStride = info[3].As<Napi::Number>().Uint32Value();
+    size_t denseStep = info[4].As<Napi::Number>().Uint32Value();
+    auto table = info[5].As<Napi::Uint32Array>();
+    if (dense.ElementLength() < nframes * denseStep || sparse.ElementLength() < nframes * fileStride) {
+        Napi::RangeError::New(env, "Scatter buffers are smaller than the frames given").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    // Check the table against one frame, so the frame loop needs no checks
+    const uint32_t* t = table.Data();
+    const size_t nent = table.ElementLength() / 3;
+    for (size_t e = 0; e < nent; ++e) {
+        size_t s = t[e * 3], d = t[e * 3 + 1], l = t[e * 3 + 2];
+        if (d + l > denseStep || (s != SCATTER_ZERO && s + l > fileStride)) {
+            Napi::RangeError::New(env, "Scatter table entry outside the frame").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+
+    const uint8_t* src = sparse.Data();
+    uint8_t* dst = dense.Data();
+    for (size_t f = 0; f < nframes; ++f, src += fileStride, dst += denseStep) {
+        for (size_t e = 0; e < nent; ++e) {
+            const uint32_t s = t[e * 3], d = t[e * 3 + 1], l = t[e * 3 + 2];
+            if (s == SCATTER_ZERO) std::memset(dst + d, 0, l);
+            else std::memcpy(dst + d, src + s, l);
+        }
+    }
+    return env.Undefined();
+}
+
+static bool isa_available(BlendIsa isa) {
+    switch (isa) {
+        case BlendIsa::Scalar:
+            return true;
+#if defined(BK_AVX2)
+        case BlendIsa::Avx2:
+            return blend_isa() == BlendIsa::Avx2;
+#endif
+#if defined(BK_SSE2)
+        case BlendIsa::Sse2:
+            return true;
+#endif
+#if defined(BK_NEON)
+        case BlendIsa::Neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+// blend(out, fg, bg, mode, alpha, mask?, isa?); the shortest of the buffers is blended.
+// isa ('none', 'sse2', 'avx2', 'neon') forces a kernel, for benchmarks.
+static Napi::Value Blend(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 5 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsTypedArray() ||
+        !info[3].IsNumber() || !info[4].IsNumber() ||
+        (info.Length() > 5 && !info[5].IsTypedArray() && !info[5].IsUndefined()) ||
+        (info.Length() > 6 && !info[6].IsString() && !info[6].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (out, fg, bg, mode, alpha, mask?, isa?)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto out = info[0].As<Napi::Uint8Array>();
+    auto fg = info[1].As<Napi::Uint8Array>();
+    auto bg = info[2].As<Napi::Uint8Array>();
+    uint32_t mode = info[3].As<Napi::Number>().Uint32Value();
+    uint32_t alpha = info[4].As<Napi::Number>().Uint32Value();
+    if (mode >= kBlendModes || alpha > 255) {
+        Napi::RangeError::New(env, "Unknown blend mode, or alpha outside 0..255").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    BlendArgs a{};
+    a.out = out.Data();
+    a.fg = fg.Data();
+    a.bg = bg.Data();
+    a.n = std::min(out.ElementLength(), std::min(fg.ElementLength(), bg.ElementLength()));
+    a.alpha = alpha;
+    a.mode = static_cast<BlendMode>(mode);
+    if (a.mode == BlendMode::Mask) {
+        if (info.Length() < 6 || !info[5].IsTypedArray()) {
+            Napi::TypeError::New(env, "Mask blend needs a mask").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        auto mask = info[5].As<Napi::Uint8Array>();
+        a.mask = mask.Data();
+        a.n = std::min(a.n, mask.ElementLength());
+    }
+
+    BlendIsa isa = blend_isa();
+    if (info.Length() > 6 && info[6].IsString()) {
+        const std::string name = info[6].As<Napi::String>().Utf8Value();
+        const BlendIsa all[] = {BlendIsa::Scalar, BlendIsa::Sse2, BlendIsa::Avx2, BlendIsa::Neon};
+        bool found = false;
+        for (BlendIsa i : all) {
+            if (name == blend_isa_name(i) && isa_available(i)) {
+                isa = i;
+                found = true;
+            }
+        }
+        if (!found) {
+            Napi::RangeError::New(env, "Blend kernel '" + name + "' is not available here")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    blend_frames(a, isa);
+    return env.Undefined();
+}
+
+// Typed arrays from an array of them (undefined entries allowed), with their lengths
+static bool typed_array_list(const Napi::Value& v, std::vector<const uint8_t*>& data, std::vector<size_t>& len) {
+    if (!v.IsArray()) return false;
+    auto arr = v.As<Napi::Array>();
+    for (uint32_t i = 0; i < arr.Length(); ++i) {
+        Napi::Value e = arr.Get(i);
+        if (e.IsUndefined()) {
+            data.push_back(nullptr);
+            len.push_back(0);
+        } else if (e.IsTypedArray()) {
+            auto a = e.As<Napi::Uint8Array>();
+            data.push_back(a.Data());
+            len.push_back(a.ElementLength());
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// composite(out, layers, masks, ops)
+static Napi::Value Composite(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    std::vector<const uint8_t*> layers, masks;
+    std::vector<size_t> layerLen, maskLen;
+    if (info.Length() < 4 || !info[0].IsTypedArray() || !typed_array_list(info[1], layers, layerLen) ||
+        !typed_array_list(info[2], masks, maskLen) || !info[3].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (out, layers, masks, ops)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto out = info[0].As<Napi::Uint8Array>();
+    auto ops = info[3].As<Napi::Uint32Array>();
+    masks.resize(layers.size(), nullptr);
+    maskLen.resize(layers.size(), 0);
+
+    // Check every op first, so the pass itself needs no checks
+    const uint32_t* t = ops.Data();
+    const size_t nops = ops.ElementLength() / kCompositeOpFields;
+    for (size_t o = 0; o < nops; ++o) {
+        const uint32_t* op = t + o * kCompositeOpFields;
+        const size_t end = static_cast<size_t>(op[3]) + op[4];
+        bool ok = end <= out.ElementLength();
+        if (op[0] != kCompositeZero) {
+            ok = ok && (op[0] == kCompositeCopy || (op[0] < kBlendModes && op[2] <= 255)) && op[1] < layers.size() &&
+                 layers[op[1]] && end <= layerLen[op[1]];
+            if (op[0] == static_cast<uint32_t>(BlendMode::Mask)) ok = ok && masks[op[1]] && end <= maskLen[op[1]];
+        }
+        if (!ok) {
+            Napi::RangeError::New(env, "Composite op outside its buffers").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    composite_frames(out.Data(), layers.data(), masks.data(), t, nops, blend_isa());
+    return env.Undefined();
+}
+
+// applyLuts(dst, src, luts, ops); dst may be src
+static Napi::Value ApplyLuts(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 4 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsTypedArray() ||
+        !info[3].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dst, src, luts, ops)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto dst = info[0].As<Napi::Uint8Array>();
+    auto src = info[1].As<Napi::Uint8Array>();
+    auto luts = info[2].As<Napi::Uint8Array>();
+    auto ops = info[3].As<Napi::Uint32Array>();
+
+    const uint32_t* t = ops.Data();
+    const size_t nops = ops.ElementLength() / kLutOpFields;
+    const size_t nluts = luts.ElementLength() / 256;
+    for (size_t o = 0; o < nops; ++o) {
+        const uint32_t lut = t[o * kLutOpFields + 2];
+        if (lut != kLutNone && lut >= nluts) {
+            Napi::RangeError::New(env, "Dimming span refers to a missing table").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    apply_luts(dst.Data(), src.Data(), std::min(dst.ElementLength(), src.ElementLength()), luts.Data(), t, nops);
+    return env.Undefined();
+}
+
+// Whether one span of a remap table stays within both buffers and names
+// channels that exist
+static bool remap_op_ok(const uint32_t* op, size_t srcLen, size_t dstLen) {
+    const uint64_t count = op[3];
+    if (op[0] == kRemapCopy) return op[1] + count <= srcLen && op[2] + count <= dstLen;
+    if (op[0] != kRemapNodes) return false;
+    const RemapNodes r = remap_nodes_from(op[4], op[5]);
+    if (r.per != 3 && r.per != 4) return false;
+    if (r.src[0] > 2 || r.src[1] > 2 || r.src[2] > 2) return false;
+    if (r.src[0] == r.src[1] || r.src[0] == r.src[2] || r.src[1] == r.src[2]) return false;
+    for (uint32_t k = 0; k < r.per; ++k) {
+        if (r.dst[k] == 3 && r.per != 4) return false;
+    }
+    return op[1] + count * 3 <= srcLen && op[2] + count * r.per <= dstLen;
+}
+
+// remap(dst, src, ops); dst must not overlap src
+static Napi::Value Remap(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 3 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dst, src, ops)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto dst = info[0].As<Napi::Uint8Array>();
+    auto src = info[1].As<Napi::Uint8Array>();
+    auto ops = info[2].As<Napi::Uint32Array>();
+
+    const uint32_t* t = ops.Data();
+    const size_t nops = ops.ElementLength() / kRemapOpFields;
+    for (size_t o = 0; o < nops; ++o) {
+        if (!remap_op_ok(t + o * kRemapOpFields, src.ElementLength(), dst.ElementLength())) {
+            Napi::RangeError::New(env, "Remap span is invalid or out of range").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    apply_remap(dst.Data(), src.Data(), t, nops);
+    return env.Undefined();
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("diffCopy", Napi::Function::New(env, DiffCopy));
+    exports.Set("scatter", Napi::Function::New(env, Scatter));
+    exports.Set("blend", Napi::Function::New(env, Blend));
+    exports.Set("composite", Napi::Function::New(env, Composite));
+    exports.Set("applyLuts", Napi::Function::New(env, ApplyLuts));
+    exports.Set("remap", Napi::Function::New(env, Remap));
+    exports.Set("remapSimd", Napi::String::New(env, remap_isa_name()));
+    exports.Set("blendSimd", Napi::String::New(env, blend_isa_name(blend_isa())));
+    Napi::Array isas = Napi::Array::New(env);
+    const BlendIsa all[] = {BlendIsa::Scalar, BlendIsa::Sse2, BlendIsa::Avx2, BlendIsa::Neon};
+    for (BlendIsa i : all) {
+        if (isa_available(i)) isas.Set(isas.Length(), Napi::String::New(env, blend_isa_name(i)));
+    }
+    exports.Set("blendKernels", isas);
+#if defined(PK_SSE2)
+    exports.Set("simd", Napi::String::New(env, "sse2"));
+#elif defined(PK_NEON)
+    exports.Set("simd", Napi::String::New(env, "neon"));
+#else
+    exports.Set("simd", Napi::String::New(env, "none"));
+#endif
+    return exports;
+}
+
+NODE_API_MODULE(pixel_kernels, Init)
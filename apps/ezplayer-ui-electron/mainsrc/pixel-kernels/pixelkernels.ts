@@ -0,0 +1,99 @@
+import { createRequire } from 'module';
+import type { DiffKernel, RemapKernel, ScatterKernel } from '@ezplayer/epp';
+import type { BlendKernel } from '../processing/blend';
+import type { CompositeKernel } from '../processing/compose';
+import type { LutKernel } from '../processing/dimming';
+
+const require = createRequire(import.meta.url);
+
+interface NativeAddon {
+    diffCopy: DiffKernel['diffCopy'];
+    scatter: ScatterKernel['scatter'];
+    simd: string;
+    blend(
+        out: Uint8Array,
+        fg: Uint8Array,
+        bg: Uint8Array,
+        mode: number,
+        alpha: number,
+        mask?: Uint8Array,
+        kernel?: string,
+    ): void;
+    composite: CompositeKernel['composite'];
+    applyLuts: LutKernel['applyLuts'];
+    remap: RemapKernel['remap'];
+    remapSimd: string;
+    blendSimd: string;
+    blendKernels: string[];
+}
+
+let native: NativeAddon | null = null;
+try {
+    const bindings = require('bindings');
+    native = bindings('pixel_kernels');
+} catch (e) {
+    console.error('NO pixel_kernels BINDING');
+    console.error(e);
+}
+
+/**
+ * Change detection for skipping unchanged packets, with SIMD compares (SSE2 / NEON).
+ *  Undefined if the addon could not be loaded; senders fall back to the Buffer-based kernel.
+ */
+export const nativeDiffKernel: DiffKernel | undefined = native
+    ? { name: `native-${native.simd}`, diffCopy: native.diffCopy }
+    : undefined;
+
+/**
+ * Sparse FSEQ chunk expansion, one native call per chunk.
+ *  Undefined if the addon could not be loaded; the prefetcher falls back to jsScatterKernel.
+ */
+export const nativeScatterKernel: ScatterKernel | undefined = native
+    ? { name: 'native', scatter: native.scatter }
+    : undefined;
+
+/**
+ * Frame compositing with the widest kernel the CPU has (AVX2, chosen at runtime; else SSE2 /
+ *  NEON).  Undefined if the addon could not be loaded; senders fall back to jsBlendKernel.
+ */
+export const nativeBlendKernel: BlendKernel | undefined = native ? nativeBlendKernelFor(native.blendSimd) : undefined;
+
+/**
+ * Layer compositing (FrameCompositor's op tables), one native call per frame.
+ *  Undefined if the addon could not be loaded; senders fall back to jsCompositeKernel.
+ */
+export const nativeCompositeKernel: CompositeKernel | undefined = native
+    ? { name: `native-${native.blendSimd}`, composite: native.composite }
+    : undefined;
+
+/**
+ * The output dimming pass (per-model curves), one native call per frame; a vector table
+ *  lookup on arm64.  Undefined if the addon could not be loaded; senders fall back to jsLutKernel.
+ */
+export const nativeLutKernel: LutKernel | undefined = native
+    ? { name: 'native', applyLuts: native.applyLuts }
+    : undefined;
+
+/**
+ * Color order remapping for controllers ([ORDER:xxx]), a byte shuffle per vector (SSSE3,
+ *  chosen at runtime, or NEON).  Undefined if the addon could not be loaded; senders fall back
+ *  to jsRemapKernel.
+ */
+export const nativeRemapKernel: RemapKernel | undefined = native
+    ? { name: `native-${native.remapSimd}`, remap: native.remap }
+    : undefined;
+
+/** Kernels nativeBlendKernelFor accepts on this machine ('none' is the scalar one) */
+export const nativeBlendKernels: string[] = native?.blendKernels ?? [];
+
+/** Native compositing with a particular kernel, for benchmarks */
+export function nativeBlendKernelFor(kernel: string): BlendKernel | undefined {
+    const n = native;
+    if (!n?.blendKernels.includes(kernel)) return undefined;
+    const forced = kernel === n.blendSimd ? undefined : kernel; // The default needs no lookup per call
+    return {
+        name: `native-${kernel}`,
+        blend: (out, fg, bg, mode, alpha = 255, mask?) =>
+            n.blend(out, fg, bg, mode, Math.max(0, Math.min(255, alpha | 0)), mask, forced),
+    };
+}
@@ -0,0 +1,189 @@
+// pixel-kernels/remapkernels.h — Reordering the channels of RGB nodes for a
+// controller that takes another color order, and widening them to RGBW.
+//
+// Plain C++ (no N-API).  A node-for-node shuffle is one byte permutation per
+// vector: PSHUFB (SSSE3, compiled alongside with a function-level target
+// attribute and chosen at runtime) or TBL on arm64.  Five nodes go through
+// per 16 bytes as they are, or four nodes become sixteen channels with white.
+// The scalar version does the tails and everything on other targets, with
+// identical results.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #include <tmmintrin.h>
+  #define RK_SSSE3 1
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    #define RK_TARGET_SSSE3
+  #else
+    #define RK_TARGET_SSSE3 __attribute__((target("ssse3")))
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define RK_NEON 1
+#endif
+
+// A remap table (ColorRemap.ts compileRemap): six u32s per span, (kind,
+// srcStart, dstStart, count, srcOrder, dstOrder).  COPY spans are count
+// bytes; NODES spans are count nodes of three channels, R, G and B at the
+// offsets in srcOrder (2 bits each, R lowest), written as dstOrder lists: low
+// 4 bits the channels per node (3 or 4), then 2 bits per channel, 0 R, 1 G,
+// 2 B, 3 W.  W is min(R, G, B), which is then taken off each of them.
+static const uint32_t kRemapCopy = 0;
+static const uint32_t kRemapNodes = 1;
+static const size_t kRemapOpFields = 6;
+
+struct RemapNodes {
+    uint8_t src[3];  // Offset of R, G, B in a source node
+    uint8_t dst[4];  // Component of each channel out, 0 R, 1 G, 2 B, 3 W
+    uint32_t per;    // Channels per node out, 3 or 4
+};
+
+static inline RemapNodes remap_nodes_from(uint32_t srcOrder, uint32_t dstOrder) {
+    RemapNodes r;
+    for (int c = 0; c < 3; ++c) r.src[c] = static_cast<uint8_t>((srcOrder >> (2 * c)) & 3);
+    for (int k = 0; k < 4; ++k) r.dst[k] = static_cast<uint8_t>((dstOrder >> (4 + 2 * k)) & 3);
+    r.per = dstOrder & 15;
+    return r;
+}
+
+static inline void remap_nodes_scalar(uint8_t* dst, const uint8_t* src, size_t count, const RemapNodes& r) {
+    for (size_t n = 0; n < count; ++n, src += 3, dst += r.per) {
+        uint8_t c[4] = {src[r.src[0]], src[r.src[1]], src[r.src[2]], 0};
+        if (r.per == 4) {
+            uint8_t w = c[0] < c[1] ? c[0] : c[1];
+            if (c[2] < w) w = c[2];
+            c[0] -= w;
+            c[1] -= w;
+            c[2] -= w;
+            c[3] = w;
+        }
+        for (uint32_t k = 0; k < r.per; ++k) dst[k] = c[r.dst[k]];
+    }
+}
+
+// Shuffle masks for one vector: each byte out takes the source byte of its
+// node's component (x: as dstOrder says, white taking R; r/g/b: that
+// component, for working out white), and w marks the white bytes.
+struct RemapMasks {
+    uint8_t x[16], r[16], g[16], b[16], w[16];
+};
+
+static inline RemapMasks remap_masks(const RemapNodes& r) {
+    RemapMasks m;
+    const uint32_t nodes = r.per == 4 ? 4 : 5;
+    for (uint32_t j = 0; j < 16; ++j) {
+        const uint32_t node = j / r.per, k = j % r.per;
+        if (node >= nodes) {
+            // PSHUFB and TBL both give 0 for an index with the top bit set
+            m.x[j] = m.r[j] = m.g[j] = m.b[j] = 0x80;
+            m.w[j] = 0;
+            continue;
+        }
+        const uint8_t base = static_cast<uint8_t>(node * 3);
+        const uint8_t comp = r.dst[k] == 3 ? 0 : r.dst[k];
+        m.x[j] = static_cast<uint8_t>(base + r.src[comp]);
+        m.r[j] = static_cast<uint8_t>(base + r.src[0]);
+        m.g[j] = static_cast<uint8_t>(base + r.src[1]);
+        m.b[j] = static_cast<uint8_t>(base + r.src[2]);
+        m.w[j] = r.dst[k] == 3 ? 0xff : 0;
+    }
+    return m;
+}
+
+// Each vector step reads 16 source bytes (15 or 12 of them used) and writes
+// 16 (the last one of the 3-channel case rewritten by the next step), so it
+// stops while six nodes are left; both stay within the span.
+#if defined(RK_SSSE3)
+static inline bool cpu_has_ssse3() {
+  #if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 1);
+    return (r[2] & (1 << 9)) != 0;
+  #else
+    return __builtin_cpu_supports("ssse3");
+  #endif
+}
+
+RK_TARGET_SSSE3 static inline size_t remap_nodes_ssse3(uint8_t* dst, const uint8_t* src, size_t count,
+                                                         const RemapNodes& r) {
+    const RemapMasks m = remap_masks(r);
+    const __m128i mx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.x));
+    const size_t step = r.per == 4 ? 4 : 5;
+    size_t n = 0;
+    if (r.per == 3) {
+        for (; n + 6 <= count; n += step) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 3), _mm_shuffle_epi8(s, mx));
+        }
+        return n;
+    }
+    const __m128i mr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.r));
+    const __m128i mg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.g));
+    const __m128i mb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.b));
+    const __m128i mw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.w));
+    for (; n + 6 <= count; n += step) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 3));
+        const __m128i w = _mm_min_epu8(_mm_min_epu8(_mm_shuffle_epi8(s, mr), _mm_shuffle_epi8(s, mg)),
+                                       _mm_shuffle_epi8(s, mb));
+        const __m128i c = _mm_sub_epi8(_mm_shuffle_epi8(s, mx), w);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4),
+                         _mm_or_si128(_mm_andnot_si128(mw, c), _mm_and_si128(mw, w)));
+    }
+    return n;
+}
+#endif
+
+#if defined(RK_NEON)
+static inline size_t remap_nodes_neon(uint8_t* dst, const uint8_t* src, size_t count, const RemapNodes& r) {
+    const RemapMasks m = remap_masks(r);
+    const uint8x16_t mx = vld1q_u8(m.x);
+    const size_t step = r.per == 4 ? 4 : 5;
+    size_t n = 0;
+    if (r.per == 3) {
+        for (; n + 6 <= count; n += step) vst1q_u8(dst + n * 3, vqtbl1q_u8(vld1q_u8(src + n * 3), mx));
+        return n;
+    }
+    const uint8x16_t mr = vld1q_u8(m.r), mg = vld1q_u8(m.g), mb = vld1q_u8(m.b), mw = vld1q_u8(m.w);
+    for (; n + 6 <= count; n += step) {
+        const uint8x16_t s = vld1q_u8(src + n * 3);
+        const uint8x16_t w = vminq_u8(vminq_u8(vqtbl1q_u8(s, mr), vqtbl1q_u8(s, mg)), vqtbl1q_u8(s, mb));
+        const uint8x16_t c = vsubq_u8(vqtbl1q_u8(s, mx), w);
+        vst1q_u8(dst + n * 4, vbslq_u8(mw, w, c));
+    }
+    return n;
+}
+#endif
+
+static inline void remap_nodes(uint8_t* dst, const uint8_t* src, size_t count, const RemapNodes& r) {
+    size_t n = 0;
+#if defined(RK_SSSE3)
+    static const bool ssse3 = cpu_has_ssse3();
+    if (ssse3) n = remap_nodes_ssse3(dst, src, count, r);
+#elif defined(RK_NEON)
+    n = remap_nodes_neon(dst, src, count, r);
+#endif
+    remap_nodes_scalar(dst + n * r.per, src + n * 3, count - n, r);
+}
+
+static inline const char* remap_isa_name() {
+#if defined(RK_SSSE3)
+    return cpu_has_ssse3() ? "ssse3" : "none";
+#elif defined(RK_NEON)
+    return "neon";
+#else
+    return "none";
+#endif
+}
+
+// Spans must already be checked against both buffers.
+static inline void apply_remap(uint8_t* dst, const uint8_t* src, const uint32_t* ops, size_t nops) {
+    for (size_t o = 0; o < nops; ++o, ops += kRemapOpFields) {
+        if (ops[0] == kRemapCopy) std::memcpy(dst + ops[2], src + ops[1], ops[3]);
+        else remap_nodes(dst + ops[2], src + ops[1], ops[3], remap_nodes_from(ops[4], ops[5]));
+    }
+}
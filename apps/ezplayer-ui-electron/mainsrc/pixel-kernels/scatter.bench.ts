@@ -0,0 +1,70 @@
+// Expanding a decoded chunk of a sparse .fseq (25 frames, ranges of 3..600 channels with gaps
+//  between) into dense frames: the per-range subarray/fill/set loop the prefetcher used to run,
+//  the compiled table in JS, and the compiled table in one native call.
+// Run with: pnpm vitest bench mainsrc/pixel-kernels/scatter
+import { bench, describe } from 'vitest';
+import { compileScatterPlan, jsScatterKernel, type ScatterRange } from '@ezplayer/epp';
+import { nativeScatterKernel } from './pixelkernels';
+
+const N_FRAMES = 25;
+
+function perRangeScatter(
+    dense: Uint8Array,
+    sparse: Uint8Array,
+    nframes: number,
+    fileStride: number,
+    denseStep: number,
+    plan: ScatterRange[],
+) {
+    for (let f = 0; f < nframes; ++f) {
+        const sBase = f * fileStride;
+        const dBase = f * denseStep;
+        let dCursor = 0;
+        for (const r of plan) {
+            if (r.dstOffset > dCursor) dense.subarray(dBase + dCursor, dBase + r.dstOffset).fill(0);
+            dense.set(sparse.subarray(sBase + r.srcOffset, sBase + r.srcOffset + r.length), dBase + r.dstOffset);
+            dCursor = r.dstOffset + r.length;
+        }
+        if (dCursor < denseStep) dense.subarray(dBase + dCursor, dBase + denseStep).fill(0);
+    }
+}
+
+function makeCase(nranges: number) {
+    const plan: ScatterRange[] = [];
+    let src = 0;
+    let dst = 0;
+    for (let i = 0; i < nranges; ++i) {
+        dst += 16 + ((i * 37) % 300); // Unused channels between models
+        const length = 3 * (1 + ((i * 53) % 200)); // Whole RGB pixels
+        plan.push({ srcOffset: src, dstOffset: dst, length });
+        src += length;
+        dst += length;
+    }
+    const fileStride = src;
+    const denseStep = (dst + 3) & ~3;
+    return {
+        plan,
+        fileStride,
+        denseStep,
+        table: compileScatterPlan(plan, fileStride, denseStep),
+        sparse: new Uint8Array(N_FRAMES * fileStride).fill(7),
+        dense: new Uint8Array(N_FRAMES * denseStep),
+    };
+}
+
+for (const nranges of [10, 100, 1000]) {
+    const c = makeCase(nranges);
+    describe(`${nranges} ranges, ${N_FRAMES} x ${c.fileStride} -> ${c.denseStep} bytes`, () => {
+        bench('per-range subarray / fill / set', () =>
+            perRangeScatter(c.dense, c.sparse, N_FRAMES, c.fileStride, c.denseStep, c.plan),
+        );
+        bench('compiled table, js', () =>
+            jsScatterKernel.scatter(c.dense, c.sparse, N_FRAMES, c.fileStride, c.denseStep, c.table),
+        );
+        if (nativeScatterKernel) {
+            bench('compiled table, native', () =>
+                nativeScatterKernel!.scatter(c.dense, c.sparse, N_FRAMES, c.fileStride, c.denseStep, c.table),
+            );
+        }
+    });
+}
@@ -1,9 +1,98 @@
-export function maxUint8(out: Uint8Array, in1: Uint8Array, in2: Uint8Array): void {
-    const len = Math.min(in1.length, in2.length, out.length);
+/** How two frames are combined, channel by channel (numbering shared with pixelkernels.cpp) */
+export const BlendMode = {
+    /** The higher value of the two (HTP merge) */
+    Max: 0,
+    /** fg, so that with an alpha below 255 it is (fg * alpha + bg * (255 - alpha)) / 255 */
+    Over: 1,
+    /** fg + bg, saturating at 255 */
+    Add: 2,
+    /** fg * bg / 255 */
+    Multiply: 3,
+    /** As Over, with each channel's alpha taken from the mask */
+    Mask: 4,
+} as const;
+export type BlendMode = (typeof BlendMode)[keyof typeof BlendMode];
 
-    for (let i = 0; i < len; i++) {
-        const av = in1[i];
-        const bv = in2[i];
-        out[i] = av > bv ? av : bv;
+/**
+ * Compositing of one frame with another.  `out` may be `fg` or `bg`; the shortest of the
+ *  buffers (and the mask, for Mask) is blended.  `alpha` is the opacity of the result over
+ *  `bg`, in every mode.  Weighted modes round to nearest, so every kernel gives the same bytes.
+ */
+export interface BlendKernel {
+    name: string;
+    blend(
+        out: Uint8Array,
+        fg: Uint8Array,
+        bg: Uint8Array,
+        mode: BlendMode,
+        alpha?: number, // 0..255, default 255
+        mask?: Uint8Array, // Mask only
+    ): void;
+}
+
+// Rounded x / 255, exact for x <= 255 * 255 (as blendkernels.h)
+function div255(x: number) {
+    const y = x + 128;
+    return (y + (y >> 8)) >> 8;
+}
+
+/** Scalar blending, for when the pixel_kernels addon is not available */
+export const jsBlendKernel: BlendKernel = {
+    name: 'js',
+    blend(out, fg, bg, mode, alpha = 255, mask?) {
+        let len = Math.min(fg.length, bg.length, out.length);
+        if (mode === BlendMode.Mask) {
+            if (!mask) throw new TypeError('Mask blend needs a mask');
+            len = Math.min(len, mask.length);
+        }
+        blendRange(out, fg, bg, mode, alpha, mask, 0, len);
+    },
+};
+
+/** jsBlendKernel's loop, over [start, end) of all the buffers */
+export function blendRange(
+    out: Uint8Array,
+    fg: Uint8Array,
+    bg: Uint8Array,
+    mode: BlendMode,
+    alpha: number,
+    mask: Uint8Array | undefined,
+    start: number,
+    end: number,
+) {
+    const a = Math.max(0, Math.min(255, alpha | 0));
+    const ia = 255 - a;
+    if (a === 255 && mode === BlendMode.Max) {
+        for (let i = start; i < end; i++) {
+            const av = fg[i];
+            const bv = bg[i];
+            out[i] = av > bv ? av : bv;
+        }
+        return;
+    }
+    for (let i = start; i < end; i++) {
+        const f = fg[i];
+        const b = bg[i];
+        let r: number;
+        switch (mode) {
+            case BlendMode.Max:
+                r = f > b ? f : b;
+                break;
+            case BlendMode.Over:
+                r = f;
+                break;
+            case BlendMode.Add:
+                r = f + b > 255 ? 255 : f + b;
+                break;
+            case BlendMode.Multiply:
+                r = div255(f * b);
+                break;
+            case BlendMode.Mask:
+                r = div255(f * mask![i] + b * (255 - mask![i]));
+                break;
+            default:
+                throw new RangeError(`Unknown blend mode ${mode}`);
+        }
+        out[i] = a === 255 ? r : div255(r * a + b * ia);
     }
 }
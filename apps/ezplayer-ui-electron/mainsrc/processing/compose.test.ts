@@ -0,0 +1,98 @@
+import { describe, expect, it } from 'vitest';
+import { ChannelMask } from '@ezplayer/epp';
+import { BlendMode, jsBlendKernel } from './blend';
+import { compileComposite, FrameCompositor, type CompositeLayer } from './compose';
+
+// One full-frame blend per layer, the slow obvious way
+function reference(n: number, layers: CompositeLayer[], frames: (Uint8Array | undefined)[]) {
+    const out = new Uint8Array(n);
+    layers.forEach((l, i) => {
+        const f = frames[i];
+        if (!f) return;
+        const blended = new Uint8Array(n);
+        jsBlendKernel.blend(blended, f, out, l.mode, l.opacity, l.mask);
+        const inRange = (c: number) =>
+            c < f.length && (!l.ranges || l.ranges.some((r) => c >= r.start && c < r.start + r.length));
+        for (let c = 0; c < n; ++c) if (inRange(c)) out[c] = blended[c];
+    });
+    return out;
+}
+
+function frame(n: number, seed: number) {
+    const f = new Uint8Array(n);
+    for (let i = 0; i < n; ++i) f[i] = (i * seed + (i >> 5) * 7) & 255;
+    return f;
+}
+
+describe('FrameCompositor', () => {
+    const n = 20_000; // Crosses tile boundaries
+    const mask = frame(n, 13);
+    const layers: CompositeLayer[] = [
+        { mode: BlendMode.Max, ranges: [{ start: 100, length: 15_000 }] },
+        { mode: BlendMode.Max },
+        { mode: BlendMode.Over, opacity: 100, ranges: [{ start: 9000, length: 3000 }] },
+        { mode: BlendMode.Add, opacity: 200, ranges: [{ start: 50, length: 60 }, { start: 16_000, length: 10_000 }] },
+        { mode: BlendMode.Multiply, ranges: [{ start: 12_000, length: 10 }] },
+        { mode: BlendMode.Mask, mask, ranges: [{ start: 8000, length: 500 }] },
+    ];
+    const frames = layers.map((_, i) => frame(n, 3 + 8 * i));
+
+    it('matches blending each layer over the whole frame in turn', () => {
+        const out = new Uint8Array(n).fill(99);
+        new FrameCompositor().compose(out, layers, frames);
+        expect(out).toEqual(reference(n, layers, frames));
+    });
+
+    it('leaves out layers without a frame, and zeroes what nothing covers', () => {
+        const some = frames.map((f, i) => (i === 1 ? undefined : f));
+        const out = new Uint8Array(n).fill(99);
+        new FrameCompositor().compose(out, layers, some);
+        expect(out).toEqual(reference(n, layers, some));
+        expect(out[20]).toBe(0);
+    });
+
+    it('zeroes the output past the longest frame', () => {
+        const short = [frames[0].subarray(0, 5000), frames[1].subarray(0, 7000)];
+        const out = new Uint8Array(n).fill(99);
+        new FrameCompositor().compose(out, layers.slice(0, 2), short);
+        expect(out).toEqual(reference(n, layers.slice(0, 2), short));
+        expect(out[7000]).toBe(0);
+    });
+
+    it('keeps its plan while the layers and frame lengths are unchanged', () => {
+        const c = new FrameCompositor();
+        const out = new Uint8Array(n);
+        c.compose(out, [...layers], frames);
+        const ops = (c as unknown as { ops: Uint32Array }).ops;
+        c.compose(out, [...layers], frames);
+        expect((c as unknown as { ops: Uint32Array }).ops).toBe(ops);
+        c.compose(out, layers, [frames[0].subarray(0, 1000), ...frames.slice(1)]);
+        expect((c as unknown as { ops: Uint32Array }).ops).not.toBe(ops);
+    });
+
+    it('plans again when a layer fades', () => {
+        const fading: CompositeLayer[] = [{ mode: BlendMode.Max }, { mode: BlendMode.Over, opacity: 0 }];
+        const pair = [frames[0], frames[1]];
+        const c = new FrameCompositor();
+        const out = new Uint8Array(n);
+        for (const opacity of [0, 64, 255]) {
+            fading[1].opacity = opacity;
+            c.compose(out, fading, pair);
+            expect(out).toEqual(reference(n, fading, pair));
+        }
+    });
+
+    it('copies the bottom layer rather than blending it over black', () => {
+        const ops = compileComposite(100, [{ mode: BlendMode.Max }, { mode: BlendMode.Add }], [100, 100]);
+        expect([...ops]).toEqual([16, 0, 255, 0, 100, BlendMode.Add, 1, 255, 0, 100]);
+    });
+
+    it('maps layer ranges into compact frames', () => {
+        const cm = new ChannelMask([
+            { start: 0, length: 10 },
+            { start: 100, length: 10 },
+        ]);
+        const ops = compileComposite(20, [{ mode: BlendMode.Over, ranges: [{ start: 105, length: 50 }] }], [20], cm);
+        expect([...ops]).toEqual([17, 0, 0, 0, 15, 16, 0, 255, 15, 5]);
+    });
+});
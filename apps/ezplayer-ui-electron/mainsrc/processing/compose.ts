@@ -0,0 +1,187 @@
+import type { ChannelMask, ChannelRange } from '@ezplayer/epp';
+import { BlendMode, blendRange } from './blend';
+
+/** One layer of a composite, and how it is combined with what is below it */
+export interface CompositeLayer {
+    mode: BlendMode;
+    /** 0..255, default 255 */
+    opacity?: number;
+    /** Absolute channels the layer covers (all of its frame if undefined); the rest show through */
+    ranges?: ChannelRange[];
+    /** Per-channel alpha for BlendMode.Mask, laid out as the layer's frames are */
+    mask?: Uint8Array;
+}
+
+// Op table (see blendkernels.h): five u32s per op, (op, layer, alpha, start, len); op is a
+//  BlendMode, or one of these
+export const COMPOSITE_COPY = 16;
+export const COMPOSITE_ZERO = 17;
+const OP_FIELDS = 5;
+// Output channels per tile; a tile of output and of a layer stay in L1 while the layers go by
+const TILE = 8192;
+
+/** Runs a table from compileComposite over one output frame */
+export interface CompositeKernel {
+    name: string;
+    composite(
+        out: Uint8Array,
+        layers: (Uint8Array | undefined)[],
+        masks: (Uint8Array | undefined)[],
+        ops: Uint32Array,
+    ): void;
+}
+
+/** Scalar compositing, for when the pixel_kernels addon is not available */
+export const jsCompositeKernel: CompositeKernel = {
+    name: 'js',
+    composite(out, layers, masks, ops) {
+        for (let o = 0; o + OP_FIELDS <= ops.length; o += OP_FIELDS) {
+            const op = ops[o];
+            const start = ops[o + 3];
+            const end = start + ops[o + 4];
+            if (op === COMPOSITE_ZERO) {
+                out.fill(0, start, end);
+            } else if (op === COMPOSITE_COPY) {
+                out.set(layers[ops[o + 1]]!.subarray(start, end), start);
+            } else {
+                const l = ops[o + 1];
+                blendRange(out, layers[l]!, out, op as BlendMode, ops[o + 2], masks[l], start, end);
+            }
+        }
+    },
+};
+
+// Sorted, non-overlapping ranges of [0, limit) a layer covers, as [start, end) pairs
+function layerSpans(layer: CompositeLayer, limit: number, channelMask?: ChannelMask): number[] {
+    if (!layer.ranges) return limit > 0 ? [0, limit] : [];
+    let ranges = layer.ranges;
+    if (channelMask) {
+        // Frames are compact; find where these channels ended up
+        ranges = channelMask
+            .maskPlan(ranges.map((r) => ({ srcOffset: 0, dstOffset: r.start, length: r.length })))
+            .map((r) => ({ start: r.dstOffset, length: r.length }));
+    }
+    const sorted = [...ranges].sort((a, b) => a.start - b.start);
+    const spans: number[] = [];
+    for (const r of sorted) {
+        const s = Math.max(0, r.start);
+        const e = Math.min(limit, r.start + r.length);
+        if (e <= s) continue;
+        if (spans.length && s <= spans[spans.length - 1]) {
+            spans[spans.length - 1] = Math.max(spans[spans.length - 1], e);
+        } else {
+            spans.push(s, e);
+        }
+    }
+    return spans;
+}
+
+/**
+ * Plans compositing `layers` (bottom first) into a frame of `nOut` channels, given the length of
+ *  each layer's frame (0 to leave the layer out).  The output is cut where any layer starts or
+ *  stops and at tile boundaries, and for each stretch the ops of every layer covering it are
+ *  emitted together: the bottom one copied (or the stretch zeroed), the others blended over it.
+ *  So the work is the channels each layer touches, done while the stretch is in cache, rather
+ *  than a pass over the whole frame per layer.  Channels no layer covers are zeroed.
+ *  With `channelMask`, frames are compact and layer ranges are mapped into them.
+ */
+export function compileComposite(
+    nOut: number,
+    layers: CompositeLayer[],
+    lengths: number[],
+    channelMask?: ChannelMask,
+): Uint32Array {
+    const spans = layers.map((l, i) => {
+        let limit = Math.min(nOut, lengths[i] ?? 0);
+        if (l.mode === BlendMode.Mask) limit = Math.min(limit, l.mask?.length ?? 0);
+        return layerSpans(l, limit, channelMask);
+    });
+
+    const cuts = new Set<number>([0, nOut]);
+    for (let t = TILE; t < nOut; t += TILE) cuts.add(t);
+    for (const s of spans) for (const c of s) cuts.add(c);
+    const bounds = [...cuts].sort((a, b) => a - b);
+
+    // Stretches with the same layers over them, not crossing a tile boundary
+    const runs: { start: number; end: number; covering: number[] }[] = [];
+    const next = spans.map(() => 0); // Per layer, its first span not yet passed
+    for (let b = 0; b + 1 < bounds.length; ++b) {
+        const start = bounds[b];
+        const end = bounds[b + 1];
+        const covering: number[] = [];
+        for (let l = 0; l < spans.length; ++l) {
+            const s = spans[l];
+            while (next[l] < s.length && s[next[l] + 1] <= start) next[l] += 2;
+            if (next[l] < s.length && s[next[l]] <= start) covering.push(l);
+        }
+        const prev = runs[runs.length - 1];
+        if (
+            prev &&
+            start % TILE !== 0 &&
+            prev.covering.length === covering.length &&
+            prev.covering.every((l, i) => l === covering[i])
+        ) {
+            prev.end = end;
+        } else {
+            runs.push({ start, end, covering });
+        }
+    }
+
+    const ops: number[] = [];
+    for (const { start, end, covering } of runs) {
+        const len = end - start;
+        if (!covering.length) {
+            ops.push(COMPOSITE_ZERO, 0, 0, start, len);
+            continue;
+        }
+        covering.forEach((l, i) => {
+            const { mode } = layers[l];
+            const alpha = Math.max(0, Math.min(255, (layers[l].opacity ?? 255) | 0));
+            if (i === 0) {
+                // Over black: max, add and an opaque over are the layer itself
+                const opaque = alpha === 255;
+                if (opaque && (mode === BlendMode.Max || mode === BlendMode.Add || mode === BlendMode.Over)) {
+                    ops.push(COMPOSITE_COPY, l, 255, start, len);
+                    return;
+                }
+                ops.push(COMPOSITE_ZERO, 0, 0, start, len);
+            }
+            ops.push(mode, l, alpha, start, len);
+        });
+    }
+    return Uint32Array.from(ops);
+}
+
+/**
+ * Composites a stack of layers into an output frame, keeping the plan from compileComposite
+ *  for as long as the layers (by identity), their opacities and the lengths of their frames stay
+ *  the same.  So a layer being faded in or out is planned again each frame, which is cheap.
+ */
+export class FrameCompositor {
+    private layers: CompositeLayer[] = [];
+    private key = '';
+    private ops = new Uint32Array(0);
+    private masks: (Uint8Array | undefined)[] = [];
+
+    constructor(public kernel: CompositeKernel = jsCompositeKernel) {}
+
+    /**
+     * `frames` has one frame per layer, bottom first; a layer whose frame is undefined is left out.
+     *  `out` past the longest frame is zeroed, as it may hold (or have been dimmed from) an earlier mix.
+     */
+    compose(out: Uint8Array, layers: CompositeLayer[], frames: (Uint8Array | undefined)[], channelMask?: ChannelMask) {
+        const lengths = frames.map((f) => f?.length ?? 0);
+        const nOut = Math.min(out.length, Math.max(0, ...lengths));
+        const opacities = layers.map((l) => l.opacity ?? 255);
+        const key = `${nOut}|${channelMask?.id ?? 0}|${lengths.join(',')}|${opacities.join(',')}`;
+        const same = layers.length === this.layers.length && layers.every((l, i) => l === this.layers[i]);
+        if (key !== this.key || !same) {
+            this.ops = compileComposite(nOut, layers, lengths, channelMask);
+            this.masks = layers.map((l) => (l.mode === BlendMode.Mask ? l.mask : undefined));
+            this.layers = [...layers];
+            this.key = key;
+        }
+        this.kernel.composite(out, frames, this.masks, this.ops);
+        if (nOut < out.length) out.fill(0, nOut);
+    }
+}
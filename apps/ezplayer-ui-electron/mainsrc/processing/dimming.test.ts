@@ -0,0 +1,51 @@
+import { describe, expect, it } from 'vitest';
+import { compileDimming, dimmingCurve, DIMMING_NONE, jsLutKernel } from './dimming';
+
+describe('dimmingCurve', () => {
+    it('is undefined when nothing changes', () => {
+        expect(dimmingCurve(1, 1, 1)).toBeUndefined();
+    });
+
+    it('scales by brightness before the gamma, and by the master after', () => {
+        const c = dimmingCurve(2, 0.5, 0.8)!;
+        expect(c[0]).toBe(0);
+        expect(c[255]).toBe(Math.round(255 * 0.25 * 0.8));
+        expect(dimmingCurve(2.2, 1, 1)![128]).toBe(Math.round(255 * Math.pow(128 / 255, 2.2)));
+    });
+});
+
+describe('compileDimming', () => {
+    const models = [
+        { start: 100, length: 50, gamma: 1, brightness: 0.5 },
+        { start: 10, length: 20, gamma: 2, brightness: 1 },
+        { start: 140, length: 30, gamma: 1, brightness: 0.5 }, // Overlaps the first; same curve
+        { start: 300, length: 10, gamma: 1, brightness: 1 },
+    ];
+
+    it('skips the pass when every curve is linear and the master is full', () => {
+        expect(compileDimming([{ start: 0, length: 10, gamma: 1, brightness: 1 }], 1, 100)).toBeUndefined();
+    });
+
+    it('covers the frame with spans, sharing tables between equal curves', () => {
+        const plan = compileDimming(models, 1, 400)!;
+        expect(plan.luts.length).toBe(2 * 256);
+        const none = DIMMING_NONE;
+        expect([...plan.ops]).toEqual([0, 10, none, 10, 20, 0, 30, 70, none, 100, 70, 1, 170, 230, none]);
+    });
+
+    it('puts the rest of the frame through the master dimmer', () => {
+        const plan = compileDimming(models, 0.5, 400)!;
+        const src = new Uint8Array(400).fill(200);
+        const dst = new Uint8Array(400);
+        jsLutKernel.applyLuts(dst, src, plan.luts, plan.ops);
+        expect(dst[0]).toBe(100);
+        expect(dst[105]).toBe(50);
+        expect(dst[305]).toBe(100);
+        expect(dst[15]).toBe(Math.round(255 * Math.pow(200 / 255, 2) * 0.5));
+
+        // In place, and on a short frame
+        const short = src.subarray(0, 120).slice();
+        jsLutKernel.applyLuts(short, short, plan.luts, plan.ops);
+        expect(short[119]).toBe(50);
+    });
+});
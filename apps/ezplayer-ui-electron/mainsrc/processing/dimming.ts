@@ -0,0 +1,112 @@
+/** A model's channels and the dimming curve xLights has for it (from ModelRec) */
+export interface DimmingModel {
+    start: number; // 0-based absolute channel
+    length: number;
+    gamma: number; // 1 is linear
+    brightness: number; // Multiplier; 1 is as sequenced
+}
+
+/** compileDimming's result: the curves, and which channels go through which */
+export interface DimmingPlan {
+    /** 256 bytes per curve */
+    luts: Uint8Array;
+    /** Three u32s per span, (start, len, lut); lut is DIMMING_NONE where channels go out unchanged */
+    ops: Uint32Array;
+}
+
+export const DIMMING_NONE = 0xffffffff;
+const OP_FIELDS = 3;
+
+/** Maps frames through a DimmingPlan; `dst` may be `src`, and spans past the shorter are cut off */
+export interface LutKernel {
+    name: string;
+    applyLuts(dst: Uint8Array, src: Uint8Array, luts: Uint8Array, ops: Uint32Array): void;
+}
+
+/** Table lookups in JS, for when the pixel_kernels addon is not available */
+export const jsLutKernel: LutKernel = {
+    name: 'js',
+    applyLuts(dst, src, luts, ops) {
+        const n = Math.min(dst.length, src.length);
+        for (let o = 0; o + OP_FIELDS <= ops.length; o += OP_FIELDS) {
+            const start = ops[o];
+            const end = Math.min(n, start + ops[o + 1]);
+            const lut = ops[o + 2];
+            if (start >= end) continue;
+            if (lut === DIMMING_NONE) {
+                if (dst !== src) dst.set(src.subarray(start, end), start);
+                continue;
+            }
+            const base = lut * 256;
+            for (let i = start; i < end; ++i) dst[i] = luts[base + src[i]];
+        }
+    },
+};
+
+/**
+ * The 256-entry curve for a gamma, brightness and master dimmer (0..1): as in xLights, the
+ *  value is scaled by the brightness and then has the gamma applied; the master dimmer scales
+ *  what comes out.  Undefined if every value would come out unchanged.
+ */
+export function dimmingCurve(gamma: number, brightness: number, master: number): Uint8Array | undefined {
+    const g = gamma > 0 && Number.isFinite(gamma) ? gamma : 1;
+    const b = brightness >= 0 && Number.isFinite(brightness) ? brightness : 1;
+    const m = Math.max(0, Math.min(1, master));
+    if (g === 1 && b === 1 && m === 1) return undefined;
+    const lut = new Uint8Array(256);
+    for (let x = 0; x < 256; ++x) {
+        const v = Math.min(1, (x / 255) * b);
+        lut[x] = Math.round(255 * Math.pow(v, g) * m);
+    }
+    return lut;
+}
+
+/**
+ * Plans the output dimming pass over frames of `nChannels`: each model's channels through its
+ *  curve, and everything else through the master dimmer alone.  Where models overlap, the one
+ *  starting first keeps the shared channels.  Spans with the same curve share one table.
+ *  Undefined if nothing would change, so the pass can be skipped altogether.
+ */
+export function compileDimming(models: DimmingModel[], master: number, nChannels: number): DimmingPlan | undefined {
+    const tables: Uint8Array[] = [];
+    const tableOf = new Map<string, number>();
+    const lutFor = (gamma: number, brightness: number) => {
+        const key = `${gamma}|${brightness}`;
+        let idx = tableOf.get(key);
+        if (idx === undefined) {
+            const curve = dimmingCurve(gamma, brightness, master);
+            idx = curve ? tables.push(curve) - 1 : DIMMING_NONE;
+            tableOf.set(key, idx);
+        }
+        return idx;
+    };
+
+    const ops: number[] = [];
+    const span = (start: number, end: number, lut: number) => {
+        if (end <= start) return;
+        const last = ops.length - OP_FIELDS;
+        if (last >= 0 && ops[last + 2] === lut && ops[last] + ops[last + 1] === start) {
+            ops[last + 1] += end - start;
+        } else {
+            ops.push(start, end - start, lut);
+        }
+    };
+
+    const sorted = [...models].sort((a, b) => a.start - b.start);
+    const masterLut = lutFor(1, 1);
+    let cursor = 0;
+    for (const m of sorted) {
+        const start = Math.max(cursor, m.start);
+        const end = Math.min(nChannels, m.start + m.length);
+        if (end <= start) continue;
+        span(cursor, start, masterLut);
+        span(start, end, lutFor(m.gamma, m.brightness));
+        cursor = end;
+    }
+    span(cursor, nChannels, masterLut);
+
+    if (!tables.length) return undefined;
+    const luts = new Uint8Array(tables.length * 256);
+    tables.forEach((t, i) => luts.set(t, i * 256));
+    return { luts, ops: Uint32Array.from(ops) };
+}
@@ -0,0 +1,736 @@
+// udp-batch/udpbatch.cpp — Batched UDP output for DDP / E1.31.
+//
+// Linux   : sendmmsg() — a whole frame's datagrams in one syscall, with
+//           runs of equal-sized datagrams handed to UDP GSO when available
+// macOS   : sendmsg() per datagram
+// Windows : WSASend() per datagram (WSABUF gather)
+//
+// JS hands over a controller's complete packet list for a frame; each
+// packet is a list of buffers (header + pixel-data slices) that are
+// gathered into one datagram, so nothing is copied.
+//
+// A single long-lived "sender" thread is created in Init() and joined in
+// Shutdown().  Requests (open / send / close) are queued via a mutex and a
+// wake signal and are processed in order, so a close never overtakes a
+// send on the same socket.  Each batch reports exactly one completion back
+// to JS via a TypedThreadSafeFunction, instead of one callback per packet.
+//
+// With zerocopy (Linux), a batch sent with MSG_ZEROCOPY completes only when
+// the kernel reports it is done with the buffers, so JS does not release
+// or reuse the frame until then.
+//
+// With io_uring (Linux), sends on sockets opened with it are queued on one
+// ring as they are taken from the work list and submitted together, so a
+// frame for many controllers costs a couple of io_uring_enter() calls rather
+// than a sendmmsg() per controller.  Results are still posted per batch, in
+// order.  If the ring cannot be set up, those sockets use sendmmsg().
+#include "napi.h"
+#include "udpsock.h"
+#include "uring.h"
+#include <string>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <deque>
+#include <chrono>
+#include <cerrno>
+
+#if !defined(_WIN32)
+  #include <poll.h>
+  #include <fcntl.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Forward declarations for TSFN template
+// ---------------------------------------------------------------------------
+struct UdpRequest;
+static void CallJs(Napi::Env env, Napi::Function jsCallback,
+                   void* context, UdpRequest* data);
+
+using TSFN = Napi::TypedThreadSafeFunction<void, UdpRequest, CallJs>;
+
+// ---------------------------------------------------------------------------
+// Module-level state
+// ---------------------------------------------------------------------------
+static TSFN tsfn;
+static std::atomic<bool> shutting_down{false};
+static std::thread send_thread;
+static std::mutex queue_mutex;
+static std::vector<UdpRequest*> send_queue;
+static int32_t next_handle = 1;
+
+// Cumulative counters, read by stats()
+static std::atomic<uint64_t> stat_datagrams{0};
+static std::atomic<uint64_t> stat_syscalls{0};
+static std::atomic<uint64_t> stat_gso_sends{0};
+static std::atomic<uint64_t> stat_zerocopy_sends{0};
+static std::atomic<uint64_t> stat_zerocopy_copied{0};
+static std::atomic<uint64_t> stat_uring_batches{0};
+
+#if defined(_WIN32)
+static HANDLE wake_event = NULL;          // auto-reset
+#else
+static int wake_pipe[2] = {-1, -1};
+#endif
+
+// ---------------------------------------------------------------------------
+// Requests (allocated on JS thread, freed in CallJs or on abort)
+// ---------------------------------------------------------------------------
+enum class ReqKind { Open, Send, Close };
+
+struct UdpRequest {
+    ReqKind kind;
+    int32_t handle = 0;
+    std::string error;
+
+    explicit UdpRequest(ReqKind k) : kind(k) {}
+    virtual ~UdpRequest() {}
+};
+
+struct OpenRequest : UdpRequest {
+    Napi::Promise::Deferred deferred;
+    std::string host;
+    int port;
+    int family;          // 4 or 6
+    int sndbuf;
+    bool gso;
+    bool multicast = false;   // unconnected; host is ignored
+    int ttl = -1;
+    std::string iface;
+    bool zerocopy = false;
+    bool uring = false;
+
+    OpenRequest(Napi::Env env, const std::string& h, int p, int f, int sb, bool g)
+        : UdpRequest(ReqKind::Open), deferred(Napi::Promise::Deferred::New(env)),
+          host(h), port(p), family(f), sndbuf(sb), gso(g) {}
+};
+
+struct SendRequest : UdpRequest {
+    std::vector<io_buf> iov;
+    std::vector<PacketSpan> packets;
+    std::vector<uint32_t> dests;         // per packet, on a multicast socket
+    Napi::ObjectReference keepAlive;     // holds the packet buffers
+    Napi::FunctionReference callback;
+    SendCounts counts;
+
+    SendRequest() : UdpRequest(ReqKind::Send) {}
+};
+
+// ---------------------------------------------------------------------------
+// TSFN callback — runs on the JS event-loop thread
+// ---------------------------------------------------------------------------
+static void CallJs(Napi::Env env, Napi::Function /*jsCallback*/,
+                   void* /*context*/, UdpRequest* data) {
+    if (data == nullptr) return;
+    if (env != nullptr) {
+        if (data->kind == ReqKind::Open) {
+            auto* req = static_cast<OpenRequest*>(data);
+            if (req->error.empty()) {
+                req->deferred.Resolve(Napi::Number::New(env, req->handle));
+            } else {
+                req->deferred.Reject(Napi::Error::New(env, req->error).Value());
+            }
+        } else if (data->kind == ReqKind::Send) {
+            auto* req = static_cast<SendRequest*>(data);
+            auto cb = req->callback.Value();
+            if (req->error.empty()) {
+                cb.Call({Napi::Number::New(env, req->counts.nOk),
+                         Napi::Number::New(env, req->counts.nErr)});
+            } else {
+                cb.Call({Napi::Number::New(env, req->counts.nOk),
+                         Napi::Number::New(env, req->counts.nErr),
+                         Napi::String::New(env, req->error)});
+            }
+        }
+    } else if (data->kind == ReqKind::Send) {
+        // Environment is going away; references die with it
+        auto* req = static_cast<SendRequest*>(data);
+        req->keepAlive.SuppressDestruct();
+        req->callback.SuppressDestruct();
+    }
+    delete data;
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+static void post_result(UdpRequest* req) {
+    if (req->kind == ReqKind::Close) {
+        delete req;   // nobody is waiting on a close
+        return;
+    }
+    if (tsfn.NonBlockingCall(req) != napi_ok) {
+        delete req;   // TSFN closing — discard
+    }
+}
+
+static void wake_thread() {
+#if defined(_WIN32)
+    if (wake_event) SetEvent(wake_event);
+#else
+    char c = 1;
+    // EAGAIN means the pipe is already full, so the thread is due to wake anyway
+    if (write(wake_pipe[1], &c, 1) < 0) {}
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Sender thread
+// ---------------------------------------------------------------------------
+using Clock = std::chrono::steady_clock;
+
+// A send waiting for the kernel to finish with its buffers
+struct ZeroCopyWait {
+    SendRequest* req;
+    uint32_t endId;           // complete once every zerocopy id before this is
+    Clock::time_point giveUp; // in case a completion is never seen
+};
+
+struct BatchSocket {
+    sock_t sock;
+    SendPath path;
+    int port;
+    bool multicast;
+    bool uring;                         // sends go through the ring
+    ZeroCopyTracker zc;
+    std::deque<ZeroCopyWait> waiting;   // in send order
+};
+
+// Post the sends whose buffers the kernel is done with (all of them if `all`)
+static void release_completed(BatchSocket& bs, bool all) {
+    if (bs.waiting.empty()) return;
+    uint32_t copied0 = bs.zc.copied;
+    read_zerocopy_completions(bs.sock, bs.zc);
+    if (bs.zc.copied != copied0) {
+        // The device copies anyway (e.g. loopback, no scatter-gather); stop paying for pinning
+        stat_zerocopy_copied += bs.zc.copied - copied0;
+        bs.path.zerocopy = false;
+    }
+    const auto now = Clock::now();
+    while (!bs.waiting.empty()) {
+        const ZeroCopyWait& w = bs.waiting.front();
+        if (!all && !bs.zc.completed(w.endId) && now < w.giveUp) break;
+        post_result(w.req);
+        bs.waiting.pop_front();
+    }
+}
+
+#if defined(UDP_HAVE_URING)
+static const unsigned kUringEntries = 256;
+
+// One message on the ring: a datagram or a GSO run of one batch
+struct UringMsg {
+    struct msghdr mh;
+    CmsgBuf ctrl;
+    SendRequest* req;
+    BatchSocket* bs;
+    size_t firstPkt;
+    size_t nSegs;
+    bool done;
+};
+
+struct UringSender {
+    UdpUring ring;
+    bool failed = false;                 // setup failed, or the ring broke; don't retry
+    std::deque<UringMsg> msgs;           // stable addresses, for the kernel and user_data
+    std::vector<SendRequest*> queued;    // batches with all their messages on the ring
+
+    bool ready(std::string& error) {
+        if (!ring.ready() && !failed && !ring.init(kUringEntries, error)) failed = true;
+        return ring.ready();
+    }
+
+    // Put a batch's messages on the ring, flushing earlier batches if it fills
+    void queue(SendRequest* req, BatchSocket& bs) {
+        io_buf* iov = req->iov.data();
+        const PacketSpan* pkts = req->packets.data();
+        const size_t npkts = req->packets.size();
+        size_t i = 0;
+        while (i < npkts) {
+            if (ring.ready() && ring.full()) flush();
+            if (!ring.ready()) {
+                // The ring broke mid-batch; the rest goes the ordinary way
+                send_batch(bs.sock, bs.path, iov, pkts + i, npkts - i, req->counts);
+                break;
+            }
+            const GsoRun run = bs.path.gso ? next_gso_run(iov, pkts, npkts, i)
+                                           : GsoRun{i, 1, pkts[i].count, 0};
+            msgs.emplace_back();
+            UringMsg& m = msgs.back();
+            std::memset(&m.mh, 0, sizeof(m.mh));
+            m.mh.msg_iov = &iov[pkts[i].first];
+            m.mh.msg_iovlen = run.niov;
+            set_cmsgs(m.mh, m.ctrl, run.nSegs > 1 ? static_cast<uint16_t>(run.segSize) : 0, nullptr, false);
+            m.req = req;
+            m.bs = &bs;
+            m.firstPkt = i;
+            m.nSegs = run.nSegs;
+            m.done = false;
+            ring.sendmsg(bs.sock, &m.mh, reinterpret_cast<uint64_t>(&m));
+            i += run.nSegs;
+        }
+        queued.push_back(req);
+    }
+
+    // Submit, wait for every completion, and post the queued batches
+    void flush() {
+        if (msgs.empty() && queued.empty()) return;
+        unsigned calls = 0;
+        bool ok = ring.wait_all([](uint64_t userData, int res) {
+            complete(*reinterpret_cast<UringMsg*>(userData), res);
+        }, calls);
+        stat_syscalls += calls;
+        if (!ok) failed = true;
+        for (auto& m : msgs) {
+            if (m.done) continue;
+            m.req->counts.nErr += static_cast<uint32_t>(m.nSegs);
+            m.req->counts.error = "io_uring_enter failed";
+        }
+        msgs.clear();
+        for (auto* req : queued) {
+            req->error = req->counts.error;
+            stat_datagrams += req->counts.nOk;
+            stat_syscalls += req->counts.nCalls;
+            stat_gso_sends += req->counts.nGso;
+            ++stat_uring_batches;
+            post_result(req);
+        }
+        queued.clear();
+    }
+
+    static void complete(UringMsg& m, int res) {
+        m.done = true;
+        SendCounts& c = m.req->counts;
+        if (res >= 0) {
+            c.nOk += static_cast<uint32_t>(m.nSegs);
+            if (m.nSegs > 1) ++c.nGso;
+        } else if (m.nSegs > 1 && gso_refused(-res)) {
+            // As in send_batch: no GSO on this route after all, so resend as datagrams
+            m.bs->path.gso = false;
+            send_datagrams(m.bs->sock, m.req->iov.data(), m.req->packets.data() + m.firstPkt, m.nSegs, c);
+        } else {
+            c.error = std::string("sendmsg: ") + strerror(-res);
+            c.nErr += static_cast<uint32_t>(m.nSegs);
+        }
+    }
+};
+#endif
+
+static void send_thread_func() {
+    std::map<int32_t, BatchSocket> sockets;
+    std::vector<UdpRequest*> work;
+#if defined(UDP_HAVE_URING)
+    UringSender us;
+#endif
+
+    while (!shutting_down.load()) {
+        {
+            std::lock_guard<std::mutex> lk(queue_mutex);
+            work.swap(send_queue);
+        }
+
+        for (auto* req : work) {
+            switch (req->kind) {
+            case ReqKind::Open: {
+                auto* oreq = static_cast<OpenRequest*>(req);
+                sock_t s = oreq->multicast
+                    ? open_udp_multicast_socket(oreq->sndbuf, oreq->ttl, oreq->iface, oreq->error)
+                    : open_udp_socket(oreq->host, oreq->port, oreq->family,
+                                      oreq->sndbuf, oreq->error);
+                if (s != BAD_SOCK) {
+                    // Filled in place; assigning a temporary trips a bogus -Wmaybe-uninitialized in the map
+                    BatchSocket& bs = sockets[oreq->handle];
+                    bs.sock = s;
+                    bs.path = open_send_path(s, oreq->gso && !oreq->multicast);
+                    bs.port = oreq->port;
+                    bs.multicast = oreq->multicast;
+                    bs.uring = false;
+                    if (oreq->zerocopy && bs.path.gso) enable_zerocopy(s, bs.path);
+#if defined(UDP_HAVE_URING)
+                    // Zerocopy needs its completions matched to sends; that stays on sendmmsg
+                    std::string uerr;
+                    bs.uring = oreq->uring && !oreq->multicast && !bs.path.zerocopy && us.ready(uerr);
+#endif
+                }
+                break;
+            }
+            case ReqKind::Send: {
+                auto it = sockets.find(req->handle);
+                auto* sreq = static_cast<SendRequest*>(req);
+                if (it == sockets.end()) {
+                    sreq->error = "socket is not open";
+                    sreq->counts.nErr = static_cast<uint32_t>(sreq->packets.size());
+                } else if (it->second.multicast ? sreq->dests.size() != sreq->packets.size()
+                                                : !sreq->dests.empty()) {
+                    sreq->error = it->second.multicast ? "multicast socket needs a destination per packet"
+                                                       : "destinations given for a connected socket";
+                    sreq->counts.nErr = static_cast<uint32_t>(sreq->packets.size());
+#if defined(UDP_HAVE_URING)
+                } else if (it->second.uring && !us.failed) {
+                    us.queue(sreq, it->second);   // posted by flush()
+                    continue;
+#endif
+                } else {
+                    if (it->second.multicast) {
+                        send_datagrams_to(it->second.sock, sreq->iov.data(), sreq->packets.data(),
+                                          sreq->dests.data(), sreq->packets.size(), it->second.port,
+                                          sreq->counts);
+                    } else {
+                        send_batch(it->second.sock, it->second.path, sreq->iov.data(),
+                                   sreq->packets.data(), sreq->packets.size(), sreq->counts);
+                    }
+                    sreq->error = sreq->counts.error;
+                    stat_datagrams += sreq->counts.nOk;
+                    stat_syscalls += sreq->counts.nCalls;
+                    stat_gso_sends += sreq->counts.nGso;
+                    stat_zerocopy_sends += sreq->counts.nZc;
+
+                    // Hold the result (and so the buffers) until the kernel is done with them;
+                    //  later sends on the socket queue behind, to keep completions in order
+                    BatchSocket& bs = it->second;
+                    bs.zc.next += sreq->counts.nZc;
+                    if (sreq->counts.nZc || !bs.waiting.empty()) {
+                        bs.waiting.push_back({sreq, bs.zc.next, Clock::now() + std::chrono::seconds(1)});
+                        continue;
+                    }
+                }
+                break;
+            }
+            case ReqKind::Close: {
+                auto it = sockets.find(req->handle);
+                if (it != sockets.end()) {
+#if defined(UDP_HAVE_URING)
+                    us.flush();
+#endif
+                    release_completed(it->second, true);
+                    close_sock(it->second.sock);
+                    sockets.erase(it);
+                }
+                break;
+            }
+            }
+            post_result(req);
+        }
+        work.clear();
+#if defined(UDP_HAVE_URING)
+        us.flush();
+#endif
+
+        // --- zerocopy completions ---
+        bool waiting = false;
+        for (auto& kv : sockets) {
+            release_completed(kv.second, false);
+            waiting = waiting || !kv.second.waiting.empty();
+        }
+
+        // --- wait for more work (or, on Linux, a completion: POLLERR) ---
+#if defined(_WIN32)
+        WaitForSingleObject(wake_event, 200);
+#else
+        std::vector<struct pollfd> fds;
+        fds.push_back({wake_pipe[0], POLLIN, 0});
+        if (waiting) {
+            for (auto& kv : sockets) {
+                if (!kv.second.waiting.empty()) fds.push_back({kv.second.sock, 0, 0});
+            }
+        }
+        poll(fds.data(), static_cast<nfds_t>(fds.size()), waiting ? 10 : 200);
+        if (fds[0].revents & POLLIN) {
+            char buf[64];
+            while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {}
+        }
+#endif
+    }
+
+    // --- shutdown: fail anything still queued, close sockets ---
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        work.swap(send_queue);
+    }
+    for (auto* req : work) {
+        req->error = "shutting down";
+        post_result(req);
+    }
+    for (auto& kv : sockets) {
+        release_completed(kv.second, true);
+        close_sock(kv.second.sock);
+    }
+}
+
+static void enqueue(UdpRequest* req) {
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        send_queue.push_back(req);
+    }
+    wake_thread();
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: open(host, port, family, sendBufSize, gso?, multicast?, zerocopy?, uring?) => Promise<handle>
+//   gso (default true) allows UDP segmentation offload where supported
+//   multicast { ttl?, interface? }: an unconnected IPv4 socket, host ignored;
+//     sendBatch then takes a destination per packet
+//   zerocopy (default false): MSG_ZEROCOPY on GSO sends (Linux); each batch's
+//     callback then waits for the kernel to be done with its buffers
+//   uring (default false): send through the shared io_uring (Linux), falling
+//     back to sendmmsg if it can't be set up; not with multicast or zerocopy
+// ---------------------------------------------------------------------------
+static Napi::Value Open(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsNumber() ||
+        !info[2].IsNumber() || !info[3].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (host: string, port: number, family: number, sendBufSize: number)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    auto* req = new OpenRequest(env,
+                                info[0].As<Napi::String>().Utf8Value(),
+                                info[1].As<Napi::Number>().Int32Value(),
+                                info[2].As<Napi::Number>().Int32Value(),
+                                info[3].As<Napi::Number>().Int32Value(),
+                                info.Length() < 5 || !info[4].IsBoolean() ||
+                                    info[4].As<Napi::Boolean>().Value());
+    if (info.Length() >= 6 && info[5].IsObject()) {
+        auto mc = info[5].As<Napi::Object>();
+        req->multicast = true;
+        Napi::Value ttl = mc.Get("ttl");
+        if (ttl.IsNumber()) req->ttl = ttl.As<Napi::Number>().Int32Value();
+        Napi::Value iface = mc.Get("interface");
+        if (iface.IsString()) req->iface = iface.As<Napi::String>().Utf8Value();
+    }
+    req->zerocopy = info.Length() >= 7 && info[6].IsBoolean() && info[6].As<Napi::Boolean>().Value();
+    req->uring = info.Length() >= 8 && info[7].IsBoolean() && info[7].As<Napi::Boolean>().Value();
+    auto promise = req->deferred.Promise();
+
+    if (shutting_down.load()) {
+        req->deferred.Reject(Napi::Error::New(env, "shutting down").Value());
+        delete req;
+        return promise;
+    }
+
+    req->handle = next_handle++;
+    enqueue(req);
+    return promise;
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: sendBatch(handle, packets, cb(nOk, nErr, err?), dests?)
+//   packets: Array<Uint8Array | Array<Uint8Array | number>>, each entry is one
+//     datagram; in an array, a Uint8Array followed by two numbers is the
+//     (offset, length) span of it
+//   dests: Array<number>, IPv4 destination of each packet (multicast sockets)
+// ---------------------------------------------------------------------------
+static bool add_buffer(SendRequest* req, const Napi::Value& v) {
+    if (!v.IsTypedArray()) return false;
+    auto u8 = v.As<Napi::Uint8Array>();
+    if (u8.TypedArrayType() != napi_uint8_array) return false;
+    req->iov.push_back(make_io_buf(u8.Data(), u8.ByteLength()));
+    return true;
+}
+
+static bool add_span(SendRequest* req, const Napi::Value& v, const Napi::Value& off, const Napi::Value& len) {
+    if (!v.IsTypedArray() || !len.IsNumber()) return false;
+    auto u8 = v.As<Napi::Uint8Array>();
+    if (u8.TypedArrayType() != napi_uint8_array) return false;
+    double o = off.As<Napi::Number>().DoubleValue(), n = len.As<Napi::Number>().DoubleValue();
+    if (!(o >= 0 && n >= 0 && o + n <= static_cast<double>(u8.ByteLength()))) return false;
+    req->iov.push_back(make_io_buf(u8.Data() + static_cast<size_t>(o), static_cast<size_t>(n)));
+    return true;
+}
+
+static Napi::Value SendBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsArray() ||
+        !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (handle: number, packets: Array, cb: Function)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    auto packets = info[1].As<Napi::Array>();
+    auto* req = new SendRequest();
+    req->handle = info[0].As<Napi::Number>().Int32Value();
+
+    uint32_t np = packets.Length();
+    req->packets.reserve(np);
+    req->iov.reserve(np * 2);
+    for (uint32_t i = 0; i < np; ++i) {
+        Napi::Value p = packets[i];
+        PacketSpan span{req->iov.size(), 0};
+        bool ok = true;
+        if (p.IsArray()) {
+            auto parts = p.As<Napi::Array>();
+            uint32_t nparts = parts.Length();
+            for (uint32_t j = 0; ok && j < nparts; ++j) {
+                Napi::Value b = parts[j];
+                Napi::Value off = j + 1 < nparts ? parts[j + 1] : env.Undefined();
+                if (off.IsNumber()) {
+                    ok = j + 2 < nparts && add_span(req, b, off, parts[j + 2]);
+                    j += 2;
+                } else {
+                    ok = add_buffer(req, b);
+                }
+            }
+        } else {
+            ok = add_buffer(req, p);
+        }
+        if (!ok) {
+            delete req;
+            Napi::TypeError::New(env, "Packets must be Uint8Array or arrays of Uint8Array and spans of them")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        span.count = req->iov.size() - span.first;
+        req->packets.push_back(span);
+    }
+
+    if (info.Length() >= 4 && info[3].IsArray()) {
+        auto dests = info[3].As<Napi::Array>();
+        uint32_t nd = std::min(dests.Length(), np);
+        req->dests.reserve(nd);
+        for (uint32_t i = 0; i < nd; ++i) {
+            Napi::Value d = dests[i];
+            req->dests.push_back(d.IsNumber() ? d.As<Napi::Number>().Uint32Value() : 0);
+        }
+    }
+
+    req->keepAlive = Napi::Persistent(packets.As<Napi::Object>());
+    req->callback = Napi::Persistent(info[2].As<Napi::Function>());
+
+    if (shutting_down.load()) {
+        req->error = "shutting down";
+        req->counts.nErr = np;
+        CallJs(env, Napi::Function(), nullptr, req);
+        return env.Undefined();
+    }
+
+    enqueue(req);
+    return env.Undefined();
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: close(handle) — ordered after any queued sends
+// ---------------------------------------------------------------------------
+static Napi::Value Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (handle: number)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!shutting_down.load()) {
+        auto* req = new UdpRequest(ReqKind::Close);
+        req->handle = info[0].As<Napi::Number>().Int32Value();
+        enqueue(req);
+    }
+    return env.Undefined();
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: stats() => { datagrams, syscalls, gsoSends, zerocopySends, zerocopyCopied, uringBatches }
+// ---------------------------------------------------------------------------
+static Napi::Value Stats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto obj = Napi::Object::New(env);
+    obj.Set("datagrams", Napi::Number::New(env, static_cast<double>(stat_datagrams.load())));
+    obj.Set("syscalls", Napi::Number::New(env, static_cast<double>(stat_syscalls.load())));
+    obj.Set("gsoSends", Napi::Number::New(env, static_cast<double>(stat_gso_sends.load())));
+    obj.Set("zerocopySends", Napi::Number::New(env, static_cast<double>(stat_zerocopy_sends.load())));
+    obj.Set("zerocopyCopied", Napi::Number::New(env, static_cast<double>(stat_zerocopy_copied.load())));
+    obj.Set("uringBatches", Napi::Number::New(env, static_cast<double>(stat_uring_batches.load())));
+    return obj;
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: uringAvailable() => boolean — whether an io_uring can be set up here
+// ---------------------------------------------------------------------------
+static Napi::Value UringAvailable(const Napi::CallbackInfo& info) {
+#if defined(UDP_HAVE_URING)
+    UdpUring probe;
+    std::string error;
+    return Napi::Boolean::New(info.Env(), probe.init(4, error));
+#else
+    return Napi::Boolean::New(info.Env(), false);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: shutdown() — join thread, abort TSFN
+// ---------------------------------------------------------------------------
+static void DoShutdown() {
+    if (!shutting_down.exchange(true)) {
+        wake_thread();
+        if (send_thread.joinable()) send_thread.join();
+        tsfn.Release();   // release thread's reference
+        tsfn.Abort();     // release owner reference, mark closing
+
+#if defined(_WIN32)
+        if (wake_event) { CloseHandle(wake_event); wake_event = NULL; }
+#else
+        if (wake_pipe[0] >= 0) { close(wake_pipe[0]); wake_pipe[0] = -1; }
+        if (wake_pipe[1] >= 0) { close(wake_pipe[1]); wake_pipe[1] = -1; }
+#endif
+    }
+}
+
+static Napi::Value Shutdown(const Napi::CallbackInfo& info) {
+    DoShutdown();
+    return info.Env().Undefined();
+}
+
+// ---------------------------------------------------------------------------
+// Cleanup hook — safety net if shutdown() was never called
+// ---------------------------------------------------------------------------
+static void CleanupHook(void*) {
+    DoShutdown();
+}
+
+// ---------------------------------------------------------------------------
+// Module init
+// ---------------------------------------------------------------------------
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    shutting_down.store(false);
+
+    // Wake channel first: without it the sender thread can't be told about work, so don't start it
+#if defined(_WIN32)
+    wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);  // auto-reset
+    if (!wake_event) {
+        Napi::Error::New(env, "udp_batch: CreateEvent failed: " + std::to_string(GetLastError()))
+            .ThrowAsJavaScriptException();
+        return exports;
+    }
+#else
+    if (pipe(wake_pipe) != 0) {
+        int e = errno;
+        wake_pipe[0] = wake_pipe[1] = -1;
+        Napi::Error::New(env, std::string("udp_batch: pipe failed: ") + strerror(e))
+            .ThrowAsJavaScriptException();
+        return exports;
+    }
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    // TSFN: unlimited queue, 2 references (owner + sender thread)
+    tsfn = TSFN::New(env, "UdpBatchTSFN", 0, 2);
+
+    send_thread = std::thread(send_thread_func);
+
+    napi_add_env_cleanup_hook(env, CleanupHook, nullptr);
+
+    exports.Set("open", Napi::Function::New(env, Open));
+    exports.Set("sendBatch", Napi::Function::New(env, SendBatch));
+    exports.Set("close", Napi::Function::New(env, Close));
+    exports.Set("stats", Napi::Function::New(env, Stats));
+    exports.Set("uringAvailable", Napi::Function::New(env, UringAvailable));
+    exports.Set("shutdown", Napi::Function::New(env, Shutdown));
+    return exports;
+}
+
+NODE_API_MODULE(udp_batch, Init)
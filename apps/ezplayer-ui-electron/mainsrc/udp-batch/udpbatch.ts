@@ -0,0 +1,106 @@
+import { createRequire } from 'module';
+import type { UdpBatchBackend, UdpBatchSocket, UdpMulticastOptions, UdpPacket } from '@ezplayer/epp';
+
+const require = createRequire(import.meta.url);
+
+interface NativeAddon {
+    open(
+        host: string,
+        port: number,
+        family: number,
+        sendBufSize: number,
+        gso?: boolean,
+        multicast?: UdpMulticastOptions,
+        zerocopy?: boolean,
+        uring?: boolean,
+    ): Promise<number>;
+    sendBatch(
+        handle: number,
+        packets: UdpPacket[],
+        cb: (nOk: number, nErr: number, err?: string) => void,
+        dests?: number[],
+    ): void;
+    close(handle: number): void;
+    stats(): UdpBatchStats;
+    uringAvailable(): boolean;
+    shutdown(): void;
+}
+
+/** Cumulative counters since the addon was loaded */
+export interface UdpBatchStats {
+    datagrams: number;
+    syscalls: number;
+    gsoSends: number; // syscalls/messages that carried a run of GSO segments
+    zerocopySends: number; // messages sent with MSG_ZEROCOPY
+    zerocopyCopied: number; // zerocopy completions where the kernel copied anyway
+    uringBatches: number; // batches sent through the io_uring
+}
+
+let native: NativeAddon | null = null;
+try {
+    const bindings = require('bindings');
+    native = bindings('udp_batch');
+} catch (e) {
+    console.error('NO udp_batch BINDING');
+    console.error(e);
+}
+
+/**
+ * Batched UDP sends on the native sender thread (sendmmsg on Linux).
+ *  With `gso` (default), runs of equal-sized packets go out as one UDP GSO send where the kernel supports it.
+ *  With `zerocopy` (and gso), those sends use MSG_ZEROCOPY; a batch then completes, and its
+ *  buffers may be released, only once the kernel is done with them.
+ *  With `uring` (Linux), all such sockets' batches go through one io_uring, submitted together
+ *  once per wakeup of the sender thread; where io_uring is unavailable this quietly stays on
+ *  sendmmsg, and the name says which is in use.  Not combined with zerocopy or multicast.
+ *  Undefined if the addon could not be loaded; callers fall back to dgram.
+ */
+export function createNativeUdpBatchBackend(opts?: {
+    gso?: boolean;
+    zerocopy?: boolean;
+    uring?: boolean;
+}): UdpBatchBackend | undefined {
+    if (!native) return undefined;
+    const addon = native;
+    const gso = opts?.gso ?? true;
+    const zerocopy = gso && !!opts?.zerocopy;
+    const uring = !zerocopy && !!opts?.uring && addon.uringAvailable();
+    return {
+        name: uring
+            ? gso
+                ? 'native-uring-gso'
+                : 'native-uring'
+            : zerocopy
+              ? 'native-gso-zerocopy'
+              : gso
+                ? 'native-gso'
+                : 'native-sendmmsg',
+        async open(type, address, port, sendBufSize, multicast): Promise<UdpBatchSocket> {
+            const handle = await addon.open(
+                address,
+                port,
+                type === 'udp6' ? 6 : 4,
+                sendBufSize ?? 0,
+                gso,
+                multicast,
+                zerocopy,
+                uring,
+            );
+            return {
+                sendBatch: (packets, done, dests) => addon.sendBatch(handle, packets, done, dests),
+                close: () => addon.close(handle),
+            };
+        },
+    };
+}
+
+export function udpBatchStats(): UdpBatchStats | undefined {
+    return native?.stats();
+}
+
+/**
+ * Stop the sender thread; queued batches complete with an error. Safe to call multiple times.
+ */
+export function shutdownUdpBatch() {
+    native?.shutdown();
+}
@@ -0,0 +1,733 @@
+// udp-batch/udpsock.h — Connected datagram sockets and batched sends.
+//
+// Shared by the udp_batch and output_engine addons.  Everything here is
+// plain C++ (no N-API) and runs on whichever native thread owns the socket.
+//
+// Linux   : sendmmsg() — many datagrams per syscall; with UDP GSO
+//           (UDP_SEGMENT, kernel 4.18+) each message carries a run of
+//           equal-sized datagrams that the kernel or NIC splits up
+// macOS   : sendmsg() per datagram
+// Windows : WSASend() per datagram (WSABUF gather)
+//
+// On Linux a batch can also carry a launch time (SO_TXTIME) so the
+// packets are queued early and released by the qdisc, and software TX
+// timestamps can be requested to see when they really left.
+//
+// Multicast sockets are left unconnected; each datagram then carries its
+// own IPv4 destination (send_datagrams_to).
+//
+// With MSG_ZEROCOPY (Linux, on GSO sends) the kernel transmits straight from
+// the caller's buffers, which must then stay untouched until the socket's
+// error queue reports the send complete (ZeroCopyTracker).
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+#else
+  #include <sys/types.h>
+  #include <sys/socket.h>
+  #include <sys/uio.h>
+  #include <netinet/in.h>
+  #include <netinet/udp.h>
+  #include <arpa/inet.h>
+  #include <netdb.h>
+  #include <unistd.h>
+  #include <errno.h>
+  #include <time.h>
+#endif
+#if defined(__linux__)
+  #include <linux/errqueue.h>
+#endif
+
+#if defined(_WIN32)
+using sock_t = SOCKET;
+static const sock_t BAD_SOCK = INVALID_SOCKET;
+using io_buf = WSABUF;
+#else
+using sock_t = int;
+static const sock_t BAD_SOCK = -1;
+using io_buf = struct iovec;
+#endif
+
+// One datagram = iov[first .. first+count)
+struct PacketSpan {
+    size_t first;
+    size_t count;
+};
+
+static inline io_buf make_io_buf(const void* data, size_t len) {
+    io_buf b;
+#if defined(_WIN32)
+    b.buf = reinterpret_cast<CHAR*>(const_cast<void*>(data));
+    b.len = static_cast<ULONG>(len);
+#else
+    b.iov_base = const_cast<void*>(data);
+    b.iov_len = len;
+#endif
+    return b;
+}
+
+static inline std::string last_sock_error() {
+#if defined(_WIN32)
+    return "winsock error " + std::to_string(WSAGetLastError());
+#else
+    return strerror(errno);
+#endif
+}
+
+static inline void close_sock(sock_t s) {
+#if defined(_WIN32)
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+// Resolve, create and connect a datagram socket.  family is 4 or 6.
+static inline sock_t open_udp_socket(const std::string& host, int port, int family,
+                                     int sndbuf, std::string& error) {
+    struct addrinfo hints{};
+    hints.ai_family = family == 6 ? AF_INET6 : AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo* res = nullptr;
+    std::string portStr = std::to_string(port);
+    if (getaddrinfo(host.c_str(), portStr.c_str(), &hints, &res) != 0 || !res) {
+        if (res) freeaddrinfo(res);
+        error = "DNS resolution failed for " + host;
+        return BAD_SOCK;
+    }
+
+    sock_t s = socket(res->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == BAD_SOCK) {
+        error = "socket: " + last_sock_error();
+        freeaddrinfo(res);
+        return BAD_SOCK;
+    }
+
+    if (sndbuf > 0) {
+        int sb = sndbuf;
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF,
+                   reinterpret_cast<const char*>(&sb), sizeof(sb));
+    }
+
+    if (connect(s, res->ai_addr, static_cast<int>(res->ai_addrlen)) != 0) {
+        error = "connect: " + last_sock_error();
+        close_sock(s);
+        freeaddrinfo(res);
+        return BAD_SOCK;
+    }
+    freeaddrinfo(res);
+    return s;
+}
+
+// Unconnected IPv4 socket for sending to multicast groups.  ttl < 0 and an
+// empty iface (local address of the interface to send from) keep the OS
+// defaults.
+static inline sock_t open_udp_multicast_socket(int sndbuf, int ttl, const std::string& iface,
+                                               std::string& error) {
+    sock_t s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == BAD_SOCK) {
+        error = "socket: " + last_sock_error();
+        return BAD_SOCK;
+    }
+    if (sndbuf > 0) {
+        int sb = sndbuf;
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF,
+                   reinterpret_cast<const char*>(&sb), sizeof(sb));
+    }
+    if (ttl >= 0) {
+#if defined(__APPLE__) || defined(__FreeBSD__)
+        unsigned char t = static_cast<unsigned char>(std::min(ttl, 255));   // BSDs want a u_char
+#else
+        int t = std::min(ttl, 255);
+#endif
+        if (setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL,
+                       reinterpret_cast<const char*>(&t), sizeof(t)) != 0) {
+            error = "IP_MULTICAST_TTL: " + last_sock_error();
+            close_sock(s);
+            return BAD_SOCK;
+        }
+    }
+    if (!iface.empty()) {
+        struct in_addr a{};
+        if (inet_pton(AF_INET, iface.c_str(), &a) != 1) {
+            error = "Bad multicast interface address " + iface;
+            close_sock(s);
+            return BAD_SOCK;
+        }
+        if (setsockopt(s, IPPROTO_IP, IP_MULTICAST_IF,
+                       reinterpret_cast<const char*>(&a), sizeof(a)) != 0) {
+            error = "IP_MULTICAST_IF: " + last_sock_error();
+            close_sock(s);
+            return BAD_SOCK;
+        }
+    }
+    return s;
+}
+
+static inline struct sockaddr_in ipv4_sockaddr(uint32_t addr, int port) {
+    struct sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(static_cast<uint16_t>(port));
+    sa.sin_addr.s_addr = htonl(addr);
+    return sa;
+}
+
+struct SendCounts {
+    uint32_t nOk = 0;
+    uint32_t nErr = 0;
+    uint32_t nCalls = 0;   // send syscalls made
+    uint32_t nGso = 0;     // of which carried a GSO run
+    uint32_t nZc = 0;      // messages sent with MSG_ZEROCOPY (completion ids used)
+    std::string error;     // last error seen, if any
+};
+
+static inline size_t span_bytes(const io_buf* iov, const PacketSpan& p) {
+    size_t n = 0;
+    for (size_t i = 0; i < p.count; ++i) {
+#if defined(_WIN32)
+        n += iov[p.first + i].len;
+#else
+        n += iov[p.first + i].iov_len;
+#endif
+    }
+    return n;
+}
+
+// Per-batch options (Linux only; ignored elsewhere).  txtimeNs is a
+// CLOCK_MONOTONIC launch time, used on sockets set up by enable_txtime();
+// txStamp requests a software TX timestamp for the batch's first datagram.
+struct SendOpts {
+    uint64_t txtimeNs = 0;
+    bool txStamp = false;
+};
+
+// ---------------------------------------------------------------------------
+// Send a list of datagrams on a connected socket
+// ---------------------------------------------------------------------------
+#if defined(__linux__)
+
+#ifndef SOL_UDP
+  #define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+  #define UDP_SEGMENT 103
+#endif
+#ifndef SO_TXTIME
+  #define SO_TXTIME 61
+  #define SCM_TXTIME SO_TXTIME
+#endif
+#ifndef SO_EE_ORIGIN_TXTIME
+  #define SO_EE_ORIGIN_TXTIME 6
+#endif
+
+// linux/net_tstamp.h values; spelled out so older kernel headers still build
+static const uint32_t kTsTxSoftware = 1u << 1;     // SOF_TIMESTAMPING_TX_SOFTWARE
+static const uint32_t kTsSoftware = 1u << 4;       // SOF_TIMESTAMPING_SOFTWARE
+static const uint32_t kTsOptTsOnly = 1u << 11;     // SOF_TIMESTAMPING_OPT_TSONLY
+static const uint32_t kTxTimeReportErrors = 1u << 1;   // SOF_TXTIME_REPORT_ERRORS
+
+struct TxTimeConfig {           // struct sock_txtime
+    int32_t clockid;
+    uint32_t flags;
+};
+
+static const size_t kCmsgSpace = CMSG_SPACE(sizeof(uint16_t)) +
+                                 CMSG_SPACE(sizeof(uint64_t)) +
+                                 CMSG_SPACE(sizeof(uint32_t));
+struct CmsgBuf {
+    alignas(struct cmsghdr) char data[kCmsgSpace];
+};
+
+// Attach GSO size, launch time and/or a timestamp request to one message
+static inline void set_cmsgs(struct msghdr& mh, CmsgBuf& buf, uint16_t gsoSize,
+                             const SendOpts* opts, bool stamp) {
+    const bool txtime = opts && opts->txtimeNs;
+    size_t len = (gsoSize ? CMSG_SPACE(sizeof(uint16_t)) : 0) +
+                 (txtime ? CMSG_SPACE(sizeof(uint64_t)) : 0) +
+                 (stamp ? CMSG_SPACE(sizeof(uint32_t)) : 0);
+    if (!len) return;
+    std::memset(buf.data, 0, len);
+    mh.msg_control = buf.data;
+    mh.msg_controllen = len;
+
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+    auto put = [&](int level, int type, const void* data, size_t n) {
+        cm->cmsg_level = level;
+        cm->cmsg_type = type;
+        cm->cmsg_len = CMSG_LEN(n);
+        std::memcpy(CMSG_DATA(cm), data, n);
+        cm = CMSG_NXTHDR(&mh, cm);
+    };
+    if (gsoSize) put(SOL_UDP, UDP_SEGMENT, &gsoSize, sizeof(gsoSize));
+    if (txtime) put(SOL_SOCKET, SCM_TXTIME, &opts->txtimeNs, sizeof(opts->txtimeNs));
+    if (stamp) put(SOL_SOCKET, SO_TIMESTAMPING, &kTsTxSoftware, sizeof(kTsTxSoftware));
+}
+
+static inline void send_datagrams(sock_t s, io_buf* iov, const PacketSpan* pkts,
+                                  size_t npkts, SendCounts& out,
+                                  const SendOpts* opts = nullptr) {
+    // sendmmsg() takes at most UIO_MAXIOV messages per call
+    const size_t kMaxMsgs = 1024;
+    struct mmsghdr msgs[64];
+    CmsgBuf ctrl[64];
+    const size_t kChunk = std::min(kMaxMsgs, sizeof(msgs) / sizeof(msgs[0]));
+
+    size_t done = 0;
+    while (done < npkts) {
+        size_t n = std::min(npkts - done, kChunk);
+        for (size_t i = 0; i < n; ++i) {
+            const PacketSpan& p = pkts[done + i];
+            std::memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[p.first];
+            msgs[i].msg_hdr.msg_iovlen = p.count;
+            set_cmsgs(msgs[i].msg_hdr, ctrl[i], 0, opts,
+                      opts && opts->txStamp && done + i == 0);
+        }
+
+        int r = sendmmsg(s, msgs, static_cast<unsigned>(n), 0);
+        ++out.nCalls;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            // The first message failed (e.g. ECONNREFUSED from an earlier
+            //  ICMP unreachable); count it and carry on with the rest.
+            out.error = std::string("sendmmsg: ") + strerror(errno);
+            ++out.nErr;
+            ++done;
+            continue;
+        }
+        out.nOk += static_cast<uint32_t>(r);
+        done += static_cast<size_t>(r);
+    }
+}
+
+#elif defined(_WIN32)
+
+static inline void send_datagrams(sock_t s, io_buf* iov, const PacketSpan* pkts,
+                                  size_t npkts, SendCounts& out,
+                                  const SendOpts* = nullptr) {
+    for (size_t i = 0; i < npkts; ++i) {
+        DWORD sent = 0;
+        ++out.nCalls;
+        if (WSASend(s, &iov[pkts[i].first], static_cast<DWORD>(pkts[i].count),
+                    &sent, 0, NULL, NULL) != 0) {
+            out.error = "WSASend: " + last_sock_error();
+            ++out.nErr;
+        } else {
+            ++out.nOk;
+        }
+    }
+}
+
+#else
+
+static inline void send_datagrams(sock_t s, io_buf* iov, const PacketSpan* pkts,
+                                  size_t npkts, SendCounts& out,
+                                  const SendOpts* = nullptr) {
+    for (size_t i = 0; i < npkts; ++i) {
+        struct msghdr mh{};
+        mh.msg_iov = &iov[pkts[i].first];
+        mh.msg_iovlen = static_cast<int>(pkts[i].count);
+        ssize_t r;
+        do {
+            r = sendmsg(s, &mh, 0);
+            ++out.nCalls;
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            out.error = std::string("sendmsg: ") + strerror(errno);
+            ++out.nErr;
+        } else {
+            ++out.nOk;
+        }
+    }
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Send a list of datagrams on an unconnected socket, datagram i to
+// dests[i] (IPv4, host order) on `port`.  No GSO: the runs would have to
+// share a destination, and multicast batches are one datagram per group.
+// ---------------------------------------------------------------------------
+static inline void send_datagrams_to(sock_t s, io_buf* iov, const PacketSpan* pkts,
+                                     const uint32_t* dests, size_t npkts, int port,
+                                     SendCounts& out) {
+#if defined(__linux__)
+    struct mmsghdr msgs[64];
+    struct sockaddr_in addrs[64];
+    const size_t kChunk = sizeof(msgs) / sizeof(msgs[0]);
+
+    size_t done = 0;
+    while (done < npkts) {
+        size_t n = std::min(npkts - done, kChunk);
+        for (size_t i = 0; i < n; ++i) {
+            const PacketSpan& p = pkts[done + i];
+            addrs[i] = ipv4_sockaddr(dests[done + i], port);
+            std::memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[p.first];
+            msgs[i].msg_hdr.msg_iovlen = p.count;
+        }
+        int r = sendmmsg(s, msgs, static_cast<unsigned>(n), 0);
+        ++out.nCalls;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            out.error = std::string("sendmmsg: ") + strerror(errno);
+            ++out.nErr;
+            ++done;
+            continue;
+        }
+        out.nOk += static_cast<uint32_t>(r);
+        done += static_cast<size_t>(r);
+    }
+#elif defined(_WIN32)
+    for (size_t i = 0; i < npkts; ++i) {
+        struct sockaddr_in sa = ipv4_sockaddr(dests[i], port);
+        DWORD sent = 0;
+        ++out.nCalls;
+        if (WSASendTo(s, &iov[pkts[i].first], static_cast<DWORD>(pkts[i].count), &sent, 0,
+                      reinterpret_cast<const sockaddr*>(&sa), sizeof(sa), NULL, NULL) != 0) {
+            out.error = "WSASendTo: " + last_sock_error();
+            ++out.nErr;
+        } else {
+            ++out.nOk;
+        }
+    }
+#else
+    for (size_t i = 0; i < npkts; ++i) {
+        struct sockaddr_in sa = ipv4_sockaddr(dests[i], port);
+        struct msghdr mh{};
+        mh.msg_name = &sa;
+        mh.msg_namelen = sizeof(sa);
+        mh.msg_iov = &iov[pkts[i].first];
+        mh.msg_iovlen = static_cast<int>(pkts[i].count);
+        ssize_t r;
+        do {
+            r = sendmsg(s, &mh, 0);
+            ++out.nCalls;
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            out.error = std::string("sendmsg: ") + strerror(errno);
+            ++out.nErr;
+        } else {
+            ++out.nOk;
+        }
+    }
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Segmentation offload
+// ---------------------------------------------------------------------------
+// Per-socket send path.  gso is turned on by open_send_path() when the
+// kernel knows UDP_SEGMENT, and turned off for good the first time a GSO
+// send is refused (e.g. EIO from a NIC without checksum offload); the
+// refused datagrams are then resent one by one.
+struct SendPath {
+    bool gso = false;
+    bool txtime = false;   // SO_TXTIME accepted; see enable_txtime()
+    bool zerocopy = false; // SO_ZEROCOPY accepted; see enable_zerocopy()
+};
+
+#if defined(__linux__)
+
+#ifndef SO_ZEROCOPY
+  #define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+  #define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+  #define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+  #define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+static const size_t kGsoMaxSegs = 64;        // UDP_MAX_SEGMENTS on older kernels
+static const size_t kGsoMaxBytes = 65507;    // one IPv4 UDP datagram
+static const size_t kGsoMaxIov = 1024;       // UIO_MAXIOV
+
+static inline SendPath open_send_path(sock_t s, bool allowGso) {
+    SendPath p;
+    if (allowGso) {
+        int v = 0;
+        socklen_t l = sizeof(v);
+        p.gso = getsockopt(s, SOL_UDP, UDP_SEGMENT, &v, &l) == 0;
+    }
+    return p;
+}
+
+static inline bool gso_refused(int err) {
+    return err == EIO || err == EINVAL || err == ENOPROTOOPT || err == EOPNOTSUPP;
+}
+
+// One GSO message: datagrams pkts[first .. first+nSegs), gathered from
+// niov consecutive iov entries, segSize bytes each (the last may be shorter)
+struct GsoRun {
+    size_t first;
+    size_t nSegs;
+    size_t niov;
+    size_t segSize;
+};
+
+// Cut the run starting at pkts[i]: equal-sized datagrams, contiguous in iov,
+//  optionally ended by one shorter datagram (the tail of a controller's
+//  range or a DDP push packet).
+static inline GsoRun next_gso_run(const io_buf* iov, const PacketSpan* pkts, size_t npkts, size_t i) {
+    const size_t seg = span_bytes(iov, pkts[i]);
+    size_t j = i, bytes = 0, niov = 0;
+    while (j < npkts && j - i < kGsoMaxSegs && seg > 0) {
+        const size_t len = span_bytes(iov, pkts[j]);
+        if (len > seg || bytes + len > kGsoMaxBytes ||
+            niov + pkts[j].count > kGsoMaxIov) break;
+        if (j > i && pkts[j].first != pkts[j - 1].first + pkts[j - 1].count) break;
+        bytes += len;
+        niov += pkts[j].count;
+        ++j;
+        if (len < seg) break;
+    }
+    if (j == i) {
+        niov = pkts[i].count;
+        j = i + 1;
+    }
+    return GsoRun{i, j - i, niov, seg};
+}
+
+static inline void send_batch(sock_t s, SendPath& path, io_buf* iov,
+                              const PacketSpan* pkts, size_t npkts, SendCounts& out,
+                              const SendOpts* opts = nullptr) {
+    if (!path.gso) {
+        send_datagrams(s, iov, pkts, npkts, out, opts);
+        return;
+    }
+
+    const size_t kMsgs = 32;
+    struct mmsghdr msgs[kMsgs];
+    CmsgBuf ctrl[kMsgs];
+    size_t firstPkt[kMsgs];
+    size_t nSegs[kMsgs];
+
+    size_t i = 0;
+    while (i < npkts) {
+        size_t m = 0;
+        while (m < kMsgs && i < npkts) {
+            const GsoRun run = next_gso_run(iov, pkts, npkts, i);
+            std::memset(&msgs[m], 0, sizeof(msgs[m]));
+            msgs[m].msg_hdr.msg_iov = &iov[pkts[i].first];
+            msgs[m].msg_hdr.msg_iovlen = run.niov;
+            set_cmsgs(msgs[m].msg_hdr, ctrl[m], run.nSegs > 1 ? static_cast<uint16_t>(run.segSize) : 0,
+                      opts, opts && opts->txStamp && i == 0);
+            firstPkt[m] = i;
+            nSegs[m] = run.nSegs;
+            ++m;
+            i += run.nSegs;
+        }
+
+        size_t sent = 0;
+        while (sent < m) {
+            // Zerocopy only here, where messages are GSO runs of up to 64K;
+            //  for single datagrams the page pinning costs more than the copy
+            const int flags = path.zerocopy ? MSG_ZEROCOPY : 0;
+            int r = sendmmsg(s, msgs + sent, static_cast<unsigned>(m - sent), flags);
+            ++out.nCalls;
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                if (flags && errno == ENOBUFS) {
+                    // Out of pinnable memory (optmem / memlock); copy from now on
+                    path.zerocopy = false;
+                    continue;
+                }
+                if (nSegs[sent] > 1 && gso_refused(errno)) {
+                    path.gso = false;
+                    SendOpts rest;
+                    if (opts) {
+                        rest = *opts;
+                        rest.txStamp = rest.txStamp && firstPkt[sent] == 0;
+                    }
+                    send_datagrams(s, iov, pkts + firstPkt[sent], npkts - firstPkt[sent], out,
+                                   opts ? &rest : nullptr);
+                    return;
+                }
+                out.error = std::string("sendmmsg: ") + strerror(errno);
+                out.nErr += static_cast<uint32_t>(nSegs[sent]);
+                ++sent;
+                continue;
+            }
+            for (size_t k = sent; k < sent + static_cast<size_t>(r); ++k) {
+                out.nOk += static_cast<uint32_t>(nSegs[k]);
+                if (nSegs[k] > 1) ++out.nGso;
+            }
+            if (flags) out.nZc += static_cast<uint32_t>(r);
+            sent += static_cast<size_t>(r);
+        }
+    }
+}
+
+#else
+
+static inline SendPath open_send_path(sock_t, bool) {
+    return SendPath();
+}
+
+static inline void send_batch(sock_t s, SendPath&, io_buf* iov,
+                              const PacketSpan* pkts, size_t npkts, SendCounts& out,
+                              const SendOpts* = nullptr) {
+    send_datagrams(s, iov, pkts, npkts, out);
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Zerocopy completions
+// ---------------------------------------------------------------------------
+// The kernel numbers a socket's zerocopy sends 0, 1, 2, ... (wrapping) and
+// reports finished ranges [lo, hi] on the error queue, usually in order.
+struct ZeroCopyTracker {
+    uint32_t next = 0;                    // id of the next zerocopy send
+    uint32_t done = 0;                    // every id before this has completed
+    std::map<uint32_t, uint32_t> early;   // completed ahead of `done`: lo -> hi
+    uint32_t copied = 0;                  // completions where the kernel copied after all
+
+    bool pending() const { return next != done; }
+    // True once all sends before id `end` have completed
+    bool completed(uint32_t end) const { return static_cast<int32_t>(done - end) >= 0; }
+
+    void complete(uint32_t lo, uint32_t hi) {
+        early[lo] = hi;
+        for (auto it = early.find(done); it != early.end(); it = early.find(done)) {
+            done = it->second + 1;
+            early.erase(it);
+        }
+    }
+};
+
+#if defined(__linux__)
+
+static inline bool enable_zerocopy(sock_t s, SendPath& path) {
+    int one = 1;
+    path.zerocopy = setsockopt(s, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    return path.zerocopy;
+}
+
+// Drain zerocopy completions from the socket's error queue
+static inline void read_zerocopy_completions(sock_t s, ZeroCopyTracker& zc) {
+    alignas(struct cmsghdr) char ctrl[256];
+    for (int guard = 0; guard < 4096; ++guard) {
+        struct msghdr mh{};
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+        if (recvmsg(s, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+            struct sock_extended_err ee;
+            std::memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee.ee_errno != 0) continue;
+            // Copied: the device can't send from user pages (e.g. loopback)
+            if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) ++zc.copied;
+            zc.complete(ee.ee_info, ee.ee_data);
+        }
+    }
+}
+
+#else
+
+static inline bool enable_zerocopy(sock_t, SendPath&) {
+    return false;
+}
+
+static inline void read_zerocopy_completions(sock_t, ZeroCopyTracker&) {}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Launch times and TX timestamps
+// ---------------------------------------------------------------------------
+// Launch times are only honoured by a time-aware qdisc on the outgoing
+// interface (fq, or etf with CLOCK_TAI); with anything else the packets
+// go out as soon as they are queued.  The TX timestamps tell which.
+struct TxReport {
+    uint32_t stamps = 0;
+    int64_t lastStampNs = 0;   // newest software TX timestamp, CLOCK_REALTIME
+    uint32_t drops = 0;        // datagrams dropped for missing their launch time
+};
+
+#if defined(__linux__)
+
+static inline bool enable_txtime(sock_t s, SendPath& path) {
+    TxTimeConfig cfg{CLOCK_MONOTONIC, kTxTimeReportErrors};
+    if (setsockopt(s, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) != 0) return false;
+    // Reporting flags are per socket; the TX stamp itself is requested per batch
+    uint32_t tsf = kTsSoftware | kTsOptTsOnly;
+    setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &tsf, sizeof(tsf));
+    path.txtime = true;
+    return true;
+}
+
+// Drain the socket's error queue: TX timestamps and launch-time drops
+static inline void read_tx_reports(sock_t s, TxReport& r) {
+    alignas(struct cmsghdr) char ctrl[512];
+    char data[64];
+    for (int guard = 0; guard < 4096; ++guard) {
+        struct iovec iv{data, sizeof(data)};
+        struct msghdr mh{};
+        mh.msg_iov = &iv;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+        if (recvmsg(s, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+                struct timespec ts;   // [0] software, [2] hardware
+                std::memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+                if (ts.tv_sec || ts.tv_nsec) {
+                    ++r.stamps;
+                    r.lastStampNs = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+                }
+            } else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                       (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                struct sock_extended_err ee;
+                std::memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+                if (ee.ee_origin == SO_EE_ORIGIN_TXTIME) ++r.drops;
+            }
+        }
+    }
+}
+
+// CLOCK_REALTIME - CLOCK_MONOTONIC, to put TX timestamps on the send clock
+static inline int64_t realtime_offset_ns() {
+    struct timespec rt, mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &rt);
+    return (static_cast<int64_t>(rt.tv_sec) - mono.tv_sec) * 1000000000LL +
+           (rt.tv_nsec - mono.tv_nsec);
+}
+
+#else
+
+static inline bool enable_txtime(sock_t, SendPath&) {
+    return false;
+}
+
+static inline void read_tx_reports(sock_t, TxReport&) {}
+
+static inline int64_t realtime_offset_ns() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,194 @@
+// udp-batch/uring.h — A minimal io_uring for batched sendmsg().
+//
+// Used by the udp_batch sender thread to put the messages of many
+// controllers' batches into one submission and reap their completions
+// together, rather than one sendmmsg() per controller.  Raw syscalls, no
+// liburing.  Everything here is plain C++ and is used from one thread.
+//
+// io_uring can be missing (kernel < 5.6 for SENDMSG) or disabled (seccomp,
+// io_uring_disabled sysctl, some containers); init() then fails and the
+// caller keeps using sendmmsg().
+#pragma once
+
+#if defined(__linux__) && defined(__has_include)
+  #if __has_include(<linux/io_uring.h>)
+    #define UDP_HAVE_URING 1
+  #endif
+#endif
+
+#if defined(UDP_HAVE_URING)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+class UdpUring {
+public:
+    UdpUring() {}
+    UdpUring(const UdpUring&) = delete;
+    UdpUring& operator=(const UdpUring&) = delete;
+    ~UdpUring() { close(); }
+
+    bool ready() const { return fd_ >= 0; }
+    unsigned inFlight() const { return inFlight_; }
+
+    bool init(unsigned entries, std::string& error) {
+        struct io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0) {
+            error = std::string("io_uring_setup: ") + strerror(errno);
+            return false;
+        }
+        fd_ = fd;
+
+        sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && cqRingSize_ > sqRingSize_) sqRingSize_ = cqRingSize_;
+
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            sqRing_ = nullptr;
+            return fail("mmap sq", error);
+        }
+        if (single) {
+            cqRing_ = sqRing_;
+        } else {
+            cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd_, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED) {
+                cqRing_ = nullptr;
+                return fail("mmap cq", error);
+            }
+        }
+        sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return fail("mmap sqes", error);
+        sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sqRing_);
+        sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sqEntries_ = p.sq_entries;
+        sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        char* cq = static_cast<char*>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+        cqEntries_ = p.cq_entries;
+        localTail_ = *sqTail_;
+        return true;
+    }
+
+    void close() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+        if (sqRing_) munmap(sqRing_, sqRingSize_);
+        if (fd_ >= 0) ::close(fd_);
+        sqes_ = nullptr;
+        sqRing_ = cqRing_ = nullptr;
+        fd_ = -1;
+        inFlight_ = 0;
+    }
+
+    // Room for another sendmsg before wait_all() must be called
+    bool full() const {
+        return localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_ ||
+               inFlight_ >= cqEntries_;
+    }
+
+    // Queue a sendmsg; `mh` and everything it points at must stay valid until
+    //  its completion is reaped.  Returns false if full().
+    bool sendmsg(int sock, const struct msghdr* mh, uint64_t userData) {
+        if (full()) return false;
+        const unsigned idx = localTail_ & sqMask_;
+        struct io_uring_sqe* sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = reinterpret_cast<uint64_t>(mh);
+        sqe->len = 1;
+        sqe->user_data = userData;
+        sqArray_[idx] = idx;
+        ++localTail_;
+        __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+        ++inFlight_;
+        return true;
+    }
+
+    // Submit what is queued and wait for every completion; onCqe(userData, res)
+    //  is called for each, res being bytes sent or -errno.  False if the ring
+    //  failed: it is closed, and entries without a completion never will have one.
+    template <typename F>
+    bool wait_all(F&& onCqe, unsigned& calls) {
+        while (inFlight_) {
+            const unsigned toSubmit = localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+            const unsigned ready = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) - *cqHead_;
+            if (toSubmit || ready < inFlight_) {
+                int r = static_cast<int>(syscall(__NR_io_uring_enter, fd_, toSubmit, inFlight_ - ready,
+                                                 IORING_ENTER_GETEVENTS, nullptr, 0));
+                ++calls;
+                if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    reap(onCqe);
+                    close();
+                    return false;
+                }
+            }
+            reap(onCqe);
+        }
+        return true;
+    }
+
+private:
+    bool fail(const char* what, std::string& error) {
+        error = std::string(what) + ": " + strerror(errno);
+        close();
+        return false;
+    }
+
+    template <typename F>
+    void reap(F&& onCqe) {
+        unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const struct io_uring_cqe& cqe = cqes_[head & cqMask_];
+            onCqe(cqe.user_data, cqe.res);
+            ++head;
+            --inFlight_;
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+
+    int fd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    size_t sqesSize_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    unsigned cqEntries_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+    unsigned localTail_ = 0;
+    unsigned inFlight_ = 0;
+};
+
+#endif
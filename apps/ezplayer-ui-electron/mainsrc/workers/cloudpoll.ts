@@ -27,7 +27,7 @@ import {
 } from '@ezplayer/ezplayer-core';
 import type { CloudPollInMessage, CloudPollOutMessage, CloudWorkerTuning } from './cloudpolltypes';
 import { collectReferencedAssets } from '../data/layoutAssets.js';
-import { FSEQReaderAsync } from '@ezplayer/epp';
+import { readFSEQHeaderFast } from '../fseq-map/fseqmap.js';
 import { trustSystemCAs } from '../trustSystemCAs.js';
 
 // Trust the OS cert store before any cloud fetch in this worker.
@@ -1137,7 +1137,7 @@ async function buildSequenceRecord(
         const fseqPath = installed.fseq?.absPath ?? existing?.files?.fseq;
         if (fseqPath) {
             try {
-                const fhdr = await FSEQReaderAsync.readFSEQHeaderAsync(fseqPath);
+                const fhdr = await readFSEQHeaderFast(fseqPath);
                 length = (fhdr.frames * fhdr.msperframe) / 1000;
             } catch (e) {
                 log('warn', `fseq length compute failed for ${fseqPath}: ${(e as Error).message}`);
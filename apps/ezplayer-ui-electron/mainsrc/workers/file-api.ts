@@ -29,7 +29,7 @@ import fsp from 'fs/promises';
 import * as crypto from 'crypto';
 import type { IncomingMessage } from 'http';
 import { send } from '@koa/send';
-import { FSEQReaderAsync } from '@ezplayer/epp';
+import { readFSEQHeaderFast } from '../fseq-map/fseqmap.js';
 import type { SequenceRecord } from '@ezplayer/ezplayer-core';
 import { autoDetectSongFilesFromFseq, extractAudioTagMetadata } from '../data/song-file-autodetect.js';
 import { fileBaseName } from './pathnames.js';
@@ -349,11 +349,8 @@ export function createFileApiRouter(deps: FileApiDeps): Router {
         }
         if (path.extname(lower) === '.fseq') {
             try {
-                const rdr = new FSEQReaderAsync(path.join(showFolder, name));
-                await rdr.open();
-                const secs = ((rdr.header!.msperframe ?? 50) * (rdr.header!.frames ?? 0)) / 1000;
-                await rdr.close();
-                return secs;
+                const header = await readFSEQHeaderFast(path.join(showFolder, name));
+                return ((header.msperframe ?? 50) * (header.frames ?? 0)) / 1000;
             } catch {
                 return undefined;
             }
@@ -1,18 +1,23 @@
 import {
+    atomicSleep,
     busySleep,
+    ChannelMask,
     endBatch,
     endFrame,
     FrameReference,
+    jsRemapKernel,
+    RemapKernel,
     SendBatch,
     sendFull,
     SendJob,
     SendJobState,
     startBatch,
-    startFrame,
 } from '@ezplayer/epp';
 import { LatestFrameRingBuffer, PlaybackStatistics } from '@ezplayer/ezplayer-core';
 import { snapshotAsyncCounts } from './perfmon';
-import { maxUint8 } from '../processing/blend';
+import { FrameCompositor, type CompositeLayer } from '../processing/compose';
+import { jsLutKernel, type DimmingPlan, type LutKernel } from '../processing/dimming';
+import type { EngineFrameStats, OutputEngine } from '../output-engine/outputengine';
 
 ////////
 // Sleep utilities
@@ -64,6 +69,25 @@ export function resetFrameSendStats(stats: OverallFrameSendStats, pn: number) {
     stats.totalMixTime = 0;
 }
 
+/** A frame to composite, and how (see FrameCompositor) */
+export interface FrameLayer {
+    ref: FrameReference | undefined;
+    layer: CompositeLayer;
+}
+
+/**
+ * Buffers one frame is built in: the mix, the expanded compact frame, the dimmed frame and the
+ *  remapped controllers' buffers.  A set is not reused until the frame's batch completes, as
+ *  MSG_ZEROCOPY sends read the packets after the send call has returned.
+ */
+interface ScratchFrames {
+    mix?: Uint8Array;
+    mask?: Uint8Array;
+    dim?: Uint8Array;
+    dataBuffers: Uint8Array[]; // The job's: the frame, then the remapped controllers' buffers
+    inUse: boolean;
+}
+
 export interface ControllerSendStats {
     nSends: number;
     nPackets: number;
@@ -82,13 +106,92 @@ export class FrameSender {
      *  leave the wire untouched so another player can drive the controllers. */
     blackFramesEnabled: boolean = true;
     blackFrame: Uint8Array | undefined = undefined;
-    mixFrame: Uint8Array | undefined = undefined;
+    /** Composite layered frames, into a frame of nChannels */
+    mixLayers: boolean = false;
+    /** Composites layered frames (set its kernel to the native one if loaded) */
+    readonly compositor = new FrameCompositor();
+    /** Set when the prefetcher decodes compact frames (see FSeqPrefetchCache.setChannelMask);
+     *  they are expanded into a frame that is zero outside the mask before sending */
+    channelMask: ChannelMask | undefined = undefined;
+    /** Output dimming (model curves and master dimmer), applied last; see compileDimming */
+    dimming: DimmingPlan | undefined = undefined;
+    lutKernel: LutKernel = jsLutKernel;
+    /** Fills the buffers of controllers with their own color order (job.remaps) from each frame */
+    remapKernel: RemapKernel = jsRemapKernel;
+    private scratch: ScratchFrames[] = [];
     exportBuffer: LatestFrameRingBuffer | undefined = undefined;
     emitWarning?: (msg: string) => void;
     emitError?: (err: Error) => void;
     private warnedShortFrame = false;
     private warnedLongFrame = false;
 
+    /** Native output engine; if set (with exportBuffer), frames are published to the
+     *  ring ahead of time and the engine puts them on the wire at targetFramePN. */
+    outputEngine: OutputEngine | undefined = undefined;
+    /** How far ahead of the due time frames are published for the engine */
+    engineLeadMs: number = 20;
+    private engineStatsTarget?: { playbackStats?: PlaybackStatistics; playbackStatsAgg?: OverallFrameSendStats };
+    private lastEngineError?: string;
+
+    /** Send every packet of the next frame, even with change detection (e.g. at sequence start) */
+    forceFullFrame() {
+        if (this.job) this.job.fullFrame = true;
+    }
+
+    private get engine() {
+        return this.exportBuffer ? this.outputEngine : undefined;
+    }
+
+    /** Stats callback for the output engine; one call per scheduled frame */
+    onEngineStats(s: EngineFrameStats) {
+        const ps = this.engineStatsTarget?.playbackStats;
+        const agg = this.engineStatsTarget?.playbackStatsAgg;
+        if (s.error && s.error !== this.lastEngineError) {
+            this.emitWarning?.(`Send error for ${s.error}`);
+        }
+        this.lastEngineError = s.error;
+        if (!ps) return;
+        if (s.txSamples || s.txDrops) {
+            if (!ps.txTime) {
+                ps.txTime = {
+                    samplesCumulative: 0,
+                    avgDeltaMs: 0,
+                    worstLateHistorical: 0,
+                    worstEarlyHistorical: 0,
+                    droppedCumulative: 0,
+                };
+            }
+            const tx = ps.txTime;
+            if (s.txSamples) {
+                const n = tx.samplesCumulative + s.txSamples;
+                tx.avgDeltaMs = (tx.avgDeltaMs * tx.samplesCumulative + (s.txDeltaSumMs ?? 0)) / n;
+                tx.samplesCumulative = n;
+                tx.worstLateHistorical = Math.max(tx.worstLateHistorical, s.txDeltaMaxMs ?? 0);
+                tx.worstEarlyHistorical = Math.max(tx.worstEarlyHistorical, -(s.txDeltaMinMs ?? 0));
+            }
+            tx.droppedCumulative += s.txDrops ?? 0;
+        }
+        if (s.dropped === 'late') {
+            ++ps.skippedFramesCumulative;
+            return;
+        } else if (s.dropped === 'overrun') {
+            ++ps.framesSkippedDueToManyOutstandingFramesCumulative;
+            return;
+        }
+        if (s.lateMs < 0) {
+            ps.worstAdvanceHistorical = Math.max(ps.worstAdvanceHistorical, -s.lateMs);
+        } else {
+            ps.worstLagHistorical = Math.max(ps.worstLagHistorical, s.lateMs);
+        }
+        ps.maxSendTimeHistorical = Math.max(s.sendMs, ps.maxSendTimeHistorical);
+        ps.cframesSkippedDueToDirectiveCumulative += s.skippedControllers;
+        ++ps.sentFramesCumulative;
+        if (agg) {
+            agg.totalSendTime += s.sendMs;
+            ++agg.nSends;
+        }
+    }
+
     async sendBlackFrame(args: {
         targetFramePN: number;
         playbackStats?: PlaybackStatistics;
@@ -96,16 +199,52 @@ export class FrameSender {
     }) {
         if (!this.blackFramesEnabled) return;
         if (!this.blackFrame || !this.job || !this.state) return;
+        const engine = this.engine;
+        if (engine) {
+            this.engineStatsTarget = args;
+            const seq = this.exportBuffer!.publishFrom(this.blackFrame.subarray(0, this.nChannels));
+            engine.schedule(seq, Math.max(args.targetFramePN, performance.now()));
+            return;
+        }
         this.releasePrevFrame();
-        this.job!.dataBuffers = [this.blackFrame];
+        const scratch = this.takeScratch();
+        this.setJobFrame(this.job, this.blackFrame, scratch);
         this.state.initialize(args.targetFramePN, this.job);
-        await this.doSendFrame({ ...args, frame: undefined });
+        // Nothing follows a black frame to be late for
+        await this.doSendFrame({ ...args, frame: undefined }, scratch, Infinity);
+    }
+
+    // A set of scratch frames not in flight
+    private takeScratch() {
+        let s = this.scratch.find((s) => !s.inUse);
+        if (!s) {
+            s = { dataBuffers: [], inUse: false };
+            this.scratch.push(s);
+        }
+        s.inUse = true;
+        return s;
+    }
+
+    // The frame, then each remapped controller's buffer filled from it; nothing is allocated per frame
+    private setJobFrame(job: SendJob, frame: Uint8Array, scratch: ScratchFrames) {
+        const bufs = scratch.dataBuffers;
+        bufs[0] = frame;
+        for (let i = 0; i < job.remaps.length; ++i) {
+            const r = job.remaps[i];
+            let out = bufs[i + 1];
+            if (out?.length !== r.out.length) out = bufs[i + 1] = new Uint8Array(r.out.length);
+            if (frame.length >= r.srcStart + r.srcLen) this.remapKernel.remap(out, frame, r.ops);
+            else out.fill(0); // Short frame; the controller goes dark rather than stale
+        }
+        bufs.length = 1 + job.remaps.length;
+        job.dataBuffers = bufs;
     }
 
     /** Return: ms of frame advance */
     async sendNextFrameAt(args: {
         frame: FrameReference | undefined;
-        bframe: FrameReference | undefined;
+        /** The whole stack, bottom first, including `frame`; without other frames, frame is sent as is */
+        layers?: FrameLayer[];
         targetFramePN: number;
         targetFrameNum: number;
         playbackStats: PlaybackStatistics;
@@ -114,6 +253,8 @@ export class FrameSender {
         skipFrameIfLateByMoreThan: number;
         dontSleepIfDurationLessThan: number;
     }): Promise<number> {
+        const main = args.frame;
+        let scratch: ScratchFrames | undefined;
         try {
             if (args.frame?.frame && this.state && this.job) {
             } else {
@@ -130,6 +271,9 @@ export class FrameSender {
                 return 0;
             }
 
+            // With the output engine, the frame only has to be in the ring before it is due
+            const engine = this.engine;
+            const publishLead = engine ? Math.min(this.engineLeadMs, args.frameInterval) : 0;
             const sleep = args.targetFramePN - preSleepPN;
             if (sleep < -args.skipFrameIfLateByMoreThan) {
                 ++args.playbackStats.skippedFramesCumulative;
@@ -137,15 +281,20 @@ export class FrameSender {
                 return args.frameInterval;
             }
 
-            if (sleep > args.dontSleepIfDurationLessThan) {
-                args.playbackStatsAgg.totalIdleTime += sleep;
+            if (sleep - publishLead > args.dontSleepIfDurationLessThan) {
+                args.playbackStatsAgg.totalIdleTime += sleep - publishLead;
                 //await sleepms(sleep);
-                await xbusySleep(args.targetFramePN, this.emitWarning);
+                // The engine does the precise timing; no need to spin for it
+                if (engine) await atomicSleep(args.targetFramePN - publishLead);
+                else await xbusySleep(args.targetFramePN - publishLead, this.emitWarning);
             }
 
             const nowTime = performance.now();
 
-            if (nowTime < args.targetFramePN) {
+            if (engine) {
+                // Wire timing is reported by the engine (onEngineStats)
+                this.engineStatsTarget = args;
+            } else if (nowTime < args.targetFramePN) {
                 args.playbackStats.worstAdvanceHistorical = Math.max(
                     args.playbackStats.worstAdvanceHistorical,
                     args.targetFramePN - nowTime,
@@ -160,15 +309,38 @@ export class FrameSender {
             // Actually send the frame
             if (args.frame?.frame && this.state && this.job) {
                 this.job.frameNumber = args.targetFrameNum;
-                if (this.mixFrame && args.bframe?.frame && args.frame?.frame) {
-                    const preMax = performance.now();
-                    maxUint8(this.mixFrame, args.frame.frame, args.bframe.frame);
-                    const mixTime = performance.now() - preMax;
+                let frame = args.frame.frame;
+                const layers = args.layers;
+                scratch = this.takeScratch();
+                if (this.mixLayers && layers?.some((l) => l.ref !== args.frame && l.ref?.frame)) {
+                    const preMix = performance.now();
+                    if (scratch.mix?.length !== this.nChannels) scratch.mix = new Uint8Array(this.nChannels);
+                    this.compositor.compose(
+                        scratch.mix,
+                        layers.map((l) => l.layer),
+                        layers.map((l) => l.ref?.frame),
+                        this.channelMask,
+                    );
+                    const mixTime = performance.now() - preMix;
                     args.playbackStatsAgg.totalMixTime += mixTime;
-                    this.job.dataBuffers = [this.mixFrame];
-                } else {
-                    this.job.dataBuffers = [args.frame.frame];
+                    frame = scratch.mix;
+                }
+                if (this.channelMask) {
+                    if (scratch.mask?.length !== this.nChannels) scratch.mask = new Uint8Array(this.nChannels);
+                    this.channelMask.expand(frame, scratch.mask);
+                    frame = scratch.mask;
                 }
+                if (this.dimming) {
+                    // Frames from the cache may be handed out again, so those are not changed in place
+                    let dst = frame;
+                    if (frame !== scratch.mix && frame !== scratch.mask) {
+                        if (scratch.dim?.length !== frame.length) scratch.dim = new Uint8Array(frame.length);
+                        dst = scratch.dim;
+                    }
+                    this.lutKernel.applyLuts(dst, frame, this.dimming.luts, this.dimming.ops);
+                    frame = dst;
+                }
+                this.setJobFrame(this.job, frame, scratch);
 
                 // Export frame
                 if (this.exportBuffer) {
@@ -187,7 +359,11 @@ export class FrameSender {
                                 `src=${srcLen} nChannels=${this.nChannels}`,
                         );
                     }
-                    this.exportBuffer.publishFrom(this.job.dataBuffers[0].slice(0, this.nChannels));
+                    const seq = this.exportBuffer.publishFrom(this.job.dataBuffers[0].subarray(0, this.nChannels));
+                    if (engine) {
+                        engine.schedule(seq, args.targetFramePN);
+                        return args.frameInterval;
+                    }
                 }
 
                 const res = this.state.initialize(args.targetFramePN, this.job);
@@ -199,27 +375,33 @@ export class FrameSender {
                 } else if (this.outstandingFrames.size > 10) {
                     ++args.playbackStats.framesSkippedDueToManyOutstandingFramesCumulative;
                 } else {
-                    await this.doSendFrame(args);
+                    await this.doSendFrame(args, scratch, args.targetFramePN + args.frameInterval);
+                    scratch = undefined; // Given back when the batch completes
                 }
             }
             return args.frameInterval;
         } finally {
+            if (scratch) scratch.inUse = false;
             if (args.frame) {
                 args.frame.release();
                 args.frame = undefined;
             }
-            if (args.bframe) {
-                args.bframe.release();
-                args.bframe = undefined;
+            for (const l of args.layers ?? []) {
+                if (l.ref !== main) l.ref?.release();
             }
+            args.layers = undefined;
         }
     }
 
-    private async doSendFrame(args: {
-        playbackStats?: PlaybackStatistics;
-        playbackStatsAgg?: OverallFrameSendStats;
-        frame: FrameReference | undefined;
-    }) {
+    private async doSendFrame(
+        args: {
+            playbackStats?: PlaybackStatistics;
+            playbackStatsAgg?: OverallFrameSendStats;
+            frame: FrameReference | undefined;
+        },
+        scratch: ScratchFrames,
+        deadline: number, // Paced controllers not done by then drop the rest of the frame
+    ) {
         try {
             const frameref = args.frame;
             if (frameref) {
@@ -227,9 +409,8 @@ export class FrameSender {
                 args.frame = undefined;
             }
             const startSendTime = performance.now();
-            startFrame(this.state);
             startBatch(this.state);
-            await sendFull(this.state, busySleep);
+            await sendFull(this.state, busySleep, deadline);
             const end = endBatch(this.state);
             this.prevSendBatch = end;
             const sendTime = performance.now() - startSendTime;
@@ -240,6 +421,7 @@ export class FrameSender {
                         //sb.sender.suspend();
                     }
                 }
+                scratch.inUse = false;
                 if (frameref) {
                     if (!this.outstandingFrames.has(frameref)) {
                         this.emitWarning?.('FRAME REFERENCE GOT REMOVED ALREADY');
@@ -259,6 +441,7 @@ export class FrameSender {
         } catch (e) {
             const err = e as Error;
             this.emitError?.(err);
+            scratch.inUse = false;
         }
         endFrame(this.state);
     }
@@ -277,7 +460,14 @@ export class FrameSender {
         }
     }
 
+    /** Wait for the last frame's packets to finish going out */
+    async drain() {
+        await Promise.allSettled((this.prevSendBatch ?? []).map((s) => s.promise));
+    }
+
     close() {
+        this.outputEngine?.stop();
+        this.outputEngine = undefined;
         for (const fr of this.outstandingFrames) {
             fr.release();
         }
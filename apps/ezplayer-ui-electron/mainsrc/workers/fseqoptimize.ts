@@ -0,0 +1,211 @@
+import * as path from 'path';
+import { createHash } from 'node:crypto';
+import { promises as fsp } from 'fs';
+
+import {
+    ChannelRange,
+    DecompZlib,
+    DecompZStd,
+    defDecompZlib,
+    FSeqPrefetchCache,
+    measureFSEQSeek,
+    NeededTimePriority,
+    sampleFSEQFrames,
+    transcodeFSEQ,
+} from '@ezplayer/epp';
+
+import { decompressZStdWithWorker } from './zstdparent';
+import { nativeZstd, nativeZstdCompressorFor } from '../zstd-native/zstdnative.js';
+import { nativeScatterKernel } from '../pixel-kernels/pixelkernels';
+
+// Blocks of this long are decoded in a few ms, so a seek costs about one frame
+const BLOCK_MS = 500;
+// How soon to look again at copies that were still being read
+const REMOVE_RETRY_MS = 60000;
+// Trained dictionary size (zstd's own default)
+const DICT_BYTES = 112 * 1024;
+
+// Behind anything playback wants from the decode pool
+const background: NeededTimePriority = { neededTime: Infinity, tier: 3 };
+const decompZstd: DecompZStd = (d, c, off, len, exp) => decompressZStdWithWorker(d, c, off, len, exp, background);
+// zlib blocks go to node's zlib on the libuv pool, which takes no priority
+const decompZlib: DecompZlib = defDecompZlib;
+
+/**
+ * Rewrites the schedule's FSEQ files, one at a time in the background, into copies with short
+ *  blocks (transcodeFSEQ) in `dir`, and has the prefetch cache read those instead.  Copies are
+ *  named for the source's path, modification time and size, and the channel ranges kept, so a
+ *  sequence that is rendered again is rewritten again; copies no longer wanted are removed once
+ *  the queue is done and the cache no longer reads them.  Files whose blocks are already short are used as they are.
+ *  With a dictionary file (setDictionary), the copies are compressed with that zstd dictionary,
+ *  trained from the schedule's files the first time if the file is not there yet.
+ */
+export class FseqOptimizer {
+    private queue: string[] = [];
+    private inUse = new Map<string, string>(); // Source -> copy the cache was pointed at
+    private ranges?: ChannelRange[];
+    private dictFile?: string;
+    private dictId?: number; // Of dictFile, once loaded
+    private dictTried = false;
+    private running?: Promise<void>;
+    private abort = new AbortController();
+    private removeTimer?: NodeJS.Timeout;
+
+    constructor(
+        private dir: string,
+        private cache: FSeqPrefetchCache,
+        private log: (msg: string) => void,
+        private warn: (msg: string) => void,
+    ) {}
+
+    /** Check these files (those the schedule uses), and forget any others */
+    update(files: string[]) {
+        const wanted = new Set(files);
+        for (const src of [...this.inUse.keys()]) {
+            if (!wanted.has(src)) {
+                this.cache.setFileSource(src);
+                this.inUse.delete(src);
+            }
+        }
+        this.queue = [...wanted];
+        this.kick();
+    }
+
+    /** Keep only these channels in the copies (as with decodePatchedChannelsOnly); all if undefined */
+    setChannelRanges(ranges?: ChannelRange[]) {
+        if (JSON.stringify(ranges) === JSON.stringify(this.ranges)) return;
+        this.ranges = ranges?.map((r) => ({ ...r }));
+        this.queue = [...new Set([...this.queue, ...this.inUse.keys()])];
+        this.kick();
+    }
+
+    /**
+     * Compress the copies with the zstd dictionary in `file` (trained from the schedule's files if
+     *  there is none yet), or without one if undefined.  Needs the native zstd addon.
+     */
+    setDictionary(file?: string) {
+        if (file === this.dictFile) return;
+        this.dictFile = file;
+        this.dictId = undefined;
+        this.dictTried = false;
+        this.queue = [...new Set([...this.queue, ...this.inUse.keys()])];
+        this.kick();
+    }
+
+    /** Stop, and read the original files again */
+    stop() {
+        this.abort.abort();
+        clearTimeout(this.removeTimer);
+        this.queue = [];
+        for (const src of this.inUse.keys()) this.cache.setFileSource(src);
+        this.inUse.clear();
+    }
+
+    private kick() {
+        if (this.running || this.abort.signal.aborted) return;
+        this.running = this.run().finally(() => (this.running = undefined));
+    }
+
+    private async run() {
+        await fsp.mkdir(this.dir, { recursive: true });
+        while (this.queue.length && !this.abort.signal.aborted) {
+            if (this.dictFile && !this.dictTried) await this.loadDictionary(this.dictFile, this.queue);
+            const src = this.queue.shift()!;
+            try {
+                await this.optimize(src);
+            } catch (e) {
+                if (!this.abort.signal.aborted) this.warn(`[fseq] could not optimize ${src}: ${(e as Error).message}`);
+            }
+        }
+        if (!this.abort.signal.aborted) await this.removeUnused();
+    }
+
+    private async optimize(src: string) {
+        const st = await fsp.stat(src);
+        const key = `${src}|${st.mtimeMs}|${st.size}|${JSON.stringify(this.ranges ?? null)}|${this.dictId ?? 0}`;
+        const copy = path.join(this.dir, createHash('sha1').update(key).digest('hex') + '.fseq');
+        if (this.inUse.get(src) === copy) return;
+
+        const have = await fsp.stat(copy).catch(() => undefined);
+        if (!have) {
+            const before = await measureFSEQSeek(src, { decompZstd, decompZlib });
+            if (!this.ranges && before.worstBlockFrames * before.msperframe <= 2 * BLOCK_MS) {
+                // Already short enough; use it as it is
+                this.cache.setFileSource(src);
+                this.inUse.delete(src);
+                return;
+            }
+            const res = await transcodeFSEQ(src, copy, {
+                blockMs: BLOCK_MS,
+                compression: 1,
+                compressZstd: nativeZstdCompressorFor(this.dictId),
+                ranges: this.ranges,
+                decompZstd,
+                decompZlib,
+                scatterKernel: nativeScatterKernel,
+                signal: this.abort.signal,
+            });
+            const after = await measureFSEQSeek(copy, { decompZstd, decompZlib });
+            this.log(
+                `[fseq] optimized ${path.basename(src)}: worst seek ${before.worstBlockMs.toFixed(1)} ms ` +
+                    `(${before.worstBlockFrames} frames) -> ${after.worstBlockMs.toFixed(1)} ms ` +
+                    `(${after.worstBlockFrames} frames); ${res.blocks} blocks, ${res.channels} channels, ` +
+                    `${Math.round(res.bytesIn / 1024)} -> ${Math.round(res.bytesOut / 1024)} KB`,
+            );
+        }
+        this.cache.setFileSource(src, copy);
+        this.inUse.set(src, copy);
+    }
+
+    private async loadDictionary(file: string, files: string[]) {
+        this.dictTried = true;
+        if (!nativeZstd) {
+            this.warn(`[fseq] a zstd dictionary needs the native zstd addon; compressing without one`);
+            return;
+        }
+        try {
+            let dict: Uint8Array | undefined = await fsp.readFile(file).catch(() => undefined);
+            if (!dict) {
+                const { samples, sizes } = await sampleFSEQFrames(files, {
+                    ranges: this.ranges,
+                    decompZstd,
+                    decompZlib,
+                    scatterKernel: nativeScatterKernel,
+                    signal: this.abort.signal,
+                });
+                const buf = new Uint8Array(DICT_BYTES);
+                dict = buf.subarray(0, await nativeZstd.trainDictionaryAsync(buf, samples, sizes));
+                const tmp = `${file}.${process.pid}.tmp`;
+                await fsp.mkdir(path.dirname(file), { recursive: true });
+                await fsp.writeFile(tmp, dict);
+                await fsp.rename(tmp, file);
+                this.log(
+                    `[fseq] trained zstd dictionary ${file} (${Math.round(dict.length / 1024)} KB) ` +
+                        `from ${sizes.length} frames of ${files.length} sequences`,
+                );
+            }
+            this.dictId = nativeZstd.loadDictionary(dict);
+        } catch (e) {
+            if (!this.abort.signal.aborted) {
+                this.warn(`[fseq] no zstd dictionary from ${file}, compressing without: ${(e as Error).message}`);
+            }
+        }
+    }
+
+    private async removeUnused() {
+        clearTimeout(this.removeTimer);
+        const keep = new Set([...this.inUse.values()].map((p) => path.basename(p)));
+        // Copies replaced but still read from, until their sequences' headers are read again
+        const reading = this.cache.dataPathsInUse();
+        let later = false;
+        for (const name of await fsp.readdir(this.dir).catch(() => [] as string[])) {
+            if (keep.has(name)) continue;
+            if (reading.has(path.join(this.dir, name))) later = true;
+            else await fsp.unlink(path.join(this.dir, name)).catch(() => {});
+        }
+        if (later && !this.abort.signal.aborted) {
+            this.removeTimer = setTimeout(() => void this.removeUnused(), REMOVE_RETRY_MS);
+            this.removeTimer.unref();
+        }
+    }
+}
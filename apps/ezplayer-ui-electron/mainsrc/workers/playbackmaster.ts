@@ -45,6 +45,8 @@ if (!parentPort) throw new Error('No parentPort in worker');
 
 import {
     openControllersForDataSend,
+    ChannelMask,
+    DiskChunkStore,
     FSeqPrefetchCache,
     ModelRec,
     readControllersFromXlights,
@@ -86,7 +88,21 @@ import { MultiSyncSender } from './multisync';
 import { fileBaseName } from './pathnames';
 
 import { decompressZStdWithWorker, getZstdStats, resetZstdStats } from './zstdparent';
+import { FseqOptimizer } from './fseqoptimize';
+import { indexShowFolder, SHOW_INDEX_MAX_DEPTH, showIndexFile } from '../fseq-map/fseqindex';
 import { setPingConfig, getLatestPingStats, stopPing } from './pingparent';
+import { createNativeUdpBatchBackend, shutdownUdpBatch } from '../udp-batch/udpbatch';
+import {
+    nativeCompositeKernel,
+    nativeDiffKernel,
+    nativeLutKernel,
+    nativeRemapKernel,
+    nativeScatterKernel,
+} from '../pixel-kernels/pixelkernels';
+import { BlendMode } from '../processing/blend';
+import type { CompositeLayer } from '../processing/compose';
+import { compileDimming } from '../processing/dimming';
+import { engineControllersFrom, OutputEngine } from '../output-engine/outputengine';
 
 import { sendRFInitiateCheck, setRFConfig, setRFControlEnabled, setRFNowPlaying, setRFPlaylist } from './rfparent';
 import { PlaylistSyncItem } from './rfsync';
@@ -223,7 +239,9 @@ const handlers: PlayWorkerRPCAPI = {
     stopPlayback: async (_args: {}) => {
         // Send black frame once as part of shutdown behavior
         isStopped = true;
+        await running; // Loop sends the black frame on its way out
         await stopPing(); // Cleanly shut down native pinger before exit
+        shutdownUdpBatch(); // And the native UDP sender thread
         return true;
     },
     getModelCoordinates: async (_args: {}) => {
@@ -324,6 +342,18 @@ function sendControllerStateUpdate() {
         const pstat = stats.stats?.[c.setup.address];
         const pss = pstat ? `${pstat.nReplies} out of ${pstat.outOf} pings` : '';
         const connectivity = !c.setup.usable ? 'N/A' : !pstat?.outOf ? 'Pending' : pstat.nReplies > 0 ? 'Up' : 'Down';
+        const rstat = c.sender ? curSender?.state.senderStats(c.sender) : undefined;
+        let rss = '';
+        if (rstat && rstat.rateLimit < 1_000_000) {
+            // bytes/ms -> Mbit/s
+            rss = `limit ${(rstat.rateLimit / 125).toFixed(1)} Mbps; achieved ${(rstat.achievedRate / 125).toFixed(1)} Mbps; ${rstat.paceWaits} waits`;
+            if (rstat.framesCut) rss += `; ${rstat.framesCut} frames cut short (limit too low for the data)`;
+        }
+        let sss = '';
+        if (rstat?.bytesSkipped) {
+            const total = rstat.bytesSkipped + rstat.bytesSent;
+            sss = `${((100 * rstat.bytesSkipped) / total).toFixed(1)}% (${(rstat.bytesSkipped / 1e6).toFixed(1)} MB) unchanged, not sent`;
+        }
         cstatus.controllers?.push({
             name: c.setup.name,
             description: c.xlRecord?.description,
@@ -338,6 +368,8 @@ function sendControllerStateUpdate() {
             errors: c.report?.error ? [c.report!.error!] : [],
             connectivity,
             pingSummary: pss,
+            rateSummary: rss,
+            skipSummary: sss,
             reported_time: stats.latestUpdate,
             startCh: c.setup.startCh,
             nCh: c.setup.nCh,
@@ -964,11 +996,39 @@ let latestSettings: PlaybackSettings | undefined = undefined;
 let lastRfRemoteToken: string | undefined = undefined;
 let rfConfigInitialized = false;
 
+// What the sender's dimming plan was compiled from
+let dimmingFrom: { sender: FrameSender; models?: ModelRec[]; master: number; nChannels: number } | undefined;
+
+/** Recompile the sender's output dimming if the models, master dimmer or frame size changed */
+function updateDimming(sender: FrameSender | undefined) {
+    if (!sender) return;
+    const advanced = latestSettings?.advanced;
+    const models = advanced?.applyModelDimming ? modelRecs : undefined;
+    const master = Math.max(0, Math.min(100, advanced?.masterDimmer ?? 100)) / 100;
+    const nChannels = sender.nChannels;
+    const from = dimmingFrom;
+    if (from?.sender === sender && from.models === models && from.master === master && from.nChannels === nChannels) {
+        return;
+    }
+    dimmingFrom = { sender, models, master, nChannels };
+    const spans = (models ?? []).map((m) => ({
+        start: m.startch - 1, // ModelRec channels are 1-based
+        length: m.nch,
+        gamma: m.gamma,
+        brightness: m.brightness,
+    }));
+    sender.dimming = compileDimming(spans, master, nChannels);
+    if (sender.dimming) {
+        emitInfo(`Output dimming: ${sender.dimming.luts.length / 256} curves, master ${Math.round(master * 100)}%`);
+    }
+}
+
 function dispatchSettings(settings: PlaybackSettings) {
     latestSettings = settings;
     multiSync.configure(settings.sync?.multisync);
     sendIdleBlackFrames = settings.sendIdleBlackFrames !== false;
     if (curSender) curSender.blackFramesEnabled = sendIdleBlackFrames;
+    updateDimming(curSender);
     const nasa = settings.audioSyncAdjust ?? 0;
     if (nasa != playbackParams.audioTimeAdjMs) {
         playbackParams.audioTimeAdjMs = nasa;
@@ -1084,6 +1144,7 @@ function resetCumulativeCounters() {
 
     playbackStats.cframesSkippedDueToDirectiveCumulative = 0;
     playbackStats.cframesSkippedDueToIncompletePriorCumulative = 0;
+    playbackStats.txTime = undefined;
 
     playbackStats.sentAudioChunksCumulative = 0;
     playbackStats.skippedAudioChunksCumulative = 0;
@@ -1174,6 +1235,8 @@ let pendingFullRebuild = false;
 
 let mp3Cache: MP3PrefetchCache | undefined = undefined;
 let fseqCache: FSeqPrefetchCache | undefined = undefined;
+let fseqChunkStore: DiskChunkStore | undefined = undefined;
+let fseqOptimizer: FseqOptimizer | undefined = undefined;
 
 /////
 // Update time variables
@@ -1183,39 +1246,11 @@ let lastPRSSchedUpdate: number = 0;
 // Build a filename index of the show folder tree in a single pass.
 // Returns a Map from lowercase filename to show-folder-relative path (forward slashes).
 // When multiple files share the same name, the shallowest one wins.
+// The listing (and every sequence header) comes from the show's saved index, revalidated.
 ////////
-async function buildShowFolderIndex(folder: string, maxDepth = 5): Promise<Map<string, string>> {
-    const index = new Map<string, string>();
-
-    async function scan(dir: string, depth: number): Promise<void> {
-        if (depth > maxDepth) return;
-        let entries: import('fs').Dirent[];
-        try {
-            entries = await fsp.readdir(dir, { withFileTypes: true });
-        } catch {
-            return;
-        }
-        const subdirs: string[] = [];
-        for (const entry of entries) {
-            if (entry.isFile()) {
-                const key = entry.name.toLowerCase();
-                // Shallowest wins — don't overwrite if already found at a higher level
-                if (!index.has(key)) {
-                    const abs = path.join(dir, entry.name);
-                    index.set(key, path.relative(folder, abs).replace(/\\/g, '/'));
-                }
-            } else if (entry.isDirectory()) {
-                subdirs.push(path.join(dir, entry.name));
-            }
-        }
-        // Recurse into subdirectories (breadth-first by level)
-        for (const sub of subdirs) {
-            await scan(sub, depth + 1);
-        }
-    }
-
-    await scan(folder, 0);
-    return index;
+async function buildShowFolderIndex(folder: string, maxDepth = SHOW_INDEX_MAX_DEPTH): Promise<Map<string, string>> {
+    const index = await indexShowFolder(folder, { cacheFile: showIndexFile(folder), maxDepth });
+    return index.fileNameIndex();
 }
 
 // Resolve a file path from the XML to a show-folder-relative path.
@@ -1509,6 +1544,15 @@ let frameExportRing: LatestFrameRingBuffer | undefined = undefined;
 let audioExportBuffer: SharedArrayBuffer | undefined = undefined;
 let audioExportRing: AudioChunkRingBuffer | undefined = undefined;
 
+// The background sequence under the foreground one, highest value winning (HTP).  Kept as
+//  constants so the sender's compositor reuses its plan from frame to frame.
+const backgroundLayer: CompositeLayer = { mode: BlendMode.Max };
+const foregroundLayer: CompositeLayer = { mode: BlendMode.Max };
+// A crossfade between sequences (sequenceCrossfadeMs): the incoming sequence over the last frame
+//  of the outgoing one, with its opacity ramping up, and the background after both.
+const fadeOutLayer: CompositeLayer = { mode: BlendMode.Max };
+const fadeInLayer: CompositeLayer = { mode: BlendMode.Over, opacity: 0 };
+
 /**
  * Apply a complementary raised-cosine ramp to the first and last `overlapFrames`
  * frames of an interleaved buffer, in place. Adjacent chunks share `overlapFrames`
@@ -1586,6 +1630,7 @@ async function processQueue() {
                 now: performance.now(),
                 fseqSpace: playbackParams.fseqSpace,
                 decompZstd: decompressZStdWithWorker,
+                scatterKernel: nativeScatterKernel,
             },
             emitError,
             emitWarning,
@@ -1597,6 +1642,9 @@ async function processQueue() {
     sender.emitError = (e) => emitError(e.message);
     sender.emitWarning = emitWarning;
     sender.blackFramesEnabled = sendIdleBlackFrames;
+    if (nativeCompositeKernel) sender.compositor.kernel = nativeCompositeKernel;
+    if (nativeLutKernel) sender.lutKernel = nativeLutKernel;
+    if (nativeRemapKernel) sender.remapKernel = nativeRemapKernel;
     curSender = sender;
 
     try {
@@ -1612,16 +1660,68 @@ async function processQueue() {
             await loadXmlCoordinates();
         }
 
+        const udpBackend =
+            latestSettings?.advanced?.nativeUdpSend === false
+                ? undefined
+                : createNativeUdpBatchBackend({
+                      gso: latestSettings?.advanced?.udpGso !== false,
+                      zerocopy: !!latestSettings?.advanced?.udpZeroCopy,
+                      uring: !!latestSettings?.advanced?.udpIoUring,
+                  });
+        if (latestSettings?.advanced?.udpIoUring && udpBackend && !udpBackend.name.includes('uring')) {
+            emitWarning(`io_uring output unavailable; sending with ${udpBackend.name}`);
+        }
         const sendJob = await openControllersForDataSend(controllers, {
             ddpPort: latestSettings?.advanced?.ddpPort,
+            udpBackend,
+            skipUnchanged: latestSettings?.advanced?.skipUnchangedPackets
+                ? { keepaliveMs: latestSettings.advanced.unchangedKeepaliveMs, kernel: nativeDiffKernel }
+                : undefined,
+            e131Multicast: {
+                interface: latestSettings?.advanced?.e131MulticastInterface,
+                ttl: latestSettings?.advanced?.e131MulticastTtl,
+                syncUniverse: latestSettings?.advanced?.e131SyncUniverse,
+            },
+            models,
         });
         setPingConfig({
-            hosts: controllers.filter((c) => c.setup.usable).map((c) => c.setup.address),
+            hosts: controllers.filter((c) => c.setup.usable && !c.setup.multicast).map((c) => c.setup.address),
             concurrency: 10,
             maxSamples: 10,
             intervalS: 5,
         });
         sender.job = sendJob;
+        // Compact frames hold just what the open controllers are sent; the sender expands them
+        const mask = latestSettings?.advanced?.decodePatchedChannelsOnly ? ChannelMask.fromSendJob(sendJob) : undefined;
+        sender.channelMask = mask?.channels ? mask : undefined;
+        fseqCache.setChannelMask(sender.channelMask);
+        if (mask?.channels) emitInfo(`Decoding ${mask.channels} patched channels in ${mask.ranges.length} ranges`);
+        // Decoded blocks on disk, for the next time these sequences play
+        const diskBudget = (latestSettings?.advanced?.fseqDiskCacheMB ?? 0) * 1_000_000;
+        const cacheDir = (workerData as PlaybackWorkerData).cacheDir;
+        if (diskBudget > 0 && cacheDir) {
+            if (fseqChunkStore?.budgetLimit !== diskBudget) {
+                fseqChunkStore = new DiskChunkStore(
+                    { dir: path.join(cacheDir, 'fseq-blocks'), budgetLimit: diskBudget },
+                    emitWarning,
+                );
+            }
+        } else {
+            fseqChunkStore = undefined;
+        }
+        fseqCache.setChunkStore(fseqChunkStore);
+        // Short-block copies of the sequences, for quick seeks
+        if (latestSettings?.advanced?.optimizeFseqFiles && cacheDir) {
+            const dir = path.join(cacheDir, 'fseq-optimized');
+            fseqOptimizer ??= new FseqOptimizer(dir, fseqCache, emitInfo, emitWarning);
+            fseqOptimizer.setChannelRanges(sender.channelMask?.ranges);
+            const dictFile = path.join(showFolder!, '.ezplayer', 'fseq.zdict');
+            fseqOptimizer.setDictionary(latestSettings?.advanced?.fseqZstdDictionary ? dictFile : undefined);
+            fseqOptimizer.update(scheduledFseqFiles());
+        } else {
+            fseqOptimizer?.stop();
+            fseqOptimizer = undefined;
+        }
         modelRecs = models;
         controllerStates = controllers;
         for (const c of controllers) {
@@ -1665,7 +1765,8 @@ async function processQueue() {
 
         sender.nChannels = nChannels;
         sender.blackFrame = new Uint8Array(nChannels);
-        sender.mixFrame = new Uint8Array(nChannels);
+        sender.mixLayers = true;
+        updateDimming(sender);
         frameExportBuffer = LatestFrameRingBuffer.allocate(nChannels, 4, true) as SharedArrayBuffer;
         frameExportRing = new LatestFrameRingBuffer({
             buffer: frameExportBuffer,
@@ -1676,6 +1777,37 @@ async function processQueue() {
         sender.exportBuffer = frameExportRing;
         send({ type: 'pixelbuffer', buffer: frameExportBuffer });
 
+        const multicastOpen = controllers.some((c) => c.setup.multicast && c.report?.status === 'open');
+        const pacedOpen = controllers.some((c) => c.xlRecord?.desc?.maxMbps && c.report?.status === 'open');
+        if (latestSettings?.advanced?.nativeOutputEngine && multicastOpen) {
+            emitWarning('Output engine: not used, as it does not support E1.31 multicast controllers');
+        } else if (latestSettings?.advanced?.nativeOutputEngine && sendJob.remaps.length) {
+            emitWarning('Output engine: not used, as it does not support controller color orders ([ORDER:...])');
+        } else if (latestSettings?.advanced?.nativeOutputEngine && pacedOpen) {
+            emitWarning('Output engine: not used, as it does not support controller rate limits ([MBPS:...])');
+        } else if (latestSettings?.advanced?.nativeOutputEngine && latestSettings.advanced.skipUnchangedPackets) {
+            emitWarning('Output engine: not used, as it does not support skipping unchanged packets');
+        } else if (latestSettings?.advanced?.nativeOutputEngine && OutputEngine.isAvailable()) {
+            const engine = new OutputEngine();
+            const opened = engine.configure({
+                ring: frameExportBuffer,
+                controllers: engineControllersFrom(controllers, { ddpPort: latestSettings?.advanced?.ddpPort }),
+                skipLateMs: playbackParams.skipFrameIfLateByMoreThan,
+                gso: latestSettings?.advanced?.udpGso !== false,
+                txTime: !!latestSettings?.advanced?.engineTxTime,
+                onStats: (s) => sender.onEngineStats(s),
+            });
+            for (const o of opened) {
+                if (o.error) emitWarning(`Output engine: ${o.address}: ${o.error}`);
+                else if (latestSettings?.advanced?.engineTxTime && !o.txTime) {
+                    emitWarning(`Output engine: ${o.address}: launch times (SO_TXTIME) not available`);
+                }
+            }
+            engine.start();
+            sender.outputEngine = engine;
+            emitInfo(`Native output engine started for ${opened.length} controllers`);
+        }
+
         // Allocate audio ring buffer: 50 slots × 12000 max samples ≈ 2.3 MB
         audioExportBuffer = AudioChunkRingBuffer.allocate(50, 12000);
         audioExportRing = new AudioChunkRingBuffer(audioExportBuffer, true);
@@ -1707,11 +1839,19 @@ async function processQueue() {
     let lastRFUpdatePN = initialPN;
 
     try {
+        // Sequence last sent, to send the first frame of the next one in full
+        let lastSentFseq: string | undefined = undefined;
+        let lastSentFrameNum = -1;
+        let lastSentFrameRTC = -Infinity;
+        let lastSentFrameInterval = 0;
+        // The outgoing sequence's frame, while the incoming one fades in over it
+        let crossfade: { fsf: string; frameNum: number; msperframe: number; startRTC: number } | undefined;
         while (true) {
             // Check if playback has been stopped - exit loop to prevent further frame sending
             if (isStopped) {
                 await sleepms(60); // TODO clean shutdown
-                sender?.sendBlackFrame({ targetFramePN: rtcConverter.computePerfNow(targetFrameRTC) });
+                await sender?.sendBlackFrame({ targetFramePN: rtcConverter.computePerfNow(targetFrameRTC) });
+                await sender?.drain();
                 multiSync.onIdle();
                 emitInfo('Playback stopped - exiting playback loop');
                 break;
@@ -1986,6 +2126,16 @@ async function processQueue() {
                     ),
                     PREFETCH_TIER.SPECULATIVE,
                 );
+                // Keep the outgoing frame of a crossfade
+                if (crossfade) {
+                    fseqCache.prefetchSeqTimes({
+                        fseqfile: crossfade.fsf,
+                        needByTime: targetFrameRTC,
+                        startTime: crossfade.frameNum * crossfade.msperframe,
+                        durationms: crossfade.msperframe,
+                        tier: PREFETCH_TIER.HAPPY,
+                    });
+                }
                 fseqCache.dispatch();
             }
 
@@ -2239,9 +2389,45 @@ async function processQueue() {
             //emitFrameDebug(`${iteration} - play the frame?`);
             multiSync.onFrame(fileBaseName(fsf), targetFrameNum, (targetFrameNum * frameInterval) / 1000);
             const frameRef = fseqCache.getFrame(fsf, { num: targetFrameNum });
+            if (fsf !== lastSentFseq || targetFrameNum < lastSentFrameNum) sender.forceFullFrame();
+
+            // Straight on from another sequence (not after idle or a pause): fade from its last frame
+            const fadeMs = latestSettings?.advanced?.sequenceCrossfadeMs ?? 0;
+            const straightOn = targetFrameRTC - lastSentFrameRTC <= 2 * Math.max(frameInterval, lastSentFrameInterval);
+            if (lastSentFseq && fsf !== lastSentFseq && fadeMs > 0 && straightOn) {
+                crossfade = {
+                    fsf: lastSentFseq,
+                    frameNum: lastSentFrameNum,
+                    msperframe: lastSentFrameInterval,
+                    startRTC: targetFrameRTC,
+                };
+            }
+            if (crossfade && (fsf === crossfade.fsf || targetFrameRTC - crossfade.startRTC >= fadeMs)) {
+                crossfade = undefined;
+            }
+            let fadeRef: FrameReference | undefined = undefined;
+            if (crossfade) {
+                fadeRef = fseqCache.getFrame(crossfade.fsf, { num: crossfade.frameNum })?.ref;
+                fadeInLayer.opacity = Math.round((255 * (targetFrameRTC - crossfade.startRTC)) / fadeMs);
+            }
+
+            lastSentFseq = fsf;
+            lastSentFrameNum = targetFrameNum;
+            lastSentFrameRTC = targetFrameRTC;
+            lastSentFrameInterval = frameInterval;
             targetFrameRTC += await sender.sendNextFrameAt({
                 frame: frameRef?.ref,
-                bframe: bframeRef,
+                // Without the outgoing frame (no longer cached), a cut
+                layers: fadeRef
+                    ? [
+                          { ref: fadeRef, layer: fadeOutLayer },
+                          { ref: frameRef?.ref, layer: fadeInLayer },
+                          { ref: bframeRef, layer: backgroundLayer },
+                      ]
+                    : [
+                          { ref: bframeRef, layer: backgroundLayer },
+                          { ref: frameRef?.ref, layer: foregroundLayer },
+                      ],
                 targetFramePN: rtcConverter.computePerfNow(targetFrameRTC),
                 targetFrameNum,
                 playbackStats,
@@ -2263,5 +2449,17 @@ function installNewSchedule(): boolean {
     curPlaylists = pendingSchedule.pls;
     curSchedule = pendingSchedule.sched;
     pendingSchedule = undefined;
+    fseqOptimizer?.update(scheduledFseqFiles());
     return true;
 }
+
+/** Absolute paths of the FSEQ files of the current sequences */
+function scheduledFseqFiles(): string[] {
+    const files: string[] = [];
+    for (const s of curSequences ?? []) {
+        let fsf = s.files?.fseq;
+        if (fsf && !path.isAbsolute(fsf)) fsf = path.join(showFolder!, fsf);
+        if (fsf) files.push(fsf);
+    }
+    return files;
+}
@@ -24,6 +24,7 @@ import type {
 export interface PlaybackWorkerData {
     name: string;
     logFile: string;
+    cacheDir?: string; // Where disk caches may go
 }
 
 // TODO CRAZ Replace with better interfaces
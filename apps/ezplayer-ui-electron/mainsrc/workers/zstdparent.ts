@@ -1,8 +1,9 @@
 // parent.ts
 import { Worker } from 'node:worker_threads';
 import * as path from 'path';
-import { type DecompZStd } from '@ezplayer/epp';
+import { type DecompZStd, type NeededTimePriority, needTimePriorityCompare } from '@ezplayer/epp';
 import { fileURLToPath } from 'node:url';
+import { nativeZstd } from '../zstd-native/zstdnative.js';
 
 // Polyfill for `__dirname` in ES Modules
 const __filename = fileURLToPath(import.meta.url);
@@ -23,20 +24,41 @@ type WorkerErr = {
     compBuf: ArrayBuffer;
 };
 
+type DecompResult = { decompBuf: ArrayBuffer; compBuf: ArrayBuffer };
+
+interface DecompRequest {
+    decomp: ArrayBuffer;
+    comp: ArrayBuffer;
+    compOff: number;
+    compLen: number;
+    expLen: number;
+    priority?: NeededTimePriority;
+    resolve: (r: DecompResult) => void;
+    reject: (e: Error) => void;
+}
+
 let nextId = 1;
 let decompTime = 0;
+let lastNow = 0;
 
+// With libzstd, blocks go to the addon's decode pool (sized to the cores); otherwise to JS workers
+const usePool = !!nativeZstd?.decompressAsync;
 const nworkers = 4;
 const workers: Worker[] = [];
-for (let i = 0; i < nworkers; ++i) {
-    workers.push(new Worker(path.join(__dirname, './zstdworker.js'), { workerData: { name: 'zstddecode' } }));
+if (!usePool) {
+    for (let i = 0; i < nworkers; ++i) {
+        workers.push(new Worker(path.join(__dirname, './zstdworker.js'), { workerData: { name: 'zstddecode' } }));
+    }
 }
-const inuse: Worker[] = [];
+
+// Blocks waiting for a free worker or pool slot
+const waiting: DecompRequest[] = [];
 
 export function getZstdStats() {
     return {
         decompTime,
-        nWorkers: nworkers,
+        nWorkers: usePool ? nativeZstd!.poolInfo().threads : nworkers,
+        nWaiting: waiting.length,
     };
 }
 
@@ -44,39 +66,108 @@ export function resetZstdStats() {
     decompTime = 0;
 }
 
-export const decompressZStdWithWorker: DecompZStd = (
-    decomp: ArrayBuffer,
-    comp: ArrayBuffer,
-    compOff: number,
-    compLen: number,
-    expLen: number,
-) => {
-    const id = nextId++;
-    const worker = workers.pop();
-    if (!worker) throw new Error('Too many outstanding requests');
+// Blocks that come without a priority are treated as needed now
+const asap: NeededTimePriority = { neededTime: -Infinity, neededThroughTime: Infinity };
+
+// Takes the most urgent waiting block, in the prefetch cache's order
+function takeWaiting() {
+    let best = 0;
+    for (let i = 1; i < waiting.length; ++i) {
+        if (needTimePriorityCompare(waiting[i].priority ?? asap, waiting[best].priority ?? asap, lastNow) < 0) {
+            best = i;
+        }
+    }
+    return waiting.splice(best, 1)[0];
+}
+
+// Start what can be started; anything left stays queued until a completion calls this again
+function pump() {
+    while (waiting.length) {
+        const req = takeWaiting();
+        if (!start(req)) {
+            waiting.push(req);
+            return;
+        }
+    }
+}
+
+function start(req: DecompRequest): boolean {
+    return usePool ? startNative(req) : startWorker(req);
+}
 
-    return new Promise((resolve, reject) => {
-        const onMessage = (msg: WorkerOk | WorkerErr) => {
-            workers.push(worker);
-            if (msg.id !== id) return;
-            worker.off('message', onMessage);
+function startNative(req: DecompRequest): boolean {
+    let p: Promise<{ decompTime: number }> | undefined;
+    try {
+        p = nativeZstd!.decompressAsync(
+            req.decomp,
+            req.comp,
+            req.compOff,
+            req.compLen,
+            req.expLen,
+            req.priority,
+            lastNow,
+        );
+    } catch (e) {
+        req.reject(e as Error);
+        return true;
+    }
+    if (!p) return false;
+    p.then(
+        (r) => {
+            decompTime += r.decompTime;
+            req.resolve({ decompBuf: req.decomp, compBuf: req.comp });
+        },
+        (e) => req.reject(e as Error),
+    ).finally(pump);
+    return true;
+}
 
-            if (!msg.ok) {
-                // The buffers may end up getting GC'd
-                // However ... this is a problematic situation w/ a corrupt file or some such...
-                reject(new Error(msg.error));
-                return;
-            }
+function startWorker(req: DecompRequest): boolean {
+    const worker = workers.pop();
+    if (!worker) return false;
+    const id = nextId++;
 
-            decompTime += msg.ok ? msg.decompTime : 0;
+    const onMessage = (msg: WorkerOk | WorkerErr) => {
+        if (msg.id !== id) return;
+        worker.off('message', onMessage);
+        workers.push(worker);
 
+        if (!msg.ok) {
+            // The buffers may end up getting GC'd
+            // However ... this is a problematic situation w/ a corrupt file or some such...
+            req.reject(new Error(msg.error));
+        } else {
+            decompTime += msg.decompTime;
             // Recreate views on the returned (transferred-back) buffers
-            resolve({ decompBuf: msg.decompBuf, compBuf: msg.compBuf });
-        };
+            req.resolve({ decompBuf: msg.decompBuf, compBuf: msg.compBuf });
+        }
+        pump();
+    };
+
+    worker.on('message', onMessage);
 
-        worker.on('message', onMessage);
+    // Transfer BOTH buffers to the worker (zero-copy). After this, these views are detached here.
+    const { expLen, compOff, compLen, decomp, comp } = req;
+    worker.postMessage({ id, expLen, compOff, compLen, decompBuf: decomp, compBuf: comp }, [decomp, comp]);
+    return true;
+}
 
-        // Transfer BOTH buffers to the worker (zero-copy). After this, these views are detached here.
-        worker.postMessage({ id, expLen, compOff, compLen, decompBuf: decomp, compBuf: comp }, [decomp, comp]);
+/**
+ * Decompress on the native decode pool, or on the zstd workers if libzstd is not there.
+ *  When every slot is taken the block waits here (most urgent first) rather than failing.
+ */
+export const decompressZStdWithWorker: DecompZStd = (
+    decomp: ArrayBuffer,
+    comp: ArrayBuffer,
+    compOff: number,
+    compLen: number,
+    expLen: number,
+    priority?: NeededTimePriority,
+    now?: number,
+) => {
+    if (now !== undefined) lastNow = now;
+    return new Promise<DecompResult>((resolve, reject) => {
+        const req: DecompRequest = { decomp, comp, compOff, compLen, expLen, priority, resolve, reject };
+        if (waiting.length || !start(req)) waiting.push(req);
     });
 };
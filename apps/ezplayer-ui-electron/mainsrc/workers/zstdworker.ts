@@ -186,6 +186,7 @@ export class ZSTDDecoder {
  */
 
 import { parentPort } from 'node:worker_threads';
+import { nativeZstd } from '../zstd-native/zstdnative.js';
 
 //import { setThreadAffinity } from '../affinity/affinity.js';
 //setThreadAffinity([5,6,7,8]);
@@ -207,7 +208,7 @@ type OutMsg =
 let decoder: ZSTDDecoder | null = null;
 
 async function ensureDecoder() {
-    if (!decoder) {
+    if (!decoder && !nativeZstd) {
         decoder = new ZSTDDecoder();
         await decoder.init();
     }
@@ -228,9 +229,10 @@ parentPort.on('message', async (msg: InMsg) => {
         const decompView = new Uint8Array(decompBuf, 0, expLen);
         const compView = new Uint8Array(compBuf, compOff, compLen);
 
-        // Decode into a temporary view, then copy into caller-provided decompView since zstd does not
-        //  accept a passed-in buffer
-        const decodedLen = decoder!.decode(compView, decompView, expLen);
+        // libzstd decodes straight into decompView; the WASM decoder goes via its own heap and copies
+        const decodedLen = nativeZstd
+            ? nativeZstd.decompress(decompView, compView)
+            : decoder!.decode(compView, decompView, expLen);
         if (decodedLen > decompView.byteLength) {
             throw new Error(`Decoded output (${decodedLen}) exceeds provided decomp buffer (${decompView.byteLength})`);
         }
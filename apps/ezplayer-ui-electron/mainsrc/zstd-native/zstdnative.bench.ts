@@ -0,0 +1,76 @@
+// Decoding the zstd blocks of .fseq files: the WASM zstddec, as defDecompZStd uses it (decode on the
+//  WASM heap, then copy out), against libzstd decoding straight into the destination buffer.
+// Run with: FSEQ_BENCH_DIR=/path/to/show pnpm vitest bench mainsrc/zstd-native
+//  FSEQ_BENCH_DIR should hold xLights-rendered (zstd, v2) sequences.  Without it, a synthetic
+//  sequence is compressed with zstd-codec instead, which says less about real shows.
+import { beforeAll, bench, describe } from 'vitest';
+import { promises as fsp } from 'fs';
+import path from 'path';
+import { ZSTDDecoder } from 'zstddec';
+import { ZstdCodec, type ZstdSimple } from 'zstd-codec';
+import { FSEQReaderAsync } from '@ezplayer/epp';
+import { nativeZstd } from './zstdnative';
+
+interface Block {
+    comp: Uint8Array;
+    len: number;
+}
+const blocks: Block[] = [];
+let dst = new Uint8Array(0);
+const wasm = new ZSTDDecoder();
+
+async function loadFseqBlocks(dir: string) {
+    for (const name of await fsp.readdir(dir)) {
+        if (path.extname(name).toLowerCase() !== '.fseq') continue;
+        const data = new Uint8Array(await fsp.readFile(path.join(dir, name)));
+        const hdr = FSEQReaderAsync.decodeFSEQHeader(data, 0, false, data.length);
+        if (hdr.compression !== 1) continue;
+        let off = hdr.chdata_offset;
+        hdr.compblocklist.forEach((b, i) => {
+            const end = i + 1 < hdr.compblocklist.length ? hdr.compblocklist[i + 1].framenum : hdr.frames;
+            blocks.push({ comp: data.subarray(off, off + b.blocksize), len: (end - b.framenum) * hdr.stepsize });
+            off += b.blocksize;
+        });
+    }
+}
+
+// 40 blocks of 25 frames of 30k channels: moving gradients, so roughly the ratio of a busy sequence
+async function makeSyntheticBlocks() {
+    const channels = 30_000;
+    const zstd = await new Promise<ZstdSimple>((resolve) => ZstdCodec.run((z) => resolve(new z.Simple())));
+    for (let b = 0; b < 40; ++b) {
+        const raw = new Uint8Array(25 * channels);
+        for (let f = 0; f < 25; ++f) {
+            const t = b * 25 + f;
+            for (let c = 0; c < channels; ++c) raw[f * channels + c] = ((c >> 2) + t * 3) & 0xff;
+        }
+        blocks.push({ comp: zstd.compress(raw, 1), len: raw.length });
+    }
+}
+
+function decodeAll(native: boolean) {
+    for (const b of blocks) {
+        const out = dst.subarray(0, b.len);
+        if (native) nativeZstd!.decompress(out, b.comp);
+        else out.set(wasm.decode(b.comp, b.len));
+    }
+}
+
+describe('zstd block decode', () => {
+    beforeAll(async () => {
+        await wasm.init();
+        if (process.env.FSEQ_BENCH_DIR) await loadFseqBlocks(process.env.FSEQ_BENCH_DIR);
+        if (!blocks.length) await makeSyntheticBlocks();
+        dst = new Uint8Array(Math.max(...blocks.map((b) => b.len)));
+
+        const compMB = blocks.reduce((a, b) => a + b.comp.length, 0) / 1e6;
+        const rawMB = blocks.reduce((a, b) => a + b.len, 0) / 1e6;
+        console.log(
+            `${blocks.length} blocks, ${compMB.toFixed(1)} MB -> ${rawMB.toFixed(1)} MB per iteration` +
+                (nativeZstd ? ` (libzstd ${nativeZstd.version})` : ' (no native zstd)'),
+        );
+    });
+
+    bench('WASM zstddec, decode + copy', () => decodeAll(false));
+    if (nativeZstd) bench('libzstd, into destination', () => decodeAll(true));
+});
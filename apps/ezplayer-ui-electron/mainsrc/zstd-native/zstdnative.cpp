@@ -0,0 +1,640 @@
+// zstd-native/zstdnative.cpp — Native decompression for the zstd blocks
+// (compression type 1) of FSEQ files.  zlib blocks (type 2) are left to
+// node's zlib, which ships with Node and Electron.
+//
+// decompress(dst, src) decodes straight into the caller's buffer; there is
+// no WASM heap to copy out of.  Each thread that decodes (the zstd decode
+// workers, the pool threads, the main thread) keeps one ZSTD_DCtx for its
+// lifetime, so tables and windows are allocated once, not per block.
+//
+// That is synchronous.  decompressAsync() hands the block to a pool of
+// decode threads, one per core less one for the playback thread, started
+// by the first call.  The pool's queue is bounded and ordered like the
+// prefetch cache (NeededTimePriority: tier, then current / future / past);
+// when it is full it returns undefined and the caller holds on to the block
+// until a completion frees a slot.  Results come back through a
+// TypedThreadSafeFunction, as in icmp-ping.
+//
+// compressAsync() writes zstd blocks for transcodeFSEQ on the libuv pool,
+// with one ZSTD_CCtx per thread.
+//
+// libzstd is compiled in from third_party/zstd (the "zstd" target in
+// binding.gyp), with its symbols kept private to this addon.
+//
+// A show's sequences can share a trained dictionary (trainDictionaryAsync,
+// from sampleFSEQFrames).  loadDictionary() digests it once for the whole
+// process; every thread's contexts then use it for frames that name its ID,
+// and compressAsync() writes with it when given the ID.  Frames written
+// without one decode as before.
+#include "napi.h"
+#include <zstd.h>
+#include <zdict.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct DCtxHolder {
+    ZSTD_DCtx* ctx = nullptr;
+    ~DCtxHolder() {
+        if (ctx) ZSTD_freeDCtx(ctx);
+    }
+};
+
+thread_local DCtxHolder tl_dctx;
+
+ZSTD_DCtx* thread_dctx() {
+    if (!tl_dctx.ctx) tl_dctx.ctx = ZSTD_createDCtx();
+    return tl_dctx.ctx;
+}
+
+struct CCtxHolder {
+    ZSTD_CCtx* ctx = nullptr;
+    ~CCtxHolder() {
+        if (ctx) ZSTD_freeCCtx(ctx);
+    }
+};
+
+thread_local CCtxHolder tl_cctx;
+
+ZSTD_CCtx* thread_cctx() {
+    if (!tl_cctx.ctx) tl_cctx.ctx = ZSTD_createCCtx();
+    return tl_cctx.ctx;
+}
+
+// A loaded dictionary, shared read-only by all threads; CDicts are made per level on first use
+struct Dictionary {
+    std::vector<uint8_t> data;
+    ZSTD_DDict* ddict = nullptr;
+    std::mutex cdictMutex;
+    std::map<int, ZSTD_CDict*> cdicts;
+
+    ~Dictionary() {
+        if (ddict) ZSTD_freeDDict(ddict);
+        for (auto& c : cdicts) {
+            if (c.second) ZSTD_freeCDict(c.second);
+        }
+    }
+
+    const ZSTD_CDict* cdict(int level) {
+        std::lock_guard<std::mutex> lk(cdictMutex);
+        ZSTD_CDict*& c = cdicts[level];
+        if (!c) c = ZSTD_createCDict(data.data(), data.size(), level);
+        return c;
+    }
+};
+
+// By the ID recorded in frames written with them; for the life of the process
+std::mutex dict_mutex;
+std::map<unsigned, std::shared_ptr<Dictionary>> dictionaries;
+
+std::shared_ptr<Dictionary> find_dictionary(unsigned id) {
+    std::lock_guard<std::mutex> lk(dict_mutex);
+    auto it = dictionaries.find(id);
+    return it == dictionaries.end() ? nullptr : it->second;
+}
+
+}  // namespace
+
+// Decode all of src into dst; empty string on success, with *written set
+static std::string decode_block(uint8_t* dst, size_t dstLen, const uint8_t* src, size_t srcLen, size_t* written) {
+    *written = 0;
+    ZSTD_DCtx* dctx = thread_dctx();
+    if (!dctx) return "ZSTD_createDCtx failed";
+    // Handles several concatenated frames, and frames without a content size
+    size_t r;
+    if (unsigned dictId = ZSTD_getDictID_fromFrame(src, srcLen)) {
+        std::shared_ptr<Dictionary> dict = find_dictionary(dictId);
+        if (!dict) return "zstd: block needs dictionary " + std::to_string(dictId) + ", which is not loaded";
+        r = ZSTD_decompress_usingDDict(dctx, dst, dstLen, src, srcLen, dict->ddict);
+    } else {
+        r = ZSTD_decompressDCtx(dctx, dst, dstLen, src, srcLen);
+    }
+    if (ZSTD_isError(r)) return std::string("zstd: ") + ZSTD_getErrorName(r);
+    *written = r;
+    return std::string();
+}
+
+// decompress(dst: Uint8Array, src: Uint8Array) -> bytes written to dst
+static Napi::Value Decompress(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dst: Uint8Array, src: Uint8Array)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto dst = info[0].As<Napi::Uint8Array>();
+    auto src = info[1].As<Napi::Uint8Array>();
+
+    size_t written = 0;
+    std::string err = decode_block(dst.Data(), dst.ByteLength(), src.Data(), src.ByteLength(), &written);
+    if (!err.empty()) {
+        Napi::Error::New(env, err).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(written));
+}
+
+// contentSize(src: Uint8Array) -> decompressed size from the frame header, or -1 if not recorded
+static Napi::Value ContentSize(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (src: Uint8Array)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto src = info[0].As<Napi::Uint8Array>();
+    unsigned long long n = ZSTD_getFrameContentSize(src.Data(), src.ByteLength());
+    if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR) return Napi::Number::New(env, -1);
+    return Napi::Number::New(env, static_cast<double>(n));
+}
+
+// ---------------------------------------------------------------------------
+// Compression, for rewriting files (transcodeFSEQ); on the libuv pool, as
+// it is background work that is not ordered against playback
+// ---------------------------------------------------------------------------
+
+// compressBound(srcLen) -> the most compress may write for srcLen bytes
+static Napi::Value CompressBound(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().DoubleValue() < 0) {
+        Napi::TypeError::New(env, "Expected (srcLen: number)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    size_t n = static_cast<size_t>(info[0].As<Napi::Number>().DoubleValue());
+    return Napi::Number::New(env, static_cast<double>(ZSTD_compressBound(n)));
+}
+
+class CompressWorker : public Napi::AsyncWorker {
+public:
+    CompressWorker(Napi::Env env, Napi::Uint8Array dst, Napi::Uint8Array src, int level,
+                   std::shared_ptr<Dictionary> dict)
+        : Napi::AsyncWorker(env, "ZstdCompress"), deferred_(Napi::Promise::Deferred::New(env)),
+          dstRef_(Napi::Persistent(dst.As<Napi::Object>())), srcRef_(Napi::Persistent(src.As<Napi::Object>())),
+          dst_(dst.Data()), dstLen_(dst.ByteLength()), src_(src.Data()), srcLen_(src.ByteLength()), level_(level),
+          dict_(std::move(dict)) {}
+
+    Napi::Promise Promise() const { return deferred_.Promise(); }
+
+    void Execute() override {
+        ZSTD_CCtx* cctx = thread_cctx();
+        if (!cctx) {
+            SetError("ZSTD_createCCtx failed");
+            return;
+        }
+        size_t r;
+        if (dict_) {
+            const ZSTD_CDict* cdict = dict_->cdict(level_);
+            if (!cdict) {
+                SetError("ZSTD_createCDict failed");
+                return;
+            }
+            r = ZSTD_compress_usingCDict(cctx, dst_, dstLen_, src_, srcLen_, cdict);
+        } else {
+            r = ZSTD_compressCCtx(cctx, dst_, dstLen_, src_, srcLen_, level_);
+        }
+        if (ZSTD_isError(r)) {
+            SetError(std::string("zstd: ") + ZSTD_getErrorName(r));
+            return;
+        }
+        written_ = r;
+    }
+
+    void OnOK() override { deferred_.Resolve(Napi::Number::New(Env(), static_cast<double>(written_))); }
+
+    void OnError(const Napi::Error& e) override { deferred_.Reject(e.Value()); }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    Napi::ObjectReference dstRef_;  // Keep both buffers alive until done
+    Napi::ObjectReference srcRef_;
+    uint8_t* dst_;
+    size_t dstLen_;
+    const uint8_t* src_;
+    size_t srcLen_;
+    int level_;
+    std::shared_ptr<Dictionary> dict_;
+    size_t written_ = 0;
+};
+
+// compressAsync(dst: Uint8Array, src: Uint8Array, level?: number, dictId?: number) => Promise<number>
+//   One zstd frame (with content size) of all of src, into dst; resolves with the bytes
+//   written.  dst should be compressBound(src.length) long.  With dictId, the frame is
+//   written with that (loaded) dictionary, and records its ID.
+static Napi::Value CompressAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dst: Uint8Array, src: Uint8Array, level?: number, dictId?: number)")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    int level = ZSTD_CLEVEL_DEFAULT;
+    if (info.Length() > 2 && info[2].IsNumber()) level = info[2].As<Napi::Number>().Int32Value();
+    if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+        Napi::RangeError::New(env, "zstd level out of range").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<Dictionary> dict;
+    if (info.Length() > 3 && info[3].IsNumber()) {
+        const unsigned id = info[3].As<Napi::Number>().Uint32Value();
+        if (id && !(dict = find_dictionary(id))) {
+            Napi::Error::New(env, "zstd dictionary " + std::to_string(id) + " is not loaded")
+                .ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    auto* w = new CompressWorker(env, info[0].As<Napi::Uint8Array>(), info[1].As<Napi::Uint8Array>(), level,
+                                 std::move(dict));
+    Napi::Promise p = w->Promise();
+    w->Queue();
+    return p;
+}
+
+// ---------------------------------------------------------------------------
+// Dictionaries
+// ---------------------------------------------------------------------------
+
+class TrainWorker : public Napi::AsyncWorker {
+public:
+    TrainWorker(Napi::Env env, Napi::Uint8Array dst, Napi::Uint8Array samples, std::vector<size_t> sizes)
+        : Napi::AsyncWorker(env, "ZstdTrainDictionary"), deferred_(Napi::Promise::Deferred::New(env)),
+          dstRef_(Napi::Persistent(dst.As<Napi::Object>())),
+          samplesRef_(Napi::Persistent(samples.As<Napi::Object>())), dst_(dst.Data()), dstLen_(dst.ByteLength()),
+          samples_(samples.Data()), sizes_(std::move(sizes)) {}
+
+    Napi::Promise Promise() const { return deferred_.Promise(); }
+
+    void Execute() override {
+        size_t r = ZDICT_trainFromBuffer(dst_, dstLen_, samples_, sizes_.data(), static_cast<unsigned>(sizes_.size()));
+        if (ZDICT_isError(r)) {
+            SetError(std::string("zdict: ") + ZDICT_getErrorName(r));
+            return;
+        }
+        written_ = r;
+    }
+
+    void OnOK() override { deferred_.Resolve(Napi::Number::New(Env(), static_cast<double>(written_))); }
+
+    void OnError(const Napi::Error& e) override { deferred_.Reject(e.Value()); }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    Napi::ObjectReference dstRef_;
+    Napi::ObjectReference samplesRef_;
+    uint8_t* dst_;
+    size_t dstLen_;
+    const uint8_t* samples_;
+    std::vector<size_t> sizes_;
+    size_t written_ = 0;
+};
+
+// trainDictionaryAsync(dst: Uint8Array, samples: Uint8Array, sizes: number[]) => Promise<number>
+//   Train a dictionary of at most dst.length bytes from the samples, which lie end to end
+//   in samples with the given lengths; on the libuv pool.  Resolves with the bytes written.
+static Napi::Value TrainDictionaryAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 3 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsArray()) {
+        Napi::TypeError::New(env, "Expected (dst: Uint8Array, samples: Uint8Array, sizes: number[])")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto samples = info[1].As<Napi::Uint8Array>();
+    auto arr = info[2].As<Napi::Array>();
+    std::vector<size_t> sizes(arr.Length());
+    double total = 0;
+    for (uint32_t i = 0; i < arr.Length(); ++i) {
+        Napi::Value v = arr.Get(i);
+        const double n = v.IsNumber() ? v.As<Napi::Number>().DoubleValue() : -1;
+        if (n < 0) {
+            Napi::TypeError::New(env, "Sample sizes must be numbers >= 0").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        sizes[i] = static_cast<size_t>(n);
+        total += n;
+    }
+    if (total > static_cast<double>(samples.ByteLength())) {
+        Napi::RangeError::New(env, "Sample sizes add up to more than the samples given").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto* w = new TrainWorker(env, info[0].As<Napi::Uint8Array>(), samples, std::move(sizes));
+    Napi::Promise p = w->Promise();
+    w->Queue();
+    return p;
+}
+
+// loadDictionary(dict: Uint8Array) -> the dictionary's ID
+//   Digested once for the process; decoding (here and on other threads) and compressAsync
+//   use it from then on.  Loading an ID that is already loaded keeps the first.
+static Napi::Value LoadDictionary(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsTypedArray()) {
+        Napi::TypeError::New(env, "Expected (dict: Uint8Array)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto buf = info[0].As<Napi::Uint8Array>();
+    const unsigned id = ZSTD_getDictID_fromDict(buf.Data(), buf.ByteLength());
+    if (!id) {
+        // Raw content would work as a prefix, but frames could not say they need it
+        Napi::Error::New(env, "Not a zstd dictionary (it has no ID)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (find_dictionary(id)) return Napi::Number::New(env, id);
+
+    auto dict = std::make_shared<Dictionary>();
+    dict->data.assign(buf.Data(), buf.Data() + buf.ByteLength());
+    dict->ddict = ZSTD_createDDict(dict->data.data(), dict->data.size());
+    if (!dict->ddict) {
+        Napi::Error::New(env, "ZSTD_createDDict failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::lock_guard<std::mutex> lk(dict_mutex);
+    dictionaries.emplace(id, std::move(dict));
+    return Napi::Number::New(env, id);
+}
+
+// ---------------------------------------------------------------------------
+// Decode pool
+// ---------------------------------------------------------------------------
+struct PoolRequest;
+static void CallJs(Napi::Env env, Napi::Function jsCallback, void* context, PoolRequest* data);
+
+using TSFN = Napi::TypedThreadSafeFunction<void, PoolRequest, CallJs>;
+
+// Mirrors NeededTimePriority / needTimePriorityCompare in epp's PrefetchCache
+struct NeedPriority {
+    int tier = 0;
+    double neededTime = 0;
+    double neededThroughTime = 0;
+};
+
+// Per-block request (allocated on JS thread, freed in CallJs)
+struct PoolRequest {
+    Napi::Promise::Deferred deferred;
+    Napi::ObjectReference decompRef;  // Keep both buffers alive while in flight
+    Napi::ObjectReference compRef;
+    uint8_t* dst;
+    size_t dstLen;
+    const uint8_t* src;
+    size_t srcLen;
+    NeedPriority prio;
+    uint64_t seq;
+    double decompTime = 0;
+    std::string error;
+
+    explicit PoolRequest(Napi::Env env) : deferred(Napi::Promise::Deferred::New(env)) {}
+};
+
+static TSFN tsfn;
+static napi_env pool_env = nullptr;
+static std::atomic<bool> shutting_down{false};
+static std::vector<std::thread> pool_threads;
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static std::vector<PoolRequest*> pool_queue;
+static size_t queue_capacity = 0;
+static size_t active = 0;
+static uint64_t next_seq = 0;
+static double js_clock_offset = 0;  // Caller's "now" minus steady clock ms, as of the last submit
+
+static double steady_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Same ordering as needTimePriorityCompare; true if a goes before b
+static bool higher_priority(const PoolRequest* a, const PoolRequest* b, double now) {
+    if (a->prio.tier != b->prio.tier) return a->prio.tier < b->prio.tier;
+    auto classify = [now](const NeedPriority& p) {
+        if (now < p.neededTime) return 1;           // future
+        if (now <= p.neededThroughTime) return 0;   // current
+        return 2;                                   // past
+    };
+    const int ca = classify(a->prio);
+    const int cb = classify(b->prio);
+    if (ca != cb) return ca < cb;
+    double d;
+    if (ca == 0) d = b->prio.neededTime - a->prio.neededTime;
+    else if (ca == 1) d = a->prio.neededTime - b->prio.neededTime;
+    else d = b->prio.neededThroughTime - a->prio.neededThroughTime;
+    if (d != 0) return d < 0;
+    return a->seq < b->seq;
+}
+
+static void CallJs(Napi::Env env, Napi::Function /*jsCallback*/, void* /*context*/, PoolRequest* data) {
+    if (data == nullptr) return;
+    if (env != nullptr) {
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lk(queue_mutex);
+            idle = --active == 0;
+        }
+        if (idle && !shutting_down.load()) tsfn.Unref(env);
+        if (data->error.empty()) {
+            auto obj = Napi::Object::New(env);
+            obj.Set("decompTime", Napi::Number::New(env, data->decompTime));
+            data->deferred.Resolve(obj);
+        } else {
+            data->deferred.Reject(Napi::Error::New(env, data->error).Value());
+        }
+    } else {
+        // Environment is going away; references cannot be deleted any more
+        data->decompRef.SuppressDestruct();
+        data->compRef.SuppressDestruct();
+    }
+    delete data;
+}
+
+static void post_result(PoolRequest* req) {
+    if (tsfn.NonBlockingCall(req) != napi_ok) {
+        req->decompRef.SuppressDestruct();
+        req->compRef.SuppressDestruct();
+        delete req;  // TSFN closing — discard
+    }
+}
+
+static void pool_thread_func() {
+    for (;;) {
+        PoolRequest* req = nullptr;
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex);
+            queue_cv.wait(lk, [] { return shutting_down.load() || !pool_queue.empty(); });
+            if (shutting_down.load()) return;
+            const double now = steady_ms() + js_clock_offset;
+            auto best = pool_queue.begin();
+            for (auto it = best + 1; it != pool_queue.end(); ++it) {
+                if (higher_priority(*it, *best, now)) best = it;
+            }
+            req = *best;
+            pool_queue.erase(best);
+        }
+
+        const double start = steady_ms();
+        size_t written = 0;
+        req->error = decode_block(req->dst, req->dstLen, req->src, req->srcLen, &written);
+        // The block must fill what the header says it holds; the rest of dst would be stale
+        if (req->error.empty() && written != req->dstLen) {
+            req->error = "decoded " + std::to_string(written) + " bytes, expected " + std::to_string(req->dstLen);
+        }
+        req->decompTime = steady_ms() - start;
+        post_result(req);
+    }
+}
+
+// env is null from the cleanup hook: queued requests are then just freed
+static void stop_pool(napi_env env) {
+    if (!pool_env || shutting_down.exchange(true)) return;
+    queue_cv.notify_all();
+    for (auto& t : pool_threads) {
+        if (t.joinable()) t.join();
+    }
+    pool_threads.clear();
+
+    std::vector<PoolRequest*> left;
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        left.swap(pool_queue);
+    }
+    for (auto* req : left) {
+        req->error = "zstd decode pool shut down";
+        CallJs(Napi::Env(env), Napi::Function(), nullptr, req);
+    }
+    tsfn.Release();  // release the pool's reference
+    tsfn.Abort();    // release owner reference, mark closing
+}
+
+static void CleanupHook(void*) {
+    stop_pool(nullptr);
+}
+
+static void start_pool(Napi::Env env) {
+    const unsigned hw = std::thread::hardware_concurrency();
+    const size_t nthreads = hw > 2 ? hw - 1 : 1;
+    queue_capacity = nthreads * 4;
+    pool_env = env;
+
+    // TSFN: unlimited queue, 2 references (owner + pool)
+    tsfn = TSFN::New(env, "ZstdPoolTSFN", 0, 2);
+    tsfn.Unref(env);  // An idle pool does not keep the thread alive
+    for (size_t i = 0; i < nthreads; ++i) pool_threads.emplace_back(pool_thread_func);
+    napi_add_env_cleanup_hook(env, CleanupHook, nullptr);
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: decompressAsync(decompBuf: ArrayBuffer, compBuf: ArrayBuffer, compOff, compLen, expLen,
+//                               priority?: { tier?, neededTime, neededThroughTime? }, now?)
+//   => Promise<{ decompTime }>, or undefined if the queue is full
+//   Neither buffer may be transferred or detached until the promise settles.
+// ---------------------------------------------------------------------------
+static Napi::Value DecompressAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 5 || !info[0].IsArrayBuffer() || !info[1].IsArrayBuffer() || !info[2].IsNumber() ||
+        !info[3].IsNumber() || !info[4].IsNumber()) {
+        Napi::TypeError::New(env,
+                             "Expected (decompBuf: ArrayBuffer, compBuf: ArrayBuffer, compOff: number, "
+                             "compLen: number, expLen: number, priority?: object, now?: number)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto decomp = info[0].As<Napi::ArrayBuffer>();
+    auto comp = info[1].As<Napi::ArrayBuffer>();
+    const double compOff = info[2].As<Napi::Number>().DoubleValue();
+    const double compLen = info[3].As<Napi::Number>().DoubleValue();
+    const double expLen = info[4].As<Napi::Number>().DoubleValue();
+    if (compOff < 0 || compLen < 0 || expLen < 0 || compOff + compLen > static_cast<double>(comp.ByteLength()) ||
+        expLen > static_cast<double>(decomp.ByteLength())) {
+        Napi::RangeError::New(env, "Block does not fit the buffers given").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!pool_env) start_pool(env);
+    if (pool_env != static_cast<napi_env>(env)) {
+        Napi::Error::New(env, "zstd decode pool was started from another thread").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (shutting_down.load()) {
+        Napi::Error::New(env, "zstd decode pool has been shut down").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    NeedPriority prio;
+    prio.neededTime = -1e300;  // No priority given: treated as current from now on
+    prio.neededThroughTime = 1e300;
+    if (info.Length() > 5 && info[5].IsObject()) {
+        auto p = info[5].As<Napi::Object>();
+        Napi::Value tier = p.Get("tier");
+        Napi::Value needed = p.Get("neededTime");
+        Napi::Value through = p.Get("neededThroughTime");
+        if (tier.IsNumber()) prio.tier = tier.As<Napi::Number>().Int32Value();
+        if (needed.IsNumber()) prio.neededTime = needed.As<Napi::Number>().DoubleValue();
+        prio.neededThroughTime = through.IsNumber() ? through.As<Napi::Number>().DoubleValue() : prio.neededTime;
+    }
+    prio.neededThroughTime = std::max(prio.neededThroughTime, prio.neededTime);
+
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        if (info.Length() > 6 && info[6].IsNumber()) {
+            js_clock_offset = info[6].As<Napi::Number>().DoubleValue() - steady_ms();
+        }
+        if (pool_queue.size() >= queue_capacity) return env.Undefined();  // Back-pressure, not an error
+
+        auto* req = new PoolRequest(env);
+        req->decompRef = Napi::Persistent(static_cast<Napi::Object>(decomp));
+        req->compRef = Napi::Persistent(static_cast<Napi::Object>(comp));
+        req->dst = static_cast<uint8_t*>(decomp.Data());
+        req->dstLen = static_cast<size_t>(expLen);
+        req->src = static_cast<const uint8_t*>(comp.Data()) + static_cast<size_t>(compOff);
+        req->srcLen = static_cast<size_t>(compLen);
+        req->prio = prio;
+        req->seq = next_seq++;
+        if (active++ == 0) tsfn.Ref(env);  // Keep the loop alive while anything is outstanding
+        pool_queue.push_back(req);
+        Napi::Promise promise = req->deferred.Promise();
+        queue_cv.notify_one();
+        return promise;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: poolInfo() => { threads, capacity, queued, active }
+//   capacity is 0 until the pool has been started by decompressAsync()
+// ---------------------------------------------------------------------------
+static Napi::Value PoolInfo(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto o = Napi::Object::New(env);
+    std::lock_guard<std::mutex> lk(queue_mutex);
+    o.Set("threads", Napi::Number::New(env, static_cast<double>(pool_threads.size())));
+    o.Set("capacity", Napi::Number::New(env, static_cast<double>(queue_capacity)));
+    o.Set("queued", Napi::Number::New(env, static_cast<double>(pool_queue.size())));
+    o.Set("active", Napi::Number::New(env, static_cast<double>(active)));
+    return o;
+}
+
+// ---------------------------------------------------------------------------
+// N-API export: shutdown() — join the pool threads, reject anything queued
+// ---------------------------------------------------------------------------
+static Napi::Value Shutdown(const Napi::CallbackInfo& info) {
+    if (pool_env == static_cast<napi_env>(info.Env())) stop_pool(info.Env());
+    return info.Env().Undefined();
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("decompress", Napi::Function::New(env, Decompress));
+    exports.Set("contentSize", Napi::Function::New(env, ContentSize));
+    exports.Set("compressBound", Napi::Function::New(env, CompressBound));
+    exports.Set("compressAsync", Napi::Function::New(env, CompressAsync));
+    exports.Set("trainDictionaryAsync", Napi::Function::New(env, TrainDictionaryAsync));
+    exports.Set("loadDictionary", Napi::Function::New(env, LoadDictionary));
+    exports.Set("decompressAsync", Napi::Function::New(env, DecompressAsync));
+    exports.Set("poolInfo", Napi::Function::New(env, PoolInfo));
+    exports.Set("shutdown", Napi::Function::New(env, Shutdown));
+    exports.Set("version", Napi::String::New(env, ZSTD_versionString()));
+    return exports;
+}
+
+NODE_API_MODULE(zstd_native, Init)
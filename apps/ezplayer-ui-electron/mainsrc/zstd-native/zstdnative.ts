@@ -0,0 +1,78 @@
+import { createRequire } from 'module';
+import type { BlockCompressor, NeededTimePriority } from '@ezplayer/epp';
+
+const require = createRequire(import.meta.url);
+
+export interface NativeZstd {
+    /** Decompress all of src into dst (which must be large enough); returns bytes written */
+    decompress(dst: Uint8Array, src: Uint8Array): number;
+    /** Decompressed size recorded in the frame header, or -1 */
+    contentSize(src: Uint8Array): number;
+    /**
+     * Queue expLen bytes of decoding, from compBuf at compOff into the start of decompBuf, on the
+     *  native decode pool.  Queued blocks are taken in NeededTimePriority order as of `now` (same
+     *  clock as the priorities).  Returns undefined, without queueing, if the pool's queue is full.
+     *  Neither buffer may be transferred until the promise settles.
+     */
+    decompressAsync(
+        decompBuf: ArrayBuffer,
+        compBuf: ArrayBuffer,
+        compOff: number,
+        compLen: number,
+        expLen: number,
+        priority?: NeededTimePriority,
+        now?: number,
+    ): Promise<{ decompTime: number }> | undefined;
+    /** Most that compressAsync can write for srcLen bytes */
+    compressBound(srcLen: number): number;
+    /**
+     * Compress all of src into one zstd frame in dst (compressBound(src.length) long), on the
+     *  libuv pool; resolves with the bytes written.  Neither buffer may be transferred meanwhile.
+     *  With dictId, uses that dictionary (which must be loaded) and records its ID in the frame.
+     */
+    compressAsync(dst: Uint8Array, src: Uint8Array, level?: number, dictId?: number): Promise<number>;
+    /**
+     * Train a dictionary of up to dst.length bytes from samples (end to end, with the given
+     *  lengths, as from sampleFSEQFrames), on the libuv pool; resolves with the bytes written.
+     */
+    trainDictionaryAsync(dst: Uint8Array, samples: Uint8Array, sizes: number[]): Promise<number>;
+    /**
+     * Make a trained dictionary available to every decoder in the process, and to compressAsync;
+     *  returns its ID.  Blocks that name an ID that has not been loaded fail to decode.
+     */
+    loadDictionary(dict: Uint8Array): number;
+    /** Pool size, queue bound, and what is queued or not yet completed */
+    poolInfo(): { threads: number; capacity: number; queued: number; active: number };
+    /** Stop the decode pool; anything still queued is rejected */
+    shutdown(): void;
+    version: string;
+}
+
+let native: NativeZstd | null = null;
+try {
+    const bindings = require('bindings');
+    native = bindings('zstd_native');
+} catch (e) {
+    console.error('NO zstd_native BINDING');
+    console.error(e);
+}
+
+/**
+ * libzstd (built in from third_party/zstd), decoding straight into caller-provided buffers with one
+ *  decoder context per thread.  Undefined if the addon could not be loaded; callers fall back to
+ *  the WASM zstddec.  zlib blocks are always left to node's zlib.
+ */
+export const nativeZstd: NativeZstd | undefined = native ?? undefined;
+
+/** transcodeFSEQ's zstd compressor, on libzstd, with a loaded dictionary if given; undefined without the addon */
+export function nativeZstdCompressorFor(dictId?: number): BlockCompressor | undefined {
+    if (!native) return undefined;
+    return async (raw) => {
+        const dst = new Uint8Array(native!.compressBound(raw.length));
+        const n = await native!.compressAsync(dst, raw, undefined, dictId);
+        return dst.subarray(0, n);
+    };
+}
+
+/** transcodeFSEQ's zstd compressor, on libzstd; undefined without the addon */
+export const nativeZstdCompressor: BlockCompressor | undefined = nativeZstdCompressorFor();
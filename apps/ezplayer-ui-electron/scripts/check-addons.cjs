@@ -0,0 +1,54 @@
+/**
+ * Post-build native addon gate.
+ *
+ * The app loads each addon in a try/catch and falls back to a JS path when it does not load,
+ * so an addon that built but cannot be loaded (a missing shared library, say) would only show
+ * up as a slower player.  This loads every addon in build/Release and fails the build if any
+ * of them throws.
+ *
+ * zstd_native has zstd built in (third_party/zstd), and leaves zlib blocks to node's zlib, so
+ * it should need nothing on the machine; a block is round-tripped through it to be sure.
+ *
+ * Run from apps/ezplayer-ui-electron after `node-gyp rebuild` (CI does, after `pnpm build`).
+ */
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+
+const dir = path.resolve('build', 'Release');
+const addons = fs.readdirSync(dir).filter((f) => f.endsWith('.node'));
+if (!addons.length) {
+    console.error(`[check-addons] No addons in ${dir}; run node-gyp rebuild first.`);
+    process.exit(1);
+}
+
+let failed = false;
+const loaded = {};
+for (const f of addons) {
+    try {
+        loaded[path.basename(f, '.node')] = require(path.join(dir, f));
+        console.log(`[check-addons] ${f}: ok`);
+    } catch (e) {
+        console.error(`[check-addons] ${f}: ${e.message}`);
+        failed = true;
+    }
+}
+
+const zstd = loaded.zstd_native;
+if (!zstd) {
+    console.error('[check-addons] zstd_native was not built');
+    failed = true;
+} else if (zlib.zstdCompressSync) {
+    const raw = new Uint8Array(100_000).map((_v, i) => (i >> 4) & 0xff);
+    const comp = zlib.zstdCompressSync(raw);
+    const out = new Uint8Array(raw.length);
+    const n = zstd.decompress(out, comp);
+    if (n !== raw.length || Buffer.compare(out, raw) !== 0) {
+        console.error(`[check-addons] zstd_native ${zstd.version}: round trip failed`);
+        failed = true;
+    } else {
+        console.log(`[check-addons] zstd_native ${zstd.version}: round trip ok`);
+    }
+}
+
+if (failed) process.exit(1);
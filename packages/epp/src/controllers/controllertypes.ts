@@ -12,4 +12,5 @@ export interface ControllerSetup {
     startCh: number;
     nCh: number;
     proto: 'DDP' | 'E131' | undefined;
+    multicast?: boolean; // E1.31 to the universes' multicast groups; `address` is not used
 }
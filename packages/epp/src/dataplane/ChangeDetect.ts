@@ -0,0 +1,51 @@
+/**
+ * Compares slices of a frame with a shadow copy of what was last sent, refreshing the shadow.
+ *  For segments first .. first + count - 1:
+ *    src[srcStart[i] .. + len[i]] is compared with shadow[shadowStart[i] .. + len[i]];
+ *    changed[i] is set to 1 (and the shadow updated) if they differ, else 0.
+ *  Returns the number of changed segments.
+ *
+ * Implementations are provided by the host (for instance, a native SIMD addon) and passed
+ *  in via OpenControllersOptions; jsDiffKernel is used otherwise.
+ */
+export interface DiffKernel {
+    readonly name: string;
+    diffCopy(
+        src: Uint8Array,
+        shadow: Uint8Array,
+        srcStart: Uint32Array,
+        shadowStart: Uint32Array,
+        len: Uint32Array,
+        first: number,
+        count: number,
+        changed: Uint8Array,
+    ): number;
+}
+
+const bufCompare = Buffer.prototype.compare;
+const bufCopy = Buffer.prototype.copy;
+
+/** One memcmp (and memcpy if changed) per segment, via Buffer */
+export const jsDiffKernel: DiffKernel = {
+    name: 'js',
+    diffCopy(src, shadow, srcStart, shadowStart, len, first, count, changed) {
+        let n = 0;
+        for (let i = first; i < first + count; ++i) {
+            const s = srcStart[i];
+            const d = shadowStart[i];
+            const l = Math.min(len[i], src.length - s);
+            if (l <= 0) {
+                changed[i] = 0;
+                continue;
+            }
+            if (bufCompare.call(src, shadow, d, d + l, s, s + l) === 0) {
+                changed[i] = 0;
+            } else {
+                bufCopy.call(src, shadow, d, s, s + l);
+                changed[i] = 1;
+                ++n;
+            }
+        }
+        return n;
+    },
+};
@@ -0,0 +1,63 @@
+import { describe, it, expect } from 'vitest';
+import { compileRemap, jsRemapKernel, parseColorOrder, REMAP_COPY, REMAP_NODES } from './ColorRemap';
+import { ModelRec } from '../xlcompat/XLXmlUtil';
+
+function rgbModel(startch: number, nodes: number, order = 'RGB') {
+    const m = new ModelRec(`m${startch}`, 'Custom', startch, nodes * 3);
+    m.simple = true;
+    m.r = order.indexOf('R');
+    m.g = order.indexOf('G');
+    m.b = order.indexOf('B');
+    return m;
+}
+
+describe('parseColorOrder', () => {
+    it('accepts each of R, G and B once, with an optional W', () => {
+        expect(parseColorOrder('RGB')).toBe(3 | (0 << 4) | (1 << 6) | (2 << 8));
+        expect(parseColorOrder(' grbw ')).toBe(4 | (1 << 4) | (0 << 6) | (2 << 8) | (3 << 10));
+        expect(parseColorOrder('RGBR')).toBeUndefined();
+        expect(parseColorOrder('RRB')).toBeUndefined();
+        expect(parseColorOrder('RGX')).toBeUndefined();
+        expect(parseColorOrder('')).toBeUndefined();
+    });
+});
+
+describe('compileRemap', () => {
+    it('is not needed when the models are already in that order', () => {
+        expect(compileRemap(0, 30, [rgbModel(1, 10)], parseColorOrder('RGB')!)).toBeUndefined();
+        expect(compileRemap(0, 30, [rgbModel(1, 10, 'GRB')], parseColorOrder('GRB')!)).toBeUndefined();
+        const notSimple = rgbModel(1, 10);
+        notSimple.simple = false;
+        expect(compileRemap(0, 30, [notSimple], parseColorOrder('GRB')!)).toBeUndefined();
+    });
+
+    it('copies the channels around the models, and widens the nodes for white', () => {
+        const order = parseColorOrder('GRBW')!;
+        // Controller at channels 100..159; one model inside it, one starting before it
+        const remap = compileRemap(100, 60, [rgbModel(111, 5), rgbModel(90, 10)], order)!;
+        expect(remap.srcStart).toBe(100);
+        expect(remap.srcLen).toBe(60);
+        // prettier-ignore
+        expect(Array.from(remap.ops)).toEqual([
+            REMAP_COPY, 100, 0, 10, 0, 0,
+            REMAP_NODES, 110, 10, 5, 0 | (1 << 2) | (2 << 4), order,
+            REMAP_COPY, 125, 30, 35, 0, 0,
+        ]);
+        expect(remap.out.length).toBe(65);
+    });
+});
+
+describe('jsRemapKernel', () => {
+    it('reorders the nodes, taking white out of R, G and B', () => {
+        const src = Uint8Array.from([9, 10, 20, 30, 200, 100, 50, 7]);
+        // One BRG model of two nodes at channels 1..6 (0-based), sent as GRB and as WRGB
+        const grb = compileRemap(0, 8, [rgbModel(2, 2, 'BRG')], parseColorOrder('GRB')!)!;
+        jsRemapKernel.remap(grb.out, src, grb.ops);
+        // Node 1: B 10, R 20, G 30; node 2: B 200, R 100, G 50
+        expect(Array.from(grb.out)).toEqual([9, 30, 20, 10, 50, 100, 200, 7]);
+
+        const wrgb = compileRemap(0, 8, [rgbModel(2, 2, 'BRG')], parseColorOrder('WRGB')!)!;
+        jsRemapKernel.remap(wrgb.out, src, wrgb.ops);
+        expect(Array.from(wrgb.out)).toEqual([9, 10, 10, 20, 0, 50, 50, 0, 150, 7]);
+    });
+});
@@ -0,0 +1,145 @@
+import type { ModelRec } from '../xlcompat/XLXmlUtil';
+
+/**
+ * Fills a controller's output buffer from the frame, following a remap table (compileRemap):
+ *  six u32s per span, (kind, srcStart, dstStart, count, srcOrder, dstOrder).
+ *    REMAP_COPY: `count` channels as they are.
+ *    REMAP_NODES: `count` nodes of three channels, R, G and B at the offsets in srcOrder
+ *      (2 bits each, R lowest), written as the channels dstOrder lists: its low 4 bits are the
+ *      channels per node (3, or 4 with white), then 2 bits per channel, 0 R / 1 G / 2 B / 3 W.
+ *      White is the smallest of R, G and B, which is then taken off each of them.
+ *  Offsets are absolute in src and dst.
+ *
+ * Implementations are provided by the host (for instance, a native SIMD addon) and set on the
+ *  sender; jsRemapKernel is used otherwise.
+ */
+export interface RemapKernel {
+    readonly name: string;
+    remap(dst: Uint8Array, src: Uint8Array, ops: Uint32Array): void;
+}
+
+export const REMAP_COPY = 0;
+export const REMAP_NODES = 1;
+const OP_FIELDS = 6;
+
+/** One controller's channels, reordered (and widened for white) into a buffer of its own */
+export class ChannelRemap {
+    /** What the controller's parts read, instead of the frame */
+    readonly out: Uint8Array;
+
+    constructor(
+        readonly srcStart: number, // The controller's channels in the frame
+        readonly srcLen: number,
+        readonly ops: Uint32Array,
+        outLen: number,
+    ) {
+        this.out = new Uint8Array(outLen);
+    }
+}
+
+/** A node at a time, in JS */
+export const jsRemapKernel: RemapKernel = {
+    name: 'js',
+    remap(dst, src, ops) {
+        const c = [0, 0, 0, 0];
+        for (let o = 0; o + OP_FIELDS <= ops.length; o += OP_FIELDS) {
+            const s = ops[o + 1];
+            const d = ops[o + 2];
+            const count = ops[o + 3];
+            if (ops[o] === REMAP_COPY) {
+                dst.set(src.subarray(s, s + count), d);
+                continue;
+            }
+            const so = ops[o + 4];
+            const dord = ops[o + 5];
+            const ro = so & 3;
+            const go = (so >> 2) & 3;
+            const bo = (so >> 4) & 3;
+            const per = dord & 15;
+            for (let n = 0, si = s, di = d; n < count; ++n, si += 3, di += per) {
+                let r = src[si + ro];
+                let g = src[si + go];
+                let b = src[si + bo];
+                let w = 0;
+                if (per === 4) {
+                    w = Math.min(r, g, b);
+                    r -= w;
+                    g -= w;
+                    b -= w;
+                }
+                c[0] = r;
+                c[1] = g;
+                c[2] = b;
+                c[3] = w;
+                for (let k = 0; k < per; ++k) dst[di + k] = c[(dord >> (4 + 2 * k)) & 3];
+            }
+        }
+    },
+};
+
+/**
+ * Parses a color order as written in a controller description ([ORDER:GRB], [ORDER:GRBW]):
+ *  R, G and B once each, and optionally W.  Returns dstOrder for a remap table.
+ */
+export function parseColorOrder(order: string): number | undefined {
+    const o = order.trim().toUpperCase();
+    if (o.length < 3 || o.length > 4) return undefined;
+    if (!o.includes('R') || !o.includes('G') || !o.includes('B')) return undefined;
+    if (o.length === 4 && !o.includes('W')) return undefined;
+    let res = o.length;
+    for (let k = 0; k < o.length; ++k) {
+        const ch = 'RGBW'.indexOf(o[k]);
+        if (ch < 0) return undefined;
+        res |= ch << (4 + 2 * k);
+    }
+    return res;
+}
+
+/**
+ * The remap that sends the simple (three-color node) models within a controller's channels in
+ *  `order` (as parseColorOrder) rather than as sequenced, in their own R/G/B order.  Everything
+ *  else on the controller is copied across as it is.  With white, the controller takes more
+ *  channels than it has in the frame.  Undefined if no channel would change, so that the
+ *  controller can read the frame directly.
+ */
+export function compileRemap(
+    start: number, // 0-based
+    nCh: number,
+    models: ModelRec[],
+    order: number,
+): ChannelRemap | undefined {
+    const per = order & 15;
+    const ops: number[] = [];
+    let changes = false;
+    let src = start;
+    let dst = 0;
+    const copyTo = (end: number) => {
+        if (end <= src) return;
+        const last = ops.length - OP_FIELDS;
+        if (last >= 0 && ops[last] === REMAP_COPY && ops[last + 1] + ops[last + 3] === src) {
+            ops[last + 3] += end - src;
+        } else {
+            ops.push(REMAP_COPY, src, dst, end - src, 0, 0);
+        }
+        dst += end - src;
+        src = end;
+    };
+
+    const end = start + nCh;
+    for (const m of [...models].sort((a, b) => a.startch - b.startch)) {
+        const mStart = m.startch - 1; // ModelRec channels are 1-based
+        // Only whole models of RGB nodes, not overlapping one already done
+        if (!m.simple || m.nch <= 0 || m.nch % 3 !== 0 || mStart < src || mStart + m.nch > end) continue;
+        const srcOrder = m.r | (m.g << 2) | (m.b << 4);
+        const asSequenced = (1 << (2 * m.g)) | (2 << (2 * m.b)); // As a dstOrder, R being 0
+        if (per === 3 && (order >> 4) === asSequenced) continue; // Already in this order
+        copyTo(mStart);
+        ops.push(REMAP_NODES, src, dst, m.nch / 3, srcOrder, order);
+        src += m.nch;
+        dst += (m.nch / 3) * per;
+        changes = true;
+    }
+    copyTo(end);
+    if (!changes) return undefined;
+    return new ChannelRemap(start, nCh, Uint32Array.from(ops), dst);
+}
@@ -13,6 +13,14 @@ export class SchedulerMinHeap<T extends SchedulerHeapItem> {
         return this.heap[0]; // Peek at the top element
     }
 
+    get size(): number {
+        return this.heap.length;
+    }
+
+    clear(): void {
+        this.heap.length = 0;
+    }
+
     updateTop(updateFn: (item: T) => void): void {
         if (this.heap.length === 0) return;
 
@@ -20,6 +28,11 @@ export class SchedulerMinHeap<T extends SchedulerHeapItem> {
         this.bubbleDown(0); // Restore heap order
     }
 
+    /** Restore heap order after the top element's nextTime was changed in place */
+    fixTop(): void {
+        this.bubbleDown(0);
+    }
+
     insert(item: T): void {
         this.heap.push(item);
         this.bubbleUp(this.heap.length - 1);
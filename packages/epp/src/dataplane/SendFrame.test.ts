@@ -0,0 +1,140 @@
+import { describe, it, expect } from 'vitest';
+import { DDPSender } from './protocols/DDP';
+import { UdpBatchBackend, UdpBatchSocket, UdpPacket, udpPacketViews } from './protocols/UDP';
+import { SenderJob, SendJob, SendJobState } from './SenderJob';
+import { endBatch, sendPartial, startBatch, startFrame } from './SendFrame';
+
+class CountingSocket implements UdpBatchSocket {
+    batches: number[] = []; // Packets per handover
+    offsets: number[] = []; // DDP data offset of each packet, in send order
+    sendBatch(packets: UdpPacket[], done: (nOk: number, nErr: number, err?: string) => void) {
+        this.batches.push(packets.length);
+        for (const p of packets) {
+            const h = udpPacketViews(p)[0];
+            this.offsets.push(new DataView(h.buffer, h.byteOffset).getUint32(4));
+        }
+        done(packets.length, 0);
+    }
+    close() {}
+}
+
+const N_CHANNELS = 144_000; // 100 full DDP packets of 1450 bytes
+
+async function addController(job: SendJob, rateLimit?: number, burstSize?: number) {
+    const sock = new CountingSocket();
+    const backend: UdpBatchBackend = { name: 'counting', open: async () => sock };
+    const sender = new DDPSender();
+    sender.address = '127.0.0.1';
+    sender.udpBackend = backend;
+    sender.pushAtEnd = false;
+    await sender.connect();
+    const sj = new SenderJob();
+    sj.parts.push({ bufIdx: 0, bufStart: 0, bufLen: N_CHANNELS });
+    sj.sender = sender;
+    if (rateLimit) sj.rateLimit = rateLimit;
+    if (burstSize) sj.burstSize = burstSize;
+    job.senders.push(sj);
+    return sock;
+}
+
+describe('sendPartial pacing', () => {
+    it('spreads a rate-limited controller over time while others go at once', async () => {
+        const job = new SendJob();
+        job.dataBuffers = [new Uint8Array(N_CHANNELS)];
+        const paced = await addController(job, 1450, 2900); // ~11.6 Mbps
+        const unpaced = await addController(job);
+
+        const state = new SendJobState();
+        state.initialize(0, job);
+        startFrame(state);
+        startBatch(state);
+
+        let now = 0;
+        let calls = 0;
+        let next = sendPartial(state, now);
+        expect(unpaced.batches.reduce((a, n) => a + n, 0)).toBe(100);
+        while (next >= 0) {
+            expect(next).toBeGreaterThan(now);
+            now = next;
+            ++calls;
+            next = sendPartial(state, now);
+        }
+        const batches = endBatch(state);
+        expect(batches.every((b) => b.isComplete())).toBe(true);
+
+        // First portion is the burst; the rest comes out at the configured rate
+        expect(now).toBeGreaterThan((145_000 - 2 * 2900) / 1450);
+        expect(now).toBeLessThan(145_000 / 1450);
+        expect(paced.batches.reduce((a, n) => a + n, 0)).toBe(100);
+        expect(paced.batches.length).toBe(calls + 1);
+
+        const st = state.senderStats(job.senders[0].sender!)!;
+        expect(st.bytesSent).toBe(145_000);
+        expect(st.paceWaits).toBe(calls);
+        expect(Math.abs(st.achievedRate - 1450) / 1450).toBeLessThan(0.05);
+
+        const ust = state.senderStats(job.senders[1].sender!)!;
+        expect(ust.bytesSent).toBe(145_000);
+        expect(ust.achievedRate).toBe(0);
+    });
+
+    it('cuts a controller too slow for its data off at the deadline, and resumes there next frame', async () => {
+        const job = new SendJob();
+        job.dataBuffers = [new Uint8Array(N_CHANNELS)];
+        const paced = await addController(job, 1450, 2900); // 145 kB takes ~98ms, frames are 25ms
+        const unpaced = await addController(job);
+
+        const state = new SendJobState();
+        let nPaced = 0;
+        for (let f = 0; f < 8; ++f) {
+            const frameStart = f * 25;
+            state.initialize(frameStart, job);
+            startFrame(state);
+            startBatch(state);
+            let now = frameStart;
+            let next = sendPartial(state, now, frameStart + 25);
+            while (next >= 0) {
+                expect(next).toBeLessThan(frameStart + 25);
+                now = next;
+                next = sendPartial(state, now, frameStart + 25);
+            }
+            endBatch(state);
+
+            // The rest of the frame was dropped, not sent late
+            const sent = paced.offsets.length - nPaced;
+            expect(sent).toBeGreaterThan(0);
+            expect(sent).toBeLessThan(100);
+            // Each frame picks up where the last one was cut
+            expect(paced.offsets[nPaced]).toBe(((nPaced % 100) * 1440) % N_CHANNELS);
+            nPaced += sent;
+        }
+        expect(unpaced.offsets.length).toBe(8 * 100);
+        // Over a few frames, every packet got out
+        expect(new Set(paced.offsets).size).toBe(100);
+        expect(nPaced).toBeLessThan(8 * 25 * 1.05);
+
+        const st = state.senderStats(job.senders[0].sender!)!;
+        expect(st.framesCut).toBe(8);
+        expect(state.senderStats(job.senders[1].sender!)!.framesCut).toBe(0);
+    });
+
+    it('skips controllers that are not due this frame', async () => {
+        const job = new SendJob();
+        job.dataBuffers = [new Uint8Array(N_CHANNELS)];
+        const sock = await addController(job);
+        (job.senders[0].sender as DDPSender).minTimeBetweenFrames = 50;
+
+        const state = new SendJobState();
+        state.initialize(100, job);
+        startBatch(state);
+        expect(sendPartial(state, 100)).toBe(-1);
+        endBatch(state);
+        expect(sock.batches.length).toBe(1);
+
+        state.initialize(125, job);
+        startBatch(state);
+        expect(sendPartial(state, 125)).toBe(-1);
+        endBatch(state);
+        expect(sock.batches.length).toBe(1);
+    });
+});
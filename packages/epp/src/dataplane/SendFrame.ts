@@ -40,27 +40,88 @@ export function endBatch(state?: SendJobState): SendBatch[] {
     return b;
 }
 
-export function sendPartial(state?: SendJobState): number {
+export function flushBatch(state?: SendJobState) {
     if (!state?.job) return -1;
-    // TODO EZP the whole scheduling thing
     for (let i = 0; i < state.states.length; ++i) {
         const sender = state.job.senders[i];
         if (!sender || !sender.sender || state.states[i].skippingThisFrame) continue;
-        sender.sender.sendPortion(state.job, sender, state.states[i]);
+        sender.sender.flushBatch();
     }
-    return -1; // Done!
 }
 
+// Run a paced sender this close to its time instead of sleeping for it
+const PACING_SLACK_MS = 0.05;
+// After running out of tokens, wait until about one packet's worth is back
+const PACING_QUANTUM = 1500;
+
+/**
+ * Runs senders in nextTime order until all are done with the frame (returns -1),
+ *  or the next one is waiting on its token bucket (returns the time to call again).
+ *  Packets collected so far are flushed to the sockets before returning a wait.
+ * A wait that would run to `deadline` (the next frame's due time) ends the frame instead:
+ *  senders still waiting are cut short (see SendJobSenderState.cutFrame) and -1 is returned.
+ */
+export function sendPartial(
+    state?: SendJobState,
+    now: number = performance.now(),
+    deadline: number = Infinity,
+): number {
+    if (!state?.job) return -1;
+    const job = state.job;
+    while (true) {
+        const top = state.sendHeap.top;
+        if (!top || top.nextTime === Infinity) return -1; // Done!
+        if (top.nextTime > now + PACING_SLACK_MS) {
+            if (top.nextTime >= deadline) {
+                // Everyone left is waiting on tokens that won't come in time; all go to Infinity, so the heap holds
+                for (const s of state.states) {
+                    if (s.nextTime !== Infinity) s.cutFrame();
+                }
+                return -1;
+            }
+            flushBatch(state);
+            return top.nextTime;
+        }
+        // Updated in place, rather than through updateTop, to keep closures off the send path
+        const s = top;
+        const sj = job.senders[s.senderIdx];
+        if (!sj?.sender || s.skippingThisFrame) {
+            s.nextTime = Infinity;
+        } else {
+            // Run it as of its own time (within the slack), so its tokens are there
+            const t = Math.max(now, s.nextTime);
+            s.beginPortion(sj, t);
+            const done = sj.sender.sendPortion(job, sj, s);
+            s.endPortion(sj, t);
+            if (done) {
+                sj.sender.sendPush(job, sj, s);
+                s.endFrame(t);
+                s.nextTime = Infinity;
+            } else {
+                // Yielded to the others; only count it if the bucket actually holds it back
+                s.nextTime = s.timeForTokens(sj, PACING_QUANTUM);
+                if (s.nextTime > t + PACING_SLACK_MS) {
+                    ++s.paceWaitsCumulative;
+                    ++s.framePaceWaits;
+                }
+            }
+        }
+        state.sendHeap.fixTop();
+    }
+}
+
+/** Sends the frame, pacing as needed; paced senders not done by `deadline` are cut short */
 export async function sendFull(
     state: SendJobState | undefined,
     sleepfn: (sleepUntil: number) => Promise<void>,
+    deadline: number = Infinity,
 ): Promise<void> {
     if (!state?.job) return;
-    startFrame();
+    startFrame(state);
     while (true) {
-        const st = sendPartial(state);
+        const st = sendPartial(state, performance.now(), deadline);
         if (st < 0) break;
         await sleepfn(st);
     }
-    endFrame();
+    endFrame(state);
 }
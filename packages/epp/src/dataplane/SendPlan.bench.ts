@@ -0,0 +1,97 @@
+// Heap allocated per frame by the JS send path (SendJobState + sendPartial + DDP/E1.31 sendPortion),
+//  with the packets going to a batch socket that drops them.  The per-packet part should be zero;
+//  what is left is per batch (the SendBatch and its promise).
+// Frames from the prefetch cache are new buffer objects each time, so that is the headline case;
+//  the same-buffer cases are for comparison.
+// Run with: pnpm vitest bench src/dataplane/SendPlan
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import { DDPSender } from './protocols/DDP';
+import { E131Sender } from './protocols/E131';
+import { UdpBatchBackend } from './protocols/UDP';
+import { SenderJob, SendJob, SendJobState } from './SenderJob';
+import { endBatch, sendPartial, startBatch, startFrame } from './SendFrame';
+
+const N_CONTROLLERS = 8;
+const N_CHANNELS = 24_000; // Per controller: 17 DDP packets, or 48 universes
+
+const dropAll: UdpBatchBackend = {
+    name: 'drop',
+    open: async () => ({ sendBatch: (packets, done) => done(packets.length, 0), close: () => {} }),
+};
+
+interface Variant {
+    job: SendJob;
+    state: SendJobState;
+    buffers: Uint8Array[]; // Frames cycled through
+    frames: number;
+    measured: number;
+    bytes: number;
+    packets: number;
+}
+const variants = new Map<string, Variant>();
+
+async function makeVariant(name: string, proto: 'DDP' | 'E131', nBuffers: number, skipUnchanged = false) {
+    const job = new SendJob();
+    for (let c = 0; c < N_CONTROLLERS; ++c) {
+        const sender = proto === 'DDP' ? new DDPSender() : new E131Sender();
+        sender.address = '127.0.0.1';
+        sender.udpBackend = dropAll;
+        sender.skipUnchanged = skipUnchanged;
+        await sender.connect();
+        const sj = new SenderJob();
+        sj.parts.push({ bufIdx: 0, bufStart: c * N_CHANNELS, bufLen: N_CHANNELS });
+        sj.burstSize = 2 * N_CHANNELS;
+        sj.sender = sender;
+        sender.compilePlan(sj);
+        job.senders.push(sj);
+    }
+    const buffers: Uint8Array[] = [];
+    for (let i = 0; i < nBuffers; ++i) buffers.push(new Uint8Array(N_CONTROLLERS * N_CHANNELS));
+    variants.set(name, { job, state: new SendJobState(), buffers, frames: 0, measured: 0, bytes: 0, packets: 0 });
+}
+
+function sendFrame(name: string) {
+    const v = variants.get(name)!;
+    v.job.dataBuffers[0] = v.buffers[v.frames % v.buffers.length];
+    const h0 = process.memoryUsage().heapUsed;
+    v.state.initialize(v.frames * 25, v.job);
+    startFrame(v.state);
+    startBatch(v.state);
+    sendPartial(v.state, v.frames * 25);
+    const batches = endBatch(v.state);
+    const h1 = process.memoryUsage().heapUsed;
+    // A GC in between makes the delta meaningless; skip those frames
+    if (h1 >= h0) {
+        v.bytes += h1 - h0;
+        ++v.measured;
+    }
+    for (const b of batches) v.packets += b.nSent;
+    ++v.frames;
+}
+
+describe(`send path, ${N_CONTROLLERS} controllers of ${N_CHANNELS} channels`, () => {
+    beforeAll(async () => {
+        await makeVariant('DDP, new buffer', 'DDP', 2);
+        await makeVariant('E1.31, new buffer', 'E131', 2);
+        await makeVariant('DDP, same buffer', 'DDP', 1);
+        await makeVariant('E1.31, same buffer', 'E131', 1);
+        await makeVariant('DDP, skip unchanged', 'DDP', 1, true);
+    });
+
+    afterAll(() => {
+        for (const [name, v] of variants) {
+            if (!v.measured) continue;
+            console.log(
+                `${name.padEnd(20)}: ${(v.bytes / v.measured).toFixed(0)} heap bytes/frame ` +
+                    `for ${(v.packets / v.frames).toFixed(0)} packets/frame`,
+            );
+        }
+    });
+
+    bench('DDP, new buffer each frame', () => sendFrame('DDP, new buffer'));
+    bench('E1.31, new buffer each frame', () => sendFrame('E1.31, new buffer'));
+    bench('DDP, same buffer', () => sendFrame('DDP, same buffer'));
+    bench('E1.31, same buffer', () => sendFrame('E1.31, same buffer'));
+    // Static frame, so only keepalives go out; with packets dropped for free, this is the cost of the JS compare
+    bench('DDP, skip unchanged (static frame)', () => sendFrame('DDP, skip unchanged'));
+});
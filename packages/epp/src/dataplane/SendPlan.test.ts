@@ -0,0 +1,300 @@
+import { describe, it, expect } from 'vitest';
+import { DDPSender, fillInDDPHeader } from './protocols/DDP';
+import { e131MulticastAddress, E131Sender } from './protocols/E131';
+import { UdpBatchBackend, UdpBatchSocket, UdpPacket, udpPacketViews } from './protocols/UDP';
+import { SenderJob, SendJob, SendJobSenderState } from './SenderJob';
+import { SendPlan } from './SendPlan';
+import { jsDiffKernel } from './ChangeDetect';
+
+class CapturingSocket implements UdpBatchSocket {
+    packets: Uint8Array[] = []; // Each datagram, flattened
+    dests: number[] = [];
+    sendBatch(
+        packets: UdpPacket[],
+        done: (nOk: number, nErr: number, err?: string) => void,
+        dests?: number[],
+    ) {
+        if (dests) this.dests.push(...dests);
+        for (const p of packets) {
+            const parts = udpPacketViews(p);
+            const d = new Uint8Array(parts.reduce((a, b) => a + b.length, 0));
+            let o = 0;
+            for (const b of parts) {
+                d.set(b, o);
+                o += b.length;
+            }
+            this.packets.push(d);
+        }
+        done(packets.length, 0);
+    }
+    close() {}
+}
+
+function twoPartJob() {
+    const job = new SenderJob();
+    job.parts.push({ bufIdx: 0, bufStart: 100, bufLen: 1000 });
+    job.parts.push({ bufIdx: 1, bufStart: 0, bufLen: 700 });
+    job.burstSize = 1_000_000;
+    return job;
+}
+
+function frameOf(...bufs: Uint8Array[]) {
+    const frame = new SendJob();
+    frame.dataBuffers = bufs;
+    return frame;
+}
+
+async function sendOneFrame(
+    sender: DDPSender | E131Sender,
+    frame: SendJob,
+    job: SenderJob,
+    state: SendJobSenderState,
+    now = 0,
+) {
+    state.reset();
+    sender.startBatch();
+    sender.startFrame();
+    state.beginPortion(job, now);
+    expect(sender.sendPortion(frame, job, state)).toBe(true);
+    sender.sendPush(frame, job, state);
+    await sender.endBatch()?.promise;
+}
+
+describe('SendPlan', () => {
+    it('cuts packets across parts', () => {
+        const plan = new SendPlan(twoPartJob(), 512, 10);
+        expect(plan.nPackets).toBe(4);
+        expect([...plan.packetLen]).toEqual([512, 512, 512, 164]);
+        expect([...plan.packetChOffset]).toEqual([0, 512, 1024, 1536]);
+        // Packet 1 straddles the two parts
+        expect(plan.firstSeg[2] - plan.firstSeg[1]).toBe(2);
+        expect(plan.segBufIdx[plan.firstSeg[1]]).toBe(0);
+        expect(plan.segStart[plan.firstSeg[1]]).toBe(612);
+        expect(plan.segLen[plan.firstSeg[1]]).toBe(488);
+        expect(plan.segBufIdx[plan.firstSeg[1] + 1]).toBe(1);
+        expect(plan.segLen[plan.firstSeg[1] + 1]).toBe(24);
+    });
+
+    it('starts a packet at each part when part-aligned', () => {
+        const plan = new SendPlan(twoPartJob(), 512, 10, true);
+        expect([...plan.packetLen]).toEqual([512, 488, 512, 188]);
+        expect([...plan.packetChOffset]).toEqual([0, 512, 1000, 1512]);
+        expect(plan.segLen.length).toBe(4);
+    });
+
+    it('points the packets at each frame buffer by offset, without cutting views', () => {
+        const plan = new SendPlan(twoPartJob(), 512, 10);
+        const a = [new Uint8Array(2000), new Uint8Array(1000)];
+        plan.bind(a);
+        const g = plan.gathers[1];
+        // Packet 1 straddles the two parts
+        expect(g.slice(1)).toEqual([a[0], 612, 488, a[1], 0, 24]);
+        expect(g[1]).toBe(a[0]);
+        const b = new Uint8Array(2000);
+        plan.bind([b, a[1]]);
+        expect(plan.gathers[1]).toBe(g);
+        expect(g[1]).toBe(b);
+        expect(plan.gathers[3][1]).toBe(a[1]);
+        expect(plan.gathers[3].slice(2)).toEqual([536, 164]);
+    });
+
+    it('sends the same DDP packets as building them per frame', async () => {
+        const sock = new CapturingSocket();
+        const backend: UdpBatchBackend = { name: 'capture', open: async () => sock };
+        const sender = new DDPSender();
+        sender.address = '127.0.0.1';
+        sender.udpBackend = backend;
+        sender.channelsPerPacket = 512;
+        sender.startChNum = 7;
+        await sender.connect();
+
+        const job = twoPartJob();
+        const b0 = new Uint8Array(2000).map((_v, i) => i & 0xff);
+        const b1 = new Uint8Array(1000).map((_v, i) => (i * 3) & 0xff);
+        const frame = frameOf(b0, b1);
+        const state = new SendJobSenderState();
+        await sendOneFrame(sender, frame, job, state);
+        await sendOneFrame(sender, frame, job, state);
+
+        // 4 data packets + push, twice; sequence numbers keep running
+        expect(sock.packets.length).toBe(10);
+        const all = new Uint8Array([...b0.subarray(100, 1100), ...b1.subarray(0, 700)]);
+        const hdr = new Uint8Array(10);
+        for (let f = 0; f < 2; ++f) {
+            for (let p = 0; p < 4; ++p) {
+                const got = sock.packets[f * 5 + p];
+                const len = Math.min(512, 1700 - p * 512);
+                fillInDDPHeader(hdr, 0, 7 + p * 512, len, false, f * 5 + p + 1);
+                expect(got.subarray(0, 10)).toEqual(hdr);
+                expect(got.subarray(10)).toEqual(all.subarray(p * 512, p * 512 + len));
+            }
+            fillInDDPHeader(hdr, 0, 7 + 1700, 0, true, f * 5 + 5);
+            expect(sock.packets[f * 5 + 4]).toEqual(hdr);
+        }
+    });
+
+    it('prebuilds E1.31 universes and patches the sequence', async () => {
+        const sock = new CapturingSocket();
+        const backend: UdpBatchBackend = { name: 'capture', open: async () => sock };
+        const sender = new E131Sender();
+        sender.address = '127.0.0.1';
+        sender.udpBackend = backend;
+        sender.startUniverse = 10;
+        sender.pushAtEnd = false;
+        await sender.connect();
+
+        const job = twoPartJob();
+        const frame = frameOf(new Uint8Array(2000), new Uint8Array(1000));
+        const state = new SendJobSenderState();
+        await sendOneFrame(sender, frame, job, state);
+        await sendOneFrame(sender, frame, job, state);
+
+        expect(sock.packets.length).toBe(8);
+        for (let i = 0; i < 8; ++i) {
+            const p = sock.packets[i];
+            expect(p[111]).toBe(i >> 2); // Per universe, one a frame
+            expect((p[113] << 8) | p[114]).toBe(10 + (i % 4));
+            expect(p.length).toBe(126 + (i % 4 === 3 ? 170 : 510));
+        }
+    });
+
+    it('sends multicast universes to their groups, then one sync', async () => {
+        const sock = new CapturingSocket();
+        let openedWith: unknown;
+        const backend: UdpBatchBackend = {
+            name: 'capture',
+            open: async (_type, _address, _port, _sendBufSize, multicast) => {
+                openedWith = multicast;
+                return sock;
+            },
+        };
+        const sender = new E131Sender();
+        sender.address = 'MULTICAST';
+        sender.udpBackend = backend;
+        sender.multicast = { ttl: 4 };
+        sender.universes = [5, 9];
+        sender.channelsPerPacket = 512;
+        sender.syncUniverse = 7;
+        sender.pushAtEnd = true;
+        await sender.connect();
+        expect(openedWith).toEqual({ ttl: 4 });
+
+        const job = new SenderJob();
+        job.parts.push({ bufIdx: 0, bufStart: 0, bufLen: 510 });
+        job.parts.push({ bufIdx: 0, bufStart: 1000, bufLen: 100 });
+        job.burstSize = 1_000_000;
+        const state = new SendJobSenderState();
+        await sendOneFrame(sender, frameOf(new Uint8Array(2000)), job, state);
+
+        expect(sock.dests).toEqual([e131MulticastAddress(5), e131MulticastAddress(9), e131MulticastAddress(7)]);
+        expect(e131MulticastAddress(0x1234)).toBe(((239 << 24) | (255 << 16) | 0x1234) >>> 0);
+        const [u5, u9, sync] = sock.packets;
+        expect(u5.length).toBe(126 + 510);
+        expect(u9.length).toBe(126 + 100);
+        expect((u9[113] << 8) | u9[114]).toBe(9);
+        // Data packets name the sync universe; the sync packet carries it too
+        expect((u5[109] << 8) | u5[110]).toBe(7);
+        expect(sync.length).toBe(49);
+        expect((sync[45] << 8) | sync[46]).toBe(7);
+    });
+
+    it('counts the sequence per universe, and for the sync universe', async () => {
+        const sock = new CapturingSocket();
+        const backend: UdpBatchBackend = { name: 'capture', open: async () => sock };
+        const sender = new E131Sender();
+        sender.address = 'MULTICAST';
+        sender.udpBackend = backend;
+        sender.multicast = {};
+        sender.universes = Array.from({ length: 300 }, (_v, i) => i + 1);
+        sender.syncUniverse = 1000;
+        sender.pushAtEnd = true;
+        sender.skipUnchanged = true;
+        sender.keepaliveMs = 1000;
+        await sender.connect();
+
+        const job = new SenderJob();
+        for (let u = 0; u < 300; ++u) job.parts.push({ bufIdx: 0, bufStart: u * 510, bufLen: 510 });
+        job.burstSize = 100_000_000;
+        const frame = frameOf(new Uint8Array(300 * 510));
+        const state = new SendJobSenderState();
+        const last = new Map<number, number>();
+        for (let f = 0; f < 300; ++f) {
+            // Only some universes change, so the others are skipped on most frames
+            frame.dataBuffers[0][((f * 7) % 300) * 510] = f;
+            await sendOneFrame(sender, frame, job, state, f * 25);
+            for (const p of sock.packets.splice(0)) {
+                const universe = p.length === 49 ? -1 : (p[113] << 8) | p[114];
+                const seq = p.length === 49 ? p[44] : p[111];
+                const prev = last.get(universe);
+                if (prev !== undefined) expect(seq).toBe((prev + 1) & 0xff);
+                last.set(universe, seq);
+            }
+        }
+        expect(last.size).toBe(301);
+    });
+
+    it('skips unchanged packets, with keepalive and full frames', async () => {
+        const sock = new CapturingSocket();
+        const backend: UdpBatchBackend = { name: 'capture', open: async () => sock };
+        const sender = new DDPSender();
+        sender.address = '127.0.0.1';
+        sender.udpBackend = backend;
+        sender.channelsPerPacket = 512;
+        sender.pushAtEnd = false; // Push flag on the last packet
+        sender.skipUnchanged = true;
+        sender.keepaliveMs = 1000;
+        await sender.connect();
+
+        const job = twoPartJob();
+        const frame = frameOf(new Uint8Array(2000), new Uint8Array(1000));
+        sender.compilePlan(job);
+        const state = new SendJobSenderState();
+        const sent = () => sock.packets.splice(0).map((p) => (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7]);
+
+        await sendOneFrame(sender, frame, job, state, 0);
+        expect(sent()).toEqual([0, 512, 1024, 1536]);
+
+        await sendOneFrame(sender, frame, job, state, 25);
+        expect(sent()).toEqual([]);
+        expect(state.bytesSkippedCumulative).toBe(1700 + 40);
+
+        // A change in the second packet; the last one goes too, for its push flag
+        frame.dataBuffers[0][700] = 1;
+        await sendOneFrame(sender, frame, job, state, 50);
+        expect(sent()).toEqual([512, 1536]);
+
+        // Change in the second part (job channel 1100)
+        frame.dataBuffers[1][100] = 1;
+        await sendOneFrame(sender, frame, job, state, 75);
+        expect(sent()).toEqual([1024, 1536]);
+
+        // Keepalive for the packet last sent at 0; the last one goes for its push flag
+        await sendOneFrame(sender, frame, job, state, 1000);
+        expect(sent()).toEqual([0, 1536]);
+        await sendOneFrame(sender, frame, job, state, 1050);
+        expect(sent()).toEqual([512, 1536]);
+
+        state.fullFramePending = true;
+        await sendOneFrame(sender, frame, job, state, 1100);
+        expect(sent()).toEqual([0, 512, 1024, 1536]);
+    });
+
+    it('diffs and copies with the JS kernel', () => {
+        const src = new Uint8Array(100).map((_v, i) => i);
+        const shadow = new Uint8Array(100);
+        const changed = new Uint8Array(3);
+        const n = jsDiffKernel.diffCopy(
+            src,
+            shadow,
+            new Uint32Array([0, 50, 90]),
+            new Uint32Array([0, 50, 90]),
+            new Uint32Array([1, 40, 20]), // The last runs past the end of src
+            0,
+            3,
+            changed,
+        );
+        expect(n).toBe(2);
+        expect([...changed]).toEqual([0, 1, 1]);
+        expect(shadow.subarray(50)).toEqual(src.subarray(50));
+    });
+});
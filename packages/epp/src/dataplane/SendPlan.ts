@@ -0,0 +1,174 @@
+import { DiffKernel } from './ChangeDetect';
+import { SenderJob } from './SenderJob';
+
+/**
+ * A sender's packets for one SenderJob, cut once when the controller is opened.
+ *  Each packet has a prebuilt header and a fixed list of frame-buffer segments;
+ *  per frame the sender only patches the sequence byte, so nothing is allocated
+ *  per packet.
+ *
+ * The gather lists ([header, then buffer, offset, length per segment]; see UdpPacket)
+ *  are handed straight to the socket.  bind() puts a new frame buffer in place
+ *  without cutting views of it, so frames that are new objects each time cost nothing.
+ */
+export class SendPlan {
+    readonly job: SenderJob;
+    readonly nPackets: number;
+    readonly headerLen: number;
+    readonly headers: Uint8Array[] = [];
+    readonly gathers: (Uint8Array | number)[][] = [];
+
+    // Per packet: payload length, channel offset of its first byte within the job,
+    //  and its segments (firstSeg[i] .. firstSeg[i + 1] - 1)
+    readonly packetLen: Uint32Array;
+    readonly packetChOffset: Uint32Array;
+    readonly firstSeg: Uint32Array;
+    // Per segment: which frame buffer, and the range within it
+    readonly segBufIdx: Uint32Array;
+    readonly segStart: Uint32Array;
+    readonly segLen: Uint32Array;
+    readonly segChOffset: Uint32Array; // Channel offset within the job, also the offset into `shadow`
+    readonly totalChannels: number;
+    // Per packet destination (IPv4, as a number) for senders on an unconnected socket, e.g. E1.31 multicast
+    dests?: Uint32Array;
+
+    // Change detection (enableChangeDetection): the data as last sent, which segments
+    //  differed from it this frame, and when each packet last went out
+    shadow?: Uint8Array;
+    segChanged?: Uint8Array;
+    lastSentAt?: Float64Array;
+
+    private boundBufs: Uint8Array[] = [];
+
+    /**
+     * With `partAligned`, each part starts a new packet (e.g. one E1.31 universe per part);
+     *  otherwise packets run across part boundaries.
+     */
+    constructor(job: SenderJob, channelsPerPacket: number, headerLen: number, partAligned = false) {
+        this.job = job;
+        this.headerLen = headerLen;
+
+        let total = 0;
+        let nSegs = 0;
+        let nPackets = 0;
+        let inPacket = 0; // Channels in the open packet
+        for (const part of job.parts) {
+            if (part.bufLen <= 0) continue;
+            if (partAligned) inPacket = 0;
+            // Segments of a part: the piece finishing the open packet, then one per packet
+            const inFirst = inPacket ? Math.min(part.bufLen, channelsPerPacket - inPacket) : 0;
+            const nNew = Math.ceil((part.bufLen - inFirst) / channelsPerPacket);
+            nSegs += (inFirst ? 1 : 0) + nNew;
+            nPackets += nNew;
+            inPacket = (inPacket + part.bufLen) % channelsPerPacket;
+            total += part.bufLen;
+        }
+        this.totalChannels = total;
+        this.nPackets = nPackets;
+        this.packetLen = new Uint32Array(this.nPackets);
+        this.packetChOffset = new Uint32Array(this.nPackets);
+        this.firstSeg = new Uint32Array(this.nPackets + 1);
+        this.segBufIdx = new Uint32Array(nSegs);
+        this.segStart = new Uint32Array(nSegs);
+        this.segLen = new Uint32Array(nSegs);
+        this.segChOffset = new Uint32Array(nSegs);
+
+        let pkt = -1;
+        let seg = 0;
+        let chOff = 0;
+        inPacket = 0;
+        for (const part of job.parts) {
+            if (part.bufLen <= 0) continue;
+            if (partAligned) inPacket = 0;
+            for (let off = 0; off < part.bufLen; ) {
+                if (inPacket === 0) {
+                    ++pkt;
+                    this.firstSeg[pkt] = seg;
+                    this.packetChOffset[pkt] = chOff;
+                }
+                const len = Math.min(part.bufLen - off, channelsPerPacket - inPacket);
+                this.segBufIdx[seg] = part.bufIdx;
+                this.segStart[seg] = part.bufStart + off;
+                this.segLen[seg] = len;
+                this.segChOffset[seg] = chOff;
+                this.packetLen[pkt] += len;
+                ++seg;
+                off += len;
+                chOff += len;
+                inPacket = (inPacket + len) % channelsPerPacket;
+            }
+        }
+        this.firstSeg[this.nPackets] = seg;
+
+        for (let i = 0; i < this.nPackets; ++i) {
+            const hdr = new Uint8Array(headerLen);
+            this.headers.push(hdr);
+            const g: (Uint8Array | number)[] = [hdr];
+            for (let s = this.firstSeg[i]; s < this.firstSeg[i + 1]; ++s) {
+                g.push(hdr, this.segStart[s], this.segLen[s]); // Header as a placeholder until bind()
+            }
+            this.gathers.push(g);
+        }
+    }
+
+    /** Point the payload views at this frame's buffers */
+    bind(dataBuffers: Uint8Array[]) {
+        let changed = false;
+        for (let b = 0; b < dataBuffers.length; ++b) {
+            if (this.boundBufs[b] !== dataBuffers[b]) changed = true;
+        }
+        if (!changed) return;
+        for (let i = 0; i < this.nPackets; ++i) {
+            const g = this.gathers[i];
+            for (let s = this.firstSeg[i], k = 1; s < this.firstSeg[i + 1]; ++s, k += 3) {
+                g[k] = dataBuffers[this.segBufIdx[s]];
+            }
+        }
+        for (let b = 0; b < dataBuffers.length; ++b) this.boundBufs[b] = dataBuffers[b];
+    }
+
+    enableChangeDetection() {
+        this.shadow = new Uint8Array(this.totalChannels);
+        this.segChanged = new Uint8Array(this.segLen.length);
+        this.lastSentAt = new Float64Array(this.nPackets).fill(-Infinity);
+    }
+
+    /** Compare this frame with the shadow, one kernel call per run of segments from the same buffer */
+    detectChanges(dataBuffers: Uint8Array[], kernel: DiffKernel) {
+        if (!this.shadow || !this.segChanged) return;
+        const nSegs = this.segLen.length;
+        for (let first = 0; first < nSegs; ) {
+            const b = this.segBufIdx[first];
+            let end = first + 1;
+            while (end < nSegs && this.segBufIdx[end] === b) ++end;
+            kernel.diffCopy(
+                dataBuffers[b],
+                this.shadow,
+                this.segStart,
+                this.segChOffset,
+                this.segLen,
+                first,
+                end - first,
+                this.segChanged,
+            );
+            first = end;
+        }
+    }
+
+    /** Whether any segment of packet `i` differed in the last detectChanges */
+    packetChanged(i: number) {
+        if (!this.segChanged) return true;
+        for (let s = this.firstSeg[i]; s < this.firstSeg[i + 1]; ++s) {
+            if (this.segChanged[s]) return true;
+        }
+        return false;
+    }
+
+    /** True if this plan was cut for `job` as it is now */
+    matches(job: SenderJob) {
+        if (job !== this.job) return false;
+        let total = 0;
+        for (let i = 0; i < job.parts.length; ++i) total += Math.max(0, job.parts[i].bufLen);
+        return total === this.totalChannels;
+    }
+}
@@ -3,6 +3,7 @@ import { ControllerRec } from '../xlcompat/XLXmlUtil';
 import { ControllerSetup } from '../controllers/controllertypes';
 import { SendBatch } from './protocols/UDP';
 import { SchedulerHeapItem, SchedulerMinHeap } from './SchedulerHeap';
+import type { ChannelRemap } from './ColorRemap';
 
 export interface Sender {
     controllerSetup?: ControllerSetup;
@@ -12,7 +13,9 @@ export interface Sender {
     startFrame(): void;
     endFrame(): void;
     startBatch(): void;
+    flushBatch(): void;
     endBatch(): SendBatch | undefined;
+    // Send what state.tokens allows; true when this sender is done with the frame
     sendPortion(frame: SendJob, job: SenderJob, state: SendJobSenderState): boolean;
     sendPush(frame: SendJob, job: SenderJob, state: SendJobSenderState): void;
     suspend(): void;
@@ -34,6 +37,7 @@ export class SenderJobPart {
 
 export class SenderJob {
     parts: SenderJobPart[] = [];
+    // Token bucket: up to burstSize bytes go out back-to-back, refilled at rateLimit
     rateLimit: number = 1000000000; // bytes per millisecond
     burstSize: number = 10000; // bytes per send batch
 
@@ -44,8 +48,11 @@ export class SenderJob {
 export class SendJob {
     dataBuffers: Uint8Array[] = [];
     senders: SenderJob[] = [];
+    // Controllers sent in another color order; remap k fills dataBuffers[k + 1] from the frame each frame
+    remaps: ChannelRemap[] = [];
 
     frameNumber: number = -1;
+    fullFrame: boolean = false; // Send every packet, changed or not (e.g. at sequence start); cleared by initialize
 }
 
 export class SendJobSenderState implements SchedulerHeapItem {
@@ -53,6 +60,11 @@ export class SendJobSenderState implements SchedulerHeapItem {
 
     curPart: number = 0;
     curOffset: number = 0;
+    curPacket: number = 0; // Packets of the sender's SendPlan gone through this frame
+    startPacket: number = 0; // Plan packet the frame starts at; moves on when a frame is cut short
+    framePrepared: boolean = false; // Per-frame work (change detection) done
+    framePacketsSent: number = 0;
+    fullFramePending: boolean = false; // Set until this sender gets a whole frame out
     nextTime: number = 0;
 
     curChNum: number = 0;
@@ -60,6 +72,70 @@ export class SendJobSenderState implements SchedulerHeapItem {
     skippingThisFrame: boolean = false;
     lastSendTime: number = 0;
 
+    // Token bucket, kept as the time the bucket would be empty; carries over between frames
+    bucketTime: number = 0;
+    tokens: number = 0; // Budget for the current sendPortion, bytes
+    portionBytes: number = 0; // Sent in the current sendPortion
+
+    // Achieved-rate counters
+    bytesSentCumulative: number = 0;
+    paceWaitsCumulative: number = 0;
+    bytesSkippedCumulative: number = 0; // Unchanged packets not sent
+    framesCutCumulative: number = 0; // Frames not finished by the next frame's due time
+    frameStartTime: number = -1;
+    frameBytes: number = 0;
+    framePaceWaits: number = 0;
+    lastPacedBytes: number = 0; // Bytes sent ahead of the last portion of the last paced frame
+    lastPacedWindow: number = 0; // ms from the first to the last portion of that frame
+
+    /** Called by senders for each packet handed to the socket */
+    countSent(bytes: number) {
+        this.tokens -= bytes;
+        this.portionBytes += bytes;
+    }
+
+    beginPortion(job: SenderJob, now: number) {
+        if (this.frameStartTime < 0) this.frameStartTime = now;
+        this.tokens = job.burstSize - Math.max(0, this.bucketTime - now) * job.rateLimit;
+        this.portionBytes = 0;
+    }
+
+    endPortion(job: SenderJob, now: number) {
+        this.bucketTime = Math.max(this.bucketTime, now) + this.portionBytes / job.rateLimit;
+        this.bytesSentCumulative += this.portionBytes;
+        this.frameBytes += this.portionBytes;
+    }
+
+    /** Earliest time at which `bytes` tokens are available */
+    timeForTokens(job: SenderJob, bytes: number) {
+        return this.bucketTime - (job.burstSize - Math.min(bytes, job.burstSize)) / job.rateLimit;
+    }
+
+    /** `now` is the start of the frame's final portion */
+    endFrame(now: number) {
+        this.fullFramePending = false;
+        if (!this.framePaceWaits) return;
+        this.lastPacedBytes = this.frameBytes - this.portionBytes;
+        this.lastPacedWindow = now - this.frameStartTime;
+    }
+
+    /**
+     * Out of time for this frame: the rest of it is dropped, and the next frame starts where this one
+     *  stopped, so a controller too slow for its data still gets all of it updated, just less often.
+     *  What was not sent may not show as changed next frame, so that one goes out in full.
+     */
+    cutFrame() {
+        this.startPacket += this.curPacket;
+        this.fullFramePending = true;
+        ++this.framesCutCumulative;
+        this.nextTime = Infinity;
+    }
+
+    /** Send rate over the last paced frame, bytes/ms; 0 if nothing had to be paced yet */
+    achievedRate() {
+        return this.lastPacedWindow > 0 ? this.lastPacedBytes / this.lastPacedWindow : 0;
+    }
+
     curDDPSeqNum: number = 1; // E131 uses low bits.
     getDDPSeqNum() {
         return this.curDDPSeqNum;
@@ -71,14 +147,24 @@ export class SendJobSenderState implements SchedulerHeapItem {
         return rv;
     }
 
-    curE131SeqNum: number = 0; // DDP uses this as 1-15; E131 uses low bits.
-    getE131SeqNum() {
-        return this.curE131SeqNum & 0xff;
+    // E1.31 receivers check the sequence per universe (and drop a packet up to 20 behind the last),
+    //  so each universe (plan packet) has its own count, and the sync universe another
+    e131UniverseSeq: Uint8Array = new Uint8Array(0);
+    e131SyncSeq: number = 0;
+    nextE131UniverseSeqNum(packet: number) {
+        if (packet >= this.e131UniverseSeq.length) {
+            const grown = new Uint8Array(Math.max(packet + 1, this.e131UniverseSeq.length * 2));
+            grown.set(this.e131UniverseSeq);
+            this.e131UniverseSeq = grown;
+        }
+        const rv = this.e131UniverseSeq[packet];
+        this.e131UniverseSeq[packet] = rv + 1; // Wraps at 256
+        return rv;
     }
-    nextE131SeqNum() {
-        const rv = this.curE131SeqNum;
-        ++this.curE131SeqNum;
-        return rv & 0xff;
+    nextE131SyncSeqNum() {
+        const rv = this.e131SyncSeq;
+        this.e131SyncSeq = (rv + 1) & 0xff;
+        return rv;
     }
 
     sendPacketNumber: number = 0;
@@ -91,9 +177,15 @@ export class SendJobSenderState implements SchedulerHeapItem {
     reset() {
         this.curPart = 0;
         this.curOffset = 0;
+        this.curPacket = 0;
+        this.framePrepared = false;
+        this.framePacketsSent = 0;
         this.nextTime = 0;
         this.curChNum = 0;
         this.sendPacketNumber = 0;
+        this.frameStartTime = -1;
+        this.frameBytes = 0;
+        this.framePaceWaits = 0;
     }
 }
 
@@ -120,6 +212,7 @@ export class SendJobState {
         let i = 0;
         for (const s of this.states) {
             s.reset();
+            if (job.fullFrame) s.fullFramePending = true;
             const frameTime = job.senders[i].sender?.minFrameTime() ?? 0;
             if (sendTime < s.lastSendTime + frameTime - 0.1) {
                 s.skippingThisFrame = true;
@@ -138,8 +231,30 @@ export class SendJobState {
                     s.lastSendTime = sendTime;
                 }
             }
+            if (s.skippingThisFrame) s.nextTime = Infinity;
             ++i;
         }
+        job.fullFrame = false;
+        // nextTime was reset outside the heap's knowledge; rebuild it
+        this.sendHeap.clear();
+        for (const s of this.states) this.sendHeap.insert(s);
         return { skipsDueToReq, skipsDueToSlowCtrl };
     }
+
+    /** Pacing counters for one sender, if it is part of the current job */
+    senderStats(sender: Sender) {
+        const idx = this.job?.senders.findIndex((sj) => sj.sender === sender) ?? -1;
+        const s = idx >= 0 ? this.states[idx] : undefined;
+        const sj = idx >= 0 ? this.job?.senders[idx] : undefined;
+        if (!s || !sj) return undefined;
+        return {
+            rateLimit: sj.rateLimit,
+            burstSize: sj.burstSize,
+            bytesSent: s.bytesSentCumulative,
+            paceWaits: s.paceWaitsCumulative,
+            bytesSkipped: s.bytesSkippedCumulative,
+            framesCut: s.framesCutCumulative,
+            achievedRate: s.achievedRate(),
+        };
+    }
 }
@@ -1,6 +1,7 @@
 import dgram from 'dgram';
 import { SendBatch, UdpClient, UDPSender } from './UDP';
 import { Sender, SenderJob, SendJob, SendJobSenderState } from '../SenderJob';
+import { SendPlan } from '../SendPlan';
 import { toDataView } from '../../util/Utils';
 
 export const DDP_PORT_DEFAULT = 4048;
@@ -145,7 +146,6 @@ export class DDPSender extends UDPSender {
     channelsPerPacket: number = DDP_MAX_PAYLOAD;
     port: number = DDP_PORT_DEFAULT;
     sendBufSize?: number = undefined;
-    headers: Uint8Array[] = []; // Max header size
     pushHeader: Uint8Array = new Uint8Array(10);
 
     curPacketNum = 0;
@@ -164,6 +164,7 @@ export class DDPSender extends UDPSender {
                 this.address,
                 this.port,
                 this.sendBufSize ?? 6_250_000 /*1Gbps 50ms*/,
+                this.udpBackend,
             );
         }
         if (!this.client.isConnected()) {
@@ -171,76 +172,36 @@ export class DDPSender extends UDPSender {
         }
     }
 
-    sendPortion(frame: SendJob, job: SenderJob, state: SendJobSenderState): boolean {
-        const connected = this.client?.isConnected();
-        if (!this.client || !connected) return true;
-
-        const burst = job.burstSize;
-        let rlLeftToSend = burst;
-
-        let bytesThisPacket = 0;
-        let packetBufs: Uint8Array[] = [];
-
-        const sendOut = (last: boolean) => {
-            if (!bytesThisPacket) return;
-            if (this.curPacketNum >= this.headers.length) {
-                this.headers.push(new Uint8Array(this.useTimecodes ? 14 : 10));
-            }
-            const hdr = this.headers[this.curPacketNum];
+    protected buildPlan(job: SenderJob) {
+        const plan = new SendPlan(job, this.channelsPerPacket, this.useTimecodes ? 14 : 10);
+        for (let i = 0; i < plan.nPackets; ++i) {
             fillInDDPHeader(
-                hdr,
+                plan.headers[i],
+                0,
+                this.startChNum + plan.packetChOffset[i],
+                plan.packetLen[i],
+                !this.pushAtEnd && i === plan.nPackets - 1,
                 0,
-                this.startChNum + state.curChNum,
-                bytesThisPacket,
-                !this.pushAtEnd && last,
-                state.nextDDPSeqNum(),
             );
-            this.client!.addSendToBatch([hdr, ...packetBufs]);
-            packetBufs = [];
-            state.curChNum += bytesThisPacket;
-            bytesThisPacket = 0;
-            ++this.curPacketNum;
-        };
-
-        // Outer loop - go through all the parts
-        //  When to return: all done, or budget hit and we're about to enqueue
-        // OK go through and do it ALL... and update the next send time based on the token bucket
-        for (; state.curPart < job.parts.length; ) {
-            const part = job.parts[state.curPart];
-            const leftThisJob = part.bufLen - state.curOffset;
-            if (!leftThisJob) {
-                ++state.curPart;
-                state.curOffset = 0;
-                continue;
-            }
-
-            const avToSend = this.channelsPerPacket - bytesThisPacket;
-
-            if (avToSend === 0) {
-                // Only way to make progress is to send -- and we know there is more.
-                rlLeftToSend -= bytesThisPacket;
-                sendOut(false);
-                continue;
-            }
-
-            // Slice, scatter gather, fragment, etc.
-            const buf = frame.dataBuffers[part.bufIdx];
-            const thisJob = Math.min(avToSend, leftThisJob);
-            packetBufs.push(buf.subarray(state.curOffset + part.bufStart, state.curOffset + part.bufStart + thisJob));
-            bytesThisPacket += thisJob;
-            state.curOffset += thisJob;
         }
+        fillInDDPHeader(this.pushHeader, 0, this.startChNum + plan.totalChannels, 0, true, 0);
+        return plan;
+    }
 
-        // TODO EZP Rate limit write-back
+    protected stampSequence(hdr: Uint8Array, state: SendJobSenderState) {
+        hdr[1] = (state.nextDDPSeqNum() % 15) + 1;
+    }
 
-        // May have stuff left...
-        sendOut(true);
-        return true;
+    protected lastPacketPushes() {
+        return !this.pushAtEnd;
     }
 
     sendPush(_frame: SendJob, _job: SenderJob, state: SendJobSenderState): void {
+        // With change detection, nothing to push if nothing was sent
+        if (this.plan?.lastSentAt && !state.framePacketsSent) return;
         if (this.pushAtEnd) {
-            fillInDDPHeader(this.pushHeader, 0, this.startChNum + state.curChNum, 0, true, state.nextDDPSeqNum());
+            // Prebuilt by compilePlan
+            this.pushHeader[1] = (state.nextDDPSeqNum() % 15) + 1;
             if (this.client?.isConnected()) {
                 this.client?.addSendToBatch(this.pushHeader);
             }
@@ -1,5 +1,6 @@
-import { UdpClient, UDPSender } from './UDP';
+import { UdpClient, UdpMulticastOptions, UDPSender } from './UDP';
 import { SenderJob, SendJob, SendJobSenderState } from '../SenderJob';
+import { SendPlan } from '../SendPlan';
 import { toDataView } from '../../util/Utils';
 
 export const E131_PORT_DEFAULT = 5568;
@@ -143,14 +144,22 @@ function buildE131SyncPacket(rsyncData: Uint8Array, syncUniverse: number, sequen
     syncData.setUint16(45, syncUniverse, false);
 }
 
+/** Multicast group of a universe, 239.255.hi.lo (as a number) */
+export function e131MulticastAddress(universe: number) {
+    return ((239 << 24) | (255 << 16) | (universe & 0xffff)) >>> 0;
+}
+
 export class E131Sender extends UDPSender {
     startUniverse: number = 0; // Unclear how to do refragmentation on this...
+    // Universe of each packet, if not consecutive from startUniverse; each job part then starts a packet
+    universes?: number[] = undefined;
     syncUniverse: number = 0;
     channelsPerPacket: number = 510;
     pushAtEnd: boolean = true;
     useTimecodes: boolean = false;
+    // If set, each universe goes to its multicast group (and the sync to the sync universe's), not to `address`
+    multicast?: UdpMulticastOptions = undefined;
 
-    headers: Buffer[] = [];
     syncPacket = Buffer.alloc(E131_SYNCPACKET_LEN);
     sendBufSize?: number = undefined;
 
@@ -162,6 +171,8 @@ export class E131Sender extends UDPSender {
                 this.address,
                 E131_PORT_DEFAULT,
                 this.sendBufSize ?? 625_000 /*100Mbps 50ms*/,
+                this.udpBackend,
+                this.multicast,
             );
         }
         if (!this.client.isConnected()) {
@@ -169,6 +180,8 @@ export class E131Sender extends UDPSender {
         }
     }
 
+    private syncDest?: number = undefined;
+
     curPacketNum = 0;
     startFrame(): void {
         this.curPacketNum = 0;
@@ -177,73 +190,36 @@ export class E131Sender extends UDPSender {
         // This would be a time to push at end?
     }
 
-    sendPortion(frame: SendJob, job: SenderJob, state: SendJobSenderState): boolean {
-        const connected = this.client?.isConnected();
-        if (!this.client || !connected) return true;
-
-        const burst = job.burstSize;
-        let rlLeftToSend = burst;
-
-        let bytesThisPacket = 0;
-        let packetBufs: Uint8Array[] = [];
-
+    protected buildPlan(job: SenderJob) {
         // TODO: We may be asked to do scattered universes and fractional packets.  Not now, but at some point.
-        const sendOut = (sourceName: string, _last: boolean) => {
-            if (!bytesThisPacket) return;
-            const univ = state.sendPacketNum() + this.startUniverse;
-            if (this.curPacketNum >= this.headers.length) {
-                this.headers.push(Buffer.alloc(E131_PACKET_HEADERLEN));
-            }
-            const hdr = this.headers[this.curPacketNum];
-            fillE131PacketHeader(hdr, univ, sourceName, state.nextE131SeqNum(), bytesThisPacket);
-            this.client!.addSendToBatch([hdr, ...packetBufs]);
-            packetBufs = [];
-            state.curChNum += bytesThisPacket;
-            bytesThisPacket = 0;
-            ++this.curPacketNum;
-        };
-
-        // Outer loop - go through all the parts
-        //  When to return: all done, or budget hit and we're about to enqueue
-        // OK go through and do it ALL... and update the next send time based on the token bucket
-        for (; state.curPart < job.parts.length; ) {
-            const part = job.parts[state.curPart];
-            const leftThisJob = part.bufLen - state.curOffset;
-            if (!leftThisJob) {
-                ++state.curPart;
-                state.curOffset = 0;
-                continue;
-            }
-
-            const avToSend = this.channelsPerPacket - bytesThisPacket;
-
-            if (avToSend === 0) {
-                // Only way to make progress is to send -- and we know there is more.
-                rlLeftToSend -= bytesThisPacket;
-                sendOut('blaBlaBLA', false);
-                continue;
-            }
-
-            // Slice, scatter gather, fragment, etc.
-            const buf = frame.dataBuffers[part.bufIdx];
-            const thisJob = Math.min(avToSend, leftThisJob);
-            packetBufs.push(buf.subarray(state.curOffset + part.bufStart, state.curOffset + part.bufStart + thisJob));
-            bytesThisPacket += thisJob;
-            state.curOffset += thisJob;
+        const plan = new SendPlan(job, this.channelsPerPacket, E131_PACKET_HEADERLEN, !!this.universes);
+        const sync = this.pushAtEnd ? this.syncUniverse : 0;
+        if (this.multicast) plan.dests = new Uint32Array(plan.nPackets);
+        for (let i = 0; i < plan.nPackets; ++i) {
+            const universe = this.universes?.[i] ?? this.startUniverse + i;
+            fillE131PacketHeader(plan.headers[i], universe, 'blaBlaBLA', 0, plan.packetLen[i]);
+            // Receivers hold the data until the sync packet, if there is one
+            plan.headers[i][109] = sync >> 8;
+            plan.headers[i][110] = sync & 0xff;
+            if (plan.dests) plan.dests[i] = e131MulticastAddress(universe);
         }
+        buildE131SyncPacket(this.syncPacket, this.syncUniverse, 0);
+        this.syncDest = this.multicast ? e131MulticastAddress(this.syncUniverse) : undefined;
+        return plan;
+    }
 
-        // TODO EZP Rate limit write-back
-
-        // May have stuff left...
-        sendOut('blaBlaBLA', true);
-        return true;
+    protected stampSequence(hdr: Uint8Array, state: SendJobSenderState, packet: number) {
+        hdr[111] = state.nextE131UniverseSeqNum(packet);
     }
 
-    async sendPush(_frame: SendJob, _job: SenderJob, state: SendJobSenderState): Promise<void> {
+    sendPush(_frame: SendJob, _job: SenderJob, state: SendJobSenderState): void {
+        // With change detection, nothing to sync if nothing was sent
+        if (this.plan?.lastSentAt && !state.framePacketsSent) return;
         if (this.pushAtEnd) {
-            buildE131SyncPacket(this.syncPacket, this.syncUniverse, state.nextE131SeqNum());
+            // Prebuilt by compilePlan
+            this.syncPacket[44] = state.nextE131SyncSeqNum();
             if (this.client?.isConnected()) {
-                this.client?.addSendToBatch(this.syncPacket);
+                this.client?.addSendToBatch(this.syncPacket, this.syncDest);
             }
         }
     }
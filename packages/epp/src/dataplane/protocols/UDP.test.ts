@@ -0,0 +1,113 @@
+import { describe, it, expect } from 'vitest';
+import { UdpBatchBackend, UdpBatchSocket, UdpClient, UdpPacket } from './UDP';
+
+class FakeBatchSocket implements UdpBatchSocket {
+    batches: UdpPacket[][] = [];
+    pending: (() => void)[] = [];
+    failNext = 0;
+    closed = false;
+
+    sendBatch(packets: UdpPacket[], done: (nOk: number, nErr: number, err?: string) => void) {
+        this.batches.push(packets);
+        const nErr = Math.min(this.failNext, packets.length);
+        this.failNext = 0;
+        this.pending.push(() => done(packets.length - nErr, nErr, nErr ? 'refused' : undefined));
+    }
+    close() {
+        this.closed = true;
+    }
+    completeAll() {
+        const p = this.pending;
+        this.pending = [];
+        for (const f of p) f();
+    }
+}
+
+function fakeBackend(sock: FakeBatchSocket): UdpBatchBackend {
+    return { name: 'fake', open: async () => sock };
+}
+
+describe('UdpClient with batch backend', () => {
+    it('hands a whole batch over at once and completes once', async () => {
+        const sock = new FakeBatchSocket();
+        const client = new UdpClient('udp4', '127.0.0.1', 4048, undefined, fakeBackend(sock));
+        await client.connect();
+        expect(client.isConnected()).toBe(true);
+
+        client.startSendBatch();
+        client.addSendToBatch([new Uint8Array(10), new Uint8Array(100)]);
+        client.addSendToBatch([new Uint8Array(10), new Uint8Array(50)]);
+        client.addSendToBatch(new Uint8Array(10));
+        expect(sock.batches.length).toBe(0);
+
+        let completions = 0;
+        const sb = client.endSendBatch(() => ++completions)!;
+        expect(sock.batches.length).toBe(1);
+        expect(sock.batches[0].length).toBe(3);
+        expect(client.batchesInFlight).toBe(1);
+        expect(sb.isComplete()).toBe(false);
+
+        sock.completeAll();
+        await sb.promise;
+        expect(completions).toBe(1);
+        expect(sb.nSCBs).toBe(3);
+        expect(sb.nECBs).toBe(0);
+        expect(client.batchesInFlight).toBe(0);
+        expect(client.nSent).toBe(3);
+        expect(client.bytesSent).toBe(180);
+    });
+
+    it('counts errors reported by the backend', async () => {
+        const sock = new FakeBatchSocket();
+        const client = new UdpClient('udp4', '127.0.0.1', 4048, undefined, fakeBackend(sock));
+        await client.connect();
+
+        sock.failNext = 1;
+        client.startSendBatch();
+        client.addSendToBatch(new Uint8Array(10));
+        client.addSendToBatch(new Uint8Array(10));
+        const sb = client.endSendBatch()!;
+        sock.completeAll();
+        await sb.promise;
+        expect(sb.nSCBs).toBe(1);
+        expect(sb.nECBs).toBe(1);
+        expect(sb.err?.message).toBe('refused');
+        expect(client.nErrors).toBe(1);
+    });
+
+    it('flushes collected packets without closing the batch', async () => {
+        const sock = new FakeBatchSocket();
+        const client = new UdpClient('udp4', '127.0.0.1', 4048, undefined, fakeBackend(sock));
+        await client.connect();
+
+        client.startSendBatch();
+        client.addSendToBatch(new Uint8Array(10));
+        client.addSendToBatch(new Uint8Array(10));
+        client.flushSendBatch();
+        expect(sock.batches.length).toBe(1);
+        sock.completeAll();
+        client.addSendToBatch(new Uint8Array(10));
+
+        let completions = 0;
+        const sb = client.endSendBatch(() => ++completions)!;
+        expect(sock.batches.length).toBe(2);
+        expect(sb.isComplete()).toBe(false);
+        sock.completeAll();
+        await sb.promise;
+        expect(completions).toBe(1);
+        expect(sb.nSCBs).toBe(3);
+        expect(client.batchesInFlight).toBe(0);
+    });
+
+    it('completes an empty batch immediately', async () => {
+        const sock = new FakeBatchSocket();
+        const client = new UdpClient('udp4', '127.0.0.1', 4048, undefined, fakeBackend(sock));
+        await client.connect();
+
+        client.startSendBatch();
+        const sb = client.endSendBatch()!;
+        await sb.promise;
+        expect(sock.batches.length).toBe(0);
+        expect(client.batchesInFlight).toBe(0);
+    });
+});
@@ -1,6 +1,8 @@
 import dgram from 'dgram';
 import { Sender, SenderJob, SendJob, SendJobSenderState } from '../SenderJob';
 import { ControllerState } from '../../xlcompat/XLControllerSetup';
+import { SendPlan } from '../SendPlan';
+import { DiffKernel, jsDiffKernel } from '../ChangeDetect';
 
 ////
 // UDP is interesting, errors coming back can slow down processing
@@ -13,6 +15,106 @@ import { ControllerState } from '../../xlcompat/XLControllerSetup';
 //   Top level issues sends - we deliver those as we can
 //     After the sends are called, top level gets a batch object
 //     This can be awaited
+// If a UdpBatchBackend is supplied, the packets of a batch are collected
+//   and handed over together at endSendBatch (e.g. to a native sendmmsg
+//   implementation), and complete with one callback instead of one per packet.
+// A client opened with multicast options is not connected to one address;
+//   each packet carries its own destination (e.g. E1.31 universe groups).
+
+/**
+ * One datagram: a buffer, or pieces gathered in order.  Among the pieces, a buffer followed by
+ *  two numbers stands for the `length` bytes from `offset` in it, so a send plan can point its
+ *  packets at a new frame buffer without cutting views of it.
+ */
+export type UdpPacket = Uint8Array | (Uint8Array | number)[];
+
+/** The pieces of a packet as views, for sends that only take whole buffers */
+export function udpPacketViews(p: UdpPacket): Uint8Array[] {
+    if (!Array.isArray(p)) return [p];
+    const views: Uint8Array[] = [];
+    for (let i = 0; i < p.length; ++i) {
+        const b = p[i] as Uint8Array;
+        if (typeof p[i + 1] === 'number') {
+            const off = p[i + 1] as number;
+            views.push(b.subarray(off, off + (p[i + 2] as number)));
+            i += 2;
+        } else {
+            views.push(b);
+        }
+    }
+    return views;
+}
+
+function udpPacketLength(p: UdpPacket) {
+    if (!Array.isArray(p)) return p.length;
+    let n = 0;
+    for (let i = 0; i < p.length; ++i) {
+        if (typeof p[i + 1] === 'number') {
+            n += p[i + 2] as number;
+            i += 2;
+        } else {
+            n += (p[i] as Uint8Array).length;
+        }
+    }
+    return n;
+}
+
+/**
+ * A connected datagram socket that can send many packets per call.
+ */
+export interface UdpBatchSocket {
+    /**
+     * Sends each entry of `packets` as one datagram (arrays are gathered; see UdpPacket).
+     *  `done` is called once, after the whole batch has been attempted.
+     *  The buffers must remain valid until then.
+     *  On a multicast socket, dests[i] is the IPv4 destination of packets[i].
+     */
+    sendBatch(
+        packets: UdpPacket[],
+        done: (nOk: number, nErr: number, err?: string) => void,
+        dests?: number[],
+    ): void;
+    close(): void;
+}
+
+/**
+ * Factory for batch sockets; implementations are provided by the host
+ *  (for instance, a native addon) and passed in via OpenControllersOptions.
+ */
+export interface UdpBatchBackend {
+    readonly name: string;
+    /** With `multicast`, the socket is left unconnected and `address` is ignored */
+    open(
+        type: 'udp4' | 'udp6',
+        address: string,
+        port: number,
+        sendBufSize?: number,
+        multicast?: UdpMulticastOptions,
+    ): Promise<UdpBatchSocket>;
+}
+
+/** Options for an unconnected socket sending to multicast groups (IPv4 only) */
+export interface UdpMulticastOptions {
+    ttl?: number; // Hops; the OS default (1) keeps it on the local subnet
+    interface?: string; // Local address of the interface to send from; the OS picks if absent
+}
+
+/** 'a.b.c.d' -> number, as used for per-packet destinations */
+export function ipv4ToNumber(addr: string) {
+    const p = addr.split('.');
+    if (p.length !== 4) return 0;
+    return ((+p[0] << 24) | (+p[1] << 16) | (+p[2] << 8) | +p[3]) >>> 0;
+}
+
+const ipv4Strings = new Map<number, string>();
+function ipv4ToString(n: number) {
+    let s = ipv4Strings.get(n);
+    if (s === undefined) {
+        s = `${n >>> 24}.${(n >>> 16) & 0xff}.${(n >>> 8) & 0xff}.${n & 0xff}`;
+        ipv4Strings.set(n, s);
+    }
+    return s;
+}
 
 export type SendBatch = {
     sender: UdpClient;
@@ -25,6 +127,9 @@ export type SendBatch = {
     resolve: () => void;
     reject: (err: Error) => void; // Not used
     cb?: (err: Error | null, bytes: number) => void;
+    packets?: UdpPacket[]; // Collected for a UdpBatchBackend
+    nPackets: number; // Entries of `packets` in use; reused lists are overwritten, not cleared
+    dests?: number[]; // Alongside `packets`, on a multicast client
     isComplete: () => boolean;
     callOnComplete?: () => void;
 };
@@ -34,8 +139,11 @@ export class UdpClient {
     readonly address: string;
     readonly port: number;
     readonly sendBufSize?: number;
+    readonly batchBackend?: UdpBatchBackend;
+    readonly multicast?: UdpMulticastOptions;
 
     private socket: dgram.Socket | undefined;
+    private batchSocket: UdpBatchSocket | undefined;
     private _isConnected = false;
     private _connAttemptInProgress = false;
     private _suspended = false;
@@ -67,11 +175,20 @@ export class UdpClient {
         };
     }
 
-    constructor(type: 'udp4' | 'udp6', address: string, port: number, sendBufSize?: number) {
+    constructor(
+        type: 'udp4' | 'udp6',
+        address: string,
+        port: number,
+        sendBufSize?: number,
+        batchBackend?: UdpBatchBackend,
+        multicast?: UdpMulticastOptions,
+    ) {
         this.type = type;
         this.address = address;
         this.sendBufSize = sendBufSize;
         this.port = port;
+        this.batchBackend = batchBackend;
+        this.multicast = multicast;
     }
 
     isConnected() {
@@ -93,6 +210,18 @@ export class UdpClient {
         if (this._isConnected) return;
         try {
             this._connAttemptInProgress = true;
+            if (this.batchBackend) {
+                this.batchSocket = await this.batchBackend.open(
+                    this.type,
+                    this.address,
+                    this.port,
+                    this.sendBufSize,
+                    this.multicast,
+                );
+                this._isConnected = true;
+                this.lastError = undefined;
+                return;
+            }
             this.socket = dgram.createSocket(this.type);
 
             if (this.sendBufSize) {
@@ -104,6 +233,13 @@ export class UdpClient {
                 }
             }
 
+            if (this.multicast) {
+                await this.bindMulticast(this.socket, this.multicast);
+                this._isConnected = true;
+                this.lastError = undefined;
+                return;
+            }
+
             await new Promise<void>((resolve, reject) => {
                 const onError = (err: Error) => {
                     this.socket?.off('connect', onConnect); // Cleanup listeners
@@ -133,6 +269,19 @@ export class UdpClient {
         }
     }
 
+    // Unconnected: bind to any port, then set the multicast options (which need a bound socket)
+    private async bindMulticast(socket: dgram.Socket, mc: UdpMulticastOptions) {
+        await new Promise<void>((resolve, reject) => {
+            socket.once('error', reject);
+            socket.bind(0, () => {
+                socket.off('error', reject);
+                resolve();
+            });
+        });
+        if (mc.ttl !== undefined) socket.setMulticastTTL(mc.ttl);
+        if (mc.interface) socket.setMulticastInterface(mc.interface);
+    }
+
     async disconnect(): Promise<void> {
         if (this._connAttemptInProgress) return;
         this._connAttemptInProgress = true;
@@ -144,6 +293,9 @@ export class UdpClient {
     }
 
     private sendBatch: SendBatch | undefined;
+    // Packet lists given back by the batch socket, for reuse by later batches
+    private spareLists: UdpPacket[][] = [];
+    private spareDests: number[][] = [];
 
     startSendBatch() {
         if (this.sendBatch) throw new Error('Already sending');
@@ -164,12 +316,17 @@ export class UdpClient {
             reject,
             resolve,
             cb: undefined,
+            packets: this.batchSocket ? (this.spareLists.pop() ?? []) : undefined,
+            nPackets: 0,
+            dests: this.batchSocket && this.multicast ? (this.spareDests.pop() ?? []) : undefined,
             isComplete: () => false,
         };
         sendBatch.cb = (err: Error | null, _bytes: number) => {
             if (err) {
                 sendBatch.err = err;
                 ++sendBatch.nECBs;
+                ++this.nErrors;
+                this.lastError = err.message;
             } else {
                 ++sendBatch.nSCBs;
             }
@@ -182,13 +339,21 @@ export class UdpClient {
         sendBatch.isComplete = () => sendBatch.batchClosed && sendBatch.nSCBs + sendBatch.nECBs === sendBatch.nSent;
         this.sendBatch = sendBatch;
     }
+    /**
+     * Hands the packets collected so far to the batch socket, keeping the batch open.
+     *  Used when a paced sender is about to wait on its token bucket.
+     */
+    flushSendBatch() {
+        const sb = this.sendBatch;
+        if (sb) this.submitCollected(sb);
+    }
     endSendBatch(callOnComplete?: () => void) {
         ++this.batchesInFlight;
         const sb = this.sendBatch;
         if (!sb) return sb;
         sb.batchClosed = true;
         sb.callOnComplete = callOnComplete;
-        if (sb.isComplete()) {
+        if (!this.submitCollected(sb) && sb.isComplete()) {
             --this.batchesInFlight;
             sb.resolve();
             sb.callOnComplete?.();
@@ -196,38 +361,92 @@ export class UdpClient {
         this.sendBatch = undefined;
         return sb;
     }
+    private submitCollected(sb: SendBatch) {
+        if (!this.batchSocket || !sb.packets || !sb.nPackets) return false;
+        const packets = sb.packets;
+        // Setting the same length as last time keeps the array's storage
+        packets.length = sb.nPackets;
+        const dests = sb.dests;
+        if (dests) dests.length = sb.nPackets;
+        sb.packets = sb.batchClosed ? undefined : (this.spareLists.pop() ?? []);
+        sb.dests = sb.batchClosed || !dests ? undefined : (this.spareDests.pop() ?? []);
+        sb.nPackets = 0;
+        this.batchSocket.sendBatch(
+            packets,
+            (nOk, nErr, err) => {
+                this.spareLists.push(packets);
+                if (dests) this.spareDests.push(dests);
+                sb.nSCBs += nOk;
+                sb.nECBs += nErr;
+                if (nErr) {
+                    sb.err = new Error(err ?? 'send failed');
+                    this.nErrors += nErr;
+                    this.lastError = sb.err.message;
+                }
+                if (sb.isComplete()) {
+                    --this.batchesInFlight;
+                    sb.callOnComplete?.();
+                    sb.resolve();
+                }
+            },
+            dests,
+        );
+        return true;
+    }
 
     /**
      * Adds a UDP packet to the batch
      *  Note that `data` must be kept valid until batch end
+     *  `dest` (IPv4 as a number) is required on a multicast client, and ignored otherwise
      */
-    addSendToBatch(data: Uint8Array | Uint8Array[]): void {
-        if (this._suspended || !this.sendBatch || this._connAttemptInProgress || !this._isConnected || !this.socket)
+    addSendToBatch(data: UdpPacket, dest?: number): void {
+        if (this._suspended || !this.sendBatch || this._connAttemptInProgress || !this._isConnected) return;
+        if (this.sendBatch.packets) {
+            ++this.sendBatch.nSent;
+            this.countSend(data);
+            if (this.sendBatch.dests) this.sendBatch.dests[this.sendBatch.nPackets] = dest ?? 0;
+            this.sendBatch.packets[this.sendBatch.nPackets++] = data;
             return;
+        }
+        if (!this.socket) return;
         ++this.sendBatch.nSent;
         this.countSend(data);
-        this.socket.send(data, this.sendBatch.cb!);
+        if (this.multicast) {
+            this.socket.send(udpPacketViews(data), this.port, ipv4ToString(dest ?? 0), this.sendBatch.cb!);
+        } else {
+            this.socket.send(udpPacketViews(data), this.sendBatch.cb!);
+        }
     }
 
-    private countSend(data: Uint8Array<ArrayBufferLike> | Uint8Array<ArrayBufferLike>[]) {
+    private countSend(data: UdpPacket) {
         ++this.nSent;
-        if (Array.isArray(data)) {
-            for (const d of data) this.bytesSent += data.length;
-        } else {
-            this.bytesSent += data.length;
-        }
+        this.bytesSent += udpPacketLength(data);
     }
 
     /**
      * Sends a UDP packet - stored connection info
      */
-    send(data: Uint8Array | Uint8Array[]): Promise<number> {
-        if (this._suspended || this._connAttemptInProgress || !this._isConnected || !this.socket)
-            return Promise.resolve(0);
+    send(data: UdpPacket, dest?: number): Promise<number> {
+        if (this._suspended || this._connAttemptInProgress || !this._isConnected) return Promise.resolve(0);
+        if (this.batchSocket) {
+            const bs = this.batchSocket;
+            const nBytes = udpPacketLength(data);
+            this.countSend(data);
+            return new Promise((resolve, reject) => {
+                bs.sendBatch(
+                    [data],
+                    (_nOk, nErr, err) => (nErr ? reject(new Error(err ?? 'send failed')) : resolve(nBytes)),
+                    this.multicast ? [dest ?? 0] : undefined,
+                );
+            });
+        }
+        if (!this.socket) return Promise.resolve(0);
         this.countSend(data);
         return new Promise((resolve, reject) => {
+            const cb = (err: Error | null, bytes: number) => (err ? reject(err) : resolve(bytes));
             if (this._isConnected && this.socket) {
-                this.socket.send(data, (err, bytes) => (err ? reject(err) : resolve(bytes)));
+                if (this.multicast) this.socket.send(udpPacketViews(data), this.port, ipv4ToString(dest ?? 0), cb);
+                else this.socket.send(udpPacketViews(data), cb);
             } else {
                 reject(new Error('Socket not connected.'));
             }
@@ -239,7 +458,12 @@ export class UdpClient {
      */
     private close(): Promise<void> {
         return new Promise((resolve) => {
-            if (this.socket) {
+            if (this.batchSocket) {
+                this.batchSocket.close();
+                this.batchSocket = undefined;
+                this._isConnected = false;
+                resolve();
+            } else if (this.socket) {
                 this.socket.close(() => {
                     this._isConnected = false;
                     resolve();
@@ -267,6 +491,7 @@ export abstract class UDPSender implements Sender {
     }
 
     client?: UdpClient;
+    udpBackend?: UdpBatchBackend; // If set, packets go out through this in batches
     headers: Uint8Array[] = []; // Max header size
     pushHeader: Uint8Array = new Uint8Array(10);
 
@@ -285,10 +510,79 @@ export abstract class UDPSender implements Sender {
         if (this.client) this.client.startSendBatch();
     }
 
+    flushBatch(): void {
+        this.client?.flushSendBatch();
+    }
+
     endBatch(): SendBatch | undefined {
         if (this.client) return this.client.endSendBatch();
     }
 
-    abstract sendPortion(frame: SendJob, job: SenderJob, state: SendJobSenderState): boolean;
+    plan?: SendPlan;
+    // Change detection: packets whose data is the same as when they were last sent are
+    //  skipped, but each still goes out at least every keepaliveMs
+    skipUnchanged: boolean = false;
+    keepaliveMs: number = 1000;
+    diffKernel: DiffKernel = jsDiffKernel;
+
+    /**
+     * Cut the job into packets and prebuild their headers.
+     *  Done when the controller is opened; again if the job or the sender settings change.
+     */
+    compilePlan(job: SenderJob) {
+        const plan = this.buildPlan(job);
+        if (this.skipUnchanged) plan.enableChangeDetection();
+        this.plan = plan;
+        return plan;
+    }
+    protected abstract buildPlan(job: SenderJob): SendPlan;
+    protected abstract stampSequence(hdr: Uint8Array, state: SendJobSenderState, packet: number): void;
+    // True if the last data packet carries the frame's push, so it can't be skipped
+    protected lastPacketPushes(): boolean {
+        return false;
+    }
+
+    sendPortion(frame: SendJob, job: SenderJob, state: SendJobSenderState): boolean {
+        const connected = this.client?.isConnected();
+        if (!this.client || !connected) return true;
+
+        const plan = this.plan?.matches(job) ? this.plan : this.compilePlan(job);
+        plan.bind(frame.dataBuffers);
+        if (!state.framePrepared) {
+            state.framePrepared = true;
+            plan.detectChanges(frame.dataBuffers, this.diffKernel);
+            state.startPacket = plan.nPackets ? state.startPacket % plan.nPackets : 0;
+        }
+
+        // Go through the packets (starting where a frame cut short stopped) until all are sent, or out of
+        //  tokens; the scheduler charges what was sent against the bucket and calls back when it has refilled
+        const lastSentAt = plan.lastSentAt;
+        while (state.curPacket < plan.nPackets) {
+            if (state.tokens <= 0) return false;
+            let i = state.startPacket + state.curPacket++;
+            if (i >= plan.nPackets) i -= plan.nPackets;
+            const bytes = plan.headerLen + plan.packetLen[i];
+            state.curChNum += plan.packetLen[i];
+            if (lastSentAt) {
+                const due =
+                    state.fullFramePending ||
+                    plan.packetChanged(i) ||
+                    state.frameStartTime - lastSentAt[i] >= this.keepaliveMs ||
+                    (i === plan.nPackets - 1 && state.framePacketsSent > 0 && this.lastPacketPushes());
+                if (!due) {
+                    state.bytesSkippedCumulative += bytes;
+                    continue;
+                }
+                lastSentAt[i] = state.frameStartTime;
+            }
+            this.stampSequence(plan.headers[i], state, i);
+            this.client.addSendToBatch(plan.gathers[i], plan.dests?.[i]);
+            state.countSent(bytes);
+            ++state.framePacketsSent;
+            ++this.curPacketNum;
+        }
+        return true;
+    }
+
     abstract sendPush(frame: SendJob, job: SenderJob, state: SendJobSenderState): void;
 }
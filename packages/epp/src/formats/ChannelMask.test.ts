@@ -0,0 +1,65 @@
+import { describe, it, expect } from 'vitest';
+import { ChannelMask } from './ChannelMask';
+import { compileScatterPlan, jsScatterKernel, ScatterRange } from './SparseScatter';
+
+describe('ChannelMask', () => {
+    it('merges overlapping and abutting ranges', () => {
+        const m = new ChannelMask([
+            { start: 100, length: 50 },
+            { start: 0, length: 10 },
+            { start: 150, length: 10 },
+            { start: 120, length: 5 },
+            { start: 300, length: 0 },
+        ]);
+        expect(m.ranges).toEqual([
+            { start: 0, length: 10 },
+            { start: 100, length: 60 },
+        ]);
+        expect(m.compactStarts).toEqual([0, 10]);
+        expect(m.channels).toBe(70);
+        expect(m.compactStep).toBe(72);
+    });
+
+    it('decodes compact frames that expand to the masked channels of the dense frame', () => {
+        // Sparse file: channels 10..59 and 200..299 (packed), frames of 300 dense channels
+        const fileRanges: ScatterRange[] = [
+            { srcOffset: 0, dstOffset: 10, length: 50 },
+            { srcOffset: 50, dstOffset: 200, length: 100 },
+        ];
+        const fileStride = 150;
+        const denseStep = 300;
+        const nframes = 3;
+        const sparse = new Uint8Array(nframes * fileStride).map((_, i) => 1 + (i % 251));
+
+        const dense = new Uint8Array(nframes * denseStep);
+        const denseTable = compileScatterPlan(fileRanges, fileStride, denseStep);
+        jsScatterKernel.scatter(dense, sparse, nframes, fileStride, denseStep, denseTable);
+
+        const mask = new ChannelMask([
+            { start: 0, length: 20 }, // Partly before the file's first range
+            { start: 40, length: 180 }, // Spans the gap between ranges
+            { start: 290, length: 30 }, // Runs past the end of the frame
+        ]);
+        const plan = mask.maskPlan(fileRanges);
+        const compact = new Uint8Array(nframes * mask.compactStep).fill(0xee);
+        jsScatterKernel.scatter(
+            compact,
+            sparse,
+            nframes,
+            fileStride,
+            mask.compactStep,
+            compileScatterPlan(plan, fileStride, mask.compactStep),
+        );
+
+        for (let f = 0; f < nframes; ++f) {
+            const full = new Uint8Array(denseStep);
+            mask.expand(compact.subarray(f * mask.compactStep, (f + 1) * mask.compactStep), full);
+            const expected = dense.slice(f * denseStep, (f + 1) * denseStep);
+            for (let c = 0; c < denseStep; ++c) {
+                const inMask = c < 20 || (c >= 40 && c < 220) || c >= 290;
+                if (!inMask) expected[c] = 0;
+            }
+            expect(full).toEqual(expected);
+        }
+    });
+});
@@ -0,0 +1,103 @@
+import type { SendJob } from '../dataplane/SenderJob';
+import type { ScatterRange } from './SparseScatter';
+
+const bufCopy = Buffer.prototype.copy;
+
+export interface ChannelRange {
+    start: number; // 0-based absolute channel
+    length: number;
+}
+
+/**
+ * The channels that are actually going out (for instance, those patched to the controllers
+ *  that were opened).  Given one, FSeqPrefetchCache decodes compact frames holding only these
+ *  channels, back to back in channel order; expand() puts one back in place in a full frame.
+ */
+export class ChannelMask {
+    private static nextId = 1;
+
+    /** Distinguishes masks in cache keys */
+    readonly id: number;
+    /** Sorted, with overlapping and abutting ranges merged */
+    readonly ranges: ChannelRange[];
+    /** Where each range starts in a compact frame */
+    readonly compactStarts: number[];
+    /** Channels in the mask */
+    readonly channels: number;
+    /** Compact frame size (padded to 4, as dense frames are) */
+    readonly compactStep: number;
+
+    constructor(ranges: ChannelRange[]) {
+        this.id = ChannelMask.nextId++;
+        const sorted = ranges.filter((r) => r.length > 0).sort((a, b) => a.start - b.start);
+        this.ranges = [];
+        for (const r of sorted) {
+            const last = this.ranges[this.ranges.length - 1];
+            if (last && r.start <= last.start + last.length) {
+                last.length = Math.max(last.length, r.start + r.length - last.start);
+            } else {
+                this.ranges.push({ start: r.start, length: r.length });
+            }
+        }
+        this.compactStarts = [];
+        let n = 0;
+        for (const r of this.ranges) {
+            this.compactStarts.push(n);
+            n += r.length;
+        }
+        this.channels = n;
+        this.compactStep = (n + 3) & ~3;
+    }
+
+    /** The channels the job's senders take from its first data buffer */
+    static fromSendJob(job: SendJob) {
+        const ranges: ChannelRange[] = [];
+        for (const sj of job.senders) {
+            if (!sj.sender) continue;
+            for (const p of sj.parts) {
+                if (p.bufIdx === 0 && p.bufStart >= 0 && p.bufLen > 0) {
+                    ranges.push({ start: p.bufStart, length: p.bufLen });
+                }
+            }
+        }
+        // Remapped controllers read the frame through their remap
+        for (const r of job.remaps) ranges.push({ start: r.srcStart, length: r.srcLen });
+        return new ChannelMask(ranges);
+    }
+
+    /**
+     * Restricts a file's ranges (dstOffset being the absolute channel) to the mask, with
+     *  dstOffset rewritten to the offset in a compact frame.
+     */
+    maskPlan(plan: ScatterRange[]): ScatterRange[] {
+        const out: ScatterRange[] = [];
+        const sorted = [...plan].sort((a, b) => a.dstOffset - b.dstOffset);
+        let m = 0;
+        for (const r of sorted) {
+            const rEnd = r.dstOffset + r.length;
+            while (m < this.ranges.length && this.ranges[m].start + this.ranges[m].length <= r.dstOffset) ++m;
+            for (let i = m; i < this.ranges.length && this.ranges[i].start < rEnd; ++i) {
+                const mr = this.ranges[i];
+                const lo = Math.max(r.dstOffset, mr.start);
+                const hi = Math.min(rEnd, mr.start + mr.length);
+                if (hi <= lo) continue;
+                out.push({
+                    srcOffset: r.srcOffset + (lo - r.dstOffset),
+                    dstOffset: this.compactStarts[i] + (lo - mr.start),
+                    length: hi - lo,
+                });
+            }
+        }
+        return out;
+    }
+
+    /** Copies a compact frame into place in a full frame; channels outside the mask are not touched */
+    expand(compact: Uint8Array, full: Uint8Array) {
+        for (let i = 0; i < this.ranges.length; ++i) {
+            const r = this.ranges[i];
+            const cs = this.compactStarts[i];
+            const len = Math.min(r.length, full.length - r.start, compact.length - cs);
+            if (len > 0) bufCopy.call(compact, full, r.start, cs, cs + len);
+        }
+    }
+}
@@ -1,10 +1,22 @@
-import { ZSTDDecoder } from 'zstddec';
+import { createHash } from 'crypto';
 import { promises as fsp } from 'fs';
+import { promisify } from 'util';
+import { inflate } from 'zlib';
 
 import { ArrayBufferPool } from '../util/BufferRecycler';
 import { NeededTimePriority, needTimePriorityCompare, PrefetchCache, RefHandle } from '../util/PrefetchCache';
-import { CompBlockCache, FSEQHeader, FSEQReaderAsync, summarizeFSEQHeader } from './FSeqUtil';
+import {
+    CompBlockCache,
+    FSEQHeader,
+    FSEQReaderAsync,
+    getZstdDecoder,
+    summarizeFSEQHeader,
+    zstdFrameDictId,
+} from './FSeqUtil';
 import { readHandleRange } from '../util/FileUtil';
+import type { ChunkStore } from '../util/DiskChunkStore';
+import { ChannelMask } from './ChannelMask';
+import { compileScatterPlan, jsScatterKernel, ScatterKernel, ScatterRange } from './SparseScatter';
 
 /**
  * Make a request for the sequence metadata... none of its frames... just let us know about it
@@ -38,6 +50,8 @@ export type DecompZStd = (
     compoff: number,
     complen: number,
     explen: number,
+    priority?: NeededTimePriority, // Where the block is wanted, for implementations that queue
+    now?: number, // Current time on the priority's clock
 ) => Promise<{ decompBuf: ArrayBuffer; compBuf: ArrayBuffer }>;
 
 export async function defDecompZStd(
@@ -47,9 +61,29 @@ export async function defDecompZStd(
     complen: number,
     explen: number,
 ) {
-    const decoder = new ZSTDDecoder();
-    await decoder.init();
-    new Uint8Array(decompbuf, 0, explen).set(decoder.decode(new Uint8Array(compbuf, compoff, complen), explen));
+    const comp = new Uint8Array(compbuf, compoff, complen);
+    const dictId = zstdFrameDictId(comp);
+    if (dictId) throw new Error(`zstd block needs dictionary ${dictId}, which only the native decoder can load`);
+    const decoder = await getZstdDecoder();
+    new Uint8Array(decompbuf, 0, explen).set(decoder.decode(comp, explen));
+    return { compBuf: compbuf, decompBuf: decompbuf };
+}
+
+/** zlib (compression type 2) block decoder; same arguments and buffer hand-back as DecompZStd */
+export type DecompZlib = DecompZStd;
+
+const inflateAsync = promisify(inflate);
+
+/** Node's zlib, inflating on the libuv pool and copying into decompbuf */
+export async function defDecompZlib(
+    decompbuf: ArrayBuffer,
+    compbuf: ArrayBuffer,
+    compoff: number,
+    complen: number,
+    explen: number,
+) {
+    const out = await inflateAsync(new Uint8Array(compbuf, compoff, complen), { maxOutputLength: Math.max(explen, 1) });
+    new Uint8Array(decompbuf, 0, out.byteLength).set(out);
     return { compBuf: compbuf, decompBuf: decompbuf };
 }
 
@@ -74,23 +108,22 @@ export interface FSeqFileVal {
     header: FSEQHeader;
     chunkMap: CompBlockCache;
     layout: FileLayout;
-}
-
-export interface ScatterRange {
-    srcOffset: number; // byte offset within one decompressed sparse frame
-    dstOffset: number; // byte offset within one dense frame (= absolute channel)
-    length: number; // number of bytes (channels) to copy
+    stamp: string; // File modification time and size when the header was read
+    dataPath: string; // Where the header and frames are read from (see setFileSource)
 }
 
 export interface FileLayout {
     isSparse: boolean;
     fileStride: number; // per-frame byte stride in decompressed file data
-    denseStep: number; // per-frame byte stride in dense output (padded to 4)
+    denseStep: number; // per-frame byte stride in dense output (padded to 4); the compact frame size if masked
     scatterPlan: ScatterRange[]; // empty when isSparse=false
+    scatterTable: Uint32Array; // scatterPlan compiled for the scatter kernel
+    signature: string; // Identifies the strides and plan, for keys that outlive the process
 }
 
 interface DecompCacheKey {
     fseqfile: string;
+    dataPath: string;
     chunknum: number;
     fileOffset: number;
     fileLen: number;
@@ -100,63 +133,63 @@ interface DecompCacheKey {
     fileStride: number;
     denseStep: number;
     scatterPlan: ScatterRange[];
+    scatterTable: Uint32Array;
+    maskId: number; // ChannelMask the frames are compacted to, or 0
+    storeKey: string; // Names the decoded content, for the chunk store
 }
 
 interface DecompCacheVal {
     decompChunk: ArrayBuffer;
 }
 
-function computeFileLayout(header: FSEQHeader): FileLayout {
-    if (header.nsparseranges === 0) {
+/** How a file's frames map to the frames that are handed out; with a mask, to compact frames */
+export function computeFileLayout(header: FSEQHeader, mask?: ChannelMask): FileLayout {
+    if (header.nsparseranges === 0 && !mask) {
         return {
             isSparse: false,
             fileStride: header.stepsize,
             denseStep: header.stepsize,
             scatterPlan: [],
+            scatterTable: new Uint32Array(0),
+            signature: `${header.stepsize}`,
         };
     }
-    const scatterPlan: ScatterRange[] = [];
-    let cumulativeSrc = 0;
-    let maxCh = 0;
-    for (const r of header.chranges) {
-        scatterPlan.push({ srcOffset: cumulativeSrc, dstOffset: r.startch, length: r.chcount });
-        cumulativeSrc += r.chcount;
-        if (r.startch + r.chcount > maxCh) maxCh = r.startch + r.chcount;
+    let fileRanges: ScatterRange[];
+    let fileStride: number;
+    let denseStep: number;
+    if (header.nsparseranges === 0) {
+        fileRanges = [{ srcOffset: 0, dstOffset: 0, length: header.stepsize }];
+        fileStride = header.stepsize;
+        denseStep = header.stepsize;
+    } else {
+        fileRanges = [];
+        let cumulativeSrc = 0;
+        let maxCh = 0;
+        for (const r of header.chranges) {
+            fileRanges.push({ srcOffset: cumulativeSrc, dstOffset: r.startch, length: r.chcount });
+            cumulativeSrc += r.chcount;
+            if (r.startch + r.chcount > maxCh) maxCh = r.startch + r.chcount;
+        }
+        fileStride = cumulativeSrc; // xLights packs sparse frames tight: sum of chcounts
+        denseStep = (maxCh + 3) & ~3;
     }
-    const denseStep = (maxCh + 3) & ~3;
+    // With a mask, frames hold only the masked channels, back to back
+    const scatterPlan = mask ? mask.maskPlan(fileRanges) : fileRanges;
+    if (mask) denseStep = mask.compactStep;
+    const scatterTable = compileScatterPlan(scatterPlan, fileStride, denseStep);
+    const tableHash = createHash('sha1')
+        .update(new Uint8Array(scatterTable.buffer, scatterTable.byteOffset, scatterTable.byteLength))
+        .digest('hex');
     return {
         isSparse: true,
-        fileStride: cumulativeSrc, // xLights packs sparse frames tight: sum of chcounts
+        fileStride,
         denseStep,
         scatterPlan,
+        scatterTable,
+        signature: `${fileStride}/${denseStep}/${tableHash}`,
     };
 }
 
-function scatterChunk(
-    dense: Uint8Array,
-    sparse: Uint8Array,
-    nframes: number,
-    fileStride: number,
-    denseStep: number,
-    plan: ScatterRange[],
-): void {
-    for (let f = 0; f < nframes; ++f) {
-        const sBase = f * fileStride;
-        const dBase = f * denseStep;
-        let dCursor = 0;
-        for (const r of plan) {
-            if (r.dstOffset > dCursor) {
-                dense.subarray(dBase + dCursor, dBase + r.dstOffset).fill(0);
-            }
-            dense.set(sparse.subarray(sBase + r.srcOffset, sBase + r.srcOffset + r.length), dBase + r.dstOffset);
-            dCursor = r.dstOffset + r.length;
-        }
-        if (dCursor < denseStep) {
-            dense.subarray(dBase + dCursor, dBase + denseStep).fill(0);
-        }
-    }
-}
-
 export type FrameTimeOrNumber = { num?: number; time?: number };
 
 export class FrameReference {
@@ -207,6 +240,9 @@ export class FSeqPrefetchCache {
             now: number;
             fseqSpace?: number;
             decompZstd?: DecompZStd; // Allow a worker thread...
+            decompZlib?: DecompZlib;
+            scatterKernel?: ScatterKernel; // Sparse file expansion, native where the host has it
+            chunkStore?: ChunkStore; // Second tier for decoded chunks, such as a DiskChunkStore
         },
         emitError: (msg: string) => void,
         emitWarning?: (msg: string) => void,
@@ -217,17 +253,29 @@ export class FSeqPrefetchCache {
         this.emitInfo = emitInfo;
         this.decompDataPool = new ArrayBufferPool();
         this.decompFunc = arg.decompZstd ?? defDecompZStd;
+        this.decompZlibFunc = arg.decompZlib ?? defDecompZlib;
+        this.scatterKernel = arg.scatterKernel ?? jsScatterKernel;
+        this.chunkStore = arg.chunkStore;
         this.decompPrefetchCache = new PrefetchCache<DecompCacheKey, DecompCacheVal, NeededTimePriority>({
-            fetchFunction: async (key, _abort) => {
+            fetchFunction: async (key, _abort, priority) => {
+                const isSparse = key.scatterTable.length > 0;
+                const fileChunkLen = key.nframes * key.fileStride;
+                const denseChunkLen = key.decompLen; // = nframes * denseStep
+
+                // Decoded before, by this run or an earlier one?
+                const store = this.chunkStore;
+                if (store && key.compression !== 0) {
+                    const sbuf = this.decompDataPool.get(denseChunkLen);
+                    if (await store.get(key.storeKey, sbuf, denseChunkLen)) return { decompChunk: sbuf };
+                    this.decompDataPool.release(sbuf);
+                }
+
                 // Fetch file data
                 let readBuf = this.decompDataPool.get(key.fileLen);
                 let readBufReleased = false;
-                const isSparse = key.scatterPlan.length > 0;
-                const fileChunkLen = key.nframes * key.fileStride;
-                const denseChunkLen = key.decompLen; // = nframes * denseStep
                 const start = performance.now();
                 try {
-                    const fh = await fsp.open(key.fseqfile);
+                    const fh = await fsp.open(key.dataPath);
                     try {
                         const rlen = await readHandleRange(fh, {
                             buf: readBuf,
@@ -243,7 +291,8 @@ export class FSeqPrefetchCache {
                         // Non-sparse path: decode (or pass through) straight into the dense buffer;
                         // the file's on-disk frame stride already equals denseStep.
                         if (!isSparse) {
-                            if (key.compression === 1) {
+                            if (key.compression === 1 || key.compression === 2) {
+                                const decomp = key.compression === 1 ? this.decompFunc : this.decompZlibFunc;
                                 const dbuf = this.decompDataPool.get(denseChunkLen);
                                 if (dbuf.byteLength < denseChunkLen) {
                                     this.emitWarning(
@@ -252,11 +301,18 @@ export class FSeqPrefetchCache {
                                             `got=${dbuf.byteLength} want=${denseChunkLen}`,
                                     );
                                 }
-                                const decres = await this.decompFunc(dbuf, readBuf, 0, key.fileLen, denseChunkLen);
+                                const decres = await decomp(
+                                    dbuf,
+                                    readBuf,
+                                    0,
+                                    key.fileLen,
+                                    denseChunkLen,
+                                    priority,
+                                    this.now,
+                                );
                                 readBuf = decres.compBuf;
+                                store?.put(key.storeKey, decres.decompBuf, denseChunkLen);
                                 return { decompChunk: decres.decompBuf };
-                            } else if (key.compression === 2) {
-                                throw new Error('Compression type 2 not supported');
                             } else {
                                 readBufReleased = true;
                                 return { decompChunk: readBuf };
@@ -268,9 +324,18 @@ export class FSeqPrefetchCache {
                         const denseBuf = this.decompDataPool.get(denseChunkLen);
                         let sparseBuf: ArrayBuffer;
                         let sparseBufIsReadBuf = false;
-                        if (key.compression === 1) {
+                        if (key.compression === 1 || key.compression === 2) {
+                            const decomp = key.compression === 1 ? this.decompFunc : this.decompZlibFunc;
                             sparseBuf = this.decompDataPool.get(fileChunkLen);
-                            const decres = await this.decompFunc(sparseBuf, readBuf, 0, key.fileLen, fileChunkLen);
+                            const decres = await decomp(
+                                sparseBuf,
+                                readBuf,
+                                0,
+                                key.fileLen,
+                                fileChunkLen,
+                                priority,
+                                this.now,
+                            );
                             readBuf = decres.compBuf;
                             sparseBuf = decres.decompBuf;
                             if (sparseBuf.byteLength < fileChunkLen) {
@@ -284,20 +349,21 @@ export class FSeqPrefetchCache {
                             sparseBuf = readBuf;
                             sparseBufIsReadBuf = true;
                         } else {
-                            throw new Error('Compression type 2 not supported');
+                            throw new Error(`Compression type ${key.compression} not supported`);
                         }
                         try {
-                            scatterChunk(
+                            this.scatterKernel.scatter(
                                 new Uint8Array(denseBuf, 0, denseChunkLen),
                                 new Uint8Array(sparseBuf, 0, fileChunkLen),
                                 key.nframes,
                                 key.fileStride,
                                 key.denseStep,
-                                key.scatterPlan,
+                                key.scatterTable,
                             );
                         } finally {
                             if (!sparseBufIsReadBuf) this.decompDataPool.release(sparseBuf);
                         }
+                        if (!sparseBufIsReadBuf) store?.put(key.storeKey, denseBuf, denseChunkLen);
                         return { decompChunk: denseBuf };
                     } catch (e) {
                         emitError((e as Error).message);
@@ -313,7 +379,7 @@ export class FSeqPrefetchCache {
             },
             budgetPredictor: (key) => key.decompLen,
             budgetCalculator: (key) => key.decompLen,
-            keyToId: (key) => `${key.fseqfile}:${key.chunknum}`,
+            keyToId: (key) => `${key.dataPath}:${key.chunknum}` + (key.maskId ? `:m${key.maskId}` : ''),
             budgetLimit: arg.fseqSpace ?? 512_000_000,
             maxConcurrency: 4,
             priorityComparator: needTimePriorityCompare,
@@ -428,10 +494,11 @@ export class FSeqPrefetchCache {
 
         const nframes = cidx.endFrame - cidx.startFrame;
         const comptype = hdr.header.compression;
-        const layout = hdr.layout;
+        const layout = this.layoutOf(hdr);
 
         const dk: DecompCacheKey = {
             fseqfile: fseq,
+            dataPath: hdr.dataPath,
             chunknum: chunk,
             fileLen: cidx.fileSize,
             fileOffset: cidx.fileOffset,
@@ -441,10 +508,67 @@ export class FSeqPrefetchCache {
             fileStride: layout.fileStride,
             denseStep: layout.denseStep,
             scatterPlan: layout.scatterPlan,
+            scatterTable: layout.scatterTable,
+            maskId: this.channelMask?.id ?? 0,
+            storeKey: `${hdr.dataPath}|${hdr.stamp}|${chunk}|${layout.signature}`,
         };
         return { dk, hdr };
     }
 
+    /** The file's layout under the current channel mask */
+    private layoutOf(hdr: FSeqFileVal): FileLayout {
+        if (!this.channelMask) return hdr.layout;
+        let layout = this.maskedLayouts.get(hdr);
+        if (!layout) {
+            layout = computeFileLayout(hdr.header, this.channelMask);
+            this.maskedLayouts.set(hdr, layout);
+        }
+        return layout;
+    }
+
+    /**
+     * Decode only the channels in `mask` from now on: getFrame returns compact frames of
+     *  mask.compactStep bytes (see ChannelMask.expand).  Chunks already decoded under another mask
+     *  are not used again and age out of the cache.  Undefined, or an empty mask, decodes everything.
+     */
+    setChannelMask(mask?: ChannelMask) {
+        this.channelMask = mask?.channels ? mask : undefined;
+        this.maskedLayouts = new WeakMap();
+    }
+
+    /**
+     * Keep decoded chunks of compressed files in `store` as well, and look there before
+     *  decoding.  Undefined stops using one.
+     */
+    setChunkStore(store?: ChunkStore) {
+        this.chunkStore = store;
+    }
+
+    /**
+     * Read `fseqfile` from `dataPath` instead, such as a copy of it rewritten by transcodeFSEQ
+     *  (same frames and timing); undefined reads the file itself again.  A cached header is read
+     *  again from the new source, the old one serving until then; chunks decoded from the old
+     *  source are dropped once the new header is in.
+     */
+    setFileSource(fseqfile: string, dataPath?: string) {
+        const cur = this.fileSources.get(fseqfile) ?? fseqfile;
+        if (dataPath && dataPath !== fseqfile) this.fileSources.set(fseqfile, dataPath);
+        else this.fileSources.delete(fseqfile);
+        if ((dataPath || fseqfile) === cur) return;
+        this.headerPrefetchCache.refresh((k) => k.fseqfile === fseqfile);
+    }
+
+    /**
+     * Files read from, or that will be, for sequences cached or given a source; a copy in here
+     *  must not be deleted yet.
+     */
+    dataPathsInUse(): Set<string> {
+        const paths = new Set<string>(this.fileSources.values());
+        for (const h of this.headerPrefetchCache.items()) if (h.value) paths.add(h.value.dataPath);
+        for (const d of this.decompPrefetchCache.items()) paths.add(d.key.dataPath);
+        return paths;
+    }
+
     getFrame(fseq: string, frame: FrameTimeOrNumber): { ref?: FrameReference; err?: Error } | undefined {
         const fk = this.getFrameKey(fseq, frame, undefined);
         if (!fk || frame.num === undefined) return undefined;
@@ -456,7 +580,7 @@ export class FSeqPrefetchCache {
 
         const cnum = fk.dk.chunknum;
         const chunk = fk.hdr.chunkMap.index[cnum];
-        const denseStep = fk.hdr.layout.denseStep;
+        const denseStep = fk.dk.denseStep;
         const frameOffset = (frame.num - chunk.startFrame) * denseStep;
         const decompBytes = cref.ref.v.decompChunk.byteLength;
         if (frameOffset + denseStep > decompBytes) {
@@ -492,20 +616,28 @@ export class FSeqPrefetchCache {
 
     headerPrefetchCache = new PrefetchCache<FSeqFileKey, FSeqFileVal, NeededTimePriority>({
         fetchFunction: async (key, _abort) => {
-            const header = await FSEQReaderAsync.readFSEQHeaderAsync(key.fseqfile);
+            const dataPath = this.fileSources.get(key.fseqfile) ?? key.fseqfile;
+            const st = await fsp.stat(dataPath);
+            const header = await FSEQReaderAsync.readFSEQHeaderAsync(dataPath);
             const chunkMap = new CompBlockCache();
             FSEQReaderAsync.createCompBlockCache(header, chunkMap);
             const layout = computeFileLayout(header);
             if (this.emitInfo) {
                 this.emitInfo(
-                    `[fseq] opened ${key.fseqfile}; ${summarizeFSEQHeader(header)}; ` +
+                    `[fseq] opened ${key.fseqfile}` +
+                        (dataPath !== key.fseqfile ? ` (from ${dataPath})` : '') +
+                        `; ${summarizeFSEQHeader(header)}; ` +
                         `layout: isSparse=${layout.isSparse} fileStride=${layout.fileStride} denseStep=${layout.denseStep}`,
                 );
             }
+            // Chunks from a previous source are done with once this header replaces the old one
+            this.decompPrefetchCache.invalidate((k) => k.fseqfile === key.fseqfile && k.dataPath !== dataPath);
             return {
                 header,
                 chunkMap,
                 layout,
+                stamp: `${st.mtimeMs}:${st.size}`,
+                dataPath,
             };
         },
         budgetPredictor: (_key) => 1,
@@ -519,6 +651,12 @@ export class FSeqPrefetchCache {
 
     decompDataPool: ArrayBufferPool;
     decompFunc: DecompZStd;
+    decompZlibFunc: DecompZlib;
+    scatterKernel: ScatterKernel;
+    channelMask?: ChannelMask;
+    chunkStore?: ChunkStore;
+    private maskedLayouts = new WeakMap<FSeqFileVal, FileLayout>();
+    private fileSources = new Map<string, string>();
     decompPrefetchCache: PrefetchCache<DecompCacheKey, DecompCacheVal, NeededTimePriority>;
     fileReadTimeCumulative: number = 0;
     private emitWarning: (msg: string) => void;
@@ -536,6 +674,7 @@ export class FSeqPrefetchCache {
             decompPool,
             totalDecompMem,
             fileReadTimeCumulative: this.fileReadTimeCumulative,
+            chunkStore: this.chunkStore?.getStats?.(),
         };
     }
 
@@ -543,6 +682,7 @@ export class FSeqPrefetchCache {
         this.fileReadTimeCumulative = 0;
         this.headerPrefetchCache.resetStats();
         this.decompPrefetchCache.resetStats();
+        this.chunkStore?.resetStats?.();
     }
     // TODO:
     //   Cache invalidation for updated .fseq files?
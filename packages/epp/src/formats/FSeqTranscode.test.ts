@@ -0,0 +1,203 @@
+import { describe, it, expect, afterAll } from 'vitest';
+import { promises as fsp } from 'fs';
+import os from 'os';
+import path from 'path';
+import { deflateSync } from 'zlib';
+import { FSEQReaderAsync, FSEQReaderSync } from './FSeqUtil';
+import { encodeFSEQHeader, measureFSEQSeek, sampleFSEQFrames, transcodeFSEQ } from './FSeqTranscode';
+import { FSeqPrefetchCache } from './FSeqPrefetcher';
+
+// v2 zlib, all frames in one block, no sparse ranges; channel c of frame f is (f * 7 + c) & 255
+function buildOneBlockFseq(channels: number, frames: number) {
+    const step = Math.ceil(channels / 4) * 4;
+    const raw = Buffer.alloc(frames * step);
+    for (let f = 0; f < frames; ++f) {
+        for (let c = 0; c < channels; ++c) raw[f * step + c] = (f * 7 + c) & 255;
+    }
+    const data = deflateSync(raw);
+    const vhdr = Buffer.from('\0\0mfsong.mp3\0', 'latin1');
+    vhdr.writeUInt16LE(vhdr.length, 0);
+    const hlen = 32 + 8 + vhdr.length;
+    const buf = Buffer.alloc(hlen + data.length);
+    buf.write('PSEQ', 0, 'latin1');
+    buf.writeUInt16LE(hlen, 4);
+    buf.writeUInt8(2, 7);
+    buf.writeUInt16LE(32, 8);
+    buf.writeUInt32LE(channels, 10);
+    buf.writeUInt32LE(frames, 14);
+    buf.writeUInt8(25, 18);
+    buf.writeUInt8(2, 20); // zlib
+    buf.writeUInt8(1, 21); // One block
+    buf.writeUInt32LE(0x12345678, 24);
+    buf.writeUInt32LE(data.length, 36);
+    vhdr.copy(buf, 40);
+    data.copy(buf, hlen);
+    return buf;
+}
+
+async function readAllFrames(file: string) {
+    const rdr = new FSEQReaderSync(file);
+    await rdr.open();
+    await rdr.readHeader();
+    const frames: Uint8Array[] = [];
+    await rdr.processFrames(({ frame }) => frames.push(frame.slice()));
+    await rdr.close();
+    return { header: rdr.header!, frames };
+}
+
+describe('transcodeFSEQ', () => {
+    const dir = path.join(os.tmpdir(), `fseqtranscode-${process.pid}`);
+    afterAll(() => fsp.rm(dir, { recursive: true, force: true }));
+
+    it('encodes headers that decode back the same', () => {
+        const hdr = FSEQReaderAsync.decodeFSEQHeader(buildOneBlockFseq(150, 10), 0, false);
+        const enc = encodeFSEQHeader({ ...hdr, nsparseranges: 1, chranges: [{ startch: 100, chcount: 50 }] });
+        const dec = FSEQReaderAsync.decodeFSEQHeader(enc, 0, false);
+        expect(dec.chdata_offset).toBe(enc.length);
+        expect(dec.compblocklist).toEqual(hdr.compblocklist);
+        expect(dec.chranges).toEqual([{ startch: 100, chcount: 50 }]);
+        expect(dec.headers).toEqual({ mf: 'song.mp3' });
+        expect(dec.uuid1).toBe(hdr.uuid1);
+        expect([dec.channels, dec.frames, dec.msperframe, dec.compression]).toEqual([150, 10, 25, 2]);
+    });
+
+    it('re-chunks into short blocks with the same frames', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const src = path.join(dir, 'big.fseq');
+        const dst = path.join(dir, 'small.fseq');
+        await fsp.writeFile(src, buildOneBlockFseq(150, 45));
+
+        const res = await transcodeFSEQ(src, dst, { blockMs: 250, compression: 2 });
+        expect(res).toMatchObject({ frames: 45, blocks: 5, framesPerBlock: 10 });
+
+        const before = await readAllFrames(src);
+        const after = await readAllFrames(dst);
+        expect(after.header.compblocklist.map((b) => b.framenum)).toEqual([0, 10, 20, 30, 40]);
+        expect(after.header.headers).toEqual({ mf: 'song.mp3' });
+        expect(after.frames).toEqual(before.frames);
+
+        const seekBefore = await measureFSEQSeek(src);
+        const seekAfter = await measureFSEQSeek(dst);
+        expect(seekBefore.worstBlockFrames).toBe(45);
+        expect(seekAfter.worstBlockFrames).toBe(10);
+    });
+
+    it('keeps only the channels asked for, as sparse ranges', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const src = path.join(dir, 'full.fseq');
+        const dst = path.join(dir, 'sparse.fseq');
+        await fsp.writeFile(src, buildOneBlockFseq(150, 12));
+
+        const res = await transcodeFSEQ(src, dst, {
+            blockMs: 100,
+            compression: 2,
+            ranges: [
+                { start: 10, length: 20 },
+                { start: 100, length: 30 },
+            ],
+        });
+        expect(res).toMatchObject({ channels: 52, sparseRanges: 2, blocks: 3 });
+
+        const hdr = await FSEQReaderAsync.readFSEQHeaderAsync(dst);
+        // Padded to 4 channels by lengthening the last range
+        expect(hdr.chranges).toEqual([
+            { startch: 10, chcount: 20 },
+            { startch: 100, chcount: 32 },
+        ]);
+        const after = await readAllFrames(dst);
+        for (let f = 0; f < 12; ++f) {
+            const fr = after.frames[f];
+            expect(fr.length).toBe(52);
+            for (let c = 0; c < 20; ++c) expect(fr[c]).toBe((f * 7 + 10 + c) & 255);
+            for (let c = 0; c < 32; ++c) expect(fr[20 + c]).toBe((f * 7 + 100 + c) & 255);
+        }
+    });
+
+    it('samples frames evenly, in the layout of the output', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const a = path.join(dir, 'sa.fseq');
+        const b = path.join(dir, 'sb.fseq');
+        await fsp.writeFile(a, buildOneBlockFseq(150, 40));
+        await fsp.writeFile(b, buildOneBlockFseq(150, 8));
+
+        const { samples, sizes } = await sampleFSEQFrames([a, b], {
+            ranges: [{ start: 100, length: 20 }],
+            maxBytes: 20 * 12,
+        });
+        // Half the bytes from each file, though b is much shorter
+        expect(sizes).toEqual(new Array(12).fill(20));
+        const first = (i: number) => samples[i * 20];
+        const picked = [3, 10, 16, 23, 30, 36].map((f) => (f * 7 + 100) & 255);
+        expect([0, 1, 2, 3, 4, 5].map(first)).toEqual(picked);
+        expect(first(6)).toBe((0 * 7 + 100) & 255);
+        expect(samples[19]).toBe((3 * 7 + 119) & 255);
+    });
+});
+
+describe('FSeqPrefetchCache.setFileSource', () => {
+    const dir = path.join(os.tmpdir(), `fseqsource-${process.pid}`);
+    afterAll(() => fsp.rm(dir, { recursive: true, force: true }));
+
+    async function settle(cache: FSeqPrefetchCache) {
+        for (let i = 0; i < 4; ++i) {
+            cache.dispatch();
+            await cache.headerPrefetchCache.finishFetches();
+            await cache.decompPrefetchCache.finishFetches();
+        }
+    }
+
+    async function readFrame(cache: FSeqPrefetchCache, fseqfile: string, num: number) {
+        cache.prefetchSeqFrames({ fseqfile, startFrame: num, nFrames: 1, needByTime: 0 });
+        await settle(cache);
+        const r = cache.getFrame(fseqfile, { num });
+        expect(r?.err).toBeUndefined();
+        return r!.ref!;
+    }
+
+    // A cached header moves to each new copy, so the one before can be deleted
+    it('reads a cached sequence from its new source', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const src = path.join(dir, 'show.fseq');
+        const copyA = path.join(dir, 'a.fseq');
+        const copyB = path.join(dir, 'b.fseq');
+        await fsp.writeFile(src, buildOneBlockFseq(150, 20));
+        await transcodeFSEQ(src, copyA, { blockMs: 250, compression: 2 });
+        await transcodeFSEQ(src, copyB, { blockMs: 100, compression: 2 });
+
+        const errors: string[] = [];
+        const cache = new FSeqPrefetchCache({ now: 0 }, (e) => errors.push(e));
+        const expectFrame = (fr: Uint8Array | undefined, f: number) => {
+            expect(Array.from(fr!.subarray(0, 150))).toEqual(Array.from({ length: 150 }, (_, c) => (f * 7 + c) & 255));
+        };
+
+        // Header read before there is a copy
+        cache.prefetchSeqMetadata({ fseqfile: src, needByTime: 0 });
+        await settle(cache);
+        const held = await readFrame(cache, src, 3);
+        expect(cache.getHeaderInfo({ fseqfile: src })?.ref?.dataPath).toBe(src);
+
+        cache.setFileSource(src, copyA);
+        expect(cache.dataPathsInUse()).toEqual(new Set([src, copyA]));
+        await settle(cache);
+        expect(cache.getHeaderInfo({ fseqfile: src })?.ref?.dataPath).toBe(copyA);
+        expect(cache.dataPathsInUse()).toEqual(new Set([copyA]));
+        expectFrame(held.frame, 3); // Still good until released
+        held.release();
+        await fsp.unlink(src);
+        const a = await readFrame(cache, src, 7);
+        expectFrame(a.frame, 7);
+        a.release();
+
+        // And from one copy to the next
+        cache.setFileSource(src, copyB);
+        await settle(cache);
+        expect(cache.getHeaderInfo({ fseqfile: src })?.ref?.dataPath).toBe(copyB);
+        await fsp.unlink(copyA);
+        const b = await readFrame(cache, src, 15);
+        expectFrame(b.frame, 15);
+        b.release();
+
+        expect(errors).toEqual([]);
+        await cache.shutdown();
+    });
+});
@@ -0,0 +1,444 @@
+import { promises as fsp } from 'fs';
+import { promisify } from 'util';
+import * as zlib from 'zlib';
+
+import { ChannelMask, ChannelRange } from './ChannelMask';
+import {
+    computeFileLayout,
+    DecompZlib,
+    DecompZStd,
+    defDecompZlib,
+    defDecompZStd,
+    FileLayout,
+} from './FSeqPrefetcher';
+import { CompBlockCache, FSEQHeader, FSEQReaderAsync } from './FSeqUtil';
+import { compileScatterPlan, jsScatterKernel, ScatterKernel } from './SparseScatter';
+import { readHandleRange } from '../util/FileUtil';
+
+/** Compresses one block of frames for an FSEQ file */
+export type BlockCompressor = (raw: Uint8Array) => Promise<Uint8Array>;
+
+/** Most blocks the v2 header can index (12 bits) */
+export const FSEQ_MAX_BLOCKS = 4095;
+/** Most sparse ranges the v2 header can hold */
+export const FSEQ_MAX_RANGES = 255;
+
+const FIXED_HEADER_LEN = 32;
+
+/**
+ * Serialize a v2.0 header: the fixed part, block index, sparse ranges and variable headers,
+ *  with chdata_offset set to where the channel data will start.  The block index, compression,
+ *  sparse ranges, channels, frames, msperframe, uuid and headers are taken from hdr; the
+ *  counts and offsets are derived from them.
+ */
+export function encodeFSEQHeader(hdr: FSEQHeader): Uint8Array {
+    const sparse = hdr.nsparseranges > 0;
+    const ranges = sparse ? hdr.chranges : [];
+    if (hdr.compblocklist.length > FSEQ_MAX_BLOCKS) throw new RangeError(`Too many blocks for FSEQ v2`);
+    if (ranges.length > FSEQ_MAX_RANGES) throw new RangeError(`Too many sparse ranges for FSEQ v2`);
+
+    const vheaders = Object.entries(hdr.headers).map(([k, v]) => {
+        if (k.length !== 2) throw new RangeError(`Variable header code must be 2 characters, not '${k}'`);
+        return { k, v: Buffer.from(v + '\0', 'utf8') };
+    });
+    let len = FIXED_HEADER_LEN + 8 * hdr.compblocklist.length + 6 * ranges.length;
+    for (const vh of vheaders) len += 4 + vh.v.length;
+    if (len > 0xffff) throw new RangeError(`FSEQ header too long (${len} bytes)`);
+
+    const buf = Buffer.alloc(len);
+    let off = 0;
+    buf.write('PSEQ', off, 'latin1');
+    off += 4;
+    buf.writeUInt16LE(len, off);
+    off += 2;
+    buf.writeUInt8(0, off++); // Minor version
+    buf.writeUInt8(2, off++); // Major version
+    buf.writeUInt16LE(FIXED_HEADER_LEN, off);
+    off += 2;
+    buf.writeUInt32LE(hdr.channels, off);
+    off += 4;
+    buf.writeUInt32LE(hdr.frames, off);
+    off += 4;
+    buf.writeUInt8(hdr.msperframe, off++);
+    buf.writeUInt8(0, off++);
+    const nblocks = hdr.compblocklist.length;
+    buf.writeUInt8((hdr.compression & 15) | ((nblocks >> 4) & 0xf0), off++);
+    buf.writeUInt8(nblocks & 0xff, off++);
+    buf.writeUInt8(ranges.length, off++);
+    buf.writeUInt8(0, off++);
+    buf.writeUInt32LE(hdr.uuid1 >>> 0, off);
+    off += 4;
+    buf.writeUInt32LE(hdr.uuid2 >>> 0, off);
+    off += 4;
+    for (const b of hdr.compblocklist) {
+        buf.writeUInt32LE(b.framenum, off);
+        buf.writeUInt32LE(b.blocksize, off + 4);
+        off += 8;
+    }
+    for (const r of ranges) {
+        buf.writeUIntLE(r.startch, off, 3);
+        buf.writeUIntLE(r.chcount, off + 3, 3);
+        off += 6;
+    }
+    for (const vh of vheaders) {
+        buf.writeUInt16LE(4 + vh.v.length, off);
+        buf.write(vh.k, off + 2, 'latin1');
+        vh.v.copy(buf, off + 4);
+        off += 4 + vh.v.length;
+    }
+    return new Uint8Array(buf.buffer, buf.byteOffset, buf.byteLength);
+}
+
+/** Merge the ranges with the smallest gaps between them until at most `max` remain */
+function limitRanges(ranges: ChannelRange[], max: number): ChannelRange[] {
+    const out = ranges.map((r) => ({ ...r }));
+    while (out.length > max) {
+        let best = 0;
+        for (let i = 1; i + 1 < out.length; ++i) {
+            const gap = out[i + 1].start - (out[i].start + out[i].length);
+            const bestGap = out[best + 1].start - (out[best].start + out[best].length);
+            if (gap < bestGap) best = i;
+        }
+        out[best].length = out[best + 1].start + out[best + 1].length - out[best].start;
+        out.splice(best + 1, 1);
+    }
+    return out;
+}
+
+type OutputLayout = Pick<FileLayout, 'fileStride' | 'denseStep' | 'scatterTable'>;
+
+/**
+ * The channels transcodeFSEQ writes: the ranges asked for, or the file's own sparse ranges.
+ *  Readers differ on whether frames are padded to 4, so the total is made a multiple of 4 either way.
+ */
+function outputLayout(hdr: FSEQHeader, ranges?: ChannelRange[]): { mask?: ChannelMask; layout: OutputLayout } {
+    let srcRanges = ranges;
+    if (!srcRanges && hdr.nsparseranges > 0) {
+        srcRanges = hdr.chranges.map((r) => ({ start: r.startch, length: r.chcount }));
+    }
+    if (!srcRanges) {
+        const all = [{ srcOffset: 0, dstOffset: 0, length: hdr.stepsize }];
+        return {
+            layout: {
+                fileStride: hdr.stepsize,
+                denseStep: hdr.stepsize,
+                scatterTable: compileScatterPlan(all, hdr.stepsize, hdr.stepsize),
+            },
+        };
+    }
+    const merged = limitRanges(new ChannelMask(srcRanges).ranges, FSEQ_MAX_RANGES);
+    if (!merged.length) throw new RangeError('No channels to keep');
+    const total = merged.reduce((n, r) => n + r.length, 0);
+    merged[merged.length - 1].length += ((total + 3) & ~3) - total;
+    const mask = new ChannelMask(merged);
+    return { mask, layout: computeFileLayout(hdr, mask) };
+}
+
+export interface FSEQTranscodeOptions {
+    /** Target duration of each block (default 500 ms); held to what the block index allows */
+    blockMs?: number;
+    /** Compression of the output (default 1, zstd) */
+    compression?: 0 | 1 | 2;
+    /** zstd or zlib level (default 3, or 6 for zlib) */
+    level?: number;
+    /** Block compressor for zstd; node's zlib.zstdCompress is used otherwise, where there is one */
+    compressZstd?: BlockCompressor;
+    /** Keep only these channels, as the sparse ranges of the output; all of them otherwise */
+    ranges?: ChannelRange[];
+    decompZstd?: DecompZStd;
+    decompZlib?: DecompZlib;
+    scatterKernel?: ScatterKernel;
+    /** Blocks being compressed at once (default 2) */
+    concurrency?: number;
+    signal?: AbortSignal;
+}
+
+export interface FSEQTranscodeResult {
+    frames: number;
+    blocks: number;
+    framesPerBlock: number;
+    channels: number; // Per frame in the output
+    sparseRanges: number;
+    bytesIn: number;
+    bytesOut: number;
+}
+
+function defaultCompressor(compression: number, level?: number): BlockCompressor | undefined {
+    if (compression === 2) {
+        const deflate = promisify(zlib.deflate);
+        return (raw) => deflate(raw, { level: level ?? 6 });
+    }
+    if (compression === 1 && typeof zlib.zstdCompress === 'function') {
+        const zstd = promisify(zlib.zstdCompress);
+        return (raw) => zstd(raw, { params: { [zlib.constants.ZSTD_c_compressionLevel]: level ?? 3 } });
+    }
+    return undefined;
+}
+
+/** Reads a file's blocks in order, decoded; those `want` turns down are skipped unread */
+async function* readBlocks(
+    fh: fsp.FileHandle,
+    hdr: FSEQHeader,
+    fileStride: number,
+    decompZstd: DecompZStd,
+    decompZlib: DecompZlib,
+    want?: (startFrame: number, endFrame: number) => boolean,
+) {
+    const cache = new CompBlockCache();
+    if (!hdr.compblocklist.length && hdr.compression === 0) {
+        // Uncompressed v2 files may have no index: the frames simply follow the header
+        hdr = { ...hdr, compblocklist: [{ framenum: 0, blocksize: hdr.frames * fileStride }] };
+    }
+    FSEQReaderAsync.createCompBlockCache(hdr, cache);
+    let comp = new ArrayBuffer(0);
+    let decomp = new ArrayBuffer(0);
+    for (const cidx of cache.index) {
+        const nframes = Math.min(cidx.endFrame, hdr.frames) - cidx.startFrame;
+        if (nframes <= 0 || (want && !want(cidx.startFrame, cidx.startFrame + nframes))) continue;
+        const rawLen = nframes * fileStride;
+        if (comp.byteLength < cidx.fileSize) comp = new ArrayBuffer(cidx.fileSize);
+        const rlen = await readHandleRange(fh, { buf: comp, offset: cidx.fileOffset, length: cidx.fileSize });
+        if (rlen !== cidx.fileSize) throw new Error(`Short read of block at ${cidx.fileOffset}`);
+        if (hdr.compression === 0) {
+            yield { startFrame: cidx.startFrame, nframes, data: new Uint8Array(comp, 0, Math.min(rlen, rawLen)) };
+            continue;
+        }
+        if (decomp.byteLength < rawLen) decomp = new ArrayBuffer(rawLen);
+        const decode = hdr.compression === 1 ? decompZstd : decompZlib;
+        const res = await decode(decomp, comp, 0, cidx.fileSize, rawLen);
+        comp = res.compBuf;
+        decomp = res.decompBuf;
+        yield { startFrame: cidx.startFrame, nframes, data: new Uint8Array(decomp, 0, rawLen) };
+    }
+}
+
+/**
+ * Rewrite an FSEQ file for playback: blocks of about blockMs each, so a seek decodes little
+ *  before its first frame, and optionally only the given channels, as sparse ranges.
+ *  Variable headers and the uuid are kept; frames, timing and (within the kept ranges)
+ *  channel data are unchanged.  The output is written beside `dst` and renamed into place.
+ */
+export async function transcodeFSEQ(
+    src: string,
+    dst: string,
+    opts: FSEQTranscodeOptions = {},
+): Promise<FSEQTranscodeResult> {
+    const hdr = await FSEQReaderAsync.readFSEQHeaderAsync(src);
+    const compression = opts.compression ?? 1;
+    const compress =
+        compression === 1 && opts.compressZstd ? opts.compressZstd : defaultCompressor(compression, opts.level);
+    if (compression !== 0 && !compress) throw new Error(`No compressor for FSEQ compression type ${compression}`);
+
+    const { mask, layout } = outputLayout(hdr, opts.ranges);
+    const outStride = layout.denseStep;
+
+    const wantFrames = Math.max(1, Math.round((opts.blockMs ?? 500) / Math.max(hdr.msperframe, 1)));
+    const framesPerBlock = Math.max(wantFrames, Math.ceil(hdr.frames / FSEQ_MAX_BLOCKS));
+    const nblocks = Math.ceil(hdr.frames / framesPerBlock);
+
+    const out: FSEQHeader = {
+        ...hdr,
+        hdr4: 'PSEQ',
+        majver: 2,
+        minver: 0,
+        channels: mask ? mask.channels : hdr.channels,
+        stepsize: outStride,
+        compression,
+        compblocklist: [],
+        nsparseranges: mask ? mask.ranges.length : 0,
+        chranges: mask ? mask.ranges.map((r) => ({ startch: r.start, chcount: r.length })) : [],
+        headers: { ...hdr.headers },
+    };
+    for (let b = 0; b < nblocks; ++b) out.compblocklist.push({ framenum: b * framesPerBlock, blocksize: 0 });
+    const hlen = encodeFSEQHeader(out).length; // Sizes don't change the length
+
+    const scatter = opts.scatterKernel ?? jsScatterKernel;
+    const concurrency = Math.max(1, opts.concurrency ?? 2);
+    const tmp = `${dst}.${process.pid}.tmp`;
+    const inFh = await fsp.open(src);
+    let outFh: fsp.FileHandle | undefined;
+    try {
+        outFh = await fsp.open(tmp, 'w');
+        let pos = hlen;
+        const pending: { block: number; data: Promise<Uint8Array> }[] = []; // Being compressed, in order
+        const writeOldest = async () => {
+            const p = pending.shift()!;
+            const data = await p.data;
+            await outFh!.write(data, 0, data.length, pos);
+            out.compblocklist[p.block].blocksize = data.length;
+            pos += data.length;
+        };
+        let block = 0;
+        let blockBuf = new Uint8Array(Math.min(framesPerBlock, hdr.frames) * outStride);
+        let inBlock = 0;
+        const finishBlock = async () => {
+            const raw = blockBuf.subarray(0, inBlock * outStride);
+            pending.push({ block, data: compression === 0 ? Promise.resolve(raw) : compress!(raw) });
+            ++block;
+            if (pending.length >= concurrency) await writeOldest();
+            const next = Math.max(0, Math.min(framesPerBlock, hdr.frames - block * framesPerBlock));
+            blockBuf = new Uint8Array(next * outStride);
+            inBlock = 0;
+        };
+
+        const decompZstd = opts.decompZstd ?? defDecompZStd;
+        const decompZlib = opts.decompZlib ?? defDecompZlib;
+        for await (const sb of readBlocks(inFh, hdr, layout.fileStride, decompZstd, decompZlib)) {
+            let done = 0;
+            while (done < sb.nframes && block < nblocks) {
+                if (opts.signal?.aborted) throw new Error(`Transcode of ${src} aborted`);
+                const n = Math.min(sb.nframes - done, framesPerBlock - inBlock);
+                // Frames missing from a short block read as black
+                const have = Math.max(0, Math.min(n, Math.floor(sb.data.length / layout.fileStride) - done));
+                if (have > 0) {
+                    scatter.scatter(
+                        blockBuf.subarray(inBlock * outStride),
+                        sb.data.subarray(done * layout.fileStride),
+                        have,
+                        layout.fileStride,
+                        outStride,
+                        layout.scatterTable,
+                    );
+                }
+                done += n;
+                inBlock += n;
+                if (inBlock === framesPerBlock || block * framesPerBlock + inBlock >= hdr.frames) {
+                    await finishBlock();
+                }
+            }
+        }
+        if (block < nblocks) throw new Error(`${src} has fewer frames than its header says`);
+        while (pending.length) await writeOldest();
+        await outFh.write(encodeFSEQHeader(out), 0, hlen, 0);
+        await outFh.sync();
+        await outFh.close();
+        outFh = undefined;
+        await fsp.rename(tmp, dst);
+        return {
+            frames: hdr.frames,
+            blocks: nblocks,
+            framesPerBlock,
+            channels: out.channels,
+            sparseRanges: out.nsparseranges,
+            bytesIn: (await inFh.stat()).size,
+            bytesOut: pos,
+        };
+    } catch (e) {
+        await outFh?.close().catch(() => {});
+        await fsp.unlink(tmp).catch(() => {});
+        throw e;
+    } finally {
+        await inFh.close().catch(() => {});
+    }
+}
+
+export interface FSEQSampleOptions {
+    /** Channels kept, as for transcodeFSEQ; samples are laid out as its output would be */
+    ranges?: ChannelRange[];
+    /** Sample bytes to gather across all the files (default 8 MB) */
+    maxBytes?: number;
+    /** Frames longer than this are cut to it (default 128 KB) */
+    maxSampleBytes?: number;
+    decompZstd?: DecompZStd;
+    decompZlib?: DecompZlib;
+    scatterKernel?: ScatterKernel;
+    signal?: AbortSignal;
+}
+
+/**
+ * Frames from across a show's files, laid out as transcodeFSEQ writes them, for training a zstd
+ *  dictionary: one frame to a sample, about as many bytes from each file, spread evenly through
+ *  it.  Only blocks holding a chosen frame are read.  `samples` is the frames end to end, and
+ *  `sizes` their lengths, as ZDICT_trainFromBuffer takes them.
+ */
+export async function sampleFSEQFrames(
+    files: string[],
+    opts: FSEQSampleOptions = {},
+): Promise<{ samples: Uint8Array; sizes: number[] }> {
+    const maxBytes = opts.maxBytes ?? 8_000_000;
+    const maxSample = opts.maxSampleBytes ?? 128 * 1024;
+    const scatter = opts.scatterKernel ?? jsScatterKernel;
+    const decompZstd = opts.decompZstd ?? defDecompZStd;
+    const decompZlib = opts.decompZlib ?? defDecompZlib;
+    const parts: Uint8Array[] = [];
+    const sizes: number[] = [];
+    let total = 0;
+    for (let i = 0; i < files.length; ++i) {
+        const hdr = await FSEQReaderAsync.readFSEQHeaderAsync(files[i]);
+        const { layout } = outputLayout(hdr, opts.ranges);
+        const sampleLen = Math.min(layout.denseStep, maxSample);
+        // Share what is left among this file and those after it
+        const n = sampleLen ? Math.min(hdr.frames, Math.floor((maxBytes - total) / (files.length - i) / sampleLen)) : 0;
+        if (n <= 0) continue;
+        const every = hdr.frames / n;
+        const picked: number[] = [];
+        for (let k = 0; k < n; ++k) picked.push(Math.floor(k * every + every / 2));
+
+        let w = 0;
+        const want = (start: number, end: number) => {
+            while (w < n && picked[w] < start) ++w;
+            return w < n && picked[w] < end;
+        };
+        const frame = new Uint8Array(layout.denseStep);
+        const fh = await fsp.open(files[i]);
+        try {
+            let p = 0;
+            for await (const sb of readBlocks(fh, hdr, layout.fileStride, decompZstd, decompZlib, want)) {
+                if (opts.signal?.aborted) throw new Error(`Sampling of ${files[i]} aborted`);
+                const have = Math.floor(sb.data.length / layout.fileStride);
+                for (; p < n && picked[p] < sb.startFrame + sb.nframes; ++p) {
+                    const f = picked[p] - sb.startFrame;
+                    if (f < 0 || f >= have) continue;
+                    const src = sb.data.subarray(f * layout.fileStride);
+                    scatter.scatter(frame, src, 1, layout.fileStride, layout.denseStep, layout.scatterTable);
+                    parts.push(frame.slice(0, sampleLen));
+                    sizes.push(sampleLen);
+                    total += sampleLen;
+                }
+            }
+        } finally {
+            await fh.close().catch(() => {});
+        }
+    }
+    const samples = new Uint8Array(total);
+    let off = 0;
+    for (const p of parts) {
+        samples.set(p, off);
+        off += p.length;
+    }
+    return { samples, sizes };
+}
+
+/**
+ * What a seek can cost in a file: the time to read and decode its largest block, which a
+ *  seek into it has to do before its first frame.
+ */
+export async function measureFSEQSeek(
+    path: string,
+    opts: { decompZstd?: DecompZStd; decompZlib?: DecompZlib } = {},
+): Promise<{ worstBlockFrames: number; worstBlockMs: number; msperframe: number }> {
+    const hdr = await FSEQReaderAsync.readFSEQHeaderAsync(path);
+    const cache = new CompBlockCache();
+    FSEQReaderAsync.createCompBlockCache(hdr, cache);
+    let worst = cache.index[0];
+    for (const c of cache.index) {
+        if (c.endFrame - c.startFrame > worst.endFrame - worst.startFrame) worst = c;
+    }
+    if (!worst) return { worstBlockFrames: 0, worstBlockMs: 0, msperframe: hdr.msperframe };
+    const fileStride = computeFileLayout(hdr).fileStride;
+    const nframes = worst.endFrame - worst.startFrame;
+    const fh = await fsp.open(path);
+    try {
+        const start = performance.now();
+        const comp = new ArrayBuffer(worst.fileSize);
+        await readHandleRange(fh, { buf: comp, offset: worst.fileOffset, length: worst.fileSize });
+        if (hdr.compression === 1 || hdr.compression === 2) {
+            const decode =
+                hdr.compression === 1 ? (opts.decompZstd ?? defDecompZStd) : (opts.decompZlib ?? defDecompZlib);
+            await decode(new ArrayBuffer(nframes * fileStride), comp, 0, worst.fileSize, nframes * fileStride);
+        }
+        return { worstBlockFrames: nframes, worstBlockMs: performance.now() - start, msperframe: hdr.msperframe };
+    } finally {
+        await fh.close().catch(() => {});
+    }
+}
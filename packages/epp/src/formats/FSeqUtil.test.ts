@@ -0,0 +1,104 @@
+import { describe, it, expect, afterAll } from 'vitest';
+import { promises as fsp } from 'fs';
+import os from 'os';
+import path from 'path';
+import { deflateSync } from 'zlib';
+import { FSEQReaderAsync, FSEQReaderSync, zstdFrameDictId } from './FSeqUtil';
+
+// v2, uncompressed or zlib: one block, one sparse range, and an 'mf' variable header
+function buildFseq(channels: number, frames: number, zlib = false) {
+    const step = Math.ceil(channels / 4) * 4;
+    const vhdr = Buffer.from('\0\0mfsong.mp3\0', 'latin1'); // Length (filled in), name, value
+    vhdr.writeUInt16LE(vhdr.length, 0);
+    const hlen = 32 + 8 + 6 + vhdr.length;
+    const raw = Buffer.alloc(frames * step);
+    for (let f = 0; f < frames; ++f) raw.fill(f, f * step, f * step + channels);
+    const data = zlib ? deflateSync(raw) : raw;
+    const buf = Buffer.alloc(hlen + data.length);
+    buf.write('PSEQ', 0, 'latin1');
+    buf.writeUInt16LE(hlen, 4);
+    buf.writeUInt8(2, 7);
+    buf.writeUInt16LE(32, 8);
+    buf.writeUInt32LE(channels, 10);
+    buf.writeUInt32LE(frames, 14);
+    buf.writeUInt8(25, 18);
+    buf.writeUInt8(zlib ? 2 : 0, 20);
+    buf.writeUInt8(1, 21); // One block
+    buf.writeUInt8(1, 22); // One sparse range
+    buf.writeUInt32LE(data.length, 36);
+    buf.writeUIntLE(1, 40, 3);
+    buf.writeUIntLE(channels, 43, 3);
+    vhdr.copy(buf, 46);
+    data.copy(buf, hlen);
+    return buf;
+}
+
+describe('FSEQReaderSync', () => {
+    const dir = path.join(os.tmpdir(), `fsequtil-${process.pid}`);
+    afterAll(() => fsp.rm(dir, { recursive: true, force: true }));
+
+    it('parses the header from one read, as decodeFSEQHeader does', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const file = path.join(dir, 'a.fseq');
+        const data = buildFseq(150, 5);
+        await fsp.writeFile(file, data);
+
+        const rdr = new FSEQReaderSync(file);
+        await rdr.open();
+        await rdr.readHeader();
+        const hdr = rdr.header!;
+        expect(hdr).toEqual(FSEQReaderAsync.decodeFSEQHeader(data, 0, false, data.length));
+        expect(hdr.stepsize).toBe(152);
+        expect(hdr.msperframe).toBe(25);
+        expect(hdr.chranges).toEqual([{ startch: 1, chcount: 150 }]);
+        expect(hdr.headers).toEqual({ mf: 'song.mp3' });
+
+        const seen: number[] = [];
+        await rdr.processFrames(({ frame, fnum }) => {
+            expect(frame.length).toBe(152);
+            seen.push(frame[149]);
+            expect(frame[0]).toBe(fnum);
+        });
+        expect(seen).toEqual([0, 1, 2, 3, 4]);
+        await rdr.close();
+    });
+
+    it('decodes zlib (compression type 2) blocks', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const file = path.join(dir, 'z.fseq');
+        await fsp.writeFile(file, buildFseq(150, 40, true));
+
+        const rdr = new FSEQReaderSync(file);
+        await rdr.open();
+        await rdr.readHeader();
+        expect(rdr.header!.compression).toBe(2);
+        const seen: number[] = [];
+        await rdr.processFrames(({ frame, fnum }) => {
+            expect(frame.length).toBe(152);
+            expect(frame[0]).toBe(fnum);
+            expect(frame[150]).toBe(0);
+            seen.push(fnum);
+        });
+        expect(seen.length).toBe(40);
+        await rdr.close();
+    });
+
+    it('rejects files that are not xSEQ', async () => {
+        await fsp.mkdir(dir, { recursive: true });
+        const file = path.join(dir, 'b.fseq');
+        await fsp.writeFile(file, Buffer.alloc(64));
+        const rdr = new FSEQReaderSync(file);
+        await rdr.open();
+        await expect(rdr.readHeader()).rejects.toThrow('Not an xSEQ file');
+        await rdr.close();
+    });
+
+    it('reads the dictionary ID from zstd frame headers', () => {
+        // Magic, frame header descriptor, [window descriptor], dictionary ID, ...
+        const frame = (fhd: number, ...rest: number[]) => new Uint8Array([0x28, 0xb5, 0x2f, 0xfd, fhd, ...rest]);
+        expect(zstdFrameDictId(frame(0x20, 0x10))).toBe(0); // Single segment, no ID
+        expect(zstdFrameDictId(frame(0x23, 0x78, 0x56, 0x34, 0x12, 0x10))).toBe(0x12345678);
+        expect(zstdFrameDictId(frame(0x02, 0x50, 0x34, 0x12))).toBe(0x1234); // After the window descriptor
+        expect(zstdFrameDictId(new Uint8Array([0x78, 0x9c, 1, 2, 3, 4]))).toBe(0); // zlib
+    });
+});
@@ -1,10 +1,53 @@
 import { promises as fsp } from 'fs';
+import { inflateSync } from 'zlib';
 import { ZSTDDecoder } from 'zstddec';
 import { FileReadRequest, FileReadWorker } from '../util/ReadFileWorkers';
 import { readUInt24LE, toDataView, toUint8Array } from '../util/Utils';
 
 const utfDecoder = new TextDecoder('utf-8');
 
+let zstdDecoder: Promise<ZSTDDecoder> | undefined;
+/** The thread's WASM zstd decoder, initialized once and shared by all readers */
+export function getZstdDecoder(): Promise<ZSTDDecoder> {
+    if (!zstdDecoder) {
+        const decoder = new ZSTDDecoder();
+        zstdDecoder = decoder.init().then(() => decoder);
+    }
+    return zstdDecoder;
+}
+
+/**
+ * The dictionary ID in a zstd frame header: 0 if the frame was written without a dictionary
+ *  (or does not say), or src is not a zstd frame.  Frames that need a dictionary can only be
+ *  decoded where it has been loaded (the native decoder); the WASM decoder has none.
+ */
+export function zstdFrameDictId(src: Uint8Array): number {
+    if (src.length < 6) return 0;
+    const dv = toDataView(src);
+    if (dv.getUint32(0, true) !== 0xfd2fb528) return 0;
+    const fhd = src[4];
+    const pos = 5 + ((fhd >> 5) & 1 ? 0 : 1); // Window descriptor unless single segment
+    switch (fhd & 3) {
+        case 1:
+            return pos < src.length ? src[pos] : 0;
+        case 2:
+            return pos + 2 <= src.length ? dv.getUint16(pos, true) : 0;
+        case 3:
+            return pos + 4 <= src.length ? dv.getUint32(pos, true) : 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Decode one zlib (compression type 2) block, as written by FPP and older xLights.
+ *  The result is expLen bytes, or shorter if the block held less.
+ */
+export function inflateZlibBlock(src: Uint8Array, expLen: number): Uint8Array {
+    const out = inflateSync(src, { maxOutputLength: Math.max(expLen, 1) });
+    return new Uint8Array(out.buffer, out.byteOffset, out.byteLength);
+}
+
 //
 // This is a very top-heavy view of fseq files.  It reads and calls back with data.
 // A better architecture is needed for streaming the file / seeking on demand / real time
@@ -190,162 +233,12 @@ export class FSEQReaderSync {
 
     async readHeader() {
         if (!this.fd) throw new Error('Not open');
-        const hdr = await this.read(4);
-        const shdr = utfDecoder.decode(hdr);
-        const isEseq = shdr === 'ESEQ';
-        if (shdr !== 'PSEQ' && shdr !== 'ESEQ' && shdr !== 'FSEQ') {
-            throw new Error('Not a PSEQ file');
-        }
-
-        // Things we will need to read the frames
-        let nframes = 0; // Number of frames
-        let stepsz = 0; // Size of uncompressed frame
-        const compblocklist: CompBlock[] = []; // Bit about reading the file and decompressing
-        const chrangelist: SparseRange[] = [];
-        const v1headers: { [key: string]: string } = {};
-        let comp = 0;
-        let ccount = 0;
-        let stepms = 50;
-        let off2chdata = 0;
-        let minver = 0;
-        let majver = 0;
-        let modelcnt = 0;
-        let modelstart = 0;
-        let modelsize = 0;
-        let shdrlen = 0;
-        let reserved = 0;
-        let univcnt = 0;
-        let univsz = 0;
-        let gamma = 0;
-        let colorenc = 0;
-        let reserved2 = 0;
-        let uuid1 = 0,
-            uuid2 = 0;
-        let blks = 0;
-        let nranges = 0;
-
-        if (isEseq) {
-            off2chdata = 20;
-            minver = 0;
-            majver = 2;
-
-            modelcnt = await this.read32bit();
-            stepsz = await this.read32bit();
-            modelstart = await this.read32bit();
-            ccount = await this.read32bit();
-            modelsize = ccount;
-
-            //Noting the lack of // of frames, frame timing, or any compression.  This format sucks.
-            const flen = (await this.fd.stat()).size;
-            nframes = Math.floor((flen - off2chdata) / stepsz);
-            compblocklist.push({ framenum: 0, blocksize: nframes * stepsz });
-            chrangelist.push({ startch: modelstart, chcount: modelsize });
-        } else {
-            off2chdata = await this.read16bit();
-            minver = await this.read8bit();
-            majver = await this.read8bit();
-
-            const isv1 = majver === 1;
-
-            //console.log("offset to channel data: "+str(off2chdata))
-            //console.log("Version "+str(majver)+'.'+str(minver))
-
-            shdrlen = await this.read16bit();
-            ccount = await this.read32bit();
-            stepsz = Math.floor((ccount + 3) / 4) * 4;
-            nframes = await this.read32bit();
-            stepms = await this.read8bit();
-            reserved = await this.read8bit();
-
-            if (isv1) {
-                univcnt = await this.read16bit();
-                univsz = await this.read16bit();
-                gamma = await this.read8bit();
-                colorenc = await this.read8bit();
-                reserved2 = await this.read16bit();
-
-                // Double check this math, is it rounded up?
-                compblocklist.push({ framenum: 0, blocksize: nframes * ccount });
-            } else {
-                const compandblks = await this.read8bit();
-                comp = compandblks & 15;
-                blks = (compandblks & 240) * 16;
-                blks += await this.read8bit();
-                //console.log ("blocks: "+str(blks))
-                nranges = await this.read8bit();
-                reserved2 = await this.read8bit();
-                uuid1 = await this.read32bit();
-                uuid2 = await this.read32bit();
-
-                // Compression blocks
-                // Compress block index: 4 frame num, 4 length
-                let seenEmpty = false;
-                for (let i = 0; i < blks; ++i) {
-                    const framenum = await this.read32bit();
-                    const blocksize = await this.read32bit();
-                    if (!blocksize) {
-                        seenEmpty = true;
-                        if (framenum) {
-                            throw new Error(`Empty block (${i}) with frame number (${framenum}) assigned`);
-                        }
-                        continue;
-                    }
-                    if (seenEmpty) {
-                        throw new Error('Empty blocks followed by nonempty blocks ' + i.toString());
-                    }
-                    compblocklist.push({ framenum, blocksize });
-                }
-
-                // Sparse range map
-                // Sparse ranges: 3 ch num, 3 num ch
-                for (let i = 0; i < nranges; ++i) {
-                    const startnum = await this.read24bit();
-                    const chcount = await this.read24bit();
-                    chrangelist.push({ startch: startnum, chcount: chcount });
-                }
-            }
-
-            if (!chrangelist.length) {
-                chrangelist.push({ startch: 1, chcount: ccount });
-            }
-
-            while (this.fdo + 4 <= off2chdata) {
-                //console.log ("At "+str(fh.tell())+" vs " + str(shdrlen))
-                const hlen = (await this.read16bit()) - 4;
-                const hname = utfDecoder.decode(await this.read(2));
-                //console.log ("Header "+hname+": "+str(hlen))
-                const hval = utfDecoder.decode(await this.read(hlen)).replace(/\0+$/, '');
-                v1headers[hname] = hval;
-            }
-        }
-        this.header = {
-            hdr4: shdr,
-            modelcount: modelcnt,
-            stepsize: stepsz,
-            modelstart: modelstart,
-            modelsize: modelsize,
-            chdata_offset: off2chdata,
-            majver: majver,
-            minver: minver,
-            fixedhdr: shdrlen,
-            channels: ccount,
-            frames: nframes,
-            msperframe: stepms,
-            reserved1: reserved,
-            univcnt: univcnt,
-            universesize: univsz,
-            gamma: gamma,
-            colorenc: colorenc,
-            reserved2: reserved2,
-            compression: comp,
-            compblks: blks,
-            nsparseranges: nranges,
-            uuid1: uuid1,
-            uuid2: uuid2,
-            compblocklist: compblocklist,
-            chranges: chrangelist,
-            headers: v1headers,
-        };
+        // The fixed part says how long the whole header is; then parse all of it from one read
+        const flen = (await this.fd.stat()).size;
+        const fixed = toUint8Array(await this.readAt(32, 0));
+        const hlen = FSEQReaderAsync.decodeFSEQHeader(fixed, 0, true, flen).chdata_offset;
+        const full = hlen > fixed.length ? toUint8Array(await this.readAt(hlen, 0)) : fixed;
+        this.header = FSEQReaderAsync.decodeFSEQHeader(full, 0, false, flen);
     }
 
     async processFrames(
@@ -373,18 +266,20 @@ export class FSEQReaderSync {
             let lenraw = dsz;
             //console.log("Read of " + str(dsz) + " got "+str(len(raw)))
             foff += dsz;
-            if (this.header.compression === 1) {
+            if (this.header.compression === 1 || this.header.compression === 2) {
                 let nframes = this.header.frames - curframe;
                 if (cn < this.header.compblocklist.length - 1) {
                     nframes = this.header.compblocklist[cn + 1].framenum - curframe;
                 }
                 lenraw = nframes * this.header.stepsize;
-                const decoder = new ZSTDDecoder();
-                await decoder.init();
-                //console.log(`${dsz} - ${lenraw} - ${nframes} - ${this.header.stepsize} - ${cn} - ${curframe}`);
-                raw = decoder.decode(raw, lenraw);
-            } else if (this.header.compression === 2) {
-                throw new Error('Need to implement zlib');
+                if (this.header.compression === 1) {
+                    const decoder = await getZstdDecoder();
+                    //console.log(`${dsz} - ${lenraw} - ${nframes} - ${this.header.stepsize} - ${cn} - ${curframe}`);
+                    raw = decoder.decode(raw, lenraw);
+                } else {
+                    raw = inflateZlibBlock(raw, lenraw);
+                    lenraw = Math.min(lenraw, raw.length);
+                }
             }
 
             let frmoffset = 0;
@@ -734,12 +629,11 @@ export class FSEQReaderAsync {
         const lenraw = nframes * this.header.stepsize;
 
         if (this.header.compression === 1) {
-            const decoder = new ZSTDDecoder();
-            await decoder.init();
+            const decoder = await getZstdDecoder();
             //console.log(`${dsz} - ${lenraw} - ${nframes} - ${this.header.stepsize} - ${cn} - ${curframe}`);
             chunk.decompBuf = decoder.decode(req.buf!, lenraw);
         } else if (this.header.compression === 2) {
-            throw new Error('Need to implement zlib');
+            chunk.decompBuf = inflateZlibBlock(req.buf!, lenraw);
         } else {
             chunk.decompBuf = req.buf!;
         }
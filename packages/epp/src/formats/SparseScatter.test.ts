@@ -0,0 +1,72 @@
+import { describe, it, expect } from 'vitest';
+import { compileScatterPlan, jsScatterKernel, SCATTER_ZERO, ScatterRange } from './SparseScatter';
+
+// Per frame, per range: what FSeqPrefetcher did before plans were compiled
+function referenceScatter(
+    dense: Uint8Array,
+    sparse: Uint8Array,
+    nframes: number,
+    fileStride: number,
+    denseStep: number,
+    plan: ScatterRange[],
+) {
+    for (let f = 0; f < nframes; ++f) {
+        const sBase = f * fileStride;
+        const dBase = f * denseStep;
+        let dCursor = 0;
+        for (const r of plan) {
+            if (r.dstOffset > dCursor) dense.subarray(dBase + dCursor, dBase + r.dstOffset).fill(0);
+            dense.set(sparse.subarray(sBase + r.srcOffset, sBase + r.srcOffset + r.length), dBase + r.dstOffset);
+            dCursor = r.dstOffset + r.length;
+        }
+        if (dCursor < denseStep) dense.subarray(dBase + dCursor, dBase + denseStep).fill(0);
+    }
+}
+
+// Ranges as computeFileLayout builds them: packed in the file, in channel order with gaps
+function makePlan(nranges: number, seed: number) {
+    const plan: ScatterRange[] = [];
+    let src = 0;
+    let dst = 0;
+    for (let i = 0; i < nranges; ++i) {
+        seed = (seed * 1103515245 + 12345) >>> 0;
+        dst += seed % 7 === 0 ? 0 : (seed >>> 8) % 50; // Some ranges abut the one before
+        const length = 1 + ((seed >>> 16) % 200);
+        plan.push({ srcOffset: src, dstOffset: dst, length });
+        src += length;
+        dst += length;
+    }
+    return { plan, fileStride: src, denseStep: (dst + 3) & ~3 };
+}
+
+describe('compileScatterPlan', () => {
+    it('merges abutting ranges and fills the gaps', () => {
+        const plan: ScatterRange[] = [
+            { srcOffset: 0, dstOffset: 10, length: 5 },
+            { srcOffset: 5, dstOffset: 15, length: 5 },
+            { srcOffset: 10, dstOffset: 30, length: 2 },
+        ];
+        // prettier-ignore
+        expect(Array.from(compileScatterPlan(plan, 12, 36))).toEqual([
+            SCATTER_ZERO, 0, 10,
+            0, 10, 10,
+            SCATTER_ZERO, 20, 10,
+            10, 30, 2,
+            SCATTER_ZERO, 32, 4,
+        ]);
+    });
+
+    it('expands like the per-range loop', () => {
+        for (const nranges of [1, 10, 100, 1000]) {
+            const { plan, fileStride, denseStep } = makePlan(nranges, nranges);
+            const nframes = 7;
+            const sparse = new Uint8Array(nframes * fileStride).map((_, i) => (i * 31) & 0xff);
+            const expected = new Uint8Array(nframes * denseStep).fill(0xaa);
+            const actual = new Uint8Array(nframes * denseStep).fill(0x55);
+            referenceScatter(expected, sparse, nframes, fileStride, denseStep, plan);
+            const table = compileScatterPlan(plan, fileStride, denseStep);
+            jsScatterKernel.scatter(actual, sparse, nframes, fileStride, denseStep, table);
+            expect(actual).toEqual(expected);
+        }
+    });
+});
@@ -0,0 +1,87 @@
+export interface ScatterRange {
+    srcOffset: number; // byte offset within one decompressed sparse frame
+    dstOffset: number; // byte offset within one dense frame (= absolute channel)
+    length: number; // number of bytes (channels) to copy
+}
+
+/** Marks a zero-fill entry in a compiled scatter table */
+export const SCATTER_ZERO = 0xffffffff;
+
+/**
+ * Flattens a sparse file's ranges, once per file, into what every frame of it needs done:
+ *  triples of (srcOffset, dstOffset, length) in destination order, where srcOffset SCATTER_ZERO
+ *  means clear the bytes rather than copy them.  Ranges that continue one another in both the
+ *  sparse and dense frame are merged; the gaps between ranges, and after the last one up to
+ *  denseStep, become zero-fills.  Ranges are clipped to the frames.
+ */
+export function compileScatterPlan(plan: ScatterRange[], fileStride: number, denseStep: number): Uint32Array {
+    const ranges = plan
+        .filter((r) => r.length > 0 && r.srcOffset < fileStride && r.dstOffset < denseStep)
+        .map((r) => ({
+            src: r.srcOffset,
+            dst: r.dstOffset,
+            len: Math.min(r.length, fileStride - r.srcOffset, denseStep - r.dstOffset),
+        }))
+        .sort((a, b) => a.dst - b.dst);
+
+    const ops: number[] = [];
+    let cursor = 0; // End of what is covered so far in the dense frame
+    let last = -1; // Index in ops of the last copy, while it can still be extended
+    for (const r of ranges) {
+        if (r.dst > cursor) {
+            ops.push(SCATTER_ZERO, cursor, r.dst - cursor);
+            last = -1;
+        }
+        if (last >= 0 && ops[last] + ops[last + 2] === r.src && ops[last + 1] + ops[last + 2] === r.dst) {
+            ops[last + 2] += r.len;
+        } else {
+            last = ops.length;
+            ops.push(r.src, r.dst, r.len);
+        }
+        cursor = Math.max(cursor, r.dst + r.len);
+    }
+    if (cursor < denseStep) ops.push(SCATTER_ZERO, cursor, denseStep - cursor);
+    return Uint32Array.from(ops);
+}
+
+/**
+ * Expands nframes sparse frames (fileStride apart in `sparse`) into dense frames (denseStep
+ *  apart in `dense`) according to a table from compileScatterPlan.
+ *
+ * Implementations are provided by the host (for instance, a native addon) and passed in to
+ *  FSeqPrefetchCache; jsScatterKernel is used otherwise.
+ */
+export interface ScatterKernel {
+    readonly name: string;
+    scatter(
+        dense: Uint8Array,
+        sparse: Uint8Array,
+        nframes: number,
+        fileStride: number,
+        denseStep: number,
+        table: Uint32Array,
+    ): void;
+}
+
+const bufCopy = Buffer.prototype.copy;
+
+/** One Buffer copy or fill per table entry per frame; no views are created */
+export const jsScatterKernel: ScatterKernel = {
+    name: 'js',
+    scatter(dense, sparse, nframes, fileStride, denseStep, table) {
+        if (dense.length < nframes * denseStep || sparse.length < nframes * fileStride) {
+            throw new RangeError('Scatter buffers are smaller than the frames given');
+        }
+        for (let f = 0; f < nframes; ++f) {
+            const sBase = f * fileStride;
+            const dBase = f * denseStep;
+            for (let i = 0; i + 2 < table.length; i += 3) {
+                const s = table[i];
+                const d = dBase + table[i + 1];
+                const l = table[i + 2];
+                if (s === SCATTER_ZERO) dense.fill(0, d, d + l);
+                else bufCopy.call(sparse, dense, d, sBase + s, sBase + s + l);
+            }
+        }
+    },
+};
@@ -2,15 +2,36 @@ export { DDPSender } from './dataplane/protocols/DDP';
 
 export { E131Sender } from './dataplane/protocols/E131';
 
-export { SendBatch } from './dataplane/protocols/UDP';
+export {
+    SendBatch,
+    UdpBatchBackend,
+    UdpBatchSocket,
+    UdpMulticastOptions,
+    UdpPacket,
+    udpPacketViews,
+} from './dataplane/protocols/UDP';
+
+export { Sender, SenderJob, SenderJobPart, SendJob, SendJobSenderState, SendJobState } from './dataplane/SenderJob';
+
+export { startFrame, endFrame, startBatch, flushBatch, endBatch, sendPartial, sendFull } from './dataplane/SendFrame';
 
-export { Sender, SenderJob, SendJob, SendJobState } from './dataplane/SenderJob';
+export { SendPlan } from './dataplane/SendPlan';
 
-export { startFrame, endFrame, startBatch, endBatch, sendPartial, sendFull } from './dataplane/SendFrame';
+export { DiffKernel, jsDiffKernel } from './dataplane/ChangeDetect';
+
+export {
+    ChannelRemap,
+    RemapKernel,
+    REMAP_COPY,
+    REMAP_NODES,
+    compileRemap,
+    jsRemapKernel,
+    parseColorOrder,
+} from './dataplane/ColorRemap';
 
 export { ControllerSetup, OpenControllerReport } from './controllers/controllertypes';
 
-export { busySleep, lpBusySleep } from './util/Utils';
+export { atomicSleep, busySleep, lpBusySleep } from './util/Utils';
 
 export { getFileSize, readFileRange, readHandleRange, readJsonFile, loadXmlFile } from './util/FileUtil';
 
@@ -21,12 +42,30 @@ export {
     FSEQReaderSync,
     dumpFSEQHeader,
     formatFSEQHeader,
+    getZstdDecoder,
+    inflateZlibBlock,
     summarizeFSEQHeader,
+    zstdFrameDictId,
 } from './formats/FSeqUtil';
 
+export { ChannelMask, ChannelRange } from './formats/ChannelMask';
+
+export {
+    ScatterKernel,
+    ScatterRange,
+    SCATTER_ZERO,
+    compileScatterPlan,
+    jsScatterKernel,
+} from './formats/SparseScatter';
+
 export { ControllerRec, ModelRec, readControllersAndModels } from './xlcompat/XLXmlUtil';
 
-export { ControllerState, readControllersFromXlights, openControllersForDataSend } from './xlcompat/XLControllerSetup';
+export {
+    ControllerState,
+    OpenControllersOptions,
+    readControllersFromXlights,
+    openControllersForDataSend,
+} from './xlcompat/XLControllerSetup';
 
 export { ArrayBufferPool, BufferPool } from './util/BufferRecycler';
 
@@ -54,14 +93,29 @@ export { FilePrefetchCache } from './util/FilePrefetchCache';
 
 export { WholeFilePrefetchCache } from './util/WholeFilePrefetchCache';
 
+export { ChunkStore, ChunkStoreStats, DiskChunkStore } from './util/DiskChunkStore';
+
 export {
     PrefetchSeqMetadataRequest,
     PrefetchSeqFramesRequest,
     DecompZStd,
     defDecompZStd,
+    DecompZlib,
+    defDecompZlib,
     FSeqFileKey,
     FSeqFileVal,
     FrameReference,
     FSeqPrefetchCache,
     FrameTimeOrNumber,
 } from './formats/FSeqPrefetcher';
+
+export {
+    BlockCompressor,
+    FSEQSampleOptions,
+    FSEQTranscodeOptions,
+    FSEQTranscodeResult,
+    encodeFSEQHeader,
+    measureFSEQSeek,
+    sampleFSEQFrames,
+    transcodeFSEQ,
+} from './formats/FSeqTranscode';
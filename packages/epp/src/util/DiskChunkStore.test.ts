@@ -0,0 +1,54 @@
+import { describe, it, expect, beforeEach, afterEach } from 'vitest';
+import { mkdtempSync, readdirSync, rmSync } from 'fs';
+import { tmpdir } from 'os';
+import * as path from 'path';
+import { DiskChunkStore } from './DiskChunkStore';
+
+function chunk(len: number, fill: number) {
+    return new Uint8Array(len).fill(fill).buffer;
+}
+
+describe('DiskChunkStore', () => {
+    let dir: string;
+    beforeEach(() => {
+        dir = mkdtempSync(path.join(tmpdir(), 'chunkstore-'));
+    });
+    afterEach(() => {
+        rmSync(dir, { recursive: true, force: true });
+    });
+
+    it('reads back what was put, in this and later instances', async () => {
+        const s1 = new DiskChunkStore({ dir, budgetLimit: 1_000_000 });
+        const src = chunk(1000, 7);
+        s1.put('a.fseq|1:2|0|100', src, 1000);
+        new Uint8Array(src).fill(0); // Caller's buffer goes back to its pool
+        await s1.flush();
+
+        const s2 = new DiskChunkStore({ dir, budgetLimit: 1_000_000 });
+        const dst = new ArrayBuffer(1024);
+        expect(await s2.get('a.fseq|1:2|0|100', dst, 1000)).toBe(true);
+        expect(new Uint8Array(dst, 0, 1000).every((v) => v === 7)).toBe(true);
+        expect(await s2.get('a.fseq|1:3|0|100', dst, 1000)).toBe(false);
+        expect(await s2.get('a.fseq|1:2|0|100', dst, 999)).toBe(false); // Wrong length is dropped
+        expect(s2.getStats()).toMatchObject({ hits: 1, misses: 2, entries: 0 });
+    });
+
+    it('evicts least recently used to stay within budget', async () => {
+        const s = new DiskChunkStore({ dir, budgetLimit: 3000 });
+        for (const k of ['a', 'b', 'c']) {
+            s.put(k, chunk(1000, 1), 1000);
+            await s.flush();
+        }
+        expect(await s.get('a', new ArrayBuffer(1000), 1000)).toBe(true);
+        s.put('d', chunk(1000, 2), 1000);
+        await s.flush();
+
+        const dst = new ArrayBuffer(1000);
+        expect(await s.get('b', dst, 1000)).toBe(false);
+        expect(await s.get('a', dst, 1000)).toBe(true);
+        expect(await s.get('c', dst, 1000)).toBe(true);
+        expect(await s.get('d', dst, 1000)).toBe(true);
+        expect(s.getStats()).toMatchObject({ evictions: 1, entries: 3, totalSize: 3000 });
+        expect(readdirSync(dir).length).toBe(3);
+    });
+});
@@ -0,0 +1,197 @@
+import { createHash } from 'crypto';
+import { promises as fsp } from 'fs';
+import * as path from 'path';
+
+import { readHandleRange } from './FileUtil';
+
+/**
+ * A second tier under an in-memory chunk cache: chunks that were expensive to produce,
+ *  kept under a key that names everything their content depends on, so that a later run
+ *  (or a jump back) can read them instead of producing them again.
+ */
+export interface ChunkStore {
+    /** Fills dst[0, len) with the chunk stored under key; false if there is none of that length */
+    get(key: string, dst: ArrayBuffer, len: number): Promise<boolean>;
+    /** Stores src[0, len) under key, in the background; src may be reused once this returns */
+    put(key: string, src: ArrayBuffer, len: number): void;
+    getStats?(): ChunkStoreStats;
+    resetStats?(): void;
+}
+
+export interface ChunkStoreStats {
+    hits: number;
+    misses: number;
+    writes: number;
+    writesSkipped: number;
+    evictions: number;
+    entries: number;
+    totalSize: number;
+}
+
+/**
+ * ChunkStore in a directory of files named by a hash of the key.  Like PrefetchCache, the
+ *  total size is held to budgetLimit, evicting least recently used first; use is recorded in
+ *  the files' modification times, so the order survives restarts.
+ *  Writes are to a temporary name and renamed into place, so a chunk is there whole or not at all.
+ */
+export class DiskChunkStore implements ChunkStore {
+    readonly dir: string;
+    readonly budgetLimit: number;
+
+    /** File name -> size, least recently used first */
+    private entries = new Map<string, number>();
+    private totalSize = 0;
+    private writing = new Set<string>();
+    private ready: Promise<void>;
+    private broken = false; // The directory could not be set up
+    private maxPendingWrites: number;
+    private stats: Omit<ChunkStoreStats, 'entries' | 'totalSize'> = {
+        hits: 0,
+        misses: 0,
+        writes: 0,
+        writesSkipped: 0,
+        evictions: 0,
+    };
+
+    constructor(
+        arg: {
+            dir: string;
+            budgetLimit: number; // Bytes
+            maxPendingWrites?: number; // Beyond this many copies waiting to be written, puts are dropped
+        },
+        private emitWarning?: (msg: string) => void,
+    ) {
+        this.dir = arg.dir;
+        this.budgetLimit = arg.budgetLimit;
+        this.maxPendingWrites = arg.maxPendingWrites ?? 8;
+        this.ready = this.scan().catch((e) => {
+            this.emitWarning?.(`[chunkstore] ${this.dir} unusable: ${(e as Error).message}`);
+            this.broken = true;
+        });
+    }
+
+    private static fileName(key: string) {
+        return createHash('sha1').update(key).digest('hex') + '.blk';
+    }
+
+    private async scan() {
+        await fsp.mkdir(this.dir, { recursive: true });
+        const found: { name: string; size: number; used: number }[] = [];
+        for (const name of await fsp.readdir(this.dir)) {
+            const full = path.join(this.dir, name);
+            if (name.endsWith('.tmp')) {
+                // Left by a write that never finished
+                await fsp.unlink(full).catch(() => {});
+                continue;
+            }
+            if (!name.endsWith('.blk')) continue;
+            try {
+                const st = await fsp.stat(full);
+                found.push({ name, size: st.size, used: st.mtimeMs });
+            } catch (_e) {}
+        }
+        found.sort((a, b) => a.used - b.used);
+        for (const f of found) {
+            this.entries.set(f.name, f.size);
+            this.totalSize += f.size;
+        }
+        this.evict();
+    }
+
+    async get(key: string, dst: ArrayBuffer, len: number): Promise<boolean> {
+        await this.ready;
+        const name = DiskChunkStore.fileName(key);
+        const size = this.entries.get(name);
+        if (size === undefined || this.broken) {
+            ++this.stats.misses;
+            return false;
+        }
+        const full = path.join(this.dir, name);
+        let ok = false;
+        if (size === len) {
+            try {
+                const fh = await fsp.open(full);
+                try {
+                    ok = (await readHandleRange(fh, { buf: dst, offset: 0, length: len })) === len;
+                } finally {
+                    await fh.close().catch(() => {});
+                }
+            } catch (_e) {}
+        }
+        if (!ok) {
+            // Wrong size or gone; it can't be used for this key
+            this.remove(name);
+            ++this.stats.misses;
+            return false;
+        }
+        ++this.stats.hits;
+        this.entries.delete(name);
+        this.entries.set(name, size);
+        const now = new Date();
+        fsp.utimes(full, now, now).catch(() => {});
+        return true;
+    }
+
+    put(key: string, src: ArrayBuffer, len: number) {
+        const name = DiskChunkStore.fileName(key);
+        if (this.broken || len > this.budgetLimit || this.entries.has(name) || this.writing.has(name)) return;
+        if (this.writing.size >= this.maxPendingWrites) {
+            ++this.stats.writesSkipped;
+            return;
+        }
+        this.writing.add(name);
+        const copy = Buffer.from(new Uint8Array(src, 0, len));
+        void this.write(name, copy).finally(() => this.writing.delete(name));
+    }
+
+    private async write(name: string, data: Buffer) {
+        await this.ready;
+        if (this.broken) return;
+        const full = path.join(this.dir, name);
+        const tmp = `${full}.${process.pid}.tmp`;
+        try {
+            await fsp.writeFile(tmp, data);
+            await fsp.rename(tmp, full);
+        } catch (e) {
+            this.emitWarning?.(`[chunkstore] write of ${full} failed: ${(e as Error).message}`);
+            await fsp.unlink(tmp).catch(() => {});
+            return;
+        }
+        ++this.stats.writes;
+        this.entries.set(name, data.byteLength);
+        this.totalSize += data.byteLength;
+        this.evict();
+    }
+
+    private evict() {
+        while (this.totalSize > this.budgetLimit && this.entries.size) {
+            const oldest = this.entries.keys().next().value!;
+            this.remove(oldest);
+            ++this.stats.evictions;
+        }
+    }
+
+    private remove(name: string) {
+        const size = this.entries.get(name);
+        if (size === undefined) return;
+        this.entries.delete(name);
+        this.totalSize -= size;
+        fsp.unlink(path.join(this.dir, name)).catch(() => {});
+    }
+
+    /** Waits for the directory scan and for writes in progress */
+    async flush() {
+        await this.ready;
+        while (this.writing.size) {
+            await new Promise((r) => setTimeout(r, 5));
+        }
+    }
+
+    getStats(): ChunkStoreStats {
+        return { ...this.stats, entries: this.entries.size, totalSize: this.totalSize };
+    }
+
+    resetStats() {
+        this.stats = { hits: 0, misses: 0, writes: 0, writesSkipped: 0, evictions: 0 };
+    }
+}
@@ -3,6 +3,7 @@ import { NeededTimePriority, needTimePriorityCompare, PrefetchCache } from './Pr
 
 export class TestPrefetchCache extends PrefetchCache<string, string, NeededTimePriority> {
     counts: Map<string, number> = new Map();
+    disposed: string[] = [];
     clearCounts() {
         this.counts = new Map();
     }
@@ -24,7 +25,7 @@ export class TestPrefetchCache extends PrefetchCache<string, string, NeededTimeP
             budgetLimit: budget,
             maxConcurrency: 1,
             priorityComparator: needTimePriorityCompare,
-            onDispose: (_k, v) => {},
+            onDispose: (_k, v) => this.disposed.push(v),
         });
     }
 
@@ -143,6 +144,63 @@ describe('PrefetchCache dispatch & eviction', () => {
     });
 });
 
+describe('PrefetchCache invalidate & refresh', () => {
+    // What a key was fetched from has changed: unused items go, ones in use stay with their
+    // holders until released, and the next request fetches again.
+    it('drops invalidated items, disposing of held ones on release', async () => {
+        const cache = new TestPrefetchCache(10);
+        cache.placeRequests(1, 3, 0);
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+        const held = cache.reference('2', 0)!.ref!;
+
+        expect(cache.invalidate((k) => k !== '3')).toBe(2);
+        expect(cache.disposed).toEqual(['1']);
+        expect(cache.check('2', 0)).toBe(false);
+        expect(held.v).toBe('2');
+        held.release();
+        expect(cache.disposed).toEqual(['1', '2']);
+
+        cache.placeRequests(2, 2, 0);
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+        expect(cache.check('2', 0)).toBe(true);
+        expect(cache.counts.get('2')).toBe(2);
+    });
+
+    // A fetch in flight when invalidated is thrown away rather than cached.
+    it('discards a fetch in flight when invalidated', async () => {
+        const cache = new TestPrefetchCache(10);
+        cache.placeRequests(1, 1, 0);
+        cache.cleanupAndDispatchRequests(0, -1);
+        cache.invalidate(() => true);
+        await cache.finishFetches();
+        expect(cache.getStats().totalItems).toBe(0);
+    });
+
+    // Refreshed items keep being served until the new fetch is in.
+    it('serves the old value while refreshing', async () => {
+        const cache = new TestPrefetchCache(10);
+        cache.placeRequests(1, 1, 0);
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+
+        expect(cache.refresh(() => true)).toBe(1);
+        cache.cleanupAndDispatchRequests(0, -1);
+        expect(cache.check('1', 0)).toBe(true);
+        await cache.finishFetches();
+        expect(cache.counts.get('1')).toBe(2);
+        expect(cache.disposed).toEqual([]);
+        cache.cleanupAndDispatchRequests(0, -1);
+        await cache.finishFetches();
+        expect(cache.counts.get('1')).toBe(2); // Once
+    });
+});
+
 // Drive the cache the way the player does each loop: a generation per frame, placing
 // the resolved plays (current + next, plus tiered background / speculative branches).
 describe('PrefetchCache player-loop simulation', () => {
@@ -30,14 +30,14 @@ export type PriorityComparator<P> = (a: P, b: P, now: number) => number;
 export type BudgetPredictor<K> = (key: K) => number; // Predict budget from key (like file space)
 export type BudgetCalculator<K, V> = (key: K, value: V) => number; // Full known budget (like decompressed size)
 export type DisposeCallback<K, V> = (key: K, value: V) => void | Promise<void>; // TODO: Add reason?
-export type FetchFunction<K, V> = (key: K, signal: AbortSignal) => Promise<V>; // GPT version suggests abort, not clear the value
+export type FetchFunction<K, V, P = unknown> = (key: K, signal: AbortSignal, priority: P) => Promise<V>; // GPT version suggests abort, not clear the value
 
 /**
  * The things you need to set up a prefetch+cache
  */
 export interface PrefetchCacheOptions<K, V, P> {
     /** Function to fetch values for keys */
-    fetchFunction: FetchFunction<K, V>;
+    fetchFunction: FetchFunction<K, V, P>;
 
     /** Condense a K to a key string */
     keyToId: (k: K) => string; // caller supplies how to serialize keys for dedupe
@@ -148,6 +148,9 @@ interface CacheItem<K, V, P> {
     // cost tracking
     estCost: number; // pending cost (key-based)
     actualCost: number;
+
+    invalidated?: boolean; // Out of the cache (see invalidate); disposed of on its last release
+    refresh?: boolean; // To be fetched again, serving the old value meanwhile (see refresh)
 }
 
 export class RefHandle<V> {
@@ -369,6 +372,50 @@ export class PrefetchCache<K, V, P> {
         };
     }
 
+    /**
+     * Drop the items whose keys match, because what they were fetched from has changed.  Items in
+     *  use stay with their holders and are disposed of when released; fetches in flight are
+     *  aborted and their results discarded.  A request for the key starts afresh.
+     */
+    invalidate(match: (key: K) => boolean): number {
+        let n = 0;
+        for (const [id, item] of [...this.cache.entries()]) {
+            if (!match(item.key)) continue;
+            ++n;
+            if (this.activeFetches.has(id)) {
+                item.invalidated = true; // Removed when the fetch settles
+                item.abort?.abort();
+            } else if (item.refCount > 0) {
+                item.invalidated = true;
+                this.cache.delete(id);
+            } else {
+                this.removeItem(item.key);
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Fetch the matching items again, serving their old values until the new ones are in.  Old
+     *  values are not disposed of, so this is for caches whose values need no disposal (parsed
+     *  headers, say).  Matching items that hold no value yet are dropped, to be requested afresh.
+     */
+    refresh(match: (key: K) => boolean): number {
+        let n = 0;
+        for (const item of [...this.cache.values()]) {
+            if (!match(item.key)) continue;
+            ++n;
+            if (item.state === 'ready' || item.state === 'fetching') item.refresh = true;
+            else this.removeItem(item.key);
+        }
+        return n;
+    }
+
+    /** Everything held: keys, and values where fetched */
+    items(): { key: K; value?: V }[] {
+        return [...this.cache.values()].map((i) => ({ key: i.key, value: i.value }));
+    }
+
     /** Set new budget; still need to run cleanup */
     setBudget(budget: number) {
         this.options.budgetLimit = budget;
@@ -516,6 +563,18 @@ export class PrefetchCache<K, V, P> {
                     continue;
                 }
                 committed += cost;
+                // Fetch again for refresh(), keeping the old value until the new one is in
+                if (item.state === 'ready' && item.refresh) {
+                    if (si.tier === STALE) {
+                        this.removeItem(item.key);
+                    } else if (this.activeFetches.size < this.options.maxConcurrency && !this.activeFetches.has(id)) {
+                        this.activeFetches.add(id);
+                        item.refresh = false;
+                        item.fetchingSince = performance.now();
+                        item.abort = new AbortController();
+                        this.fetchItem(item);
+                    }
+                }
                 continue;
             }
 
@@ -568,13 +627,18 @@ export class PrefetchCache<K, V, P> {
     }
     private releaseRefInternal(item: CacheItem<K, V, P>) {
         item.refCount = Math.max(0, item.refCount - 1);
+        // Invalidated while in use; nothing else will dispose of it
+        if (item.invalidated && item.refCount === 0 && this.cache.get(this.options.keyToId(item.key)) !== item) {
+            this.disposeValue(item);
+        }
     }
 
     private async fetchItem(item: CacheItem<K, V, P>): Promise<void> {
         try {
-            const promise = this.options.fetchFunction(item.key, item.abort!.signal);
+            const promise = this.options.fetchFunction(item.key, item.abort!.signal, item.priority);
             item.fetchPromise = promise;
             const value = await promise;
+            if (item.invalidated) throw new Error('Invalidated');
             const budgetCost = this.options.budgetCalculator(item.key, value);
 
             item.value = value;
@@ -600,7 +664,9 @@ export class PrefetchCache<K, V, P> {
             item.fetchingSince = undefined;
             item.abort = undefined;
 
-            this.activeFetches.delete(this.options.keyToId(item.key));
+            const id = this.options.keyToId(item.key);
+            this.activeFetches.delete(id);
+            if (item.invalidated && this.cache.get(id) === item) this.removeItem(item.key);
         }
     }
 
@@ -613,13 +679,7 @@ export class PrefetchCache<K, V, P> {
         item.abort?.abort();
         item.abort = undefined;
 
-        if (item.value && this.options.onDispose) {
-            try {
-                this.options.onDispose(key, item.value);
-            } catch (error) {
-                console.error('Error disposing cache item:', error);
-            }
-        }
+        this.disposeValue(item);
 
         // Notify waiters if any
         if (item.waiters.size > 0) {
@@ -631,6 +691,17 @@ export class PrefetchCache<K, V, P> {
         this.cache.delete(id);
     }
 
+    private disposeValue(item: CacheItem<K, V, P>) {
+        if (item.value && this.options.onDispose) {
+            try {
+                this.options.onDispose(item.key, item.value);
+            } catch (error) {
+                console.error('Error disposing cache item:', error);
+            }
+        }
+        item.value = undefined;
+    }
+
     // Test / shutdown
     async finishFetches() {
         while (this.activeFetches.size) {
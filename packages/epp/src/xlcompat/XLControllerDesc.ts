@@ -1,6 +1,10 @@
 export class ExplicitControllerDesc {
     desc: string = '';
     minFrameTime: number = 0;
+    maxMbps: number = 0; // Send rate limit; 0 for none
+    burstBytes: number = 0; // Bytes allowed back-to-back under maxMbps; 0 for the default
+    multicast: boolean = false; // E1.31: send the universes to their multicast groups instead of the address
+    colorOrder: string = ''; // Send RGB models in this order (e.g. GRB, or GRBW to add white); '' as sequenced
     tags: string[] = [];
 
     constructor(sval: string) {
@@ -17,6 +21,10 @@ export class ExplicitControllerDesc {
         if (this.desc) res += this.desc;
         // Special tags
         if (this.minFrameTime) res += '[MFT:' + this.minFrameTime + ']';
+        if (this.maxMbps) res += '[MBPS:' + this.maxMbps + ']';
+        if (this.burstBytes) res += '[BURST:' + this.burstBytes + ']';
+        if (this.multicast) res += '[MCAST]';
+        if (this.colorOrder) res += '[ORDER:' + this.colorOrder + ']';
         // Things that sorta looked like tags
         for (const t of this.tags) res += '[' + t + ']';
         return res;
@@ -53,11 +61,16 @@ export class ExplicitControllerDesc {
             const parts = t.split(':');
             if (parts.length === 2) {
                 if (parts[0] === 'MFT') this.minFrameTime = Number.parseInt(parts[1]);
+                else if (parts[0] === 'MBPS') this.maxMbps = Number.parseFloat(parts[1]);
+                else if (parts[0] === 'BURST') this.burstBytes = Number.parseInt(parts[1]);
+                else if (parts[0] === 'ORDER') this.colorOrder = parts[1].trim().toUpperCase();
                 else {
                     // Unidentified KV tag
                     console.log('Unexpected tag in controller description: ' + parts[0]);
                     this.tags.push(t);
                 }
+            } else if (t === 'MCAST') {
+                this.multicast = true;
             } else {
                 // Unidentified tag
                 this.tags.push(t);
@@ -68,6 +81,9 @@ export class ExplicitControllerDesc {
     hasTags(): boolean {
         if (this.tags.length) return true;
         if (this.minFrameTime) return true;
+        if (this.maxMbps || this.burstBytes) return true;
+        if (this.multicast) return true;
+        if (this.colorOrder) return true;
         return false;
     }
 
@@ -1,10 +1,13 @@
 import { DDPSender } from '../dataplane/protocols/DDP';
-import { E131Sender } from '../dataplane/protocols/E131';
-import { Sender, SenderJob, SendJob } from '../dataplane/SenderJob';
+import { E131_MAX_PAYLOAD, E131Sender } from '../dataplane/protocols/E131';
+import { Sender, SenderJob, SenderJobPart, SendJob } from '../dataplane/SenderJob';
+import { UdpBatchBackend, UDPSender } from '../dataplane/protocols/UDP';
+import { DiffKernel } from '../dataplane/ChangeDetect';
+import { ChannelRemap, compileRemap, parseColorOrder } from '../dataplane/ColorRemap';
 import { ControllerSetup, OpenControllerReport } from '../controllers/controllertypes';
 
 import type { ModelParseOptions } from 'xllayoutcalcs';
-import { ControllerRec, readControllersAndModels } from './XLXmlUtil';
+import { ControllerRec, ModelRec, readControllersAndModels } from './XLXmlUtil';
 
 export interface ControllerState {
     setup: ControllerSetup; // This is the name and channel map (as it pertains to xLights fseq layout)
@@ -59,6 +62,8 @@ export async function readControllersFromXlights(showdir: string, options?: Mode
             address: xc.address,
             nCh: xc.maxch,
             proto: xc.protocol as 'DDP' | 'E131',
+            // xLights marks an E1.31 multicast controller by its address
+            multicast: xc.protocol === 'E131' && (xc.address.toUpperCase() === 'MULTICAST' || !!xc.desc?.multicast),
         };
 
         const ctrl: ControllerState = {
@@ -74,10 +79,137 @@ export async function readControllersFromXlights(showdir: string, options?: Mode
 export interface OpenControllersOptions {
     /** DDP destination port override (default 4048) — a testing/diagnostic knob. */
     ddpPort?: number;
+    /** Batched UDP send implementation (e.g. native sendmmsg); per-packet dgram sends if absent. */
+    udpBackend?: UdpBatchBackend;
+    /** Skip packets whose data hasn't changed since they were last sent, refreshing each at least every keepaliveMs. */
+    skipUnchanged?: {
+        keepaliveMs?: number;
+        /** Comparison implementation (e.g. native SIMD); a Buffer-based one if absent. */
+        kernel?: DiffKernel;
+    };
+    /** Settings for E1.31 multicast controllers (xLights address MULTICAST, or [MCAST] in the description) */
+    e131Multicast?: {
+        /** Local IPv4 address of the interface to send from; the OS routing decides if absent */
+        interface?: string;
+        /** Multicast TTL (hops); the OS default of 1 if absent */
+        ttl?: number;
+        /** If set, data packets name this sync universe, and one sync packet follows each frame */
+        syncUniverse?: number;
+    };
+    /** The layout's models (from readControllersFromXlights), for controllers with a color order ([ORDER:GRB]) */
+    models?: ModelRec[];
+}
+
+// Token bucket settings from the controller description ([MBPS:n], [BURST:n])
+function applyRateLimit(jobSender: SenderJob, xc: ControllerRec) {
+    if (xc.desc?.maxMbps) jobSender.rateLimit = xc.desc.maxMbps * 125; // Mbit/s -> bytes/ms
+    if (xc.desc?.burstBytes) jobSender.burstSize = xc.desc.burstBytes;
+}
+
+// For a controller taking another color order ([ORDER:xxx]); undefined if it can read the frame as it is
+function controllerRemap(c: ControllerState, opts?: OpenControllersOptions) {
+    const order = c.xlRecord?.desc?.colorOrder ? parseColorOrder(c.xlRecord.desc.colorOrder) : undefined;
+    if (order === undefined || !opts?.models) return undefined;
+    return compileRemap(c.setup.startCh - 1, c.setup.nCh, opts.models, order);
+}
+
+// The controller's channels: from the frame, or from its remap's buffer
+function controllerPart(job: SendJob, c: ControllerState, remap?: ChannelRemap): SenderJobPart {
+    if (!remap) return { bufIdx: 0, bufStart: c.setup.startCh - 1, bufLen: c.setup.nCh };
+    job.remaps.push(remap);
+    return { bufIdx: job.remaps.length, bufStart: 0, bufLen: remap.out.length };
+}
+
+function applyChangeDetection(sender: UDPSender, opts?: OpenControllersOptions) {
+    if (!opts?.skipUnchanged) return;
+    sender.skipUnchanged = true;
+    if (opts.skipUnchanged.keepaliveMs !== undefined) sender.keepaliveMs = opts.skipUnchanged.keepaliveMs;
+    if (opts.skipUnchanged.kernel) sender.diffKernel = opts.skipUnchanged.kernel;
+}
+
+// Universes of an E1.31 controller, numbered and sized as xLights lays them out
+function e131Universes(xc: ControllerRec, nCh: number) {
+    const nums = xc.universeNumbers ?? [];
+    const sizes = xc.universeSizes ?? [];
+    const res: { universe: number; size: number }[] = [];
+    for (let off = 0, k = 0; off < nCh; ++k) {
+        const size = Math.min(sizes[k] ?? sizes[0] ?? 510, E131_MAX_PAYLOAD, nCh - off);
+        if (size <= 0) break;
+        res.push({ universe: nums[k] ?? (nums[0] ?? 1) + k, size });
+        off += size;
+    }
+    return res;
+}
+
+/**
+ * All multicast E1.31 controllers share one sender: one packet per universe, even if several
+ *  controllers (receivers) carry it, one batch per frame, and one sync packet after it.
+ *  Universes go out as sequenced; a color order ([ORDER:xxx]) is not applied to them.
+ */
+async function openE131Multicast(job: SendJob, mctrls: ControllerState[], opts?: OpenControllersOptions) {
+    const esender = new E131Sender();
+    const jobSender = new SenderJob();
+    esender.address = 'MULTICAST';
+    esender.multicast = { interface: opts?.e131Multicast?.interface, ttl: opts?.e131Multicast?.ttl };
+    esender.udpBackend = opts?.udpBackend;
+    esender.universes = [];
+    esender.channelsPerPacket = E131_MAX_PAYLOAD;
+    esender.syncUniverse = opts?.e131Multicast?.syncUniverse ?? 0;
+    esender.pushAtEnd = !!esender.syncUniverse;
+
+    const seen = new Set<number>();
+    let nCh = 0;
+    let maxMbps = 0;
+    for (const c of mctrls) {
+        const xc = c.xlRecord!;
+        let off = 0;
+        for (const u of e131Universes(xc, c.setup.nCh)) {
+            if (!seen.has(u.universe)) {
+                seen.add(u.universe);
+                esender.universes.push(u.universe);
+                jobSender.parts.push({ bufIdx: 0, bufStart: c.setup.startCh - 1 + off, bufLen: u.size });
+                nCh += u.size;
+            }
+            off += u.size;
+        }
+        esender.minTimeBetweenFrames = Math.max(esender.minTimeBetweenFrames, xc.desc?.minFrameTime ?? 0);
+        // The tightest limit given by any of them
+        const m = xc.desc?.maxMbps ?? 0;
+        if (m && (!maxMbps || m < maxMbps)) maxMbps = m;
+    }
+    esender.sendBufSize = Math.max(256_000, nCh * 2);
+    if (maxMbps) jobSender.rateLimit = maxMbps * 125;
+
+    try {
+        await esender.connect();
+    } catch (e) {
+        const err = e as Error;
+        for (const c of mctrls) {
+            c.report = {
+                name: c.setup.name,
+                status: 'error',
+                error: `Error opening multicast for ${c.setup.name}: ${err.message}`,
+            };
+        }
+        return;
+    }
+    jobSender.sender = esender;
+    applyChangeDetection(esender, opts);
+    esender.compilePlan(jobSender);
+    job.senders.push(jobSender);
+    for (const c of mctrls) {
+        c.report = {
+            name: c.setup.name,
+            status: 'open',
+            error: '',
+        };
+        c.sender = esender;
+    }
 }
 
 export async function openControllersForDataSend(ctrls: ControllerState[], opts?: OpenControllersOptions) {
     const job = new SendJob();
+    const multicast: ControllerState[] = [];
     for (const c of ctrls) {
         if (!c.setup.usable || !c.setup.proto || !c.xlRecord) {
             c.report = {
@@ -93,10 +225,12 @@ export async function openControllersForDataSend(ctrls: ControllerState[], opts?
             const dsender = new DDPSender();
             dsender.address = c.setup.address;
             if (opts?.ddpPort) dsender.port = opts.ddpPort;
+            dsender.udpBackend = opts?.udpBackend;
             dsender.pushAtEnd = false; // TODO try variety
             dsender.startChNum = xc.keepChannelNumbers ? xc.startch - 1 : 0;
             dsender.minTimeBetweenFrames = xc.desc?.minFrameTime ?? 0;
-            dsender.sendBufSize = Math.max(256_000, c.setup.nCh * 2);
+            const remap = controllerRemap(c, opts);
+            dsender.sendBufSize = Math.max(256_000, (remap?.out.length ?? c.setup.nCh) * 2);
 
             try {
                 await dsender.connect();
@@ -110,8 +244,11 @@ export async function openControllersForDataSend(ctrls: ControllerState[], opts?
                 continue;
             }
             const jobSender = new SenderJob();
-            jobSender.parts.push({ bufIdx: 0, bufStart: c.setup.startCh - 1, bufLen: c.setup.nCh });
+            jobSender.parts.push(controllerPart(job, c, remap));
             jobSender.sender = dsender;
+            applyRateLimit(jobSender, xc);
+            applyChangeDetection(dsender, opts);
+            dsender.compilePlan(jobSender);
             job.senders.push(jobSender);
             c.report = {
                 name: xc.name,
@@ -120,10 +257,14 @@ export async function openControllersForDataSend(ctrls: ControllerState[], opts?
             };
             dsender.controller = c;
             c.sender = dsender;
+        } else if (c.setup.proto === 'E131' && c.setup.multicast) {
+            multicast.push(c);
         } else if (c.setup.proto === 'E131') {
             const esender = new E131Sender();
             esender.address = c.setup.address;
-            esender.sendBufSize = Math.max(256_000, c.setup.nCh * 2);
+            const remap = controllerRemap(c, opts);
+            esender.sendBufSize = Math.max(256_000, (remap?.out.length ?? c.setup.nCh) * 2);
+            esender.udpBackend = opts?.udpBackend;
             esender.pushAtEnd = false; // TODO try variety
             // TODO!  Must fill in universe and ch per packet on multiple universes!  Do not do this now.
             esender.startUniverse = xc.universeNumbers?.[0] ?? 1;
@@ -141,8 +282,11 @@ export async function openControllersForDataSend(ctrls: ControllerState[], opts?
                 continue;
             }
             const jobSender = new SenderJob();
-            jobSender.parts.push({ bufIdx: 0, bufStart: c.setup.startCh - 1, bufLen: c.setup.nCh });
+            jobSender.parts.push(controllerPart(job, c, remap));
             jobSender.sender = esender;
+            applyRateLimit(jobSender, xc);
+            applyChangeDetection(esender, opts);
+            esender.compilePlan(jobSender);
             job.senders.push(jobSender);
             c.report = {
                 name: xc.name,
@@ -159,6 +303,7 @@ export async function openControllersForDataSend(ctrls: ControllerState[], opts?
             };
         }
     }
+    if (multicast.length) await openE131Multicast(job, multicast, opts);
 
     return job;
 }
@@ -332,6 +332,8 @@ export interface ControllerStatus {
     errors?: string[];
     connectivity?: 'Up' | 'Down' | 'Pending' | 'N/A';
     pingSummary?: string;
+    rateSummary?: string; // Send pacing: configured limit, achieved rate, waits
+    skipSummary?: string; // Change detection: share of bytes skipped as unchanged
     reported_time?: number;
     startCh?: number; // 1-based start channel within the fseq channel array
     nCh?: number; // Channel count owned by this controller
@@ -412,6 +414,15 @@ export interface PlaybackStatistics {
     cframesSkippedDueToDirectiveCumulative: number;
     cframesSkippedDueToIncompletePriorCumulative: number;
 
+    // Kernel-scheduled transmit (output engine txTime); achieved - requested launch time
+    txTime?: {
+        samplesCumulative: number;
+        avgDeltaMs: number;
+        worstLateHistorical: number;
+        worstEarlyHistorical: number;
+        droppedCumulative: number;
+    };
+
     // Audio delivery
     sentAudioChunksCumulative: number;
     skippedAudioChunksCumulative: number;
@@ -631,6 +642,86 @@ export interface AdvancedPlaybackSettings {
     /** DDP output port override (default 4048). Takes effect when controllers
      *  reopen (show folder reload or player restart). */
     ddpPort?: number;
+    /** Send controller output through the native batched UDP sender when it is
+     *  available (default true). Takes effect when controllers reopen. */
+    nativeUdpSend?: boolean;
+    /** Let native senders use UDP segmentation offload (Linux UDP_SEGMENT) for
+     *  runs of equal-sized packets (default true). Takes effect when controllers reopen. */
+    udpGso?: boolean;
+    /** Let the native batched sender use MSG_ZEROCOPY on its GSO sends (Linux,
+     *  default false): the NIC reads pixel data straight from the frame buffers,
+     *  and each frame is held until the kernel reports it sent. Only pays off
+     *  for large outputs on NICs with scatter-gather; it turns itself off for a
+     *  socket where the kernel ends up copying anyway. Takes effect when
+     *  controllers reopen. */
+    udpZeroCopy?: boolean;
+    /** Send through one io_uring shared by all controllers (Linux 5.6+, default
+     *  false), so a frame's sends are submitted and completed together instead
+     *  of a sendmmsg() per controller. Falls back to sendmmsg where io_uring is
+     *  unavailable or disabled; ignored with udpZeroCopy. Takes effect when
+     *  controllers reopen. */
+    udpIoUring?: boolean;
+    /** Pace and send frames from a native output thread instead of the JS
+     *  event loop (default false). Takes effect when controllers reopen.
+     *  Not used while any open controller is multicast, has a color order or
+     *  a rate limit, or while skipUnchangedPackets is on. */
+    nativeOutputEngine?: boolean;
+    /** With the native output engine, queue each frame a few ms early with a
+     *  kernel launch time (Linux SO_TXTIME; needs the fq qdisc on the output
+     *  interface). Default false. Takes effect when controllers reopen. */
+    engineTxTime?: boolean;
+    /** Skip DDP/E1.31 packets whose data hasn't changed since they were last
+     *  sent (default false). Each packet is still refreshed every
+     *  `unchangedKeepaliveMs`, and the first frame of each sequence is sent in
+     *  full. Not used by the native output engine. Takes effect when controllers reopen. */
+    skipUnchangedPackets?: boolean;
+    /** With `skipUnchangedPackets`, the longest a packet goes unsent (default 1000 ms). */
+    unchangedKeepaliveMs?: number;
+    /** Decode and cache only the sequence channels patched to the controllers
+     *  that were opened (default false). Saves decode time and cache memory
+     *  when sequences cover much more than the network does; models on no
+     *  open controller show dark in the preview. Takes effect when
+     *  controllers reopen. */
+    decodePatchedChannelsOnly?: boolean;
+    /** Also keep decoded sequence blocks on disk, up to this many MB (default 0,
+     *  off), so shows played again (or jumped back into) read them instead of
+     *  decompressing. Least recently used blocks are dropped first. Takes effect
+     *  when controllers reopen. */
+    fseqDiskCacheMB?: number;
+    /** Rewrite scheduled sequences whose compression blocks are long into
+     *  copies with short blocks (kept in the app's cache folder), so seeks and
+     *  mid-sequence starts decode little before the first frame (default
+     *  false). With `decodePatchedChannelsOnly`, the copies hold only the
+     *  patched channels. Runs in the background; takes effect when
+     *  controllers reopen. */
+    optimizeFseqFiles?: boolean;
+    /** With `optimizeFseqFiles`, compress the copies with a zstd dictionary
+     *  trained from the show's sequences and kept in the show's `.ezplayer`
+     *  folder as `fseq.zdict` (default false). Smaller copies that decode
+     *  faster; delete the file to train it again. Needs the native zstd
+     *  decoder; takes effect when controllers reopen. */
+    fseqZstdDictionary?: boolean;
+    /** Put each model's channels through its xLights dimming curve (gamma and
+     *  brightness, from the layout) on the way out (default false), so that
+     *  changing them needs no re-render. Takes effect immediately. */
+    applyModelDimming?: boolean;
+    /** Master dimmer for all channels sent, 0-100 (default 100). Takes effect
+     *  immediately. */
+    masterDimmer?: number;
+    /** Fade from one sequence to the next over this many ms (default 0, a
+     *  cut): the next sequence starts on time and fades in over the last
+     *  frame sent of the one before. Takes effect immediately. */
+    sequenceCrossfadeMs?: number;
+    /** E1.31 multicast controllers (xLights address MULTICAST, or [MCAST] in the
+     *  description): local IPv4 address of the interface to send from. The OS
+     *  routing table decides if unset. */
+    e131MulticastInterface?: string;
+    /** Multicast TTL (hops); the OS default of 1 keeps it on the local subnet. */
+    e131MulticastTtl?: number;
+    /** If set, multicast universes are held by receivers until a sync packet on
+     *  this universe, sent once after each frame. (The native output engine does
+     *  not do multicast; it is not started while a multicast controller is open.) */
+    e131SyncUniverse?: number;
 }
 
 /** The "playback" cloud-managed settings group — the part of PlaybackSettings
@@ -25,6 +25,8 @@ export class LatestFrameRingBuffer {
     // 2: writeSlot (next slot the writer will write into)
     // 3: latestSlot (slot index of latest published complete frame)
     // 4: latestSeq  (monotonic increasing; commit indicator)
+    //    Slots are written in turn from 0, so seq n is always in slot (n - 1) % slotCount
+    //    (the native output engine finds a frame by its seq this way)
     // 5..7: reserved, but 32 is a nice byte count
     static SLOT_COUNT_HDRIDX = 0;
     static FRAME_SIZE_HDRIDX = 1;
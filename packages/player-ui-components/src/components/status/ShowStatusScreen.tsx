@@ -523,6 +523,20 @@ export const ShowStatusScreen = ({ title, statusArea }: ShowStatusScreenProps) =
                                                                     </Typography>
                                                                 </Grid>
                                                             )}
+                                                            {ctrl.rateSummary && (
+                                                                <Grid item xs={6}>
+                                                                    <Typography variant="body2">
+                                                                        Send Rate: {ctrl.rateSummary}
+                                                                    </Typography>
+                                                                </Grid>
+                                                            )}
+                                                            {ctrl.skipSummary && (
+                                                                <Grid item xs={6}>
+                                                                    <Typography variant="body2">
+                                                                        Skipped: {ctrl.skipSummary}
+                                                                    </Typography>
+                                                                </Grid>
+                                                            )}
                                                             {ctrl.startCh !== undefined &&
                                                                 ctrl.nCh !== undefined &&
                                                                 ctrl.nCh > 0 && (
@@ -185,6 +185,17 @@ export const StatsDialog = ({ open, onClose, stats }: StatsDialogProps) => {
                                                 {formatValue(stats.worstAdvanceHistorical)}ms
                                             </Typography>
                                         </Box>
+                                        {stats.txTime && (
+                                            <Box sx={{ display: 'flex', justifyContent: 'space-between' }}>
+                                                <Typography variant="body2">Launch Time Delta:</Typography>
+                                                <Typography variant="body2" fontWeight="bold">
+                                                    {formatValue(stats.txTime.avgDeltaMs)}ms avg;{' '}
+                                                    {formatValue(stats.txTime.worstLateHistorical)}ms late;{' '}
+                                                    {formatValue(stats.txTime.worstEarlyHistorical)}ms early;{' '}
+                                                    {formatValue(stats.txTime.droppedCumulative)} dropped
+                                                </Typography>
+                                            </Box>
+                                        )}
                                         <Box sx={{ display: 'flex', justifyContent: 'space-between' }}>
                                             <Typography variant="body2">
                                                 Controller Frame Skips (intentional):